@@ -9,6 +9,7 @@
 #include "services/media/factory_service/media_sink_impl.h"
 #include "services/media/factory_service/media_source_impl.h"
 #include "services/media/factory_service/network_reader_impl.h"
+#include "services/media/framework/graph.h"
 
 namespace mojo {
 namespace media {
@@ -20,6 +21,10 @@ MediaFactoryService::ProductBase::ProductBase(MediaFactoryService* owner)
 
 MediaFactoryService::ProductBase::~ProductBase() {}
 
+Graph* MediaFactoryService::ProductBase::graph() {
+  return nullptr;
+}
+
 MediaFactoryService::MediaFactoryService() {}
 
 MediaFactoryService::~MediaFactoryService() {}
@@ -35,6 +40,11 @@ bool MediaFactoryService::ConfigureIncomingConnection(
              InterfaceRequest<MediaFactory> media_factory_request) {
         bindings_.AddBinding(this, media_factory_request.Pass());
       });
+  service_provider_impl->AddService<MediaGraphDebug>(
+      [this](const ConnectionContext& connection_context,
+             InterfaceRequest<MediaGraphDebug> media_graph_debug_request) {
+        debug_bindings_.AddBinding(this, media_graph_debug_request.Pass());
+      });
   return true;
 }
 
@@ -79,5 +89,25 @@ void MediaFactoryService::CreateNetworkReader(
       NetworkReaderImpl::Create(url, reader.Pass(), this)));
 }
 
+void MediaFactoryService::GetGraphSnapshots(
+    const GetGraphSnapshotsCallback& callback) {
+  Array<MediaGraphSnapshotPtr> result = Array<MediaGraphSnapshotPtr>::New(0);
+
+  for (const std::shared_ptr<ProductBase>& product : products_) {
+    Graph* graph = product->graph();
+    if (graph == nullptr) {
+      continue;
+    }
+
+    GraphSnapshot snapshot = graph->GetSnapshot();
+    MediaGraphSnapshotPtr media_graph_snapshot = MediaGraphSnapshot::New();
+    media_graph_snapshot->json = snapshot.ToJson();
+    media_graph_snapshot->dot = snapshot.ToDot();
+    result.push_back(media_graph_snapshot.Pass());
+  }
+
+  callback.Run(result.Pass());
+}
+
 }  // namespace media
 }  // namespace mojo
@@ -11,18 +11,26 @@
 #include "mojo/public/cpp/application/application_delegate.h"
 #include "mojo/public/cpp/application/application_impl.h"
 #include "mojo/services/media/control/interfaces/media_factory.mojom.h"
+#include "mojo/services/media/control/interfaces/media_graph_debug.mojom.h"
 
 namespace mojo {
 namespace media {
 
+class Graph;
+
 class MediaFactoryService : public ApplicationDelegate,
-                            public MediaFactory {
+                            public MediaFactory,
+                            public MediaGraphDebug {
  public:
   // Provides common behavior for all objects created by the factory service.
   class ProductBase : public std::enable_shared_from_this<ProductBase> {
    public:
     virtual ~ProductBase();
 
+    // Returns the graph the product operates or nullptr if it has none. Used
+    // for debugging. The default implementation returns nullptr.
+    virtual Graph* graph();
+
    protected:
     ProductBase(MediaFactoryService* owner);
 
@@ -100,8 +108,12 @@ class MediaFactoryService : public ApplicationDelegate,
   void CreateNetworkReader(const String& url,
                            InterfaceRequest<SeekingReader> reader) override;
 
+  // MediaGraphDebug implementation.
+  void GetGraphSnapshots(const GetGraphSnapshotsCallback& callback) override;
+
  private:
   BindingSet<MediaFactory> bindings_;
+  BindingSet<MediaGraphDebug> debug_bindings_;
   ApplicationImpl* app_;
   std::unordered_set<std::shared_ptr<ProductBase>> products_;
 };
@@ -61,6 +61,10 @@ MediaDecoderImpl::MediaDecoderImpl(MediaTypePtr input_media_type,
 
 MediaDecoderImpl::~MediaDecoderImpl() {}
 
+Graph* MediaDecoderImpl::graph() {
+  return &graph_;
+}
+
 void MediaDecoderImpl::GetOutputType(const GetOutputTypeCallback& callback) {
   DCHECK(decoder_);
   callback.Run(MediaType::From(decoder_->output_stream_type()));
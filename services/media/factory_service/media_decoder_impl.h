@@ -30,6 +30,9 @@ class MediaDecoderImpl
 
   ~MediaDecoderImpl() override;
 
+  // MediaFactoryService::ProductBase implementation.
+  Graph* graph() override;
+
   // MediaTypeConverter implementation.
   void GetOutputType(const GetOutputTypeCallback& callback) override;
 
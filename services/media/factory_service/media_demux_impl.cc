@@ -66,6 +66,10 @@ MediaDemuxImpl::MediaDemuxImpl(InterfaceHandle<SeekingReader> reader,
 
 MediaDemuxImpl::~MediaDemuxImpl() {}
 
+Graph* MediaDemuxImpl::graph() {
+  return &graph_;
+}
+
 void MediaDemuxImpl::OnDemuxInitialized(Result result) {
   demux_part_ = graph_.Add(demux_);
 
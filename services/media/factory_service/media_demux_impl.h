@@ -34,6 +34,9 @@ class MediaDemuxImpl : public MediaFactoryService::Product<MediaDemux>,
 
   ~MediaDemuxImpl() override;
 
+  // MediaFactoryService::ProductBase implementation.
+  Graph* graph() override;
+
   // MediaDemux implementation.
   void Describe(const DescribeCallback& callback) override;
 
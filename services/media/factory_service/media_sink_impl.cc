@@ -126,6 +126,7 @@ MediaSinkImpl::MediaSinkImpl(const String& destination_url,
           DCHECK(rate_control);
           rate_control_ = rate_control.Pass();
           producer_->Connect(consumer.Pass(), [this]() {
+            graph_.FuseTransforms();
             graph_.Prepare();
             ready_.Occur();
             MaybeSetRate();
@@ -136,6 +137,10 @@ MediaSinkImpl::MediaSinkImpl(const String& destination_url,
 
 MediaSinkImpl::~MediaSinkImpl() {}
 
+Graph* MediaSinkImpl::graph() {
+  return &graph_;
+}
+
 void MediaSinkImpl::GetConsumer(InterfaceRequest<MediaConsumer> consumer) {
   consumer_->AddBinding(consumer.Pass());
 }
@@ -36,6 +36,9 @@ class MediaSinkImpl : public MediaFactoryService::Product<MediaSink>,
 
   ~MediaSinkImpl() override;
 
+  // MediaFactoryService::ProductBase implementation.
+  Graph* graph() override;
+
   // MediaSink implementation.
   void GetConsumer(InterfaceRequest<MediaConsumer> consumer) override;
 
@@ -70,6 +70,10 @@ MediaSourceImpl::MediaSourceImpl(
 
 MediaSourceImpl::~MediaSourceImpl() {}
 
+Graph* MediaSourceImpl::graph() {
+  return &graph_;
+}
+
 void MediaSourceImpl::OnDemuxInitialized(Result result) {
   demux_part_ = graph_.Add(demux_);
 
@@ -137,6 +141,7 @@ void MediaSourceImpl::Prepare(const PrepareCallback& callback) {
   for (std::unique_ptr<Stream>& stream : streams_) {
     stream->EnsureSink();
   }
+  graph_.FuseTransforms();
   graph_.Prepare();
   state_ = MediaState::PAUSED;
   callback.Run();
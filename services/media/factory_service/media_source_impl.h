@@ -37,6 +37,9 @@ class MediaSourceImpl : public MediaFactoryService::Product<MediaSource>,
 
   ~MediaSourceImpl() override;
 
+  // MediaFactoryService::ProductBase implementation.
+  Graph* graph() override;
+
   // MediaSource implementation.
   void GetStreams(const GetStreamsCallback& callback) override;
 
@@ -0,0 +1,393 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures Graph/Engine throughput using synthetic parts. Each scenario is run
+// single-threaded and multithreaded and reports packets per second, engine
+// overhead per packet per hop, stage updates per packet and payload and packet
+// allocations per packet.
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "services/media/framework/graph.h"
+#include "services/media/framework/models/active_multistream_sink.h"
+#include "services/media/framework/models/active_sink.h"
+#include "services/media/framework/models/multistream_source.h"
+#include "services/media/framework/models/transform.h"
+#include "services/media/framework/packet_pool.h"
+#include "services/media/framework/slab_allocator.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+// Number of workers used for multithreaded runs.
+static constexpr size_t kWorkerCount = 4;
+
+// Allocator that counts allocations and forwards them to a SlabAllocator.
+class CountingAllocator : public PayloadAllocator {
+ public:
+  CountingAllocator()
+      : allocator_(SlabAllocator::Create()), allocation_count_(0) {}
+
+  uint64_t allocation_count() const { return allocation_count_; }
+
+  void* AllocatePayloadBuffer(size_t size) override {
+    ++allocation_count_;
+    return allocator_->AllocatePayloadBuffer(size);
+  }
+
+  void ReleasePayloadBuffer(size_t size, void* buffer) override {
+    allocator_->ReleasePayloadBuffer(size, buffer);
+  }
+
+ private:
+  std::shared_ptr<SlabAllocator> allocator_;
+  std::atomic<uint64_t> allocation_count_;
+};
+
+// Signals when the expected number of streams have ended.
+class Completion {
+ public:
+  explicit Completion(size_t stream_count)
+      : condition_variable_(&lock_), remaining_(stream_count) {}
+
+  void StreamEnded() {
+    base::AutoLock lock(lock_);
+    DCHECK(remaining_ != 0);
+    if (--remaining_ == 0) {
+      condition_variable_.Broadcast();
+    }
+  }
+
+  void Wait() {
+    base::AutoLock lock(lock_);
+    while (remaining_ != 0) {
+      condition_variable_.Wait();
+    }
+  }
+
+ private:
+  base::Lock lock_;
+  base::ConditionVariable condition_variable_;
+  size_t remaining_;
+};
+
+// Emits packets_per_stream fixed-size packets on each of stream_count streams,
+// round-robin.
+class SyntheticSource : public MultistreamSource {
+ public:
+  SyntheticSource(size_t stream_count,
+                  size_t packets_per_stream,
+                  size_t packet_size,
+                  PayloadAllocator* allocator)
+      : stream_count_(stream_count),
+        packets_per_stream_(packets_per_stream),
+        packet_size_(packet_size),
+        allocator_(allocator),
+        pulled_count_(0) {}
+
+  // MultistreamSource implementation.
+  size_t stream_count() const override { return stream_count_; }
+
+  PacketPtr PullPacket(size_t* stream_index_out) override {
+    DCHECK(stream_index_out);
+    *stream_index_out = pulled_count_ % stream_count_;
+    int64_t pts = pulled_count_ / stream_count_;
+    ++pulled_count_;
+
+    void* payload = nullptr;
+    if (packet_size_ != 0) {
+      payload = allocator_->AllocatePayloadBuffer(packet_size_);
+      memset(payload, static_cast<int>(pts), packet_size_);
+    }
+
+    bool end_of_stream =
+        pts + 1 == static_cast<int64_t>(packets_per_stream_);
+    return Packet::Create(pts, end_of_stream, packet_size_, payload,
+                          payload == nullptr ? nullptr : allocator_);
+  }
+
+ private:
+  size_t stream_count_;
+  size_t packets_per_stream_;
+  size_t packet_size_;
+  PayloadAllocator* allocator_;
+  size_t pulled_count_;
+};
+
+// Relays packets (work_per_packet == 0) or burns CPU over each payload,
+// producing a new payload of the same size (work_per_packet > 0). A relay
+// copies the payload, because a transform can't take ownership of its input
+// packet.
+class SyntheticTransform : public Transform {
+ public:
+  explicit SyntheticTransform(uint32_t work_per_packet)
+      : work_per_packet_(work_per_packet) {}
+
+  // Transform implementation.
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) override {
+    DCHECK(input);
+    DCHECK(allocator);
+    DCHECK(output);
+
+    if (input->size() == 0) {
+      *output = Packet::CreateNoAllocator(input->pts(),
+                                          input->end_of_stream(), 0, nullptr);
+      return true;
+    }
+
+    size_t size = input->size();
+    const uint8_t* in = static_cast<const uint8_t*>(input->payload());
+    uint8_t* out =
+        static_cast<uint8_t*>(allocator->AllocatePayloadBuffer(size));
+
+    if (work_per_packet_ == 0) {
+      memcpy(out, in, size);
+    }
+
+    uint8_t accumulator = 0;
+    for (uint32_t pass = 0; pass < work_per_packet_; ++pass) {
+      for (size_t i = 0; i < size; ++i) {
+        accumulator = accumulator * 31 + in[i];
+        out[i] = accumulator;
+      }
+    }
+
+    *output = Packet::Create(input->pts(), input->end_of_stream(), size, out,
+                             allocator);
+    return true;
+  }
+
+ private:
+  uint32_t work_per_packet_;
+};
+
+// Consumes packets, optionally sleeping for delay_us per packet.
+class SyntheticSink : public ActiveSink {
+ public:
+  SyntheticSink(uint32_t delay_us, Completion* completion)
+      : delay_us_(delay_us), completion_(completion) {}
+
+  void Start() {
+    DCHECK(demand_callback_);
+    demand_callback_(Demand::kPositive);
+  }
+
+  // ActiveSink implementation.
+  PayloadAllocator* allocator() override { return nullptr; }
+
+  void SetDemandCallback(const DemandCallback& demand_callback) override {
+    demand_callback_ = demand_callback;
+  }
+
+  Demand SupplyPacket(PacketPtr packet) override {
+    if (delay_us_ != 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay_us_));
+    }
+
+    if (packet->end_of_stream()) {
+      completion_->StreamEnded();
+    }
+
+    return Demand::kPositive;
+  }
+
+ private:
+  uint32_t delay_us_;
+  Completion* completion_;
+  DemandCallback demand_callback_;
+};
+
+// Consumes packets from input_count inputs, optionally sleeping for delay_us
+// per packet.
+class SyntheticMultistreamSink : public ActiveMultistreamSink {
+ public:
+  SyntheticMultistreamSink(size_t input_count,
+                           uint32_t delay_us,
+                           Completion* completion)
+      : input_count_(input_count),
+        delay_us_(delay_us),
+        completion_(completion),
+        host_(nullptr) {}
+
+  void Start() {
+    DCHECK(host_);
+    for (size_t i = 0; i < input_count_; ++i) {
+      host_->UpdateDemand(i, Demand::kPositive);
+    }
+  }
+
+  // ActiveMultistreamSink implementation.
+  void SetHost(ActiveMultistreamSinkHost* host) override {
+    DCHECK(host);
+    host_ = host;
+    for (size_t i = 0; i < input_count_; ++i) {
+      host_->AllocateInput();
+    }
+  }
+
+  Demand SupplyPacket(size_t input_index, PacketPtr packet) override {
+    if (delay_us_ != 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay_us_));
+    }
+
+    if (packet->end_of_stream()) {
+      completion_->StreamEnded();
+    }
+
+    return Demand::kPositive;
+  }
+
+ private:
+  size_t input_count_;
+  uint32_t delay_us_;
+  Completion* completion_;
+  ActiveMultistreamSinkHost* host_;
+};
+
+// Describes a benchmark topology. Each stream of the source runs through a
+// chain of chain_length transforms. In fan-in scenarios, all the chains feed a
+// single ActiveMultistreamSink. Otherwise, each chain has its own ActiveSink.
+struct Scenario {
+  const char* name;
+  size_t stream_count;
+  size_t packets_per_stream;
+  size_t packet_size;
+  size_t chain_length;
+  uint32_t work_per_packet;
+  uint32_t sink_delay_us;
+  bool fan_in;
+  bool fuse;
+};
+
+// Builds the scenario's graph, runs it to end-of-stream and prints the results.
+void Run(const Scenario& scenario, bool multithreaded) {
+  CountingAllocator* allocator = new CountingAllocator();
+  std::shared_ptr<PayloadAllocator> allocator_ptr(allocator);
+  Completion completion(scenario.stream_count);
+  uint64_t packet_blocks_before =
+      Packet::GetDefaultPool()->counters().block_count;
+
+  std::chrono::steady_clock::duration elapsed;
+  uint64_t update_count = 0;
+
+  {
+    Graph graph;
+    if (multithreaded) {
+      graph.EnableMultithreading(kWorkerCount);
+    }
+
+    graph.SetDefaultAllocator(allocator_ptr);
+
+    PartRef source = graph.Add(std::make_shared<SyntheticSource>(
+        scenario.stream_count, scenario.packets_per_stream,
+        scenario.packet_size, allocator));
+
+    std::vector<OutputRef> chain_outputs;
+    for (size_t stream = 0; stream < scenario.stream_count; ++stream) {
+      OutputRef output = source.output(stream);
+      for (size_t i = 0; i < scenario.chain_length; ++i) {
+        PartRef transform = graph.Add(
+            std::make_shared<SyntheticTransform>(scenario.work_per_packet));
+        graph.ConnectOutputToPart(output, transform);
+        output = transform.output();
+      }
+      chain_outputs.push_back(output);
+    }
+
+    std::vector<std::shared_ptr<SyntheticSink>> sinks;
+    std::shared_ptr<SyntheticMultistreamSink> multistream_sink;
+    if (scenario.fan_in) {
+      multistream_sink = std::make_shared<SyntheticMultistreamSink>(
+          scenario.stream_count, scenario.sink_delay_us, &completion);
+      PartRef sink = graph.Add(multistream_sink);
+      for (size_t stream = 0; stream < scenario.stream_count; ++stream) {
+        graph.Connect(chain_outputs[stream], sink.input(stream));
+      }
+    } else {
+      for (const OutputRef& output : chain_outputs) {
+        sinks.push_back(std::make_shared<SyntheticSink>(scenario.sink_delay_us,
+                                                        &completion));
+        graph.ConnectOutputToPart(output, graph.Add(sinks.back()));
+      }
+    }
+
+    if (scenario.fuse) {
+      graph.FuseTransforms();
+    }
+
+    graph.Prepare();
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (multistream_sink) {
+      multistream_sink->Start();
+    }
+
+    for (const std::shared_ptr<SyntheticSink>& sink : sinks) {
+      sink->Start();
+    }
+
+    completion.Wait();
+    elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const PartProfile& profile : graph.GetPartProfiles()) {
+      update_count += profile.update_count;
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  double packets = scenario.stream_count * scenario.packets_per_stream;
+  // The source, each transform and the sink handle each packet.
+  double hops = scenario.chain_length + 2;
+  uint64_t packet_blocks =
+      Packet::GetDefaultPool()->counters().block_count - packet_blocks_before;
+
+  printf(
+      "%-26s %-3s %10.0f packets/s %8.1f ns/packet/hop %6.2f updates/packet "
+      "%5.2f allocs/packet %6llu packet blocks\n",
+      scenario.name, multithreaded ? "mt" : "st", packets / seconds,
+      seconds * 1e9 / (packets * hops), update_count / packets,
+      allocator->allocation_count() / packets,
+      static_cast<unsigned long long>(packet_blocks));
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
+
+int main(int argc, char** argv) {
+  using namespace mojo::media;
+
+  // name, streams, packets per stream, packet size, chain length, work,
+  // sink delay, fan in, fuse
+  static const Scenario kScenarios[] = {
+      {"relay", 1, 100000, 4096, 1, 0, 0, false, false},
+      {"chain of 8", 1, 50000, 4096, 8, 0, 0, false, false},
+      {"chain of 8, fused", 1, 50000, 4096, 8, 0, 0, false, true},
+      {"8 streams, chains of 4", 8, 10000, 4096, 4, 0, 0, false, false},
+      {"8 streams, cpu-bound", 8, 2000, 4096, 2, 4, 0, false, false},
+      {"16 streams fan-in", 16, 5000, 4096, 1, 0, 0, true, false},
+      {"16 streams fan-in, cpu", 16, 1000, 4096, 1, 4, 0, true, false},
+      {"slow sink", 1, 1000, 4096, 2, 0, 50, false, false},
+  };
+
+  for (const Scenario& scenario : kScenarios) {
+    Run(scenario, false);
+    Run(scenario, true);
+  }
+
+  return 0;
+}
@@ -0,0 +1,190 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares SlabAllocator with a plain malloc/free allocator (the framework's
+// original default) on allocation patterns typical of media pipelines.
+
+#include <stdio.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "services/media/framework/payload_allocator.h"
+#include "services/media/framework/slab_allocator.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class MallocAllocator : public PayloadAllocator {
+ public:
+  void* AllocatePayloadBuffer(size_t size) override {
+    return std::malloc(size);
+  }
+
+  void ReleasePayloadBuffer(size_t size, void* buffer) override {
+    std::free(buffer);
+  }
+};
+
+// 1024 frames of stereo 16-bit audio.
+static constexpr size_t kAudioPacketSize = 1024 * 2 * 2;
+
+// A 1280x720 I420 frame.
+static constexpr size_t kVideoFrameSize = 1280 * 720 * 3 / 2;
+
+// Number of packets in flight between stages.
+static constexpr size_t kPipelineDepth = 8;
+
+// Allocates and releases buffers of the indicated size on one thread, keeping
+// kPipelineDepth buffers outstanding.
+void SteadyStream(PayloadAllocator* allocator, size_t size, size_t count) {
+  std::deque<void*> in_flight;
+  for (size_t i = 0; i < count; ++i) {
+    void* buffer = allocator->AllocatePayloadBuffer(size);
+    // Touch the buffer so the comparison includes page faults.
+    memset(buffer, 0, 64);
+    in_flight.push_back(buffer);
+    if (in_flight.size() > kPipelineDepth) {
+      allocator->ReleasePayloadBuffer(size, in_flight.front());
+      in_flight.pop_front();
+    }
+  }
+
+  for (void* buffer : in_flight) {
+    allocator->ReleasePayloadBuffer(size, buffer);
+  }
+}
+
+// Allocates buffers of varying sizes, like a decoder producing variable-length
+// compressed packets, on one thread.
+void VaryingSizes(PayloadAllocator* allocator, size_t count) {
+  std::deque<std::pair<size_t, void*>> in_flight;
+  uint32_t seed = 1;
+  for (size_t i = 0; i < count; ++i) {
+    seed = seed * 1103515245 + 12345;
+    size_t size = 512 + (seed >> 8) % 16384;
+    in_flight.emplace_back(size, allocator->AllocatePayloadBuffer(size));
+    if (in_flight.size() > kPipelineDepth) {
+      allocator->ReleasePayloadBuffer(in_flight.front().first,
+                                      in_flight.front().second);
+      in_flight.pop_front();
+    }
+  }
+
+  for (auto& pair : in_flight) {
+    allocator->ReleasePayloadBuffer(pair.first, pair.second);
+  }
+}
+
+// Allocates buffers on one thread and releases them on another, as when a
+// decoder feeds a renderer.
+void CrossThread(PayloadAllocator* allocator, size_t size, size_t count) {
+  base::Lock lock;
+  base::ConditionVariable condition_variable(&lock);
+  std::deque<void*> queue;
+  bool done = false;
+
+  std::thread consumer([&]() {
+    base::AutoLock auto_lock(lock);
+    while (true) {
+      while (queue.empty() && !done) {
+        condition_variable.Wait();
+      }
+
+      if (queue.empty()) {
+        return;
+      }
+
+      void* buffer = queue.front();
+      queue.pop_front();
+      condition_variable.Broadcast();
+      base::AutoUnlock auto_unlock(lock);
+      allocator->ReleasePayloadBuffer(size, buffer);
+    }
+  });
+
+  for (size_t i = 0; i < count; ++i) {
+    void* buffer = allocator->AllocatePayloadBuffer(size);
+    memset(buffer, 0, 64);
+    base::AutoLock auto_lock(lock);
+    while (queue.size() >= kPipelineDepth) {
+      condition_variable.Wait();
+    }
+    queue.push_back(buffer);
+    condition_variable.Broadcast();
+  }
+
+  {
+    base::AutoLock auto_lock(lock);
+    done = true;
+    condition_variable.Broadcast();
+  }
+
+  consumer.join();
+}
+
+// Runs the scenario with both allocators and prints the results.
+void Compare(const char* name,
+             size_t count,
+             const std::function<void(PayloadAllocator*)>& scenario) {
+  MallocAllocator malloc_allocator;
+  std::shared_ptr<SlabAllocator> slab_allocator = SlabAllocator::Create();
+
+  auto time = [&scenario](PayloadAllocator* allocator) {
+    auto start = std::chrono::steady_clock::now();
+    scenario(allocator);
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  double malloc_ns = time(&malloc_allocator);
+  double slab_ns = time(slab_allocator.get());
+
+  printf("%-28s malloc %8.1f ns/op   slab %8.1f ns/op   %5.2fx\n", name,
+         malloc_ns / count, slab_ns / count, malloc_ns / slab_ns);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
+
+int main(int argc, char** argv) {
+  using namespace mojo::media;
+
+  static constexpr size_t kCount = 200000;
+  static constexpr size_t kVideoCount = 5000;
+
+  Compare("audio packets", kCount, [](PayloadAllocator* allocator) {
+    SteadyStream(allocator, kAudioPacketSize, kCount);
+  });
+
+  Compare("video frames", kVideoCount, [](PayloadAllocator* allocator) {
+    SteadyStream(allocator, kVideoFrameSize, kVideoCount);
+  });
+
+  Compare("varying sizes", kCount, [](PayloadAllocator* allocator) {
+    VaryingSizes(allocator, kCount);
+  });
+
+  Compare("audio packets, two threads", kCount,
+          [](PayloadAllocator* allocator) {
+            CrossThread(allocator, kAudioPacketSize, kCount);
+          });
+
+  Compare("video frames, two threads", kVideoCount,
+          [](PayloadAllocator* allocator) {
+            CrossThread(allocator, kVideoFrameSize, kVideoCount);
+          });
+
+  return 0;
+}
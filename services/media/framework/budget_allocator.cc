@@ -0,0 +1,188 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/logging.h"
+#include "services/media/framework/budget_allocator.h"
+
+namespace mojo {
+namespace media {
+
+namespace {
+
+// Raises peak to at least value.
+void UpdatePeak(std::atomic<size_t>* peak, size_t value) {
+  size_t previous = *peak;
+  while (previous < value && !peak->compare_exchange_weak(previous, value)) {
+  }
+}
+
+}  // namespace
+
+BudgetAllocator::Account::Account(BudgetAllocator* budget)
+    : budget_(budget), current_bytes_(0), peak_bytes_(0) {
+  DCHECK(budget_);
+}
+
+BudgetAllocator::Account::~Account() {}
+
+void* BudgetAllocator::Account::AllocatePayloadBuffer(size_t size) {
+  void* buffer = budget_->Allocate(size);
+  if (buffer != nullptr) {
+    UpdatePeak(&peak_bytes_, current_bytes_ += size);
+  }
+
+  return buffer;
+}
+
+void BudgetAllocator::Account::ReleasePayloadBuffer(size_t size,
+                                                    void* buffer) {
+  DCHECK(current_bytes_ >= size);
+  current_bytes_ -= size;
+  budget_->Release(size, buffer);
+}
+
+// static
+std::shared_ptr<BudgetAllocator> BudgetAllocator::Create(
+    std::shared_ptr<PayloadAllocator> allocator,
+    size_t soft_limit,
+    size_t hard_limit) {
+  return std::shared_ptr<BudgetAllocator>(
+      new BudgetAllocator(allocator, soft_limit, hard_limit));
+}
+
+BudgetAllocator::BudgetAllocator(std::shared_ptr<PayloadAllocator> allocator,
+                                 size_t soft_limit,
+                                 size_t hard_limit)
+    : allocator_(allocator),
+      soft_limit_(soft_limit),
+      hard_limit_(hard_limit),
+      resume_level_(soft_limit / 8 * kResumeEighths),
+      current_bytes_(0),
+      peak_bytes_(0),
+      throttled_(false),
+      resume_count_(0),
+      condition_variable_(&lock_),
+      transition_count_(0),
+      resume_callback_calls_(0) {
+  DCHECK(soft_limit_ <= hard_limit_);
+}
+
+BudgetAllocator::~BudgetAllocator() {
+  DCHECK_EQ(current_bytes_, 0u) << "payloads outstanding";
+}
+
+BudgetAllocator::Account* BudgetAllocator::CreateAccount() {
+  base::AutoLock lock(lock_);
+  accounts_.emplace_back(new Account(this));
+  return accounts_.back().get();
+}
+
+void BudgetAllocator::SetResumeCallback(const ResumeCallback& callback) {
+  base::AutoLock lock(lock_);
+  resume_callback_ = callback;
+  while (resume_callback_calls_ != 0) {
+    condition_variable_.Wait();
+  }
+}
+
+void* BudgetAllocator::AllocatePayloadBuffer(size_t size) {
+  return Allocate(size);
+}
+
+void BudgetAllocator::ReleasePayloadBuffer(size_t size, void* buffer) {
+  Release(size, buffer);
+}
+
+void* BudgetAllocator::Allocate(size_t size) {
+  // Reserve the bytes first, so concurrent allocations can't together exceed
+  // the hard limit.
+  size_t current = current_bytes_;
+  do {
+    if (size > hard_limit_ - current) {
+      return nullptr;
+    }
+  } while (!current_bytes_.compare_exchange_weak(current, current + size));
+
+  PayloadAllocator* allocator =
+      allocator_ ? allocator_.get() : PayloadAllocator::GetDefault();
+  void* buffer = allocator->AllocatePayloadBuffer(size);
+  if (buffer == nullptr) {
+    current_bytes_ -= size;
+    return nullptr;
+  }
+
+  UpdatePeak(&peak_bytes_, current + size);
+
+  if (current + size > soft_limit_ && !throttled_) {
+    UpdateThrottle();
+  }
+
+  return buffer;
+}
+
+void BudgetAllocator::Release(size_t size, void* buffer) {
+  PayloadAllocator* allocator =
+      allocator_ ? allocator_.get() : PayloadAllocator::GetDefault();
+  allocator->ReleasePayloadBuffer(size, buffer);
+
+  DCHECK(current_bytes_ >= size);
+  size_t current = current_bytes_ -= size;
+
+  if (current <= resume_level_ && throttled_) {
+    UpdateThrottle();
+  }
+}
+
+void BudgetAllocator::UpdateThrottle() {
+  ResumeCallback callback;
+  uint64_t transition = 0;
+
+  {
+    base::AutoLock lock(lock_);
+
+    // Other threads may have changed current_bytes_ since the caller looked,
+    // so decide again with the lock held. The last thread to change it always
+    // gets here if a transition is due.
+    size_t current = current_bytes_;
+    if (!throttled_ && current > soft_limit_) {
+      throttled_ = true;
+      ++transition_count_;
+    } else if (throttled_ && current <= resume_level_) {
+      throttled_ = false;
+      transition = ++transition_count_;
+      ++resume_count_;
+      if (resume_callback_) {
+        callback = resume_callback_;
+        ++resume_callback_calls_;
+      }
+    }
+  }
+
+  if (!callback) {
+    return;
+  }
+
+  bool overtaken;
+  {
+    // Another thread may have throttled the budget again since the lock was
+    // released. Its resume, if any, is the one to report.
+    base::AutoLock lock(lock_);
+    overtaken = transition != transition_count_;
+  }
+
+  // The lock isn't held here, because the callback may allocate or release
+  // buffers, which may bring us back here.
+  if (!overtaken) {
+    callback();
+  }
+
+  base::AutoLock lock(lock_);
+  DCHECK(resume_callback_calls_ != 0);
+  if (--resume_callback_calls_ == 0) {
+    condition_variable_.Broadcast();
+  }
+}
+
+}  // namespace media
+}  // namespace mojo
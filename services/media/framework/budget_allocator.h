@@ -0,0 +1,158 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_BUDGET_ALLOCATOR_H_
+#define SERVICES_MEDIA_FRAMEWORK_BUDGET_ALLOCATOR_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "services/media/framework/payload_allocator.h"
+
+namespace mojo {
+namespace media {
+
+// Payload allocator that accounts for the memory allocated through it and
+// enforces limits on it.
+//
+// Allocations are passed to another allocator. The bytes outstanding are
+// counted in total and per account. A graph creates an account for each of its
+// stages, so the memory each stage holds can be reported (see
+// Graph::SetMemoryBudget).
+//
+// When the bytes outstanding exceed the soft limit, the budget is throttled.
+// Allocations still succeed, but the outputs of sources report negative
+// demand, so sources stop producing, and the packets already in the graph
+// drain. The throttle is
+// released, and the resume callback is called, when the bytes outstanding
+// fall to kResumeEighths eighths of the soft limit, so the graph doesn't stop
+// and start on every packet. An allocation that would take the bytes
+// outstanding over the hard limit fails.
+class BudgetAllocator : public PayloadAllocator {
+ public:
+  // Portion of the soft limit, in eighths, to which usage must fall before a
+  // throttled budget resumes.
+  static constexpr size_t kResumeEighths = 7;
+
+  // Allocator whose allocations are counted against the budget and also
+  // against the account. Accounts are owned by the budget and last as long as
+  // it does, because payloads may be released after the part that allocated
+  // them is gone.
+  class Account : public PayloadAllocator {
+   public:
+    ~Account();
+
+    // Bytes allocated through this account and not yet released.
+    size_t current_bytes() const { return current_bytes_; }
+
+    // Highest value current_bytes has had.
+    size_t peak_bytes() const { return peak_bytes_; }
+
+    // PayloadAllocator implementation.
+    void* AllocatePayloadBuffer(size_t size) override;
+
+    void ReleasePayloadBuffer(size_t size, void* buffer) override;
+
+   private:
+    explicit Account(BudgetAllocator* budget);
+
+    BudgetAllocator* budget_;
+    std::atomic<size_t> current_bytes_;
+    std::atomic<size_t> peak_bytes_;
+
+    friend class BudgetAllocator;
+  };
+
+  // Called when a throttled budget resumes. May be called on any thread.
+  using ResumeCallback = std::function<void()>;
+
+  // Creates a budget allocator. Allocations are passed to allocator, or to
+  // PayloadAllocator::GetDefault() if allocator is nullptr. hard_limit must be
+  // at least soft_limit.
+  static std::shared_ptr<BudgetAllocator> Create(
+      std::shared_ptr<PayloadAllocator> allocator,
+      size_t soft_limit,
+      size_t hard_limit);
+
+  // All buffers allocated by this allocator and its accounts must be released
+  // before it's deleted.
+  ~BudgetAllocator();
+
+  // Creates an account.
+  Account* CreateAccount();
+
+  size_t soft_limit() const { return soft_limit_; }
+
+  size_t hard_limit() const { return hard_limit_; }
+
+  // Bytes allocated and not yet released.
+  size_t current_bytes() const { return current_bytes_; }
+
+  // Highest value current_bytes has had.
+  size_t peak_bytes() const { return peak_bytes_; }
+
+  // Determines whether the budget is throttled.
+  bool throttled() const { return throttled_; }
+
+  // Number of times the budget has resumed after being throttled.
+  uint64_t resume_count() const { return resume_count_; }
+
+  // Sets the callback to call when the budget resumes. The callback is called
+  // without internal locks held, so it may allocate and release buffers. A
+  // resume that a later throttle has overtaken by the time the callback would
+  // be called isn't reported. When this method returns, no call to the
+  // previous callback is in progress. This method must not be called from the
+  // callback.
+  void SetResumeCallback(const ResumeCallback& callback);
+
+  // PayloadAllocator implementation.
+  void* AllocatePayloadBuffer(size_t size) override;
+
+  void ReleasePayloadBuffer(size_t size, void* buffer) override;
+
+ private:
+  BudgetAllocator(std::shared_ptr<PayloadAllocator> allocator,
+                  size_t soft_limit,
+                  size_t hard_limit);
+
+  // Reserves size bytes and allocates a buffer, returning nullptr if that
+  // would exceed the hard limit or the allocation fails.
+  void* Allocate(size_t size);
+
+  // Releases a buffer allocated with Allocate.
+  void Release(size_t size, void* buffer);
+
+  // Throttles or resumes the budget according to current_bytes_.
+  void UpdateThrottle();
+
+  std::shared_ptr<PayloadAllocator> allocator_;
+  size_t soft_limit_;
+  size_t hard_limit_;
+  size_t resume_level_;
+
+  std::atomic<size_t> current_bytes_;
+  std::atomic<size_t> peak_bytes_;
+  std::atomic_bool throttled_;
+  std::atomic<uint64_t> resume_count_;
+
+  // lock_ serializes throttle transitions and protects the following fields.
+  base::Lock lock_;
+  // Signalled when resume_callback_calls_ drops to zero.
+  base::ConditionVariable condition_variable_;
+  // Incremented on every throttle transition.
+  uint64_t transition_count_;
+  ResumeCallback resume_callback_;
+  // Number of calls to resume_callback_ in progress.
+  size_t resume_callback_calls_;
+  std::vector<std::unique_ptr<Account>> accounts_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_BUDGET_ALLOCATOR_H_
@@ -2,32 +2,174 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+#include <thread>
+
+#include "base/trace_event/trace_event.h"
+#include "services/media/framework/budget_allocator.h"
 #include "services/media/framework/engine.h"
 
 namespace mojo {
 namespace media {
 
-Engine::Engine() {}
+Engine::Engine()
+    : scheduling_policy_(SchedulingPolicy::kBacklog),
+      budget_(nullptr),
+      resume_pending_(false),
+      profiling_enabled_(false),
+      gate_condition_variable_(&gate_lock_) {}
 
 Engine::~Engine() {
+  if (budget_ != nullptr) {
+    budget_->SetResumeCallback(nullptr);
+  }
+
+  // Discards a posted resume, or waits for it to finish.
+  resume_sequence_.reset();
+
+  // pool_ or queue_ is destroyed after this, running any queued updates. Those
+  // updates delete stages whose deletion was deferred.
+  base::AutoLock lock(lock_);
+}
+
+void Engine::EnableMultithreading(size_t worker_count) {
+  base::AutoLock lock(lock_);
+  DCHECK(!multithreaded()) << "engine is already multithreaded";
+  DCHECK(supply_backlog_.empty() && demand_backlog_.empty());
+  pool_.reset(new WorkStealingPool(worker_count));
+}
+
+void Engine::UseScheduler(std::shared_ptr<Scheduler> scheduler,
+                          uint32_t weight) {
+  DCHECK(scheduler);
   base::AutoLock lock(lock_);
+  DCHECK(!multithreaded()) << "engine is already multithreaded";
+  DCHECK(supply_backlog_.empty() && demand_backlog_.empty());
+  queue_.reset(new Scheduler::Queue(scheduler, weight));
+}
+
+void Engine::SetSchedulingPolicy(SchedulingPolicy policy) {
+  base::AutoLock lock(lock_);
+  DCHECK(supply_backlog_.empty() && demand_backlog_.empty() &&
+         deadline_backlog_.empty());
+  scheduling_policy_ = policy;
+}
+
+void Engine::SetPresentationDeadline(Stage* sink,
+                                     const Stage::DeadlineFunction& deadline) {
+  DCHECK(sink);
+  DCHECK(deadline);
+  base::AutoLock lock(lock_);
+  std::vector<std::shared_ptr<const Stage::DeadlineFunction>> functions =
+      sink->deadline_functions_;
+  functions.push_back(
+      std::make_shared<const Stage::DeadlineFunction>(deadline));
+  SetDeadlineFunctions(sink, std::move(functions));
+}
+
+void Engine::SetMemoryBudget(BudgetAllocator* budget) {
+  DCHECK(budget);
+  DCHECK(budget_ == nullptr);
+  budget_ = budget;
+  resume_sequence_.reset(new Scheduler::Sequence(Scheduler::GetDefault()));
+  budget_->SetResumeCallback([this]() { ResumeThrottledStages(); });
+}
+
+void Engine::RunExclusive(const std::function<void()>& function) {
+  base::AutoLock lock(lock_);
+  BeginExclusive();
+  function();
+  EndExclusive();
+}
+
+void Engine::DeleteStage(Stage* stage) {
+  DCHECK(stage);
+
+  if (!multithreaded()) {
+    {
+      // Parts such as async transforms may update the graph from their own
+      // threads. Wait for any such update to finish. The lock isn't held
+      // during deletion, because a stage may wait for those threads.
+      base::AutoLock lock(lock_);
+      RetireStage(stage);
+    }
+
+    delete stage;
+    return;
+  }
+
+  BeginExclusive();
+  bool delete_now = RetireStage(stage);
+  EndExclusive();
+
+  if (delete_now) {
+    delete stage;
+  }
+}
+
+bool Engine::RetireStage(Stage* stage) {
+  {
+    base::AutoLock lock(throttle_lock_);
+    if (stage->throttled_) {
+      throttled_stages_.erase(std::find(throttled_stages_.begin(),
+                                        throttled_stages_.end(), stage));
+      stage->throttled_ = false;
+    }
+  }
+
+  if (!multithreaded()) {
+    return true;
+  }
+
+  // With no updates in progress, the stage is either idle or queued.
+  uint32_t state = Stage::kIdle;
+  if (stage->update_state_.compare_exchange_strong(state, Stage::kRemoved)) {
+    return true;
+  }
+
+  // The queued update will delete the stage.
+  DCHECK_EQ(state, Stage::kQueued);
+  stage->update_state_ = Stage::kRemoved;
+  return false;
 }
 
 void Engine::PrepareInput(const InputRef& input) {
-  VisitUpstream(input, [](const InputRef& input, const OutputRef& output,
-                          const Stage::UpstreamCallback& callback) {
+  VisitUpstream(input, [this](const InputRef& input, const OutputRef& output,
+                              const Stage::UpstreamCallback& callback) {
     DCHECK(!input.actual().prepared());
     PayloadAllocator* allocator = input.stage_->PrepareInput(input.index_);
     input.actual().set_prepared(true);
+
+    // Stages upstream of a sink share its deadlines.
+    std::vector<std::shared_ptr<const Stage::DeadlineFunction>> functions =
+        output.stage_->deadline_functions_;
+    AddDeadlineFunctions(input.stage_, &functions);
+    SetDeadlineFunctions(output.stage_, std::move(functions));
+
     output.stage_->PrepareOutput(output.index_, allocator, callback);
   });
 }
 
 void Engine::UnprepareInput(const InputRef& input) {
-  VisitUpstream(input, [](const InputRef& input, const OutputRef& output,
-                          const Stage::UpstreamCallback& callback) {
+  VisitUpstream(input, [this](const InputRef& input, const OutputRef& output,
+                              const Stage::UpstreamCallback& callback) {
     DCHECK(input.actual().prepared());
     input.stage_->UnprepareInput(input.index_);
+    input.actual().set_prepared(false);
+
+    // The stage upstream keeps the deadlines of the sinks it still feeds
+    // through its other outputs.
+    std::vector<std::shared_ptr<const Stage::DeadlineFunction>> functions;
+    size_t output_count = output.stage_->output_count();
+    for (size_t i = 0; i < output_count; ++i) {
+      Output& other_output = output.stage_->output(i);
+      if (other_output.connected() && other_output.actual_mate().prepared()) {
+        AddDeadlineFunctions(other_output.mate().stage_, &functions);
+      }
+    }
+
+    SetDeadlineFunctions(output.stage_, std::move(functions));
+
     output.stage_->UnprepareOutput(output.index_, callback);
   });
 }
@@ -36,26 +178,189 @@ void Engine::FlushOutput(const OutputRef& output) {
   if (!output.connected()) {
     return;
   }
-  VisitDownstream(output, [](const OutputRef& output, const InputRef& input,
-                             const Stage::DownstreamCallback& callback) {
-    DCHECK(input.actual().prepared());
-    output.stage_->FlushOutput(output.index_);
-    input.stage_->FlushInput(input.index_, callback);
-  });
+
+  Stage* stage = output.stage_;
+  Stage* downstream_stage = output.mate().stage_;
+
+  if (!multithreaded()) {
+    base::AutoLock lock(lock_);
+    stage->FlushOutput(output.index_);
+    output.actual().AdvanceGeneration();
+    // The stage downstream catches up when the graph is next updated.
+    PushToSupplyBacklog(downstream_stage);
+    return;
+  }
+
+  // Only the stage and its neighbors touch the output, and none of them can be
+  // updated while the stage's update lock is held.
+  BeginUpdate();
+  stage->update_lock_.Acquire();
+  stage->FlushOutput(output.index_);
+  output.actual().AdvanceGeneration();
+  stage->update_lock_.Release();
+  EndUpdate();
+
+  ScheduleUpdate(downstream_stage);
+}
+
+void Engine::InsertStage(const OutputRef& output, Stage* stage) {
+  DCHECK(output.valid());
+  DCHECK(output.connected());
+  DCHECK(stage);
+  DCHECK_EQ(stage->input_count(), 1u);
+  DCHECK_EQ(stage->output_count(), 1u);
+  DCHECK(!stage->input(0).connected());
+  DCHECK(!stage->output(0).connected());
+
+  base::AutoLock lock(lock_);
+  BeginExclusive();
+
+  InputRef input = output.mate();
+  PayloadAllocator* previous_requirement =
+      input.actual().prepared() ? input.stage_->PrepareInput(input.index_)
+                                : nullptr;
+  bool prepared = DisconnectPrepared(output, input);
+
+  // The packets waiting in the input haven't been through the stage yet.
+  SpliceStage(output, stage, input, prepared, previous_requirement,
+              &input.actual());
+
+  EndExclusive();
+  UpdateAfterReconfiguration({output.stage_, stage, input.stage_});
+}
+
+void Engine::ExtractStage(Stage* stage) {
+  DCHECK(stage);
+  DCHECK_EQ(stage->input_count(), 1u);
+  DCHECK_EQ(stage->output_count(), 1u);
+
+  InputRef stage_input(stage, 0);
+  OutputRef stage_output(stage, 0);
+  DCHECK(stage_input.connected());
+  DCHECK(stage_output.connected());
+
+  // The lock is released before the stage is deleted. See DeleteStage.
+  lock_.Acquire();
+  BeginExclusive();
+
+  OutputRef output = stage_input.mate();
+  InputRef input = stage_output.mate();
+  PayloadAllocator* previous_requirement =
+      stage_input.actual().prepared() ? stage->PrepareInput(0) : nullptr;
+  bool prepared = DisconnectPrepared(stage_output, input);
+  if (DisconnectPrepared(output, stage_input)) {
+    stage->UnprepareInput(0);
+    stage->UnprepareOutput(0, [](size_t input_index) {});
+  }
+
+  ConnectPrepared(output, input, prepared);
+
+  // The packets waiting for the stage go straight to the input.
+  input.actual().TakePackets(&stage_input.actual());
+
+  if (prepared) {
+    PayloadAllocator* allocator = input.stage_->PrepareInput(input.index_);
+    if (allocator != previous_requirement) {
+      RenegotiateOutput(output, allocator);
+    }
+  }
+
+  bool delete_now = RetireStage(stage);
+  EndExclusive();
+  UpdateAfterReconfiguration({output.stage_, input.stage_});
+  lock_.Release();
+
+  if (delete_now) {
+    delete stage;
+  }
+}
+
+void Engine::ReplaceStage(Stage* stage,
+                          Stage* replacement,
+                          bool flush_downstream) {
+  DCHECK(stage);
+  DCHECK_EQ(stage->input_count(), 1u);
+  DCHECK_EQ(stage->output_count(), 1u);
+  DCHECK(replacement);
+  DCHECK_EQ(replacement->input_count(), 1u);
+  DCHECK_EQ(replacement->output_count(), 1u);
+  DCHECK(!replacement->input(0).connected());
+  DCHECK(!replacement->output(0).connected());
+
+  InputRef stage_input(stage, 0);
+  OutputRef stage_output(stage, 0);
+  DCHECK(stage_input.connected());
+  DCHECK(stage_output.connected());
+
+  // The lock is released before the stage is deleted. See DeleteStage.
+  lock_.Acquire();
+  BeginExclusive();
+
+  OutputRef output = stage_input.mate();
+  InputRef input = stage_output.mate();
+  PayloadAllocator* previous_requirement =
+      stage_input.actual().prepared() ? stage->PrepareInput(0) : nullptr;
+  bool prepared = DisconnectPrepared(stage_output, input);
+  if (DisconnectPrepared(output, stage_input)) {
+    stage->UnprepareInput(0);
+    stage->UnprepareOutput(0, [](size_t input_index) {});
+  }
+
+  // The packets waiting for the stage go to the replacement. Packets the
+  // stage has already produced stay where they are.
+  SpliceStage(output, replacement, input, prepared, previous_requirement,
+              &stage_input.actual());
+
+  if (flush_downstream) {
+    // The replacement hasn't supplied anything yet, so the packets downstream
+    // of it all came from the stage. The stages downstream catch up when
+    // they're next updated.
+    replacement->output(0).AdvanceGeneration();
+  }
+
+  bool delete_now = RetireStage(stage);
+  EndExclusive();
+  UpdateAfterReconfiguration({output.stage_, replacement, input.stage_});
+  lock_.Release();
+
+  if (delete_now) {
+    delete stage;
+  }
 }
 
 void Engine::RequestUpdate(Stage* stage) {
   DCHECK(stage);
+
+  if (multithreaded()) {
+    ScheduleUpdate(stage);
+    return;
+  }
+
   base::AutoLock lock(lock_);
   Update(stage);
   Update();
 }
 
 void Engine::PushToSupplyBacklog(Stage* stage) {
-  lock_.AssertAcquired();
   DCHECK(stage);
 
+  if (multithreaded()) {
+    ScheduleUpdate(stage);
+    return;
+  }
+
+  lock_.AssertAcquired();
+
   packets_produced_ = true;
+
+  if (scheduling_policy_ == SchedulingPolicy::kDeadline) {
+    if (!stage->in_supply_backlog_) {
+      deadline_backlog_.push_back(stage);
+      stage->in_supply_backlog_ = true;
+    }
+    return;
+  }
+
   if (!stage->in_supply_backlog_) {
     supply_backlog_.push(stage);
     stage->in_supply_backlog_ = true;
@@ -63,9 +368,23 @@ void Engine::PushToSupplyBacklog(Stage* stage) {
 }
 
 void Engine::PushToDemandBacklog(Stage* stage) {
-  lock_.AssertAcquired();
   DCHECK(stage);
 
+  if (multithreaded()) {
+    ScheduleUpdate(stage);
+    return;
+  }
+
+  lock_.AssertAcquired();
+
+  if (scheduling_policy_ == SchedulingPolicy::kDeadline) {
+    if (!stage->in_supply_backlog_) {
+      deadline_backlog_.push_back(stage);
+      stage->in_supply_backlog_ = true;
+    }
+    return;
+  }
+
   if (!stage->in_demand_backlog_) {
     demand_backlog_.push(stage);
     stage->in_demand_backlog_ = true;
@@ -75,6 +394,7 @@ void Engine::PushToDemandBacklog(Stage* stage) {
 void Engine::VisitUpstream(const InputRef& input,
                            const UpstreamVisitor& vistor) {
   base::AutoLock lock(lock_);
+  BeginExclusive();
 
   std::queue<InputRef> backlog;
   backlog.push(input);
@@ -92,27 +412,110 @@ void Engine::VisitUpstream(const InputRef& input,
       backlog.push(InputRef(output_stage, input_index));
     });
   }
+
+  EndExclusive();
 }
 
-void Engine::VisitDownstream(const OutputRef& output,
-                             const DownstreamVisitor& vistor) {
-  base::AutoLock lock(lock_);
+void Engine::SpliceStage(const OutputRef& output,
+                         Stage* stage,
+                         const InputRef& input,
+                         bool prepared,
+                         PayloadAllocator* previous_requirement,
+                         Input* packets_from) {
+  lock_.AssertAcquired();
+  DCHECK(packets_from);
 
-  std::queue<OutputRef> backlog;
-  backlog.push(output);
+  InputRef stage_input(stage, 0);
+  OutputRef stage_output(stage, 0);
 
-  while (!backlog.empty()) {
-    OutputRef output = backlog.front();
-    backlog.pop();
-    DCHECK(output.valid());
-    DCHECK(output.connected());
+  ConnectPrepared(output, stage_input, false);
+  ConnectPrepared(stage_output, input, prepared);
+  stage_input.actual().TakePackets(packets_from);
+
+  if (!prepared) {
+    return;
+  }
 
-    const InputRef& input = output.mate();
-    Stage* input_stage = input.stage_;
+  // Prepare the stage as Prepare would have, stopping at the stage's input.
+  SetDeadlineFunctions(stage, input.stage_->deadline_functions_);
+  stage->PrepareOutput(0, input.stage_->PrepareInput(input.index_),
+                       [](size_t input_index) {});
+  PayloadAllocator* allocator = stage->PrepareInput(0);
+  stage_input.actual().set_prepared(true);
 
-    vistor(output, input, [input_stage, &backlog](size_t output_index) {
-      backlog.push(OutputRef(input_stage, output_index));
-    });
+  if (allocator != previous_requirement) {
+    RenegotiateOutput(output, allocator);
+  }
+}
+
+// static
+bool Engine::DisconnectPrepared(const OutputRef& output,
+                                const InputRef& input) {
+  DCHECK(output.connected());
+  DCHECK(input.connected());
+
+  bool prepared = input.actual().prepared();
+  input.actual().set_prepared(false);
+  input.actual().Disconnect();
+  output.actual().Disconnect();
+  return prepared;
+}
+
+// static
+void Engine::ConnectPrepared(const OutputRef& output,
+                             const InputRef& input,
+                             bool prepared) {
+  output.actual().Connect(input);
+  input.actual().Connect(output);
+  input.actual().set_prepared(prepared);
+}
+
+void Engine::RenegotiateOutput(const OutputRef& output,
+                               PayloadAllocator* allocator) {
+  lock_.AssertAcquired();
+
+  Stage* stage = output.stage_;
+
+  // Note what the stage currently requires of its inputs.
+  std::vector<PayloadAllocator*> previous_requirements(stage->input_count(),
+                                                       nullptr);
+  for (size_t i = 0; i < stage->input_count(); ++i) {
+    if (stage->input(i).prepared()) {
+      previous_requirements[i] = stage->PrepareInput(i);
+    }
+  }
+
+  std::vector<size_t> input_indices;
+  stage->UnprepareOutput(output.index_, [](size_t input_index) {});
+  stage->PrepareOutput(output.index_, allocator,
+                       [&input_indices](size_t input_index) {
+                         input_indices.push_back(input_index);
+                       });
+
+  // Continue upstream through the inputs whose requirements changed.
+  for (size_t input_index : input_indices) {
+    InputRef input(stage, input_index);
+    if (!input.connected() || !input.actual().prepared()) {
+      continue;
+    }
+
+    PayloadAllocator* input_allocator = stage->PrepareInput(input_index);
+    if (input_allocator != previous_requirements[input_index]) {
+      RenegotiateOutput(input.mate(), input_allocator);
+    }
+  }
+}
+
+void Engine::UpdateAfterReconfiguration(const std::vector<Stage*>& stages) {
+  lock_.AssertAcquired();
+
+  // The stages' supply and demand may have changed.
+  for (Stage* stage : stages) {
+    PushToSupplyBacklog(stage);
+  }
+
+  if (!multithreaded()) {
+    Update();
   }
 }
 
@@ -120,7 +523,17 @@ void Engine::Update() {
   lock_.AssertAcquired();
 
   while (true) {
-    Stage* stage = PopFromSupplyBacklog();
+    if (resume_pending_.exchange(false)) {
+      PushThrottledStagesToBacklog();
+    }
+
+    Stage* stage = PopFromDeadlineBacklog();
+    if (stage != nullptr) {
+      Update(stage);
+      continue;
+    }
+
+    stage = PopFromSupplyBacklog();
     if (stage != nullptr) {
       Update(stage);
       continue;
@@ -132,7 +545,9 @@ void Engine::Update() {
       continue;
     }
 
-    break;
+    if (!resume_pending_) {
+      break;
+    }
   }
 }
 
@@ -143,7 +558,7 @@ void Engine::Update(Stage* stage) {
 
   packets_produced_ = false;
 
-  stage->Update(this);
+  UpdateStage(stage);
 
   // If the stage produced packets, it may need to reevaluate demand later.
   if (packets_produced_) {
@@ -151,6 +566,237 @@ void Engine::Update(Stage* stage) {
   }
 }
 
+Stage* Engine::PopFromDeadlineBacklog() {
+  lock_.AssertAcquired();
+
+  if (deadline_backlog_.empty()) {
+    return nullptr;
+  }
+
+  // Find the most urgent stage. The backlog is short, so a linear search is
+  // fine, and urgency changes as packets move, so it's evaluated here.
+  auto most_urgent = deadline_backlog_.end();
+  int64_t most_urgent_deadline = Packet::kUnknownPts;
+  bool most_urgent_has_positive_demand = false;
+
+  for (auto iter = deadline_backlog_.begin(); iter != deadline_backlog_.end();
+       ++iter) {
+    int64_t deadline = EarliestDeadline(*iter);
+    if (deadline != Packet::kUnknownPts) {
+      if (most_urgent_deadline == Packet::kUnknownPts ||
+          deadline < most_urgent_deadline) {
+        most_urgent = iter;
+        most_urgent_deadline = deadline;
+      }
+      continue;
+    }
+
+    if (most_urgent_deadline != Packet::kUnknownPts ||
+        most_urgent_has_positive_demand) {
+      continue;
+    }
+
+    if (HasPositiveDemand(*iter)) {
+      most_urgent = iter;
+      most_urgent_has_positive_demand = true;
+    } else if (most_urgent == deadline_backlog_.end()) {
+      most_urgent = iter;
+    }
+  }
+
+  Stage* stage = *most_urgent;
+  deadline_backlog_.erase(most_urgent);
+  DCHECK(stage->in_supply_backlog_);
+  stage->in_supply_backlog_ = false;
+  return stage;
+}
+
+// static
+int64_t Engine::EarliestDeadline(Stage* stage) {
+  DCHECK(stage);
+
+  int64_t result = Packet::kUnknownPts;
+  if (stage->deadline_functions_.empty()) {
+    return result;
+  }
+
+  size_t input_count = stage->input_count();
+  for (size_t i = 0; i < input_count; ++i) {
+    int64_t pts = stage->input(i).next_packet_pts();
+    if (pts == Packet::kUnknownPts) {
+      continue;
+    }
+
+    for (const auto& function : stage->deadline_functions_) {
+      int64_t deadline = (*function)(pts);
+      if (result == Packet::kUnknownPts || deadline < result) {
+        result = deadline;
+      }
+    }
+  }
+
+  return result;
+}
+
+void Engine::SetDeadlineFunctions(
+    Stage* stage,
+    std::vector<std::shared_ptr<const Stage::DeadlineFunction>> functions) {
+  lock_.AssertAcquired();
+  DCHECK(stage);
+
+  stage->deadline_functions_ = std::move(functions);
+  stage->has_deadlines_ = !stage->deadline_functions_.empty();
+}
+
+// static
+void Engine::AddDeadlineFunctions(
+    Stage* stage,
+    std::vector<std::shared_ptr<const Stage::DeadlineFunction>>* functions) {
+  DCHECK(stage);
+  DCHECK(functions);
+
+  for (const auto& function : stage->deadline_functions_) {
+    if (std::find(functions->begin(), functions->end(), function) ==
+        functions->end()) {
+      functions->push_back(function);
+    }
+  }
+}
+
+// static
+bool Engine::HasPositiveDemand(Stage* stage) {
+  DCHECK(stage);
+
+  size_t output_count = stage->output_count();
+  for (size_t i = 0; i < output_count; ++i) {
+    Output& output = stage->output(i);
+    if (output.connected() && output.demand() == Demand::kPositive) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void Engine::UpdateStage(Stage* stage) {
+  DCHECK(stage);
+
+  ++stage->update_count_;
+
+  CatchUpGenerations(stage);
+
+  uint64_t resume_count = budget_ == nullptr ? 0 : budget_->resume_count();
+
+  if (!profiling_enabled()) {
+    stage->Update(this);
+  } else {
+    TRACE_EVENT1("media", "Stage::Update", "stage",
+                 static_cast<void*>(stage));
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    stage->Update(this);
+    base::TimeDelta update_time = base::TimeTicks::Now() - start;
+
+    stage->total_update_time_ += update_time;
+    stage->max_update_time_ = std::max(stage->max_update_time_, update_time);
+  }
+
+  if (budget_ != nullptr && stage->input_count() == 0 &&
+      stage->output_count() != 0) {
+    CheckBudget(stage, resume_count);
+  }
+}
+
+void Engine::CheckBudget(Stage* stage, uint64_t resume_count) {
+  DCHECK(budget_);
+
+  if (!budget_->throttled()) {
+    if (budget_->resume_count() != resume_count) {
+      // The budget resumed during the update, after the stage may have seen
+      // throttled demand.
+      PushToSupplyBacklog(stage);
+    }
+    return;
+  }
+
+  {
+    base::AutoLock lock(throttle_lock_);
+    if (!stage->throttled_) {
+      stage->throttled_ = true;
+      throttled_stages_.push_back(stage);
+    }
+  }
+
+  if (!budget_->throttled()) {
+    // The budget resumed before the stage was noted.
+    ResumeThrottledStages();
+  }
+}
+
+void Engine::ResumeThrottledStages() {
+  if (!multithreaded()) {
+    // Every time resume_pending_ is set, an update is posted, so the stages
+    // are picked up even if an update in progress has already looked at
+    // resume_pending_ for the last time.
+    if (!resume_pending_.exchange(true)) {
+      resume_sequence_->Post([this]() {
+        base::AutoLock lock(lock_);
+        Update();
+      });
+    }
+    return;
+  }
+
+  // Schedule with the lock held, so the stages can't be deleted meanwhile.
+  base::AutoLock lock(throttle_lock_);
+  for (Stage* stage : throttled_stages_) {
+    stage->throttled_ = false;
+    ScheduleUpdate(stage);
+  }
+
+  throttled_stages_.clear();
+}
+
+void Engine::PushThrottledStagesToBacklog() {
+  lock_.AssertAcquired();
+
+  std::vector<Stage*> stages;
+  {
+    base::AutoLock lock(throttle_lock_);
+    stages.swap(throttled_stages_);
+    for (Stage* stage : stages) {
+      stage->throttled_ = false;
+    }
+  }
+
+  for (Stage* stage : stages) {
+    PushToSupplyBacklog(stage);
+  }
+}
+
+void Engine::CatchUpGenerations(Stage* stage) {
+  DCHECK(stage);
+
+  size_t input_count = stage->input_count();
+  for (size_t input_index = 0; input_index < input_count; ++input_index) {
+    Input& input = stage->input(input_index);
+    if (!input.generation_advanced()) {
+      continue;
+    }
+
+    input.CatchUpGeneration();
+    stage->FlushInput(input_index, [this, stage](size_t output_index) {
+      stage->FlushOutput(output_index);
+      Output& output = stage->output(output_index);
+      output.AdvanceGeneration();
+      if (output.connected()) {
+        // The downstream stage catches up when it's updated.
+        PushToSupplyBacklog(output.mate().stage_);
+      }
+    });
+  }
+}
+
 Stage* Engine::PopFromSupplyBacklog() {
   lock_.AssertAcquired();
 
@@ -179,5 +825,181 @@ Stage* Engine::PopFromDemandBacklog() {
   return stage;
 }
 
+void Engine::ScheduleUpdate(Stage* stage) {
+  DCHECK(multithreaded());
+  DCHECK(stage);
+
+  uint32_t state = stage->update_state_;
+  while (true) {
+    switch (state) {
+      case Stage::kIdle:
+        if (stage->update_state_.compare_exchange_weak(state,
+                                                       Stage::kQueued)) {
+          // Let updates of stages with deadlines go first.
+          PostUpdate(stage,
+                     scheduling_policy_ == SchedulingPolicy::kDeadline &&
+                         !stage->has_deadlines_);
+          return;
+        }
+        break;
+      case Stage::kRunning:
+        if (stage->update_state_.compare_exchange_weak(
+                state, Stage::kRunningAndDirty)) {
+          return;
+        }
+        break;
+      default:
+        // Already queued or due to run again.
+        return;
+    }
+  }
+}
+
+void Engine::RunScheduledUpdate(Stage* stage) {
+  DCHECK(multithreaded());
+  DCHECK(stage);
+
+  BeginUpdate();
+
+  uint32_t state = Stage::kQueued;
+  if (!stage->update_state_.compare_exchange_strong(state, Stage::kRunning)) {
+    // The stage was removed from the graph while this update was queued.
+    DCHECK_EQ(state, Stage::kRemoved);
+    EndUpdate();
+    delete stage;
+    return;
+  }
+
+  std::vector<Stage*> neighborhood;
+  if (!TryLockNeighborhood(stage, &neighborhood)) {
+    // The stage or one of its neighbors is busy. Try again after other work.
+    stage->update_state_ = Stage::kQueued;
+    EndUpdate();
+    std::this_thread::yield();
+    PostUpdate(stage, true);
+    return;
+  }
+
+  UpdateStage(stage);
+
+  for (Stage* locked_stage : neighborhood) {
+    locked_stage->update_lock_.Release();
+  }
+
+  state = Stage::kRunning;
+  if (!stage->update_state_.compare_exchange_strong(state, Stage::kIdle)) {
+    // Another update was requested while this one was running.
+    DCHECK_EQ(state, Stage::kRunningAndDirty);
+    stage->update_state_ = Stage::kQueued;
+    EndUpdate();
+    PostUpdate(stage, false);
+    return;
+  }
+
+  EndUpdate();
+}
+
+void Engine::PostUpdate(Stage* stage, bool deferred) {
+  DCHECK(multithreaded());
+  DCHECK(stage);
+
+  Scheduler::Task task = [this, stage]() { RunScheduledUpdate(stage); };
+
+  if (queue_) {
+    if (deferred) {
+      queue_->PostDeferred(task);
+    } else {
+      queue_->Post(task);
+    }
+  } else if (deferred) {
+    pool_->PostDeferred(task);
+  } else {
+    pool_->Post(task);
+  }
+}
+
+bool Engine::TryLockNeighborhood(Stage* stage, std::vector<Stage*>* locked) {
+  DCHECK(stage);
+  DCHECK(locked);
+  DCHECK(locked->empty());
+
+  std::vector<Stage*>& stages = *locked;
+  stages.push_back(stage);
+
+  size_t input_count = stage->input_count();
+  for (size_t i = 0; i < input_count; ++i) {
+    Input& input = stage->input(i);
+    if (input.connected()) {
+      stages.push_back(input.mate().stage_);
+    }
+  }
+
+  size_t output_count = stage->output_count();
+  for (size_t i = 0; i < output_count; ++i) {
+    Output& output = stage->output(i);
+    if (output.connected()) {
+      stages.push_back(output.mate().stage_);
+    }
+  }
+
+  // A stage may be connected to another more than once.
+  std::sort(stages.begin(), stages.end());
+  stages.erase(std::unique(stages.begin(), stages.end()), stages.end());
+
+  for (size_t i = 0; i < stages.size(); ++i) {
+    if (!stages[i]->update_lock_.Try()) {
+      while (i != 0) {
+        stages[--i]->update_lock_.Release();
+      }
+      stages.clear();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void Engine::BeginUpdate() {
+  base::AutoLock lock(gate_lock_);
+  while (exclusive_) {
+    gate_condition_variable_.Wait();
+  }
+  ++updates_in_progress_;
+}
+
+void Engine::EndUpdate() {
+  base::AutoLock lock(gate_lock_);
+  DCHECK(updates_in_progress_ != 0);
+  if (--updates_in_progress_ == 0) {
+    gate_condition_variable_.Broadcast();
+  }
+}
+
+void Engine::BeginExclusive() {
+  if (!multithreaded()) {
+    return;
+  }
+
+  base::AutoLock lock(gate_lock_);
+  while (exclusive_) {
+    gate_condition_variable_.Wait();
+  }
+  exclusive_ = true;
+  while (updates_in_progress_ != 0) {
+    gate_condition_variable_.Wait();
+  }
+}
+
+void Engine::EndExclusive() {
+  if (!multithreaded()) {
+    return;
+  }
+
+  base::AutoLock lock(gate_lock_);
+  DCHECK(exclusive_);
+  exclusive_ = false;
+  gate_condition_variable_.Broadcast();
+}
+
 }  // namespace media
 }  // namespace mojo
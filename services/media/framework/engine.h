@@ -5,14 +5,21 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_ENGINE_H_
 #define SERVICES_MEDIA_FRAMEWORK_ENGINE_H_
 
+#include <atomic>
+#include <deque>
 #include <list>
+#include <memory>
 #include <queue>
 #include <stack>
 #include <unordered_map>
+#include <vector>
 
+#include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
 #include "services/media/framework/refs.h"
+#include "services/media/framework/scheduler.h"
 #include "services/media/framework/stages/stage.h"
+#include "services/media/framework/util/work_stealing_pool.h"
 
 namespace mojo {
 namespace media {
@@ -46,7 +53,7 @@ namespace media {
 // the operation of the graph is driven by external events signalled through
 // update callbacks.
 //
-// Currently, Engine uses an opportunistic threading model that only allows
+// By default, Engine uses an opportunistic threading model that only allows
 // one thread to drive the backlog processing at any given time. The engine
 // runs the processing on whatever thread enters it via an update callback.
 // An engine employs a single lock that protects manipulation of the graph and
@@ -75,12 +82,154 @@ namespace media {
 // NOTE: Allocators, not otherwise discussed here, are required to be thread-
 // safe so that packets may be cleaned up on any thread.
 //
+// MULTITHREADED MODE
+//
+// EnableMultithreading switches the engine to a model in which stage updates
+// run on a WorkStealingPool. There is no global lock and no ordered backlog.
+// Instead, pushing a stage to either backlog schedules an update task for the
+// stage, and the update callback does the same and returns immediately.
+// Independent parts of the graph (the audio and video branches downstream of
+// a demux, for example) are updated concurrently.
+//
+// A Stage::Update call manipulates the state of the stage's inputs and
+// outputs and of the outputs and inputs to which they're connected, so an
+// update of a stage excludes updates of the stage itself and of all adjacent
+// stages. Each stage has a lock that's taken while that stage or any of its
+// neighbors is updated. Workers only try these locks. If one is busy, the
+// update is requeued behind the worker's other tasks. Each stage also records
+// whether it's queued or running, so a stage is never queued more than once,
+// and an update requested while the stage is running causes it to run again
+// afterwards.
+//
+// Preparing and unpreparing still take the engine lock and, in addition, wait
+// for updates in progress to complete and hold off new ones.
+// The constraints above still apply except for 1): in multithreaded mode,
+// update callbacks may be called during Update, though parts must still not
+// hold their own locks when doing so.
+//
+// UseScheduler also selects multithreaded mode, but runs updates on a shared
+// Scheduler rather than a pool of the engine's own. The scheduler runs one
+// update of a given engine at a time and divides its workers fairly among the
+// engines that use it, so many graphs can share a fixed number of threads.
+//
 // In the future, the threading model will be enhanced. Intended features
-// include:
-// 1) Support for multiple threads.
-// 2) Marshalling update callbacks to a different thread.
+// include marshalling update callbacks to a different thread.
+//
+
+//
+// SCHEDULING POLICY
+//
+// With the default policy, SchedulingPolicy::kBacklog, stages that were
+// supplied packets are updated first, in the order they were supplied, and
+// then stages whose demand changed, most recent first. This ignores timing
+// constraints, so a CPU-hungry branch (video decode, say) can delay a branch
+// that's about to miss a deadline (audio).
+//
+// With SchedulingPolicy::kDeadline, pending updates are ordered by urgency:
+//
+// 1) Stages with packets waiting in their inputs that are headed for a sink
+//    with presentation deadlines (see SetPresentationDeadline), earliest
+//    deadline first.
+// 2) Stages with positive demand on an output, meaning downstream needs a
+//    packet to meet timing constraints.
+// 3) Everything else.
+//
+// Ties are broken in the order updates were requested. In multithreaded mode,
+// stage state can't be inspected when an update is scheduled, so updates of
+// stages upstream of a sink with deadlines are simply run ahead of other work
+// queued on the same worker.
+//
+
+//
+// FLUSHING
+//
+// Every output has a flush generation, and every packet is stamped with the
+// generation of the output that supplied it. FlushOutput flushes the output's
+// stage, advances the output's generation and returns. The subgraph downstream
+// isn't visited. Instead, before a stage is updated, the engine compares the
+// generation of each of its inputs with that of the connected output. An input
+// whose output has moved on adopts the new generation, and the stage's
+// FlushInput is called, which discards the input's packets from earlier
+// generations. Outputs that the stage flushes as a consequence advance their
+// generations in turn, and the stages downstream of them are scheduled for
+// update. The flush therefore works its way downstream with the other work in
+// the graph. It holds no global lock and doesn't wait for the graph to go
+// idle, and packets from the new generation can follow the flush downstream
+// before the old packets have been discarded everywhere.
+//
+// Engine::FlushOutput doesn't wait for the stages downstream to catch up,
+// so a sink may be flushed after the caller has restarted it. A sink is always
+// flushed before it's supplied packets from the new generation, and flushing
+// a sink doesn't change its demand. Sinks that have to stop pulling at a flush
+// signal negative demand themselves.
+//
+// A stage's FlushInput and FlushOutput are called during that stage's
+// update or from Engine::FlushOutput on the calling thread, with the engine
+// lock held in single-threaded mode and the stage's update lock held in
+// multithreaded mode.
 //
 
+//
+// RECONFIGURATION
+//
+// InsertStage, ExtractStage and ReplaceStage change a path through a prepared
+// graph while it's running. Each takes the engine lock and, in multithreaded
+// mode, waits for updates in progress and holds off new ones, so the change
+// lands between packets. Packets waiting at the point where the path changes
+// take the new path, so an inserted stage sees the packets that were waiting
+// for the stage downstream of it, and the stage downstream of an extracted
+// stage gets the packets that were waiting for the extracted stage. Packets
+// held inside an extracted or replaced stage are discarded with it. Nothing
+// else is flushed.
+//
+// Packets a replaced stage has already supplied stay downstream, ahead of the
+// replacement's, so the stages downstream get the old stage's output until
+// they've consumed them. If the two stages' outputs differ in format, the
+// caller can ask ReplaceStage to flush the subgraph downstream of the
+// replacement instead. That marks the boundary as FlushOutput would: the old
+// packets are discarded, and the stages downstream, sinks included, are
+// flushed as they catch up.
+//
+// A new stage is prepared with the allocator the downstream input requires.
+// If that changes what the stage's input or the downstream input requires of
+// the output upstream, the output is prepared again with the new allocator,
+// and so on upstream until a stage's requirement stays the same. A fan-out
+// absorbs the change by copying rather than disturbing its other branches.
+//
+
+//
+// MEMORY BUDGET
+//
+// SetMemoryBudget makes the outputs of sources report negative demand while
+// the budget is throttled (see BudgetAllocator). Other stages aren't held back,
+// because they drain the graph by consuming packets. A source that's updated
+// while the budget is throttled is noted, and when the budget resumes, the
+// noted sources are updated again, so production picks up where it left off.
+// The resume callback comes on whatever thread releases a payload, which may
+// hold locks of its own, so the updates never run on that thread. In
+// multithreaded mode, they're simply scheduled. In single-threaded mode, an
+// update of the whole graph is posted to a sequence on the default scheduler
+// (see Scheduler::GetDefault). The sources join the backlog there or in an
+// update already in progress, whichever gets to them first.
+//
+
+//
+// PROFILING
+//
+// The engine counts updates of each stage, and inputs and outputs count the
+// packets that pass through them. When profiling is enabled, the engine also
+// times each update, inputs time how long each packet waits before the stage
+// consumes it, and both are reported as trace events in the "media" category.
+// Timing is off by default, because it takes two clock reads per update and
+// per packet.
+//
+
+// Policies for ordering stage updates. See SCHEDULING POLICY above.
+enum class SchedulingPolicy {
+  kBacklog,
+  kDeadline
+};
+
 // Manages operation of a Graph.
 class Engine {
  public:
@@ -88,6 +237,53 @@ class Engine {
 
   ~Engine();
 
+  // Switches the engine to multithreaded mode, in which stages are updated on
+  // a pool of worker_count threads. If worker_count is zero, one worker per
+  // hardware thread is used. This method must be called before any stages are
+  // prepared.
+  void EnableMultithreading(size_t worker_count);
+
+  // Switches the engine to multithreaded mode, in which stages are updated by
+  // the shared scheduler. weight determines the engine's share of the
+  // scheduler's workers relative to other engines using the same scheduler.
+  // This method must be called before any stages are prepared.
+  void UseScheduler(std::shared_ptr<Scheduler> scheduler, uint32_t weight);
+
+  // Determines whether the engine is in multithreaded mode.
+  bool multithreaded() const { return pool_ || queue_; }
+
+  // Sets the policy used to order stage updates. This method must be called
+  // before any stages are prepared.
+  void SetSchedulingPolicy(SchedulingPolicy policy);
+
+  // Marks a sink with its presentation deadlines. deadline maps the PTS of a
+  // packet to the time by which the sink must present it. The deadlines of all
+  // sinks in a graph must be expressed against the same clock. Used by
+  // SchedulingPolicy::kDeadline. This method must be called before the sink is
+  // prepared.
+  void SetPresentationDeadline(Stage* sink,
+                               const Stage::DeadlineFunction& deadline);
+
+  // Sets the memory budget whose throttling holds back the graph. This method
+  // must be called before any stages are prepared.
+  void SetMemoryBudget(BudgetAllocator* budget);
+
+  // Enables or disables timing of updates and of packets waiting in inputs.
+  void EnableProfiling(bool enabled) { profiling_enabled_ = enabled; }
+
+  // Determines whether profiling is enabled.
+  bool profiling_enabled() const {
+    return profiling_enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Calls the function with no updates in progress and no new ones starting,
+  // so stage state may be inspected safely.
+  void RunExclusive(const std::function<void()>& function);
+
+  // Deletes a stage that has been removed from the graph. In multithreaded
+  // mode, deletion is deferred if an update of the stage is queued.
+  void DeleteStage(Stage* stage);
+
   // Prepares the input and the subgraph upstream of it.
   void PrepareInput(const InputRef& input_ref);
 
@@ -97,6 +293,22 @@ class Engine {
   // Flushes the output and the subgraph downstream of it.
   void FlushOutput(const OutputRef& output_ref);
 
+  // Inserts stage, which has one input and one output, neither connected,
+  // between output and the input connected to it.
+  void InsertStage(const OutputRef& output, Stage* stage);
+
+  // Disconnects stage, which has one input and one output, both connected,
+  // connects the output upstream of it to the input downstream of it and
+  // deletes stage as DeleteStage does.
+  void ExtractStage(Stage* stage);
+
+  // Disconnects stage, which has one input and one output, both connected,
+  // connects replacement, which has one input and one output, neither
+  // connected, in its place and deletes stage as DeleteStage does. If
+  // flush_downstream is true, the subgraph downstream of replacement is
+  // flushed before replacement supplies any packets.
+  void ReplaceStage(Stage* stage, Stage* replacement, bool flush_downstream);
+
   // Queues the stage for update and winds down the backlog.
   void RequestUpdate(Stage* stage);
 
@@ -111,22 +323,95 @@ class Engine {
       std::function<void(const InputRef& input,
                          const OutputRef& output,
                          const Stage::UpstreamCallback& callback)>;
-  using DownstreamVisitor =
-      std::function<void(const OutputRef& output,
-                         const InputRef& input,
-                         const Stage::DownstreamCallback& callback)>;
 
   void VisitUpstream(const InputRef& input, const UpstreamVisitor& vistor);
 
-  void VisitDownstream(const OutputRef& output,
-                       const DownstreamVisitor& vistor);
-
   // Processes the entire backlog.
   void Update();
 
+  // Notes that the stage was updated while the budget was throttled or, if the
+  // budget resumed during the update, updates the stage again. resume_count is
+  // the budget's resume count from before the update.
+  void CheckBudget(Stage* stage, uint64_t resume_count);
+
+  // Updates the stages noted by CheckBudget. Called when the budget resumes.
+  void ResumeThrottledStages();
+
+  // Moves the stages noted by CheckBudget to the supply backlog. Used in
+  // single-threaded mode only.
+  void PushThrottledStagesToBacklog();
+
+  // Ensures no update of the removed stage runs. Returns true if the caller
+  // should delete the stage or false if a queued update will delete it. In
+  // multithreaded mode, called with updates held off.
+  bool RetireStage(Stage* stage);
+
+  // Connects stage, which has one input and one output, neither connected,
+  // between output and input, neither connected. If prepared is true, input
+  // was prepared, and stage is prepared to match. previous_requirement is the
+  // allocator output was prepared with. Packets waiting in packets_from are
+  // moved to the stage's input. Called with the engine lock held and, in
+  // multithreaded mode, with updates held off.
+  void SpliceStage(const OutputRef& output,
+                   Stage* stage,
+                   const InputRef& input,
+                   bool prepared,
+                   PayloadAllocator* previous_requirement,
+                   Input* packets_from);
+
+  // Disconnects output and input, which may be prepared. Returns true if input
+  // was prepared.
+  static bool DisconnectPrepared(const OutputRef& output,
+                                 const InputRef& input);
+
+  // Connects output to input and marks input as prepared or not.
+  static void ConnectPrepared(const OutputRef& output,
+                              const InputRef& input,
+                              bool prepared);
+
+  // Prepares output again with allocator and, if that changes what the
+  // output's stage requires of its own inputs, prepares the outputs upstream
+  // of those inputs again, and so on.
+  void RenegotiateOutput(const OutputRef& output, PayloadAllocator* allocator);
+
+  // Updates the stages after a reconfiguration. Called with the engine lock
+  // held.
+  void UpdateAfterReconfiguration(const std::vector<Stage*>& stages);
+
   // Performs processing for a single stage, updating the backlog accordingly.
   void Update(Stage* stage);
 
+  // Pops the most urgent stage from the deadline backlog and returns it or
+  // returns nullptr if the deadline backlog is empty.
+  Stage* PopFromDeadlineBacklog();
+
+  // Returns the earliest presentation deadline of the packets waiting in the
+  // stage's inputs or Packet::kUnknownPts if there's no such deadline.
+  static int64_t EarliestDeadline(Stage* stage);
+
+  // Replaces the stage's presentation deadlines.
+  void SetDeadlineFunctions(
+      Stage* stage,
+      std::vector<std::shared_ptr<const Stage::DeadlineFunction>> functions);
+
+  // Adds the stage's presentation deadlines to functions, skipping those
+  // already there.
+  static void AddDeadlineFunctions(
+      Stage* stage,
+      std::vector<std::shared_ptr<const Stage::DeadlineFunction>>* functions);
+
+  // Determines whether any of the stage's outputs has positive demand.
+  static bool HasPositiveDemand(Stage* stage);
+
+  // Calls stage->Update, counting and, if profiling is enabled, timing the
+  // update.
+  void UpdateStage(Stage* stage);
+
+  // Flushes the inputs of the stage whose connected outputs have advanced
+  // their generations and advances the generations of the outputs the stage
+  // flushes as a consequence.
+  void CatchUpGenerations(Stage* stage);
+
   // Pops a stage from the supply backlog and returns it or returns nullptr if
   // the supply backlog is empty.
   Stage* PopFromSupplyBacklog();
@@ -135,6 +420,36 @@ class Engine {
   // the demand backlog is empty.
   Stage* PopFromDemandBacklog();
 
+  // Queues an update of the stage if one isn't already queued. Used in
+  // multithreaded mode only.
+  void ScheduleUpdate(Stage* stage);
+
+  // Runs a queued update of the stage. Used in multithreaded mode only.
+  void RunScheduledUpdate(Stage* stage);
+
+  // Posts an update of the stage to the pool or scheduler. If deferred is true,
+  // the update runs after other queued work. Used in multithreaded mode only.
+  void PostUpdate(Stage* stage, bool deferred);
+
+  // Tries to take the update locks of the stage and all adjacent stages. If
+  // that succeeds, returns true and delivers the locked stages via locked.
+  // Otherwise, returns false with no locks taken.
+  bool TryLockNeighborhood(Stage* stage, std::vector<Stage*>* locked);
+
+  // Waits until no exclusive operation is in progress and registers an
+  // update in progress. Used in multithreaded mode only.
+  void BeginUpdate();
+
+  // Ends an update started with BeginUpdate.
+  void EndUpdate();
+
+  // Waits until no updates are in progress and holds off new updates until
+  // EndExclusive is called. Does nothing in single-threaded mode.
+  void BeginExclusive();
+
+  // Ends an exclusive operation started with BeginExclusive.
+  void EndExclusive();
+
   mutable base::Lock lock_;
   // supply_backlog_ contains pointers to all the stages that have been supplied
   // (packets or frames) but have not been updated since. demand_backlog_ does
@@ -144,7 +459,39 @@ class Engine {
   // TODO(dalesat): Determine the best ordering and implement it.
   std::queue<Stage*> supply_backlog_;
   std::stack<Stage*> demand_backlog_;
+  // Used instead of the supply and demand backlogs when the scheduling policy
+  // is SchedulingPolicy::kDeadline, in the order updates were requested.
+  std::deque<Stage*> deadline_backlog_;
   bool packets_produced_;
+
+  SchedulingPolicy scheduling_policy_;
+
+  BudgetAllocator* budget_;
+  // throttle_lock_ protects throttled_stages_ and the stages' throttled_
+  // fields.
+  base::Lock throttle_lock_;
+  std::vector<Stage*> throttled_stages_;
+  // Indicates that the budget has resumed, and the throttled stages haven't
+  // been moved to the backlog yet. Used in single-threaded mode only.
+  std::atomic_bool resume_pending_;
+  // Runs the updates posted when the budget resumes. Used in single-threaded
+  // mode only.
+  std::unique_ptr<Scheduler::Sequence> resume_sequence_;
+
+  std::atomic_bool profiling_enabled_;
+
+  // Multithreaded mode only. gate_lock_ protects updates_in_progress_ and
+  // exclusive_.
+  base::Lock gate_lock_;
+  base::ConditionVariable gate_condition_variable_;
+  size_t updates_in_progress_ = 0;
+  bool exclusive_ = false;
+
+  // Declared last so they're destroyed first. Their destructors run the
+  // remaining queued updates, which use the fields above. At most one of these
+  // is set.
+  std::unique_ptr<WorkStealingPool> pool_;
+  std::unique_ptr<Scheduler::Queue> queue_;
 };
 
 }  // namespace media
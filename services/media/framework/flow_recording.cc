@@ -0,0 +1,346 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "services/media/framework/flow_recording.h"
+
+namespace mojo {
+namespace media {
+
+namespace {
+
+const uint8_t kSignature[] = {'M', 'F', 'L', 'W'};
+const uint64_t kVersion = 1;
+
+// Record types, stored in the low bits of the first varint of each record.
+const uint64_t kTrackRecord = 0;
+const uint64_t kPacketRecord = 1;
+const uint64_t kDemandRecord = 2;
+const uint64_t kRecordTypeBits = 2;
+const uint64_t kRecordTypeMask = (1 << kRecordTypeBits) - 1;
+
+// Packet flags.
+const uint64_t kEndOfStreamFlag = 1;
+const uint64_t kUnknownPtsFlag = 2;
+
+void AppendVarint(uint64_t value, std::vector<uint8_t>* data) {
+  while (value >= 0x80) {
+    data->push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+
+  data->push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+uint64_t EncodeDemand(Demand demand) {
+  switch (demand) {
+    case Demand::kNegative:
+      return 0;
+    case Demand::kNeutral:
+      return 1;
+    case Demand::kPositive:
+      return 2;
+  }
+
+  NOTREACHED();
+  return 0;
+}
+
+// Reads a recording.
+class RecordReader {
+ public:
+  RecordReader(const uint8_t* data, size_t size)
+      : next_(data), end_(data + size) {}
+
+  bool at_end() const { return next_ == end_; }
+
+  bool ReadVarint(uint64_t* value_out) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (next_ == end_) {
+        return false;
+      }
+
+      uint8_t byte = *next_++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        *value_out = value;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool ReadBytes(size_t size, const uint8_t** bytes_out) {
+    if (static_cast<size_t>(end_ - next_) < size) {
+      return false;
+    }
+
+    *bytes_out = next_;
+    next_ += size;
+    return true;
+  }
+
+ private:
+  const uint8_t* next_;
+  const uint8_t* end_;
+};
+
+}  // namespace
+
+constexpr size_t FlowRecorder::kDefaultMaxSize;
+
+FlowRecorder::FlowRecorder(size_t max_size)
+    : max_size_(max_size),
+      truncated_(false),
+      time_recorded_(base::TimeTicks::Now()) {
+  data_.insert(data_.end(), std::begin(kSignature), std::end(kSignature));
+  AppendVarint(kVersion, &data_);
+}
+
+FlowRecorder::~FlowRecorder() {}
+
+size_t FlowRecorder::AddTrack(const std::string& label) {
+  base::AutoLock lock(lock_);
+  size_t track = last_pts_.size();
+  last_pts_.push_back(0);
+  if (!HasRoom()) {
+    return track;
+  }
+
+  AppendVarint((track << kRecordTypeBits) | kTrackRecord, &data_);
+  AppendVarint(label.size(), &data_);
+  data_.insert(data_.end(), label.begin(), label.end());
+  return track;
+}
+
+void FlowRecorder::RecordPacket(size_t track, const Packet& packet) {
+  base::AutoLock lock(lock_);
+  DCHECK(track < last_pts_.size());
+  if (!HasRoom()) {
+    return;
+  }
+
+  AppendRecordHeader(track, kPacketRecord);
+
+  uint64_t flags = packet.end_of_stream() ? kEndOfStreamFlag : 0;
+  if (packet.pts() == Packet::kUnknownPts) {
+    AppendVarint(flags | kUnknownPtsFlag, &data_);
+  } else {
+    AppendVarint(flags, &data_);
+    AppendVarint(ZigZagEncode(packet.pts() - last_pts_[track]), &data_);
+    last_pts_[track] = packet.pts();
+  }
+
+  AppendVarint(packet.size(), &data_);
+}
+
+void FlowRecorder::RecordDemand(size_t track, Demand demand) {
+  base::AutoLock lock(lock_);
+  DCHECK(track < last_pts_.size());
+  if (!HasRoom()) {
+    return;
+  }
+
+  AppendRecordHeader(track, kDemandRecord);
+  AppendVarint(EncodeDemand(demand), &data_);
+}
+
+std::vector<uint8_t> FlowRecorder::GetData() const {
+  base::AutoLock lock(lock_);
+  return data_;
+}
+
+bool FlowRecorder::truncated() const {
+  base::AutoLock lock(lock_);
+  return truncated_;
+}
+
+bool FlowRecorder::WriteToFile(const std::string& path) const {
+  std::vector<uint8_t> data = GetData();
+  int size = static_cast<int>(data.size());
+  if (base::WriteFile(base::FilePath(path),
+                      reinterpret_cast<const char*>(data.data()),
+                      size) != size) {
+    LOG(ERROR) << "failed to write flow recording to " << path;
+    return false;
+  }
+
+  return true;
+}
+
+bool FlowRecorder::HasRoom() {
+  // Records are dropped from the first one that doesn't fit onwards, so the
+  // recording remains a valid prefix of the traffic. PTS and time deltas stay
+  // correct because nothing is recorded after a gap.
+  if (!truncated_ && data_.size() >= max_size_) {
+    LOG(WARNING) << "flow recording reached " << max_size_
+                 << " bytes, dropping further records";
+    truncated_ = true;
+  }
+
+  return !truncated_;
+}
+
+void FlowRecorder::AppendRecordHeader(size_t track, uint64_t type) {
+  AppendVarint((track << kRecordTypeBits) | type, &data_);
+
+  // Whole microseconds are recorded, and the remainder is carried over to the
+  // next record, so rounding errors don't accumulate.
+  int64_t elapsed_us =
+      (base::TimeTicks::Now() - time_recorded_).InMicroseconds();
+  time_recorded_ =
+      time_recorded_ + base::TimeDelta::FromMicroseconds(elapsed_us);
+  AppendVarint(static_cast<uint64_t>(elapsed_us), &data_);
+}
+
+// static
+std::shared_ptr<FlowRecording> FlowRecording::Create(
+    const std::vector<uint8_t>& data) {
+  std::shared_ptr<FlowRecording> recording(new FlowRecording());
+  if (!recording->Parse(data.data(), data.size())) {
+    return nullptr;
+  }
+
+  return recording;
+}
+
+// static
+std::shared_ptr<FlowRecording> FlowRecording::CreateFromFile(
+    const std::string& path) {
+  std::string contents;
+  if (!base::ReadFileToString(base::FilePath(path), &contents)) {
+    LOG(ERROR) << "failed to read flow recording from " << path;
+    return nullptr;
+  }
+
+  std::shared_ptr<FlowRecording> recording(new FlowRecording());
+  if (!recording->Parse(reinterpret_cast<const uint8_t*>(contents.data()),
+                        contents.size())) {
+    LOG(ERROR) << path << " isn't a valid flow recording";
+    return nullptr;
+  }
+
+  return recording;
+}
+
+FlowRecording::FlowRecording() {}
+
+FlowRecording::~FlowRecording() {}
+
+bool FlowRecording::Parse(const uint8_t* data, size_t size) {
+  RecordReader reader(data, size);
+
+  const uint8_t* signature;
+  uint64_t version;
+  if (!reader.ReadBytes(sizeof(kSignature), &signature) ||
+      !std::equal(std::begin(kSignature), std::end(kSignature), signature) ||
+      !reader.ReadVarint(&version) || version != kVersion) {
+    return false;
+  }
+
+  base::TimeDelta time;
+  std::vector<int64_t> last_pts;
+
+  while (!reader.at_end()) {
+    uint64_t header;
+    if (!reader.ReadVarint(&header)) {
+      return false;
+    }
+
+    uint64_t type = header & kRecordTypeMask;
+    uint64_t track = header >> kRecordTypeBits;
+
+    if (type == kTrackRecord) {
+      // Tracks are numbered in the order they're added.
+      uint64_t label_size;
+      const uint8_t* label;
+      if (track != tracks_.size() || !reader.ReadVarint(&label_size) ||
+          !reader.ReadBytes(label_size, &label)) {
+        return false;
+      }
+
+      tracks_.emplace_back();
+      tracks_.back().label.assign(reinterpret_cast<const char*>(label),
+                                  label_size);
+      last_pts.push_back(0);
+      continue;
+    }
+
+    uint64_t elapsed_us;
+    if (track >= tracks_.size() || !reader.ReadVarint(&elapsed_us)) {
+      return false;
+    }
+
+    time += base::TimeDelta::FromMicroseconds(elapsed_us);
+
+    Event event;
+    event.time = time;
+    event.pts = Packet::kUnknownPts;
+    event.size = 0;
+    event.end_of_stream = false;
+    event.demand = Demand::kNegative;
+
+    if (type == kPacketRecord) {
+      uint64_t flags;
+      if (!reader.ReadVarint(&flags)) {
+        return false;
+      }
+
+      if ((flags & kUnknownPtsFlag) == 0) {
+        uint64_t pts_delta;
+        if (!reader.ReadVarint(&pts_delta)) {
+          return false;
+        }
+
+        last_pts[track] += ZigZagDecode(pts_delta);
+        event.pts = last_pts[track];
+      }
+
+      uint64_t packet_size;
+      if (!reader.ReadVarint(&packet_size)) {
+        return false;
+      }
+
+      event.type = EventType::kPacket;
+      event.size = packet_size;
+      event.end_of_stream = (flags & kEndOfStreamFlag) != 0;
+    } else if (type == kDemandRecord) {
+      uint64_t demand;
+      if (!reader.ReadVarint(&demand) || demand > 2) {
+        return false;
+      }
+
+      event.type = EventType::kDemand;
+      event.demand = demand == 0 ? Demand::kNegative
+                                 : demand == 1 ? Demand::kNeutral
+                                               : Demand::kPositive;
+    } else {
+      return false;
+    }
+
+    tracks_[track].events.push_back(event);
+  }
+
+  return true;
+}
+
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,146 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_FLOW_RECORDING_H_
+#define SERVICES_MEDIA_FRAMEWORK_FLOW_RECORDING_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "services/media/framework/models/demand.h"
+#include "services/media/framework/packet.h"
+
+namespace mojo {
+namespace media {
+
+//
+// FLOW RECORDINGS
+//
+// A flow recording captures the traffic on connections in a graph: for each
+// packet, its PTS, payload size and end-of-stream flag, and each change in the
+// demand signalled upstream, all with the time they occurred. Payloads aren't
+// captured. Each recorded connection is a track. Recordings are made with
+// FlowRecorder (see Graph::RecordConnection) and read with FlowRecording, and
+// a track can be replayed into another graph with ReplaySource, so timing
+// problems seen in production can be reproduced and benchmarked offline.
+//
+// The format is compact: a four-byte signature and a version, followed by
+// records. Each record starts with a varint combining the track index and the
+// record type. A track record gives the track's label. Packet and demand
+// records give the time elapsed since the previous record in microseconds,
+// then, for packets, flags, the PTS as a zigzag-encoded difference from the
+// track's previous PTS, and the size, or, for demand, the new demand.
+//
+
+// Records the traffic on connections. Methods may be called on any thread.
+//
+// The recording is kept in memory. Once it reaches its maximum size, further
+// records are dropped, so it holds the traffic from the start of the recording
+// until it filled up.
+class FlowRecorder {
+ public:
+  // Default maximum size of a recording, enough for a couple of million
+  // packets.
+  static constexpr size_t kDefaultMaxSize = 16 * 1024 * 1024;
+
+  static std::shared_ptr<FlowRecorder> Create(
+      size_t max_size = kDefaultMaxSize) {
+    return std::shared_ptr<FlowRecorder>(new FlowRecorder(max_size));
+  }
+
+  ~FlowRecorder();
+
+  // Adds a track described by label, returning its index.
+  size_t AddTrack(const std::string& label);
+
+  // Records a packet supplied on the track.
+  void RecordPacket(size_t track, const Packet& packet);
+
+  // Records a change in the demand signalled on the track.
+  void RecordDemand(size_t track, Demand demand);
+
+  // Returns the recording so far.
+  std::vector<uint8_t> GetData() const;
+
+  // Returns whether records have been dropped because the recording reached
+  // its maximum size.
+  bool truncated() const;
+
+  // Writes the recording so far to the file at path, returning false if the
+  // file couldn't be written.
+  bool WriteToFile(const std::string& path) const;
+
+ private:
+  explicit FlowRecorder(size_t max_size);
+
+  // Determines whether the recording has room for another record, noting the
+  // truncation if it doesn't. Called with lock_ held.
+  bool HasRoom();
+
+  // Appends the header of a packet or demand record. Called with lock_ held.
+  void AppendRecordHeader(size_t track, uint64_t type);
+
+  const size_t max_size_;
+
+  mutable base::Lock lock_;
+  // The following fields are protected by lock_.
+  std::vector<uint8_t> data_;
+  bool truncated_;
+  std::vector<int64_t> last_pts_;
+  // Time up to which elapsed time has been recorded.
+  base::TimeTicks time_recorded_;
+};
+
+// A flow recording read back for analysis or replay.
+class FlowRecording {
+ public:
+  enum class EventType { kPacket, kDemand };
+
+  // A packet or a demand change on a track.
+  struct Event {
+    EventType type;
+    // Time since the recording started.
+    base::TimeDelta time;
+    // For kPacket events.
+    int64_t pts;
+    size_t size;
+    bool end_of_stream;
+    // For kDemand events.
+    Demand demand;
+  };
+
+  // The events recorded for a connection, in the order they occurred.
+  struct Track {
+    std::string label;
+    std::vector<Event> events;
+  };
+
+  // Parses a recording, returning nullptr if data isn't a valid recording.
+  static std::shared_ptr<FlowRecording> Create(
+      const std::vector<uint8_t>& data);
+
+  // Reads and parses the recording in the file at path, returning nullptr if
+  // the file couldn't be read or isn't a valid recording.
+  static std::shared_ptr<FlowRecording> CreateFromFile(const std::string& path);
+
+  ~FlowRecording();
+
+  const std::vector<Track>& tracks() const { return tracks_; }
+
+ private:
+  FlowRecording();
+
+  // Parses data into tracks_, returning false if it isn't a valid recording.
+  bool Parse(const uint8_t* data, size_t size);
+
+  std::vector<Track> tracks_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_FLOW_RECORDING_H_
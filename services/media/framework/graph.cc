@@ -2,11 +2,23 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+
 #include "services/media/framework/graph.h"
 
 namespace mojo {
 namespace media {
 
+PartProfile::PartProfile()
+    : update_count(0),
+      packets_in(0),
+      packets_out(0),
+      payload_bytes(0),
+      peak_payload_bytes(0) {}
+
+ConnectionProfile::ConnectionProfile()
+    : packet_count(0), timed_packet_count(0) {}
+
 Graph::Graph() {
   update_function_ = [this](Stage* stage) { engine_.RequestUpdate(stage); };
 }
@@ -39,13 +51,17 @@ void Graph::RemovePart(PartRef part) {
   sources_.remove(stage);
   sinks_.remove(stage);
   stages_.remove(stage);
+  accounts_.erase(stage);
 
-  delete stage;
+  engine_.DeleteStage(stage);
 }
 
-PartRef Graph::Connect(const OutputRef& output, const InputRef& input) {
+PartRef Graph::Connect(const OutputRef& output,
+                       const InputRef& input,
+                       size_t queue_depth) {
   DCHECK(output.valid());
   DCHECK(input.valid());
+  DCHECK(queue_depth != 0);
 
   if (output.connected()) {
     DisconnectOutput(output);
@@ -56,6 +72,7 @@ PartRef Graph::Connect(const OutputRef& output, const InputRef& input) {
 
   output.actual().Connect(input);
   input.actual().Connect(output);
+  input.actual().set_queue_depth(queue_depth);
 
   return input.part();
 }
@@ -164,13 +181,335 @@ void Graph::RemovePartsConnectedToInput(const InputRef& input) {
   RemovePartsConnectedToPart(upstream_part);
 }
 
+PartRef Graph::InsertPart(const OutputRef& output, PartRef part) {
+  DCHECK(output.valid());
+  DCHECK(part.valid());
+  engine_.InsertStage(output, part.stage_);
+  return part;
+}
+
+void Graph::ExtractPart(PartRef part) {
+  DCHECK(part.valid());
+
+  Stage* stage = part.stage_;
+  stage->SetUpdateCallback(nullptr);
+  stages_.remove(stage);
+  accounts_.erase(stage);
+
+  // The engine deletes the stage.
+  engine_.ExtractStage(stage);
+}
+
+PartRef Graph::ReplacePart(PartRef part,
+                           PartRef replacement,
+                           bool flush_downstream) {
+  DCHECK(part.valid());
+  DCHECK(replacement.valid());
+
+  Stage* stage = part.stage_;
+  stage->SetUpdateCallback(nullptr);
+  stages_.remove(stage);
+  accounts_.erase(stage);
+
+  // The engine deletes the stage.
+  engine_.ReplaceStage(stage, replacement.stage_, flush_downstream);
+  return replacement;
+}
+
 void Graph::Reset() {
   sources_.clear();
   sinks_.clear();
+  accounts_.clear();
   while (!stages_.empty()) {
     Stage* stage = stages_.front();
     stages_.pop_front();
-    delete stage;
+    engine_.DeleteStage(stage);
+  }
+}
+
+void Graph::FuseTransforms() {
+  // Find the last transform in each chain.
+  std::vector<TransformStage*> chain_ends;
+  for (Stage* stage : stages_) {
+    TransformStage* transform_stage = stage->AsTransformStage();
+    if (transform_stage == nullptr) {
+      continue;
+    }
+
+    const Output& output = transform_stage->output(0);
+    if (output.connected() &&
+        output.mate().stage_->AsTransformStage() != nullptr) {
+      continue;
+    }
+
+    chain_ends.push_back(transform_stage);
+  }
+
+  // Fuse each chain into its last transform, working upstream.
+  for (TransformStage* chain_end : chain_ends) {
+    while (true) {
+      Input& input = chain_end->input(0);
+      if (!input.connected() || input.prepared()) {
+        break;
+      }
+
+      TransformStage* upstream_stage = input.mate().stage_->AsTransformStage();
+      if (upstream_stage == nullptr) {
+        break;
+      }
+
+      Input& upstream_input = upstream_stage->input(0);
+      OutputRef upstream_output = upstream_input.mate();
+      size_t queue_depth = upstream_input.queue_depth();
+
+      DisconnectInput(InputRef(chain_end, 0));
+      if (upstream_output) {
+        DisconnectOutput(upstream_output);
+      }
+
+      chain_end->FuseUpstream(upstream_stage);
+
+      if (upstream_output) {
+        Connect(upstream_output, InputRef(chain_end, 0), queue_depth);
+      }
+
+      upstream_stage->SetUpdateCallback(nullptr);
+      stages_.remove(upstream_stage);
+      accounts_.erase(upstream_stage);
+      engine_.DeleteStage(upstream_stage);
+    }
+  }
+}
+
+std::vector<std::vector<std::shared_ptr<Transform>>>
+Graph::GetFusedTransforms() {
+  std::vector<std::vector<std::shared_ptr<Transform>>> result;
+
+  for (Stage* stage : stages_) {
+    TransformStage* transform_stage = stage->AsTransformStage();
+    if (transform_stage == nullptr || transform_stage->transform_count() < 2) {
+      continue;
+    }
+
+    result.emplace_back();
+    for (size_t i = 0; i < transform_stage->transform_count(); ++i) {
+      result.back().push_back(transform_stage->transform(i));
+    }
+  }
+
+  return result;
+}
+
+void Graph::EnableMultithreading(size_t worker_count) {
+  engine_.EnableMultithreading(worker_count);
+}
+
+void Graph::UseScheduler(std::shared_ptr<Scheduler> scheduler,
+                         uint32_t weight) {
+  engine_.UseScheduler(scheduler, weight);
+}
+
+void Graph::SetSchedulingPolicy(SchedulingPolicy policy) {
+  engine_.SetSchedulingPolicy(policy);
+}
+
+void Graph::SetPresentationDeadline(PartRef sink,
+                                    const Stage::DeadlineFunction& deadline) {
+  DCHECK(sink.valid());
+  DCHECK_EQ(sink.output_count(), 0u);
+  engine_.SetPresentationDeadline(sink.stage_, deadline);
+}
+
+void Graph::SetStreamBufferLimit(PartRef part, size_t limit) {
+  DCHECK(part.valid());
+  DCHECK_EQ(part.input_count(), 0u);
+  part.stage_->SetStreamBufferLimit(limit);
+}
+
+void Graph::EnableProfiling(bool enabled) {
+  engine_.EnableProfiling(enabled);
+}
+
+std::vector<PartProfile> Graph::GetPartProfiles() {
+  std::vector<PartProfile> result;
+
+  engine_.RunExclusive([this, &result]() {
+    for (Stage* stage : stages_) {
+      result.emplace_back();
+      PartProfile& profile = result.back();
+      profile.part = PartRef(stage);
+      profile.update_count = stage->update_count();
+      profile.total_update_time = stage->total_update_time();
+      profile.max_update_time = stage->max_update_time();
+
+      for (size_t i = 0; i < stage->input_count(); ++i) {
+        const Input::Counters& counters = stage->input(i).counters();
+        profile.packets_in += counters.packet_count;
+        profile.total_input_wait_time += counters.total_wait_time;
+        profile.max_input_wait_time =
+            std::max(profile.max_input_wait_time, counters.max_wait_time);
+      }
+
+      for (size_t i = 0; i < stage->output_count(); ++i) {
+        profile.packets_out += stage->output(i).packet_count();
+      }
+
+      auto iter = accounts_.find(stage);
+      if (iter != accounts_.end()) {
+        profile.payload_bytes = iter->second->current_bytes();
+        profile.peak_payload_bytes = iter->second->peak_bytes();
+      }
+    }
+  });
+
+  return result;
+}
+
+std::vector<ConnectionProfile> Graph::GetConnectionProfiles() {
+  std::vector<ConnectionProfile> result;
+
+  engine_.RunExclusive([this, &result]() {
+    for (Stage* stage : stages_) {
+      for (size_t i = 0; i < stage->input_count(); ++i) {
+        const Input& input = stage->input(i);
+        if (!input.connected()) {
+          continue;
+        }
+
+        const Input::Counters& counters = input.counters();
+        result.emplace_back();
+        ConnectionProfile& profile = result.back();
+        profile.output = input.mate();
+        profile.input = InputRef(stage, i);
+        profile.packet_count = counters.packet_count;
+        profile.timed_packet_count = counters.timed_packet_count;
+        profile.total_latency = counters.total_wait_time;
+        profile.max_latency = counters.max_wait_time;
+      }
+    }
+  });
+
+  return result;
+}
+
+GraphSnapshot Graph::GetSnapshot() {
+  GraphSnapshot snapshot;
+
+  std::unordered_map<Stage*, size_t> part_indices;
+  for (Stage* stage : stages_) {
+    part_indices.emplace(stage, part_indices.size());
+  }
+
+  engine_.RunExclusive([this, &snapshot, &part_indices]() {
+    snapshot.time = base::TimeTicks::Now();
+
+    for (Stage* stage : stages_) {
+      snapshot.parts.emplace_back();
+      GraphSnapshot::Part& part = snapshot.parts.back();
+      part.type = stage->type_name();
+      part.input_count = stage->input_count();
+      part.output_count = stage->output_count();
+      part.prepared = true;
+      part.update_count = stage->update_count();
+      part.default_allocator = stage->default_allocator();
+
+      for (size_t i = 0; i < part.input_count; ++i) {
+        Input& input = stage->input(i);
+        part.packets_in += input.counters().packet_count;
+
+        if (!input.connected()) {
+          ++part.unconnected_inputs;
+          continue;
+        }
+
+        part.prepared = part.prepared && input.prepared();
+
+        // Connections are listed by their inputs, so each appears once.
+        Output& output = input.actual_mate();
+        snapshot.connections.emplace_back();
+        GraphSnapshot::Connection& connection = snapshot.connections.back();
+        connection.output_part = part_indices[input.mate().stage_];
+        connection.output_index = input.mate().index_;
+        connection.input_part = part_indices[stage];
+        connection.input_index = i;
+        connection.prepared = input.prepared();
+        connection.demand = output.demand();
+        connection.packet_count = input.packet_count();
+        connection.queue_depth = input.queue_depth();
+        connection.packets_supplied = output.packet_count();
+        connection.copy_allocator = output.copy_allocator();
+        connection.output_generation = output.generation();
+        connection.input_generation = input.generation();
+      }
+
+      for (size_t i = 0; i < part.output_count; ++i) {
+        Output& output = stage->output(i);
+        part.packets_out += output.packet_count();
+
+        if (!output.connected()) {
+          ++part.unconnected_outputs;
+          continue;
+        }
+
+        part.prepared = part.prepared && output.actual_mate().prepared();
+      }
+    }
+  });
+
+  return snapshot;
+}
+
+void Graph::RecordConnection(const OutputRef& output,
+                             std::shared_ptr<FlowRecorder> recorder,
+                             const std::string& label) {
+  DCHECK(output.valid());
+  size_t track = recorder ? recorder->AddTrack(label) : 0;
+  engine_.RunExclusive([&output, &recorder, track]() {
+    output.actual().SetRecorder(recorder, track);
+  });
+}
+
+void Graph::RecordAllConnections(std::shared_ptr<FlowRecorder> recorder) {
+  DCHECK(recorder);
+
+  std::unordered_map<Stage*, size_t> part_indices;
+  for (Stage* stage : stages_) {
+    part_indices.emplace(stage, part_indices.size());
+  }
+
+  engine_.RunExclusive([this, &recorder, &part_indices]() {
+    for (Stage* stage : stages_) {
+      for (size_t i = 0; i < stage->output_count(); ++i) {
+        Output& output = stage->output(i);
+        if (!output.connected()) {
+          continue;
+        }
+
+        std::string label = std::to_string(part_indices[stage]) + "." +
+                            std::to_string(i) + "->" +
+                            std::to_string(part_indices[output.mate().stage_]) +
+                            "." + std::to_string(output.mate().index_);
+        output.SetRecorder(recorder, recorder->AddTrack(label));
+      }
+    }
+  });
+}
+
+void Graph::SetDefaultAllocator(std::shared_ptr<PayloadAllocator> allocator) {
+  DCHECK(!budget_) << "SetDefaultAllocator called after SetMemoryBudget";
+  default_allocator_ = allocator;
+  for (Stage* stage : stages_) {
+    stage->SetDefaultAllocator(default_allocator_.get());
+  }
+}
+
+void Graph::SetMemoryBudget(size_t soft_limit, size_t hard_limit) {
+  DCHECK(!budget_) << "SetMemoryBudget called twice";
+  budget_ = BudgetAllocator::Create(default_allocator_, soft_limit, hard_limit);
+  engine_.SetMemoryBudget(budget_.get());
+
+  for (Stage* stage : stages_) {
+    AttachToBudget(stage);
   }
 }
 
@@ -187,6 +526,23 @@ void Graph::PrepareInput(const InputRef& input) {
   engine_.PrepareInput(input);
 }
 
+std::vector<OutputRef> Graph::GetCopyingOutputs() {
+  std::vector<OutputRef> result;
+
+  engine_.RunExclusive([this, &result]() {
+    for (Stage* stage : stages_) {
+      for (size_t i = 0; i < stage->output_count(); ++i) {
+        OutputRef output(stage, i);
+        if (output.connected() && output.copies_payloads()) {
+          result.push_back(output);
+        }
+      }
+    }
+  });
+
+  return result;
+}
+
 void Graph::FlushOutput(const OutputRef& output) {
   DCHECK(output);
   engine_.FlushOutput(output);
@@ -213,8 +569,22 @@ PartRef Graph::Add(Stage* stage) {
 
   stage->SetUpdateCallback(update_function_);
 
+  if (budget_) {
+    AttachToBudget(stage);
+  } else {
+    stage->SetDefaultAllocator(default_allocator_.get());
+  }
+
   return PartRef(stage);
 }
 
+void Graph::AttachToBudget(Stage* stage) {
+  DCHECK(budget_);
+  BudgetAllocator::Account* account = budget_->CreateAccount();
+  accounts_[stage] = account;
+  stage->SetDefaultAllocator(account);
+  stage->SetBudget(budget_.get());
+}
+
 }  // namespace media
 }  // namespace mojo
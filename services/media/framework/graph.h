@@ -6,12 +6,22 @@
 #define SERVICES_MEDIA_FRAMEWORK_GRAPH_H_
 
 #include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "base/time/time.h"
+#include "services/media/framework/budget_allocator.h"
 #include "services/media/framework/engine.h"
+#include "services/media/framework/flow_recording.h"
+#include "services/media/framework/graph_snapshot.h"
 #include "services/media/framework/refs.h"
+#include "services/media/framework/stages/active_multistream_sink_stage.h"
 #include "services/media/framework/stages/active_multistream_source_stage.h"
 #include "services/media/framework/stages/active_sink_stage.h"
 #include "services/media/framework/stages/active_source_stage.h"
+#include "services/media/framework/stages/async_transform_stage.h"
+#include "services/media/framework/stages/fan_out_stage.h"
 #include "services/media/framework/stages/multistream_source_stage.h"
 #include "services/media/framework/stages/stage.h"
 #include "services/media/framework/stages/transform_stage.h"
@@ -42,6 +52,9 @@ DEFINE_STAGE_CREATOR(Transform, TransformStage);
 DEFINE_STAGE_CREATOR(ActiveSource, ActiveSourceStage);
 DEFINE_STAGE_CREATOR(ActiveSink, ActiveSinkStage);
 DEFINE_STAGE_CREATOR(ActiveMultistreamSource, ActiveMultistreamSourceStage);
+DEFINE_STAGE_CREATOR(ActiveMultistreamSink, ActiveMultistreamSinkStage);
+DEFINE_STAGE_CREATOR(FanOut, FanOutStage);
+DEFINE_STAGE_CREATOR(AsyncTransform, AsyncTransformStage);
 
 #undef DEFINE_STAGE_CREATOR
 
@@ -78,8 +91,16 @@ DEFINE_STAGE_CREATOR(ActiveMultistreamSource, ActiveMultistreamSourceStage);
 // Parts come in various flavors, defined by 'model' abstract classes. The
 // current list of supported models is:
 //
+//  ActiveMultistreamSink
+//                    - a sink that consumes packets asynchronously via
+//                      multiple inputs
 //  ActiveSink        - a sink that consumes packets asynchronously
 //  ActiveSource      - a source that produces packets asynchronously
+//  AsyncTransform    - a transform that consumes and produces packets via one
+//                      input and one output, processing packets off the
+//                      engine's threads
+//  FanOut            - a part that supplies each packet it receives via one
+//                      input to all of its outputs without copying payloads
 //  MultistreamSource - a source that produces multiple streams of packets
 //                      synchronously
 //  Transform         - a synchronous transform that consumes and produces
@@ -114,6 +135,48 @@ DEFINE_STAGE_CREATOR(ActiveMultistreamSource, ActiveMultistreamSourceStage);
 // demand for media signalled from that input.
 //
 
+// Profiling counters for a part. Times are measured only while profiling is
+// enabled.
+struct PartProfile {
+  PartProfile();
+
+  PartRef part;
+  // Number of times the part's stage was updated.
+  uint64_t update_count;
+  // Total and maximum time spent in updates.
+  base::TimeDelta total_update_time;
+  base::TimeDelta max_update_time;
+  // Number of packets received via the part's inputs.
+  uint64_t packets_in;
+  // Number of packets supplied via the part's outputs.
+  uint64_t packets_out;
+  // Total and maximum time packets waited in the part's inputs.
+  base::TimeDelta total_input_wait_time;
+  base::TimeDelta max_input_wait_time;
+  // Payload bytes the part has allocated through its default allocator and
+  // not yet released, and the maximum that value has reached. Only counted
+  // when the graph has a memory budget.
+  size_t payload_bytes;
+  size_t peak_payload_bytes;
+};
+
+// Profiling counters for a connection. Times are measured only while profiling
+// is enabled.
+struct ConnectionProfile {
+  ConnectionProfile();
+
+  OutputRef output;
+  InputRef input;
+  // Number of packets supplied via the connection.
+  uint64_t packet_count;
+  // Number of packets whose queueing latency was measured.
+  uint64_t timed_packet_count;
+  // Total and maximum time from the arrival of a packet at the input to its
+  // consumption by the downstream part.
+  base::TimeDelta total_latency;
+  base::TimeDelta max_latency;
+};
+
 // Host for a source, sink or transform.
 class Graph {
  public:
@@ -132,8 +195,12 @@ class Graph {
   void RemovePart(PartRef part);
 
   // Connects an output connector to an input connector. Returns the dowstream
-  // part.
-  PartRef Connect(const OutputRef& output, const InputRef& input);
+  // part. queue_depth is the number of packets the input may hold before
+  // demand on the output goes negative. The downstream part may ask for a
+  // deeper queue when the input is prepared.
+  PartRef Connect(const OutputRef& output,
+                  const InputRef& input,
+                  size_t queue_depth = Input::kDefaultQueueDepth);
 
   // Connects a part with exactly one output to a part with exactly one input.
   // Returns the downstream part.
@@ -164,13 +231,41 @@ class Graph {
   // Disconnects and removes everything connected to input.
   void RemovePartsConnectedToInput(const InputRef& input);
 
+  // Inserts part between output and the input connected to it. part must have
+  // exactly one input and one output, neither connected. The graph may be
+  // prepared and running, in which case part is prepared, and the change takes
+  // effect between packets: packets waiting in the input pass through part.
+  // Other parts aren't flushed. Returns part.
+  PartRef InsertPart(const OutputRef& output, PartRef part);
+
+  // Removes part, which must have exactly one input and one output, both
+  // connected, and connects the output upstream of it to the input downstream
+  // of it. The graph may be prepared and running. Packets waiting in part's
+  // input go to the downstream input, and packets inside part are discarded.
+  void ExtractPart(PartRef part);
+
+  // Removes part, which must have exactly one input and one output, both
+  // connected, and connects replacement in its place. replacement must have
+  // exactly one input and one output, neither connected. The graph may be
+  // prepared and running. Packets waiting in part's input pass through
+  // replacement, and packets inside part are discarded. This is the way to
+  // change a conversion (a reformatter's output type, say) without stopping.
+  // Packets part has already supplied stay downstream and arrive ahead of
+  // replacement's, so if the two produce different formats, parts downstream
+  // see a change of format without notice. If flush_downstream is true, those
+  // packets are discarded instead: the subgraph downstream of replacement is
+  // flushed as FlushOutput would flush it. Returns replacement.
+  PartRef ReplacePart(PartRef part,
+                      PartRef replacement,
+                      bool flush_downstream = false);
+
   // Adds all the parts in t (which must all have one input and one output) and
   // connects them in sequence to the output connector. Returns the output
   // connector of the last part or the output parameter if it is empty.
   template <typename T>
   OutputRef AddAndConnectAll(OutputRef output, const T& t) {
     for (const auto& element : t) {
-      PartRef part = Add(StageCreator<T>::Create(element));
+      PartRef part = Add(element);
       Connect(output, part.input());
       output = part.output();
     }
@@ -180,6 +275,111 @@ class Graph {
   // Removes all parts from the graph.
   void Reset();
 
+  // Fuses each chain of directly-connected transforms into a single part, so
+  // packets pass between the transforms without going through the engine.
+  // This method must be called before the chains are prepared. A fused chain
+  // is referenced by the PartRef of its last transform, and references to the
+  // other parts in the chain (and to their inputs and outputs) are no longer
+  // valid after this method returns. References to the last transform's
+  // output and to parts outside the chain remain valid.
+  void FuseTransforms();
+
+  // Returns the transforms in each fused chain, upstream first. Intended for
+  // debugging.
+  std::vector<std::vector<std::shared_ptr<Transform>>> GetFusedTransforms();
+
+  // Causes the graph to be operated by a pool of worker_count threads rather
+  // than by whatever threads call back into the graph. Independent branches of
+  // the graph then run concurrently. If worker_count is zero, one thread per
+  // hardware thread is used. This method must be called before the graph is
+  // prepared.
+  void EnableMultithreading(size_t worker_count);
+
+  // Causes the graph to be operated by a scheduler shared with other graphs
+  // rather than by whatever threads call back into the graph. weight sets the
+  // graph's share of the scheduler's threads relative to the other graphs
+  // using it. This method must be called before the graph is prepared. It's
+  // an alternative to EnableMultithreading. Like EnableMultithreading, it
+  // causes parts to be updated on worker threads while other threads call into
+  // them, so it should only be used with parts that are safe under those
+  // conditions. Graphs use neither by default.
+  void UseScheduler(std::shared_ptr<Scheduler> scheduler, uint32_t weight);
+
+  // Sets the policy used to order updates of parts. The default is
+  // SchedulingPolicy::kBacklog. SchedulingPolicy::kDeadline runs the parts
+  // feeding sinks with near presentation deadlines first. This method must be
+  // called before the graph is prepared.
+  void SetSchedulingPolicy(SchedulingPolicy policy);
+
+  // Marks a sink with its presentation deadlines. deadline maps the PTS of a
+  // packet arriving at the sink to the time by which the sink must present
+  // it. Deadlines for all the sinks in the graph must be expressed against the
+  // same clock. Used when the scheduling policy is SchedulingPolicy::kDeadline.
+  // This method must be called before the sink is prepared.
+  void SetPresentationDeadline(PartRef sink,
+                               const Stage::DeadlineFunction& deadline);
+
+  // Sets the limit on the number of bytes a multistream source part buffers
+  // for each of its streams. A stream whose downstream parts are backed up
+  // stalls only itself until its buffer reaches this limit, after which the
+  // source stops producing packets for any stream. This method must be called
+  // before the part is prepared.
+  void SetStreamBufferLimit(PartRef part, size_t limit);
+
+  // Enables or disables profiling. While profiling is enabled, the time spent
+  // updating each part and the time packets wait in inputs are measured and
+  // emitted as trace events. Update and packet counts are maintained whether
+  // profiling is enabled or not. This method may be called at any time.
+  void EnableProfiling(bool enabled);
+
+  // Returns profiling counters for each part in the graph.
+  std::vector<PartProfile> GetPartProfiles();
+
+  // Returns profiling counters for each connection in the graph.
+  std::vector<ConnectionProfile> GetConnectionProfiles();
+
+  // Returns the current topology and state of the graph. This method may be
+  // called at any time.
+  GraphSnapshot GetSnapshot();
+
+  // Records the packets supplied via output and the changes in demand
+  // signalled to it as a track labelled label in recorder (see FlowRecorder).
+  // If recorder is nullptr, recording of output stops. This method may be
+  // called at any time.
+  void RecordConnection(const OutputRef& output,
+                        std::shared_ptr<FlowRecorder> recorder,
+                        const std::string& label);
+
+  // Records every connection currently in the graph in recorder, labelling
+  // each track with the indices of the parts, in the order they were added,
+  // and of the connectors (for example, "2.0->3.0"). This method may be called
+  // at any time.
+  void RecordAllConnections(std::shared_ptr<FlowRecorder> recorder);
+
+  // Sets the allocator parts use for their outputs when downstream parts have
+  // no allocator requirement. If this method isn't called, or allocator is
+  // nullptr, PayloadAllocator::GetDefault() is used. This method must be
+  // called before the graph is prepared. Buffers from the allocator may not
+  // be released after the graph is deleted.
+  void SetDefaultAllocator(std::shared_ptr<PayloadAllocator> allocator);
+
+  // Limits the payload memory parts allocate through their default allocators.
+  // Above soft_limit bytes, the outputs of sources report negative demand, so
+  // sources stop producing until the packets in the graph have drained (see
+  // BudgetAllocator). Other parts keep going, because consuming packets is
+  // what drains the graph. Allocations that would exceed hard_limit bytes fail.
+  // Usage per part is reported by GetPartProfiles. soft_limit should leave
+  // room for the packets the sinks hold, or the graph will stall. Allocators
+  // required by sinks aren't limited. This method must be called before the
+  // graph is prepared and after SetDefaultAllocator, if that's called.
+  void SetMemoryBudget(size_t soft_limit, size_t hard_limit);
+
+  // Returns the memory budget or nullptr if SetMemoryBudget hasn't been
+  // called.
+  const std::shared_ptr<BudgetAllocator>& memory_budget() const {
+    return budget_;
+  }
+
   // Prepares the graph for operation.
   void Prepare();
 
@@ -187,16 +387,34 @@ class Graph {
   // prepare subgraphs added when the rest of the graph is already prepared.
   void PrepareInput(const InputRef& input);
 
-  // Flushes the output and the subgraph downstream of it.
+  // Returns the outputs that copy payloads, because the allocator required
+  // downstream can't be pushed any further upstream. Ideally, this is empty.
+  // Only meaningful once the graph is prepared.
+  std::vector<OutputRef> GetCopyingOutputs();
+
+  // Flushes the output and the subgraph downstream of it. The part that owns
+  // the output is flushed before this method returns. The parts downstream,
+  // sinks included, are flushed as they catch up with the flush, before they
+  // get packets produced after it, which may be produced right away. Flushing
+  // a sink doesn't change its demand. See Engine.
   void FlushOutput(const OutputRef& output);
 
-  // Flushes the output and the subgraph downstream of it.
+  // Flushes all the part's outputs and the subgraphs downstream of them.
   void FlushAllOutputs(PartRef part);
 
  private:
   // Adds a stage to the graph.
   PartRef Add(Stage* stage);
 
+  // Gives the stage an account with budget_ for its default allocator.
+  void AttachToBudget(Stage* stage);
+
+  // Declared before engine_, because stages may be deleted when engine_ is
+  // destroyed, and their packets may refer to these allocators.
+  std::shared_ptr<PayloadAllocator> default_allocator_;
+  std::shared_ptr<BudgetAllocator> budget_;
+  std::unordered_map<Stage*, BudgetAllocator::Account*> accounts_;
+
   std::list<Stage*> stages_;
   std::list<Stage*> sources_;
   std::list<Stage*> sinks_;
@@ -0,0 +1,142 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sstream>
+
+#include "services/media/framework/graph_snapshot.h"
+#include "services/media/framework/util/formatting.h"
+
+namespace mojo {
+namespace media {
+
+namespace {
+
+// Writes an allocator identity as a JSON value.
+void WriteAllocatorJson(std::ostream& os, const void* allocator) {
+  if (allocator == nullptr) {
+    os << "null";
+  } else {
+    os << "\"" << allocator << "\"";
+  }
+}
+
+const char* BoolJson(bool value) {
+  return value ? "true" : "false";
+}
+
+}  // namespace
+
+GraphSnapshot::Part::Part()
+    : input_count(0),
+      output_count(0),
+      unconnected_inputs(0),
+      unconnected_outputs(0),
+      prepared(false),
+      update_count(0),
+      packets_in(0),
+      packets_out(0),
+      default_allocator(nullptr) {}
+
+GraphSnapshot::Connection::Connection()
+    : output_part(0),
+      output_index(0),
+      input_part(0),
+      input_index(0),
+      prepared(false),
+      demand(Demand::kNegative),
+      packet_count(0),
+      queue_depth(0),
+      packets_supplied(0),
+      copy_allocator(nullptr),
+      output_generation(0),
+      input_generation(0) {}
+
+GraphSnapshot::GraphSnapshot() {}
+
+GraphSnapshot::~GraphSnapshot() {}
+
+std::string GraphSnapshot::ToJson() const {
+  std::ostringstream os;
+
+  os << "{\"time_us\":" << (time - base::TimeTicks()).InMicroseconds()
+     << ",\"parts\":[";
+
+  for (size_t i = 0; i < parts.size(); ++i) {
+    const Part& part = parts[i];
+    os << (i == 0 ? "" : ",") << "{\"index\":" << i << ",\"type\":\""
+       << part.type << "\",\"inputs\":" << part.input_count
+       << ",\"outputs\":" << part.output_count
+       << ",\"unconnected_inputs\":" << part.unconnected_inputs
+       << ",\"unconnected_outputs\":" << part.unconnected_outputs
+       << ",\"prepared\":" << BoolJson(part.prepared)
+       << ",\"updates\":" << part.update_count
+       << ",\"packets_in\":" << part.packets_in
+       << ",\"packets_out\":" << part.packets_out
+       << ",\"default_allocator\":";
+    WriteAllocatorJson(os, part.default_allocator);
+    os << "}";
+  }
+
+  os << "],\"connections\":[";
+
+  for (size_t i = 0; i < connections.size(); ++i) {
+    const Connection& connection = connections[i];
+    os << (i == 0 ? "" : ",") << "{\"output_part\":" << connection.output_part
+       << ",\"output_index\":" << connection.output_index
+       << ",\"input_part\":" << connection.input_part
+       << ",\"input_index\":" << connection.input_index
+       << ",\"prepared\":" << BoolJson(connection.prepared)
+       << ",\"demand\":\"" << connection.demand
+       << "\",\"packet_count\":" << connection.packet_count
+       << ",\"queue_depth\":" << connection.queue_depth
+       << ",\"packets_supplied\":" << connection.packets_supplied
+       << ",\"copy_allocator\":";
+    WriteAllocatorJson(os, connection.copy_allocator);
+    os << ",\"output_generation\":" << connection.output_generation
+       << ",\"input_generation\":" << connection.input_generation << "}";
+  }
+
+  os << "]}";
+
+  return os.str();
+}
+
+std::string GraphSnapshot::ToDot() const {
+  std::ostringstream os;
+
+  os << "digraph media_graph {\n";
+
+  for (size_t i = 0; i < parts.size(); ++i) {
+    const Part& part = parts[i];
+    os << "  p" << i << " [shape=box,label=\"" << i << ": " << part.type
+       << "\\nupdates " << part.update_count << "\\nin " << part.packets_in
+       << " out " << part.packets_out << "\"";
+    if (!part.prepared) {
+      os << ",style=dashed";
+    }
+    os << "];\n";
+  }
+
+  for (const Connection& connection : connections) {
+    os << "  p" << connection.output_part << " -> p" << connection.input_part
+       << " [label=\"" << connection.output_index << "->"
+       << connection.input_index << "\\n" << connection.demand << " "
+       << connection.packet_count << "/" << connection.queue_depth << "\\n"
+       << connection.packets_supplied << " packets\"";
+    if (connection.copy_allocator != nullptr) {
+      os << ",color=red";
+    }
+    if (!connection.prepared) {
+      os << ",style=dashed";
+    }
+    os << "];\n";
+  }
+
+  os << "}\n";
+
+  return os.str();
+}
+
+}  // namespace media
+}  // namespace mojo
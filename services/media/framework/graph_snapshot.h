@@ -0,0 +1,90 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_GRAPH_SNAPSHOT_H_
+#define SERVICES_MEDIA_FRAMEWORK_GRAPH_SNAPSHOT_H_
+
+#include <string>
+#include <vector>
+
+#include "base/time/time.h"
+#include "services/media/framework/models/demand.h"
+
+namespace mojo {
+namespace media {
+
+// The topology and state of a graph at a moment in time, for inspecting a
+// running pipeline (see Graph::GetSnapshot). Parts are identified by their
+// indices in parts, which follow the order in which the parts were added.
+// Counters are cumulative, so throughput is found by comparing two snapshots.
+struct GraphSnapshot {
+  struct Part {
+    Part();
+
+    // Name of the class of the part's stage, such as "TransformStage".
+    std::string type;
+    size_t input_count;
+    size_t output_count;
+    // Number of inputs and outputs that aren't connected.
+    size_t unconnected_inputs;
+    size_t unconnected_outputs;
+    // Whether all the part's connections are prepared.
+    bool prepared;
+    // Number of times the part has been updated.
+    uint64_t update_count;
+    // Number of packets the part has received and supplied.
+    uint64_t packets_in;
+    uint64_t packets_out;
+    // Identity of the allocator the part uses for its outputs when downstream
+    // has no requirement.
+    const void* default_allocator;
+  };
+
+  struct Connection {
+    Connection();
+
+    size_t output_part;
+    size_t output_index;
+    size_t input_part;
+    size_t input_index;
+    // Whether the input is prepared.
+    bool prepared;
+    // Demand as seen by the output.
+    Demand demand;
+    // Number of packets waiting in the input and the most it holds.
+    size_t packet_count;
+    size_t queue_depth;
+    // Number of packets supplied via the connection.
+    uint64_t packets_supplied;
+    // Identity of the allocator the output copies payloads into, or nullptr
+    // if the output doesn't copy. Copying links are worth eliminating.
+    const void* copy_allocator;
+    // Flush generations of the output and the input. They differ while a
+    // flush is propagating.
+    uint64_t output_generation;
+    uint64_t input_generation;
+  };
+
+  GraphSnapshot();
+
+  ~GraphSnapshot();
+
+  // Returns the snapshot as a JSON object with "time_us", "parts" and
+  // "connections" members.
+  std::string ToJson() const;
+
+  // Returns the snapshot as a Graphviz digraph. Copying connections are red,
+  // and unprepared connections are dashed.
+  std::string ToDot() const;
+
+  // When the snapshot was taken.
+  base::TimeTicks time;
+  std::vector<Part> parts;
+  std::vector<Connection> connections;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_GRAPH_SNAPSHOT_H_
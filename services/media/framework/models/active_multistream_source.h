@@ -5,8 +5,12 @@
 #ifndef MOJO_MEDIA_MODELS_ACTIVE_MULTISTREAM_SOURCE_H_
 #define MOJO_MEDIA_MODELS_ACTIVE_MULTISTREAM_SOURCE_H_
 
+#include <vector>
+
 #include "services/media/framework/models/part.h"
+#include "services/media/framework/models/stream_packet.h"
 #include "services/media/framework/packet.h"
+#include "services/media/framework/payload_allocator.h"
 
 namespace mojo {
 namespace media {
@@ -16,6 +20,8 @@ class ActiveMultistreamSource : public Part {
  public:
   using SupplyCallback =
       std::function<void(size_t output_index, PacketPtr packet)>;
+  using BatchSupplyCallback =
+      std::function<void(std::vector<StreamPacket> packets)>;
 
   ~ActiveMultistreamSource() override {}
 
@@ -24,12 +30,38 @@ class ActiveMultistreamSource : public Part {
   // Returns the number of streams the source produces.
   virtual size_t stream_count() const = 0;
 
+  // Whether the source can allocate the payloads of the indicated stream's
+  // packets from an allocator required downstream. The default implementation
+  // returns false, in which case the stream's payloads are copied into the
+  // required allocator.
+  virtual bool can_accept_allocator(size_t stream_index) const {
+    return false;
+  }
+
+  // Sets the allocator for the indicated stream's payloads. Called only for
+  // streams for which can_accept_allocator returns true. allocator is nullptr
+  // if downstream has no requirement.
+  virtual void set_allocator(size_t stream_index,
+                             PayloadAllocator* allocator) {}
+
   // Sets the callback that supplies a packet asynchronously.
   virtual void SetSupplyCallback(const SupplyCallback& supply_callback) = 0;
 
   // Requests a packet from the source to be supplied asynchronously via
   // the supply callback.
   virtual void RequestPacket() = 0;
+
+  // Sets the callback that supplies a batch of packets asynchronously. Sources
+  // that don't override RequestPackets never call it.
+  virtual void SetBatchSupplyCallback(
+      const BatchSupplyCallback& batch_supply_callback) {}
+
+  // Requests between 1 and max_count packets from the source. The source
+  // answers with exactly one call to either the supply callback or the batch
+  // supply callback. A batch holds packets in the order the source would have
+  // supplied them individually and ends early after the end-of-stream packet
+  // for the last stream. The default implementation calls RequestPacket.
+  virtual void RequestPackets(size_t max_count) { RequestPacket(); }
 };
 
 }  // namespace media
@@ -5,6 +5,9 @@
 #ifndef MOJO_MEDIA_MODELS_ACTIVE_SINK_H_
 #define MOJO_MEDIA_MODELS_ACTIVE_SINK_H_
 
+#include <vector>
+
+#include "base/logging.h"
 #include "services/media/framework/models/demand.h"
 #include "services/media/framework/models/part.h"
 #include "services/media/framework/packet.h"
@@ -13,7 +16,10 @@
 namespace mojo {
 namespace media {
 
-// Sink that consumes packets asynchronously.
+// Sink that consumes packets asynchronously. When the graph is flushed, Flush
+// (see Part) is called before the sink is supplied any packets from after the
+// flush, possibly after the sink has signalled demand again. It doesn't
+// change the sink's demand.
 class ActiveSink : public Part {
  public:
   using DemandCallback = std::function<void(Demand demand)>;
@@ -24,11 +30,41 @@ class ActiveSink : public Part {
   // no such requirement.
   virtual PayloadAllocator* allocator() = 0;
 
+  // The number of packets the sink would like queued ahead of it. The queue on
+  // the sink's input is made at least this deep when the input is prepared.
+  virtual size_t input_queue_depth() { return 1; }
+
   // Sets the callback that signals demand asynchronously.
   virtual void SetDemandCallback(const DemandCallback& demand_callback) = 0;
 
   // Supplies a packet to the sink, returning the new demand for the input.
   virtual Demand SupplyPacket(PacketPtr packet) = 0;
+
+  // The maximum number of packets the sink accepts in a call to SupplyPackets.
+  // If this is 1, the default, the sink is supplied one packet at a time using
+  // SupplyPacket. A sink that returns more should also have an input queue at
+  // least this deep (see input_queue_depth), or batches will be small.
+  virtual size_t supply_batch_size() { return 1; }
+
+  // Supplies up to supply_batch_size packets to the sink, returning the new
+  // demand for the input. The sink takes packets from the front of packets by
+  // moving them out, stopping when it has taken them all or its demand is
+  // negative. Packets it leaves in packets are supplied again later. The
+  // default implementation calls SupplyPacket for each packet.
+  virtual Demand SupplyPackets(std::vector<PacketPtr>* packets) {
+    DCHECK(packets);
+    DCHECK(!packets->empty());
+
+    Demand demand = Demand::kNegative;
+    for (PacketPtr& packet : *packets) {
+      demand = SupplyPacket(std::move(packet));
+      if (demand == Demand::kNegative) {
+        break;
+      }
+    }
+
+    return demand;
+  }
 };
 
 }  // namespace media
@@ -0,0 +1,53 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_MEDIA_MODELS_ASYNC_TRANSFORM_H_
+#define MOJO_MEDIA_MODELS_ASYNC_TRANSFORM_H_
+
+#include "services/media/framework/models/part.h"
+#include "services/media/framework/packet.h"
+#include "services/media/framework/payload_allocator.h"
+
+namespace mojo {
+namespace media {
+
+// Asynchronous packet transform. Packets are processed off the engine's
+// threads, so long-running work doesn't hold up the rest of the graph.
+class AsyncTransform : public Part {
+ public:
+  // Supplies an output packet, if output isn't nullptr. input_consumed
+  // indicates the transform is done with the oldest input packet it's been
+  // given.
+  using OutputCallback =
+      std::function<void(PacketPtr output, bool input_consumed)>;
+
+  ~AsyncTransform() override {}
+
+  // The maximum number of input packets that may be given to the transform
+  // before it reports them consumed.
+  virtual size_t max_packets_in_flight() const { return 1; }
+
+  // Sets the callback that supplies output packets asynchronously. The
+  // callback must not be called synchronously from TransformPacket.
+  virtual void SetOutputCallback(const OutputCallback& output_callback) = 0;
+
+  // Starts processing a packet. Output packets for each input packet must be
+  // supplied in order, and input packets must be consumed in the order they
+  // were given. Output payloads must be allocated using allocator.
+  virtual void TransformPacket(PacketPtr input,
+                               PayloadAllocator* allocator) = 0;
+
+  // Part implementation. Discards the input packets the transform has been
+  // given. Flush doesn't wait for work in progress, because it's called with
+  // engine locks held, and the output callback may need those locks. The
+  // output callback may therefore still be called with output from packets
+  // given before the flush, and the caller must discard that output (see
+  // AsyncTransformStage). Output from packets given after the flush follows.
+  void Flush() override = 0;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // MOJO_MEDIA_MODELS_ASYNC_TRANSFORM_H_
@@ -0,0 +1,30 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_MEDIA_MODELS_FAN_OUT_H_
+#define MOJO_MEDIA_MODELS_FAN_OUT_H_
+
+#include "services/media/framework/models/part.h"
+
+namespace mojo {
+namespace media {
+
+// Part with one input and multiple outputs that supplies every packet it
+// receives to all of its connected outputs. Payloads aren't copied. Instead,
+// all the outputs get packets that share the input packet's payload, which is
+// released when the last of those packets is released. Demand on the input is
+// the aggregate of the demand on the outputs: negative if any output can't
+// accept a packet, otherwise positive if any output has positive demand.
+class FanOut : public Part {
+ public:
+  ~FanOut() override {}
+
+  // Returns the number of outputs.
+  virtual size_t output_count() const = 0;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // MOJO_MEDIA_MODELS_FAN_OUT_H_
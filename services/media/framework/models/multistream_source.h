@@ -5,7 +5,11 @@
 #ifndef MOJO_MEDIA_MODELS_MULTISTREAM_SOURCE_H_
 #define MOJO_MEDIA_MODELS_MULTISTREAM_SOURCE_H_
 
+#include <vector>
+
+#include "base/logging.h"
 #include "services/media/framework/models/part.h"
+#include "services/media/framework/models/stream_packet.h"
 #include "services/media/framework/packet.h"
 
 namespace mojo {
@@ -23,6 +27,20 @@ class MultistreamSource : public Part {
   // should always produce a packet until end-of-stream. The caller is
   // responsible for releasing the packet.
   virtual PacketPtr PullPacket(size_t* stream_index_out) = 0;
+
+  // Gets between 1 and max_count packets, appending them to packets_out in the
+  // order PullPacket would have produced them. The batch ends early after the
+  // end-of-stream packet for the last stream. The default implementation calls
+  // PullPacket once. Sources that produce many small packets can override this
+  // to produce them in batches, saving a call and a stage update per packet.
+  virtual void PullPackets(size_t max_count,
+                           std::vector<StreamPacket>* packets_out) {
+    DCHECK(max_count != 0);
+    DCHECK(packets_out);
+    size_t stream_index;
+    PacketPtr packet = PullPacket(&stream_index);
+    packets_out->emplace_back(stream_index, std::move(packet));
+  }
 };
 
 }  // namespace media
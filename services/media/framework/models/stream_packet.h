@@ -0,0 +1,28 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_MEDIA_MODELS_STREAM_PACKET_H_
+#define MOJO_MEDIA_MODELS_STREAM_PACKET_H_
+
+#include <utility>
+
+#include "services/media/framework/packet.h"
+
+namespace mojo {
+namespace media {
+
+// A packet produced by a multistream source together with the index of the
+// stream it belongs to.
+struct StreamPacket {
+  StreamPacket(size_t stream_index, PacketPtr packet)
+      : stream_index(stream_index), packet(std::move(packet)) {}
+
+  size_t stream_index;
+  PacketPtr packet;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // MOJO_MEDIA_MODELS_STREAM_PACKET_H_
@@ -17,6 +17,20 @@ class Transform : public Part {
  public:
   ~Transform() override {}
 
+  // Indicates whether the transform can process packets in place, passing them
+  // through with their payloads modified rather than producing new packets. If
+  // so, any allocator required downstream of the transform is required
+  // upstream of it as well, so payloads reach downstream without being copied.
+  // TransformPacketInPlace is then called for packets whose payloads aren't
+  // shared with other packets, and TransformPacket for the rest.
+  virtual bool passes_payloads_through() const { return false; }
+
+  // Processes a packet in place. The packet is passed downstream when this
+  // method returns. Called instead of TransformPacket if
+  // passes_payloads_through returns true and the packet's payload isn't
+  // shared. The default implementation does nothing.
+  virtual void TransformPacketInPlace(Packet* packet) {}
+
   // Processes a packet. Returns true to indicate the transform is done
   // processing the input packet. Returns false to indicate the input
   // packet should be processed again. new_input indicates whether the input
@@ -26,6 +40,12 @@ class Transform : public Part {
                                bool new_input,
                                PayloadAllocator* allocator,
                                PacketPtr* output) = 0;
+
+  // Sets the allocator for payloads that don't leave the transform, such as
+  // those of packets passed between the transforms of a pipeline. Called by
+  // the hosting stage when its output is prepared. The default implementation
+  // does nothing.
+  virtual void SetIntermediateAllocator(PayloadAllocator* allocator) {}
 };
 
 }  // namespace media
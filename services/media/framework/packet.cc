@@ -2,26 +2,36 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <new>
+
 #include "base/logging.h"
 #include "services/media/framework/packet.h"
+#include "services/media/framework/packet_pool.h"
 #include "services/media/framework/payload_allocator.h"
 
 namespace mojo {
 namespace media {
 
 Packet::Packet(int64_t pts, bool end_of_stream, size_t size, void* payload)
-    : pts_(pts), end_of_stream_(end_of_stream), size_(size), payload_(payload) {
+    : pts_(pts),
+      end_of_stream_(end_of_stream),
+      size_(size),
+      payload_(payload),
+      generation_(0) {
   DCHECK((size == 0) == (payload == nullptr));
 }
 
 class PacketImpl : public Packet {
  public:
-  PacketImpl(int64_t pts,
-             bool end_of_stream,
-             size_t size,
-             void* payload,
-             PayloadAllocator* allocator)
-      : Packet(pts, end_of_stream, size, payload), allocator_(allocator) {}
+  static PacketPtr Create(int64_t pts,
+                          bool end_of_stream,
+                          size_t size,
+                          void* payload,
+                          PayloadAllocator* allocator) {
+    void* block = GetDefaultPool()->AllocateBlock(sizeof(PacketImpl));
+    return PacketPtr(
+        new (block) PacketImpl(pts, end_of_stream, size, payload, allocator));
+  }
 
  protected:
   ~PacketImpl() override{};
@@ -34,10 +44,18 @@ class PacketImpl : public Packet {
     if (payload() != nullptr && allocator_ != nullptr) {
       allocator_->ReleasePayloadBuffer(size(), payload());
     }
-    delete this;
+    this->~PacketImpl();
+    GetDefaultPool()->ReleaseBlock(this);
   }
 
  private:
+  PacketImpl(int64_t pts,
+             bool end_of_stream,
+             size_t size,
+             void* payload,
+             PayloadAllocator* allocator)
+      : Packet(pts, end_of_stream, size, payload), allocator_(allocator) {}
+
   PayloadAllocator* allocator_;
 };
 
@@ -48,8 +66,7 @@ PacketPtr Packet::Create(int64_t pts,
                          void* payload,
                          PayloadAllocator* allocator) {
   DCHECK(payload == nullptr || allocator != nullptr);
-  return PacketPtr(
-      new PacketImpl(pts, end_of_stream, size, payload, allocator));
+  return PacketImpl::Create(pts, end_of_stream, size, payload, allocator);
 }
 
 // static
@@ -57,16 +74,24 @@ PacketPtr Packet::CreateNoAllocator(int64_t pts,
                                     bool end_of_stream,
                                     size_t size,
                                     void* payload) {
-  return PacketPtr(new PacketImpl(pts, end_of_stream, size, payload, nullptr));
+  return PacketImpl::Create(pts, end_of_stream, size, payload, nullptr);
 }
 
 // static
 PacketPtr Packet::CreateEndOfStream(int64_t pts) {
-  return PacketPtr(new PacketImpl(pts,
-                                  true,       // end_of_stream
-                                  0,          // size
-                                  nullptr,    // payload
-                                  nullptr));  // allocator
+  return PacketImpl::Create(pts,
+                            true,      // end_of_stream
+                            0,         // size
+                            nullptr,   // payload
+                            nullptr);  // allocator
+}
+
+// static
+PacketPool* Packet::GetDefaultPool() {
+  // The pool is never deleted, because packets may be released during
+  // shutdown after static destructors have run.
+  static PacketPool* pool = new PacketPool(sizeof(PacketImpl));
+  return pool;
 }
 
 }  // namespace media
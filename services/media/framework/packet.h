@@ -10,11 +10,13 @@
 
 #include "base/logging.h"
 #include "services/media/framework/payload_allocator.h"
+#include "services/media/framework/types/stream_type.h"
 
 namespace mojo {
 namespace media {
 
 class Packet;
+class PacketPool;
 
 // Used for PacketPtr.
 struct PacketDeleter {
@@ -26,7 +28,8 @@ typedef std::unique_ptr<Packet, PacketDeleter> PacketPtr;
 
 // Media packet abstract base class. Subclasses may be defined as needed.
 // Packet::Create and Packet::CreateEndOfStream use an implementation with
-// no special behavior.
+// no special behavior. Subclasses that are created at a high rate should
+// allocate their instances from a PacketPool.
 // TODO(dalesat): Revisit this definition:
 // 1) We probably need an extensible way to add metadata to packets.
 // 2) The relationship to the allocator could be clearer.
@@ -53,6 +56,14 @@ class Packet {
   // Creates an end-of-stream packet with no payload.
   static PacketPtr CreateEndOfStream(int64_t pts);
 
+  // Gets the pool from which Create, CreateNoAllocator and CreateEndOfStream
+  // allocate packets. Useful mostly for its counters. The pool is shared by
+  // all graphs in the process, because these methods have no graph context
+  // and packets may be released after their graph is gone. Parts that create
+  // many packets own pools of their own (see PacketPool), which keeps their
+  // traffic apart from other graphs'.
+  static PacketPool* GetDefaultPool();
+
   int64_t pts() const { return pts_; }
 
   bool end_of_stream() const { return end_of_stream_; }
@@ -61,6 +72,28 @@ class Packet {
 
   void* payload() const { return payload_; }
 
+  // Indicates whether other packets refer to this packet's payload, in which
+  // case the payload must not be modified.
+  virtual bool payload_shared() const { return false; }
+
+  // The stream type that applies from this packet on, if it differs from the
+  // type previously in effect. Null if the type hasn't changed.
+  const std::unique_ptr<StreamType>& revised_stream_type() const {
+    return revised_stream_type_;
+  }
+
+  // Sets the revised stream type.
+  void SetRevisedStreamType(std::unique_ptr<StreamType> stream_type) {
+    revised_stream_type_ = std::move(stream_type);
+  }
+
+  // The flush generation of the output that supplied the packet. Packets from
+  // generations that have been flushed are discarded downstream.
+  uint64_t generation() const { return generation_; }
+
+  // Sets the generation. Called only by Output and Input.
+  void set_generation(uint64_t generation) { generation_ = generation; }
+
  protected:
   Packet(int64_t pts, bool end_of_stream, size_t size, void* payload);
 
@@ -73,6 +106,8 @@ class Packet {
   bool end_of_stream_;
   size_t size_;
   void* payload_;
+  std::unique_ptr<StreamType> revised_stream_type_;
+  uint64_t generation_;
 
   friend PacketDeleter;
 };
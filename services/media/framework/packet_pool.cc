@@ -0,0 +1,194 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <new>
+
+#include "base/logging.h"
+#include "services/media/framework/packet_pool.h"
+
+namespace mojo {
+namespace media {
+
+namespace {
+
+static constexpr uint64_t kIndexMask = 0xffffffff;
+static constexpr int kTagShift = 32;
+
+size_t RoundUpToAlignment(size_t size) {
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // namespace
+
+constexpr uint32_t PacketPool::kBlocksPerSegment;
+constexpr uint32_t PacketPool::kMaxSegments;
+constexpr uint32_t PacketPool::kNoIndex;
+
+// static
+std::shared_ptr<PacketPool> PacketPool::Create(size_t block_size) {
+  return std::make_shared<PacketPool>(block_size);
+}
+
+PacketPool::PacketPool(size_t block_size)
+    : block_size_(block_size),
+      stride_(sizeof(Header) + RoundUpToAlignment(block_size)),
+      free_list_(kNoIndex),
+      segment_count_(0),
+      allocation_count_(0),
+      hit_count_(0),
+      outstanding_count_(0),
+      high_water_mark_(0),
+      block_count_(0) {
+  DCHECK(block_size_ != 0);
+  for (std::atomic<char*>& segment : segments_) {
+    segment.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+PacketPool::~PacketPool() {
+  DCHECK_EQ(outstanding_count_.load(), 0u) << "packets outlived their pool";
+  for (uint32_t i = 0; i < segment_count_; ++i) {
+    delete[] segments_[i].load(std::memory_order_relaxed);
+  }
+}
+
+void* PacketPool::AllocateBlock(size_t size) {
+  DCHECK(size <= block_size_);
+
+  allocation_count_.fetch_add(1, std::memory_order_relaxed);
+
+  uint32_t index = Pop();
+  if (index != kNoIndex) {
+    hit_count_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    index = Grow();
+  }
+
+  Header* header;
+  if (index != kNoIndex) {
+    header = HeaderFromIndex(index);
+  } else {
+    // The pool is as big as it gets. Go to the heap.
+    header = new (::operator new(sizeof(Header) + block_size_)) Header();
+    header->index_ = kNoIndex;
+  }
+
+  size_t outstanding =
+      outstanding_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+  size_t high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+  while (outstanding > high_water_mark &&
+         !high_water_mark_.compare_exchange_weak(high_water_mark, outstanding,
+                                                 std::memory_order_relaxed)) {
+  }
+
+  return BlockFromHeader(header);
+}
+
+void PacketPool::ReleaseBlock(void* block) {
+  DCHECK(block);
+
+  outstanding_count_.fetch_sub(1, std::memory_order_relaxed);
+
+  Header* header = HeaderFromBlock(block);
+  if (header->index_ == kNoIndex) {
+    header->~Header();
+    ::operator delete(header);
+    return;
+  }
+
+  DCHECK_EQ(HeaderFromIndex(header->index_), header);
+  Push(header->index_);
+}
+
+PacketPool::Counters PacketPool::counters() const {
+  Counters counters;
+  counters.allocation_count = allocation_count_.load();
+  counters.hit_count = hit_count_.load();
+  counters.outstanding_count = outstanding_count_.load();
+  counters.high_water_mark = high_water_mark_.load();
+  counters.block_count = block_count_.load();
+  return counters;
+}
+
+PacketPool::Header* PacketPool::HeaderFromIndex(uint32_t index) const {
+  DCHECK(index != kNoIndex);
+  char* segment =
+      segments_[index / kBlocksPerSegment].load(std::memory_order_acquire);
+  DCHECK(segment);
+  return reinterpret_cast<Header*>(segment +
+                                   (index % kBlocksPerSegment) * stride_);
+}
+
+uint32_t PacketPool::Pop() {
+  uint64_t head = free_list_.load(std::memory_order_acquire);
+
+  while (true) {
+    uint32_t index = static_cast<uint32_t>(head & kIndexMask);
+    if (index == kNoIndex) {
+      return kNoIndex;
+    }
+
+    // If another thread pops this block before we do, next_ may be stale, but
+    // the tag will have changed, so the exchange below will fail.
+    uint64_t next =
+        HeaderFromIndex(index)->next_.load(std::memory_order_relaxed);
+    uint64_t new_head = (((head >> kTagShift) + 1) << kTagShift) | next;
+
+    if (free_list_.compare_exchange_weak(head, new_head,
+                                         std::memory_order_acquire,
+                                         std::memory_order_acquire)) {
+      return index;
+    }
+  }
+}
+
+void PacketPool::Push(uint32_t index) {
+  Header* header = HeaderFromIndex(index);
+  uint64_t head = free_list_.load(std::memory_order_relaxed);
+  uint64_t new_head;
+
+  do {
+    header->next_.store(static_cast<uint32_t>(head & kIndexMask),
+                        std::memory_order_relaxed);
+    new_head = (((head >> kTagShift) + 1) << kTagShift) | index;
+  } while (!free_list_.compare_exchange_weak(head, new_head,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+}
+
+uint32_t PacketPool::Grow() {
+  base::AutoLock lock(grow_lock_);
+
+  // Another thread may have grown the pool while we were waiting for the lock.
+  uint32_t index = Pop();
+  if (index != kNoIndex) {
+    return index;
+  }
+
+  if (segment_count_ == kMaxSegments) {
+    return kNoIndex;
+  }
+
+  char* segment = new char[stride_ * kBlocksPerSegment];
+  uint32_t first_index = segment_count_ * kBlocksPerSegment;
+  for (uint32_t i = 0; i < kBlocksPerSegment; ++i) {
+    Header* header = new (segment + i * stride_) Header();
+    header->index_ = first_index + i;
+  }
+
+  segments_[segment_count_].store(segment, std::memory_order_release);
+  ++segment_count_;
+  block_count_.fetch_add(kBlocksPerSegment, std::memory_order_relaxed);
+
+  // Keep the first block for the caller.
+  for (uint32_t i = kBlocksPerSegment - 1; i > 0; --i) {
+    Push(first_index + i);
+  }
+
+  return first_index;
+}
+
+}  // namespace media
+}  // namespace mojo
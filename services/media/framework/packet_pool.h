@@ -0,0 +1,162 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_PACKET_POOL_H_
+#define SERVICES_MEDIA_FRAMEWORK_PACKET_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "base/synchronization/lock.h"
+
+namespace mojo {
+namespace media {
+
+// Recycles fixed-size blocks of memory for Packet objects so that steady-state
+// packet traffic doesn't touch the heap.
+//
+// Blocks are allocated from the heap in segments the first time they're
+// needed and are never returned to the heap until the pool is destroyed.
+// Released blocks go on a free list. Allocating and releasing blocks is
+// lock-free; a lock is taken only when the pool has to grow. Blocks may be
+// released on any thread.
+//
+// Packet subclasses construct themselves in blocks from a pool using
+// placement new and, in Release, run their destructor and then return the
+// block to the pool. A packet that may outlive the part that created it should
+// hold a reference to the pool:
+//
+//     class MyPacket : public Packet {
+//      public:
+//       static PacketPtr Create(std::shared_ptr<PacketPool> pool, ...) {
+//         void* block = pool->AllocateBlock(sizeof(MyPacket));
+//         return PacketPtr(new (block) MyPacket(pool, ...));
+//       }
+//
+//      protected:
+//       void Release() override {
+//         std::shared_ptr<PacketPool> pool = std::move(pool_);
+//         this->~MyPacket();
+//         pool->ReleaseBlock(this);
+//       }
+//       ...
+//     };
+class PacketPool {
+ public:
+  // Snapshot of the pool's counters.
+  struct Counters {
+    // Total number of blocks handed out.
+    uint64_t allocation_count;
+    // Number of allocations satisfied from the free list.
+    uint64_t hit_count;
+    // Number of blocks currently handed out.
+    size_t outstanding_count;
+    // Largest value outstanding_count has reached.
+    size_t high_water_mark;
+    // Number of blocks the pool has obtained from the heap.
+    size_t block_count;
+
+    // Fraction of allocations satisfied from the free list.
+    double hit_rate() const {
+      return allocation_count == 0
+                 ? 1.0
+                 : static_cast<double>(hit_count) / allocation_count;
+    }
+  };
+
+  // Creates a pool whose blocks hold objects of up to block_size bytes.
+  static std::shared_ptr<PacketPool> Create(size_t block_size);
+
+  explicit PacketPool(size_t block_size);
+
+  // Frees all the blocks. All blocks must have been released.
+  ~PacketPool();
+
+  // Size of the objects the blocks in this pool can hold.
+  size_t block_size() const { return block_size_; }
+
+  // Returns a block that can hold size bytes. size must not exceed
+  // block_size(). Never returns nullptr.
+  void* AllocateBlock(size_t size);
+
+  // Returns a block obtained from AllocateBlock to the pool.
+  void ReleaseBlock(void* block);
+
+  // Returns a snapshot of the pool's counters. The counters are updated
+  // independently, so the snapshot may be slightly inconsistent while blocks
+  // are being allocated and released on other threads.
+  Counters counters() const;
+
+ private:
+  // Blocks are allocated this many at a time.
+  static constexpr uint32_t kBlocksPerSegment = 64;
+
+  // The pool grows to at most this many segments. After that, blocks come
+  // straight from the heap.
+  static constexpr uint32_t kMaxSegments = 1024;
+
+  // Index value used to terminate the free list and to mark blocks that came
+  // straight from the heap.
+  static constexpr uint32_t kNoIndex = 0xffffffff;
+
+  // Precedes each block. Padded to preserve the alignment of the block.
+  struct alignas(alignof(std::max_align_t)) Header {
+    // Index of the next block in the free list. Only meaningful when the
+    // block is in the free list.
+    std::atomic<uint32_t> next_;
+    // Index of this block or kNoIndex.
+    uint32_t index_;
+  };
+
+  // Returns the header for the block with the indicated index.
+  Header* HeaderFromIndex(uint32_t index) const;
+
+  // Returns the header for the indicated block.
+  static Header* HeaderFromBlock(void* block) {
+    return reinterpret_cast<Header*>(block) - 1;
+  }
+
+  // Returns the block for the indicated header.
+  static void* BlockFromHeader(Header* header) { return header + 1; }
+
+  // Pops a block index from the free list, returning kNoIndex if the list is
+  // empty.
+  uint32_t Pop();
+
+  // Pushes a block index onto the free list.
+  void Push(uint32_t index);
+
+  // Adds a segment's worth of blocks to the pool, returning the index of one
+  // of the new blocks and putting the rest on the free list. Returns kNoIndex
+  // if the pool is already as large as it can get.
+  uint32_t Grow();
+
+  const size_t block_size_;
+  // Distance between adjacent headers in a segment.
+  const size_t stride_;
+
+  // Low 32 bits are the index of the first free block. High 32 bits are a
+  // count of modifications, which prevents a pop from succeeding when the
+  // list has changed underneath it (the ABA problem).
+  std::atomic<uint64_t> free_list_;
+
+  std::atomic<char*> segments_[kMaxSegments];
+
+  base::Lock grow_lock_;
+  uint32_t segment_count_;  // Protected by grow_lock_.
+
+  std::atomic<uint64_t> allocation_count_;
+  std::atomic<uint64_t> hit_count_;
+  std::atomic<size_t> outstanding_count_;
+  std::atomic<size_t> high_water_mark_;
+  std::atomic<size_t> block_count_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_PACKET_POOL_H_
@@ -0,0 +1,367 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "services/media/framework/parts/disk_spill.h"
+
+namespace mojo {
+namespace media {
+
+namespace {
+
+const char kIndexSuffix[] = ".index";
+const uint8_t kSignature[] = {'M', 'S', 'P', 'L'};
+const uint64_t kVersion = 2;
+
+// Value of DiskSpill::slot_blocks_ elements for unused slots.
+const uint32_t kNoBlock = 0xffffffff;
+
+template <typename T>
+void AppendValue(T value, std::vector<uint8_t>* data) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  data->insert(data->end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool ReadValue(const std::string& data, size_t* offset, T* value_out) {
+  if (data.size() - *offset < sizeof(T)) {
+    return false;
+  }
+
+  std::memcpy(value_out, data.data() + *offset, sizeof(T));
+  *offset += sizeof(T);
+  return true;
+}
+
+}  // namespace
+
+DiskSpill::Settings::Settings() : capacity(0), cleanup(Cleanup::kDelete) {}
+
+// static
+std::unique_ptr<DiskSpill> DiskSpill::Create(const Settings& settings,
+                                             size_t asset_size) {
+  DCHECK(!settings.path.empty());
+  DCHECK(asset_size != 0);
+
+  base::File file(base::FilePath(settings.path),
+                  base::File::FLAG_OPEN_ALWAYS | base::File::FLAG_READ |
+                      base::File::FLAG_WRITE);
+  if (!file.IsValid()) {
+    LOG(ERROR) << "failed to open spill file " << settings.path;
+    return nullptr;
+  }
+
+  std::unique_ptr<DiskSpill> spill(
+      new DiskSpill(settings, asset_size, std::move(file)));
+
+  {
+    base::AutoLock lock(spill->lock_);
+    if (!spill->LoadIndex()) {
+      // Nothing to reuse.
+      spill->file_.SetLength(0);
+    }
+  }
+
+  // The index is written again when the spill is deleted. Until then, it
+  // would be stale, so it mustn't survive a crash.
+  base::DeleteFile(base::FilePath(spill->index_path_), false);
+
+  return spill;
+}
+
+DiskSpill::DiskSpill(const Settings& settings,
+                     size_t asset_size,
+                     base::File file)
+    : settings_(settings),
+      asset_size_(asset_size),
+      index_path_(settings.path + kIndexSuffix),
+      file_(std::move(file)),
+      blocks_((asset_size + kBlockSize - 1) / kBlockSize, Block{0, 0, 0}),
+      slot_blocks_(std::max(settings.capacity / kBlockSize,
+                            static_cast<size_t>(1)),
+                   kNoBlock),
+      next_slot_(0),
+      stored_bytes_(0) {
+  DCHECK(blocks_.size() < kNoBlock);
+}
+
+DiskSpill::~DiskSpill() {
+  base::AutoLock lock(lock_);
+
+  if (settings_.cleanup == Cleanup::kKeep) {
+    SaveIndex();
+    return;
+  }
+
+  file_.Close();
+  base::DeleteFile(base::FilePath(settings_.path), false);
+}
+
+void DiskSpill::Write(size_t position, const uint8_t* data, size_t size) {
+  DCHECK(data);
+  DCHECK(position + size <= asset_size_);
+
+  base::AutoLock lock(lock_);
+
+  while (size != 0) {
+    size_t block_index = position / kBlockSize;
+    size_t begin = position % kBlockSize;
+    size_t count = std::min(size, kBlockSize - begin);
+    size_t end = begin + count;
+    Block& block = blocks_[block_index];
+
+    bool write = true;
+    if (block.end == 0) {
+      AllocateSlot(block_index);
+      block.begin = static_cast<uint16_t>(begin);
+      block.end = static_cast<uint16_t>(end);
+    } else if (end < block.begin || begin > block.end) {
+      // Disjoint from the stored content. Keep whichever is larger.
+      write = count > static_cast<size_t>(block.end - block.begin);
+      if (write) {
+        stored_bytes_ -= block.end - block.begin;
+        block.begin = static_cast<uint16_t>(begin);
+        block.end = static_cast<uint16_t>(end);
+      }
+    } else if (begin >= block.begin && end <= block.end) {
+      // Already stored.
+      write = false;
+    } else {
+      // Overlapping or adjacent. Extend the stored content.
+      stored_bytes_ -= block.end - block.begin;
+      block.begin = std::min(block.begin, static_cast<uint16_t>(begin));
+      block.end = std::max(block.end, static_cast<uint16_t>(end));
+    }
+
+    if (write) {
+      stored_bytes_ += block.end - block.begin;
+
+      int64_t offset = static_cast<int64_t>(block.slot) * kBlockSize + begin;
+      if (file_.Write(offset, reinterpret_cast<const char*>(data),
+                      static_cast<int>(count)) != static_cast<int>(count)) {
+        LOG(ERROR) << "failed to write spill file " << settings_.path;
+        stored_bytes_ -= block.end - block.begin;
+        slot_blocks_[block.slot] = kNoBlock;
+        block.end = 0;
+      }
+    }
+
+    position += count;
+    data += count;
+    size -= count;
+  }
+}
+
+size_t DiskSpill::Read(size_t position, uint8_t* buffer, size_t size) {
+  DCHECK(buffer);
+
+  base::AutoLock lock(lock_);
+
+  size_t bytes_read = 0;
+
+  while (size != 0 && position < asset_size_) {
+    size_t block_index = position / kBlockSize;
+    size_t offset = position % kBlockSize;
+    const Block& block = blocks_[block_index];
+
+    if (block.end == 0 || offset < block.begin || offset >= block.end) {
+      break;
+    }
+
+    size_t count = std::min(size, block.end - offset);
+    int64_t file_offset =
+        static_cast<int64_t>(block.slot) * kBlockSize + offset;
+    if (file_.Read(file_offset, reinterpret_cast<char*>(buffer),
+                   static_cast<int>(count)) != static_cast<int>(count)) {
+      LOG(ERROR) << "failed to read spill file " << settings_.path;
+      break;
+    }
+
+    position += count;
+    buffer += count;
+    size -= count;
+    bytes_read += count;
+
+    if (block.end != kBlockSize) {
+      // The rest of the block isn't stored.
+      break;
+    }
+  }
+
+  return bytes_read;
+}
+
+size_t DiskSpill::GetMissingSize(size_t position, size_t size) {
+  base::AutoLock lock(lock_);
+
+  size_t missing = 0;
+
+  while (missing < size && position < asset_size_) {
+    size_t block_index = position / kBlockSize;
+    size_t offset = position % kBlockSize;
+    size_t count = std::min(size - missing, kBlockSize - offset);
+    const Block& block = blocks_[block_index];
+
+    if (block.end != 0 && block.end > offset && block.begin < offset + count) {
+      // Stored content starts in this block.
+      return missing + (block.begin > offset ? block.begin - offset : 0);
+    }
+
+    position += count;
+    missing += count;
+  }
+
+  return std::min(missing, size);
+}
+
+size_t DiskSpill::stored_bytes() {
+  base::AutoLock lock(lock_);
+  return stored_bytes_;
+}
+
+bool DiskSpill::LoadIndex() {
+  lock_.AssertAcquired();
+
+  // Without a key, there's no telling whether the files hold this asset.
+  if (settings_.asset_key.empty()) {
+    return false;
+  }
+
+  std::string data;
+  if (!base::ReadFileToString(base::FilePath(index_path_), &data)) {
+    return false;
+  }
+
+  size_t offset = 0;
+  uint8_t signature[sizeof(kSignature)];
+  uint64_t version;
+  uint64_t key_size;
+  uint64_t asset_size;
+  uint64_t block_size;
+  uint64_t slot_count;
+  uint64_t next_slot;
+  uint64_t block_count;
+
+  if (data.size() < sizeof(kSignature)) {
+    return false;
+  }
+
+  std::memcpy(signature, data.data(), sizeof(kSignature));
+  offset += sizeof(kSignature);
+
+  if (!std::equal(std::begin(kSignature), std::end(kSignature), signature) ||
+      !ReadValue(data, &offset, &version) || version != kVersion ||
+      !ReadValue(data, &offset, &key_size) ||
+      key_size != settings_.asset_key.size() ||
+      data.compare(offset, key_size, settings_.asset_key) != 0) {
+    return false;
+  }
+
+  offset += key_size;
+
+  if (!ReadValue(data, &offset, &asset_size) || asset_size != asset_size_ ||
+      !ReadValue(data, &offset, &block_size) || block_size != kBlockSize ||
+      !ReadValue(data, &offset, &slot_count) ||
+      slot_count != slot_blocks_.size() ||
+      !ReadValue(data, &offset, &next_slot) || next_slot >= slot_count ||
+      !ReadValue(data, &offset, &block_count)) {
+    return false;
+  }
+
+  int64_t file_length = file_.GetLength();
+
+  for (uint64_t i = 0; i < block_count; ++i) {
+    uint64_t block_index;
+    Block block;
+    if (!ReadValue(data, &offset, &block_index) ||
+        !ReadValue(data, &offset, &block.slot) ||
+        !ReadValue(data, &offset, &block.begin) ||
+        !ReadValue(data, &offset, &block.end) ||
+        block_index >= blocks_.size() || blocks_[block_index].end != 0 ||
+        block.slot >= slot_count || slot_blocks_[block.slot] != kNoBlock ||
+        block.begin >= block.end || block.end > kBlockSize ||
+        static_cast<int64_t>(block.slot * kBlockSize + block.end) >
+            file_length) {
+      // Discard everything loaded so far.
+      std::fill(blocks_.begin(), blocks_.end(), Block{0, 0, 0});
+      std::fill(slot_blocks_.begin(), slot_blocks_.end(), kNoBlock);
+      stored_bytes_ = 0;
+      return false;
+    }
+
+    blocks_[block_index] = block;
+    slot_blocks_[block.slot] = static_cast<uint32_t>(block_index);
+    stored_bytes_ += block.end - block.begin;
+  }
+
+  next_slot_ = static_cast<uint32_t>(next_slot);
+
+  return true;
+}
+
+void DiskSpill::SaveIndex() {
+  lock_.AssertAcquired();
+
+  std::vector<uint8_t> data(std::begin(kSignature), std::end(kSignature));
+  AppendValue<uint64_t>(kVersion, &data);
+  AppendValue<uint64_t>(settings_.asset_key.size(), &data);
+  data.insert(data.end(), settings_.asset_key.begin(),
+              settings_.asset_key.end());
+  AppendValue<uint64_t>(asset_size_, &data);
+  AppendValue<uint64_t>(kBlockSize, &data);
+  AppendValue<uint64_t>(slot_blocks_.size(), &data);
+  AppendValue<uint64_t>(next_slot_, &data);
+
+  uint64_t block_count = 0;
+  for (uint32_t block_index : slot_blocks_) {
+    if (block_index != kNoBlock) {
+      ++block_count;
+    }
+  }
+
+  AppendValue<uint64_t>(block_count, &data);
+
+  for (uint32_t block_index : slot_blocks_) {
+    if (block_index != kNoBlock) {
+      const Block& block = blocks_[block_index];
+      AppendValue<uint64_t>(block_index, &data);
+      AppendValue<uint32_t>(block.slot, &data);
+      AppendValue<uint16_t>(block.begin, &data);
+      AppendValue<uint16_t>(block.end, &data);
+    }
+  }
+
+  int size = static_cast<int>(data.size());
+  if (base::WriteFile(base::FilePath(index_path_),
+                      reinterpret_cast<const char*>(data.data()),
+                      size) != size) {
+    LOG(ERROR) << "failed to write spill index " << index_path_;
+  }
+}
+
+void DiskSpill::AllocateSlot(size_t block_index) {
+  lock_.AssertAcquired();
+
+  uint32_t slot = next_slot_;
+  next_slot_ = (next_slot_ + 1) % slot_blocks_.size();
+
+  uint32_t evicted_index = slot_blocks_[slot];
+  if (evicted_index != kNoBlock) {
+    Block& evicted = blocks_[evicted_index];
+    stored_bytes_ -= evicted.end - evicted.begin;
+    evicted.end = 0;
+  }
+
+  slot_blocks_[slot] = static_cast<uint32_t>(block_index);
+  blocks_[block_index].slot = slot;
+}
+
+}  // namespace media
+}  // namespace mojo
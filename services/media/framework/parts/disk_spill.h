@@ -0,0 +1,122 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_PARTS_DISK_SPILL_H_
+#define SERVICES_MEDIA_FRAMEWORK_PARTS_DISK_SPILL_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file.h"
+#include "base/synchronization/lock.h"
+
+namespace mojo {
+namespace media {
+
+// On-disk store for content of an asset, used by ReaderCache as a second tier
+// for regions evicted from memory.
+//
+// Content is stored in fixed-size blocks aligned to the asset. Each block of
+// the asset may occupy a slot in a data file, and the part of the block that's
+// valid is recorded in a block table. The number of slots is limited by the
+// capacity, and when all slots are in use, the slot that was filled longest
+// ago is reused. If the DiskSpill is kept when it's deleted, the block table
+// is written to an index file, and a DiskSpill created later for the same
+// path, asset key and asset size picks up where this one left off.
+//
+// DiskSpill is thread-safe. Its methods perform blocking file IO.
+class DiskSpill {
+ public:
+  // What happens to the data and index files when the DiskSpill is deleted.
+  enum class Cleanup {
+    // The files are deleted.
+    kDelete,
+    // The files are kept for use by a later DiskSpill.
+    kKeep
+  };
+
+  // Describes the disk tier of a ReaderCache.
+  struct Settings {
+    Settings();
+
+    // Path of the data file. The index file has the same path with ".index"
+    // appended. If empty, there's no disk tier.
+    std::string path;
+    // Maximum bytes of content stored in the data file.
+    size_t capacity;
+    Cleanup cleanup;
+    // Identifies the content of the asset, for example by its URL and ETag.
+    // Kept files are reused only for the same non-empty key.
+    std::string asset_key;
+  };
+
+  // Size of the blocks in which content is stored.
+  static constexpr size_t kBlockSize = 16 * 1024;
+
+  // Creates a DiskSpill for an asset of size asset_size. Returns nullptr if
+  // the data file can't be opened.
+  static std::unique_ptr<DiskSpill> Create(const Settings& settings,
+                                           size_t asset_size);
+
+  ~DiskSpill();
+
+  // Stores content at the indicated position in the asset. Content in blocks
+  // that are only partially covered is kept if it extends content already
+  // stored for the block or if there's none.
+  void Write(size_t position, const uint8_t* data, size_t size);
+
+  // Reads content starting at the indicated position, up to the first byte
+  // that isn't stored. Returns the number of bytes read.
+  size_t Read(size_t position, uint8_t* buffer, size_t size);
+
+  // Returns the number of bytes starting at position, up to size, that
+  // precede the first stored byte.
+  size_t GetMissingSize(size_t position, size_t size);
+
+  // Returns the number of bytes of content stored.
+  size_t stored_bytes();
+
+ private:
+  // An asset block. The valid part of the block is [begin, end), and end is
+  // zero if the block isn't stored.
+  struct Block {
+    uint32_t slot;
+    uint16_t begin;
+    uint16_t end;
+  };
+
+  DiskSpill(const Settings& settings, size_t asset_size, base::File file);
+
+  // Loads the block table from the index file, if it matches this spill.
+  // Returns false if it doesn't.
+  bool LoadIndex();
+
+  // Writes the block table to the index file.
+  void SaveIndex();
+
+  // Assigns a slot to the indicated block, evicting the block that occupies
+  // the slot, if any.
+  void AllocateSlot(size_t block_index);
+
+  Settings settings_;
+  size_t asset_size_;
+  std::string index_path_;
+
+  base::Lock lock_;
+  // The following fields are protected by lock_.
+  base::File file_;
+  std::vector<Block> blocks_;
+  // Block index by slot, or a value greater than any block index if the slot
+  // is unused.
+  std::vector<uint32_t> slot_blocks_;
+  // Slot to use next. Slots are used in rotation.
+  uint32_t next_slot_;
+  size_t stored_bytes_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_PARTS_DISK_SPILL_H_
@@ -0,0 +1,91 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "services/media/framework/parts/file_reader.h"
+
+namespace mojo {
+namespace media {
+
+// static
+std::shared_ptr<Reader> FileReader::Create(const std::string& path) {
+  return std::shared_ptr<Reader>(new FileReader(path));
+}
+
+FileReader::FileReader(const std::string& path)
+    : mapped_file_(std::make_shared<base::MemoryMappedFile>()) {
+  if (!mapped_file_->Initialize(base::FilePath(path))) {
+    LOG(ERROR) << "failed to map file " << path;
+    result_ = Result::kNotFound;
+  }
+}
+
+FileReader::~FileReader() {}
+
+void FileReader::Describe(const DescribeCallback& callback) {
+  callback(result_,
+           result_ == Result::kOk ? mapped_file_->length() : kUnknownSize,
+           true);
+}
+
+void FileReader::ReadAt(size_t position,
+                        uint8_t* buffer,
+                        size_t bytes_to_read,
+                        const ReadAtCallback& callback) {
+  DCHECK(buffer);
+  DCHECK(bytes_to_read);
+
+  size_t size;
+  Result result = PrepareRead(position, bytes_to_read, &size);
+  if (result != Result::kOk) {
+    callback(result, 0);
+    return;
+  }
+
+  std::memcpy(buffer, mapped_file_->data() + position, size);
+  callback(Result::kOk, size);
+}
+
+void FileReader::ViewAt(size_t position,
+                        size_t max_bytes,
+                        const ViewAtCallback& callback) {
+  DCHECK(max_bytes);
+
+  size_t size;
+  Result result = PrepareRead(position, max_bytes, &size);
+  if (result != Result::kOk) {
+    callback(result, nullptr, 0);
+    return;
+  }
+
+  callback(Result::kOk,
+           std::shared_ptr<const uint8_t>(mapped_file_,
+                                          mapped_file_->data() + position),
+           size);
+}
+
+Result FileReader::PrepareRead(size_t position,
+                               size_t bytes_to_read,
+                               size_t* size_out) {
+  DCHECK(size_out);
+
+  if (result_ != Result::kOk) {
+    return result_;
+  }
+
+  size_t length = mapped_file_->length();
+  if (position >= length) {
+    return Result::kInvalidArgument;
+  }
+
+  *size_out = std::min(bytes_to_read, length - position);
+  return Result::kOk;
+}
+
+}  // namespace media
+}  // namespace mojo
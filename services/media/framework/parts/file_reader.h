@@ -0,0 +1,57 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_PARTS_FILE_READER_H_
+#define SERVICES_MEDIA_FRAMEWORK_PARTS_FILE_READER_H_
+
+#include <memory>
+#include <string>
+
+#include "base/files/memory_mapped_file.h"
+#include "services/media/framework/parts/reader.h"
+
+namespace mojo {
+namespace media {
+
+// Reads raw data from a local file.
+//
+// The file is mapped into memory. ReadAt copies from the mapping, and ViewAt
+// lends out mapped pages without copying them. Views keep the mapping alive,
+// so they remain valid after the reader is deleted. Calls complete
+// synchronously.
+class FileReader : public Reader {
+ public:
+  // Creates a FileReader for the file at path. If the file can't be mapped,
+  // Describe and all reads fail with Result::kNotFound.
+  static std::shared_ptr<Reader> Create(const std::string& path);
+
+  ~FileReader() override;
+
+  // Reader implementation.
+  void Describe(const DescribeCallback& callback) override;
+
+  void ReadAt(size_t position,
+              uint8_t* buffer,
+              size_t bytes_to_read,
+              const ReadAtCallback& callback) override;
+
+  void ViewAt(size_t position,
+              size_t max_bytes,
+              const ViewAtCallback& callback) override;
+
+ private:
+  FileReader(const std::string& path);
+
+  // Checks a read of bytes_to_read bytes at position, returning the number of
+  // bytes that can be read via size_out.
+  Result PrepareRead(size_t position, size_t bytes_to_read, size_t* size_out);
+
+  Result result_ = Result::kOk;
+  std::shared_ptr<base::MemoryMappedFile> mapped_file_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_PARTS_FILE_READER_H_
@@ -2,8 +2,11 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <cstring>
+
 #include "base/logging.h"
 #include "services/media/framework/parts/lpcm_reformatter.h"
+#include "services/media/framework/parts/transform_pipeline.h"
 
 namespace mojo {
 namespace media {
@@ -24,108 +27,118 @@ class LpcmReformatterImpl : public LpcmReformatter {
                        PayloadAllocator* allocator,
                        PacketPtr* output) override;
 
+  bool passes_payloads_through() const override;
+
+  void TransformPacketInPlace(Packet* packet) override;
+
  private:
   AudioStreamType in_type_;
   AudioStreamType out_type_;
 };
 
-std::shared_ptr<LpcmReformatter> LpcmReformatter::Create(
-    const AudioStreamType& in_type,
-    const AudioStreamTypeSet& out_type) {
-  LpcmReformatter* result = nullptr;
+namespace {
 
+// Returns factory.Create<TIn, TOut>(), where TOut is the sample type for
+// out_type.
+template <typename Result, typename TIn, typename Factory>
+std::shared_ptr<Result> CreateForOutSampleFormat(
+    const AudioStreamTypeSet& out_type,
+    const Factory& factory) {
+  switch (out_type.sample_format()) {
+    case AudioStreamType::SampleFormat::kUnsigned8:
+      return factory.template Create<TIn, uint8_t>();
+    case AudioStreamType::SampleFormat::kSigned16:
+      return factory.template Create<TIn, int16_t>();
+    case AudioStreamType::SampleFormat::kSigned24In32:
+      return factory.template Create<TIn, int32_t>();
+    case AudioStreamType::SampleFormat::kFloat:
+      return factory.template Create<TIn, float>();
+    case AudioStreamType::SampleFormat::kAny:
+      return factory.template Create<TIn, TIn>();
+    default:
+      NOTREACHED() << "unsupported sample format";
+      return nullptr;
+  }
+}
+
+// Returns factory.Create<TIn, TOut>(), where TIn and TOut are the sample types
+// for in_type and out_type, respectively.
+template <typename Result, typename Factory>
+std::shared_ptr<Result> CreateForSampleFormats(
+    const AudioStreamType& in_type,
+    const AudioStreamTypeSet& out_type,
+    const Factory& factory) {
   switch (in_type.sample_format()) {
     case AudioStreamType::SampleFormat::kUnsigned8:
-      switch (out_type.sample_format()) {
-        case AudioStreamType::SampleFormat::kUnsigned8:
-        case AudioStreamType::SampleFormat::kAny:
-          result = new LpcmReformatterImpl<uint8_t, uint8_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned16:
-          result = new LpcmReformatterImpl<uint8_t, int16_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned24In32:
-          result = new LpcmReformatterImpl<uint8_t, int32_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kFloat:
-          result = new LpcmReformatterImpl<uint8_t, float>(in_type, out_type);
-          break;
-        default:
-          NOTREACHED() << "unsupported sample format";
-          result = nullptr;
-          break;
-      }
-      break;
+      return CreateForOutSampleFormat<Result, uint8_t>(out_type, factory);
     case AudioStreamType::SampleFormat::kSigned16:
-      switch (out_type.sample_format()) {
-        case AudioStreamType::SampleFormat::kUnsigned8:
-          result = new LpcmReformatterImpl<int16_t, uint8_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned16:
-        case AudioStreamType::SampleFormat::kAny:
-          result = new LpcmReformatterImpl<int16_t, int16_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned24In32:
-          result = new LpcmReformatterImpl<int16_t, int32_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kFloat:
-          result = new LpcmReformatterImpl<int16_t, float>(in_type, out_type);
-          break;
-        default:
-          NOTREACHED() << "unsupported sample format";
-          result = nullptr;
-          break;
-      }
-      break;
+      return CreateForOutSampleFormat<Result, int16_t>(out_type, factory);
     case AudioStreamType::SampleFormat::kSigned24In32:
-      switch (out_type.sample_format()) {
-        case AudioStreamType::SampleFormat::kUnsigned8:
-          result = new LpcmReformatterImpl<int32_t, uint8_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned16:
-          result = new LpcmReformatterImpl<int32_t, int16_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned24In32:
-        case AudioStreamType::SampleFormat::kAny:
-          result = new LpcmReformatterImpl<int32_t, int32_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kFloat:
-          result = new LpcmReformatterImpl<int32_t, float>(in_type, out_type);
-          break;
-        default:
-          NOTREACHED() << "unsupported sample format";
-          result = nullptr;
-          break;
-      }
-      break;
+      return CreateForOutSampleFormat<Result, int32_t>(out_type, factory);
     case AudioStreamType::SampleFormat::kFloat:
-      switch (out_type.sample_format()) {
-        case AudioStreamType::SampleFormat::kUnsigned8:
-          result = new LpcmReformatterImpl<float, uint8_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned16:
-          result = new LpcmReformatterImpl<float, int16_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kSigned24In32:
-          result = new LpcmReformatterImpl<float, int32_t>(in_type, out_type);
-          break;
-        case AudioStreamType::SampleFormat::kFloat:
-        case AudioStreamType::SampleFormat::kAny:
-          result = new LpcmReformatterImpl<float, float>(in_type, out_type);
-          break;
-        default:
-          NOTREACHED() << "unsupported sample format";
-          result = nullptr;
-          break;
-      }
-      break;
+      return CreateForOutSampleFormat<Result, float>(out_type, factory);
     default:
       NOTREACHED() << "unsupported sample format";
-      result = nullptr;
-      break;
+      return nullptr;
+  }
+}
+
+// Creates reformatters.
+class ReformatterFactory {
+ public:
+  ReformatterFactory(const AudioStreamType& in_type,
+                     const AudioStreamTypeSet& out_type)
+      : in_type_(in_type), out_type_(out_type) {}
+
+  template <typename TIn, typename TOut>
+  std::shared_ptr<LpcmReformatter> Create() const {
+    return std::make_shared<LpcmReformatterImpl<TIn, TOut>>(in_type_,
+                                                            out_type_);
+  }
+
+ private:
+  const AudioStreamType& in_type_;
+  const AudioStreamTypeSet& out_type_;
+};
+
+// Creates pipelines consisting of an upstream transform and a reformatter.
+class FusedReformatterFactory {
+ public:
+  FusedReformatterFactory(std::shared_ptr<Transform> upstream,
+                          const AudioStreamType& in_type,
+                          const AudioStreamTypeSet& out_type)
+      : upstream_(upstream), in_type_(in_type), out_type_(out_type) {}
+
+  template <typename TIn, typename TOut>
+  std::shared_ptr<Transform> Create() const {
+    return std::make_shared<
+        TransformPipeline<DynamicTransform, LpcmReformatterImpl<TIn, TOut>>>(
+        DynamicTransform(upstream_),
+        LpcmReformatterImpl<TIn, TOut>(in_type_, out_type_));
   }
 
-  return std::shared_ptr<LpcmReformatter>(result);
+ private:
+  std::shared_ptr<Transform> upstream_;
+  const AudioStreamType& in_type_;
+  const AudioStreamTypeSet& out_type_;
+};
+
+}  // namespace
+
+std::shared_ptr<LpcmReformatter> LpcmReformatter::Create(
+    const AudioStreamType& in_type,
+    const AudioStreamTypeSet& out_type) {
+  return CreateForSampleFormats<LpcmReformatter>(
+      in_type, out_type, ReformatterFactory(in_type, out_type));
+}
+
+std::shared_ptr<Transform> LpcmReformatter::CreateFused(
+    std::shared_ptr<Transform> upstream,
+    const AudioStreamType& in_type,
+    const AudioStreamTypeSet& out_type) {
+  DCHECK(upstream);
+  return CreateForSampleFormats<Transform>(
+      in_type, out_type, FusedReformatterFactory(upstream, in_type, out_type));
 }
 
 template <typename TIn, typename TOut>
@@ -273,5 +286,29 @@ bool LpcmReformatterImpl<TIn, TOut>::TransformPacket(
   return true;
 }
 
+template <typename TIn, typename TOut>
+bool LpcmReformatterImpl<TIn, TOut>::passes_payloads_through() const {
+  // Samples of the same size can be converted in place.
+  return sizeof(TIn) == sizeof(TOut);
+}
+
+template <typename TIn, typename TOut>
+void LpcmReformatterImpl<TIn, TOut>::TransformPacketInPlace(Packet* packet) {
+  DCHECK(packet);
+  DCHECK_EQ(sizeof(TIn), sizeof(TOut));
+
+  size_t sample_count =
+      in_type_.frame_count(packet->size()) * in_type_.channels();
+  uint8_t* sample = static_cast<uint8_t*>(packet->payload());
+
+  for (size_t i = 0; i < sample_count; ++i, sample += sizeof(TIn)) {
+    TIn in_sample;
+    TOut out_sample;
+    std::memcpy(&in_sample, sample, sizeof(TIn));
+    CopySample(&out_sample, &in_sample);
+    std::memcpy(sample, &out_sample, sizeof(TOut));
+  }
+}
+
 }  // namespace media
 }  // namespace mojo
@@ -18,6 +18,15 @@ class LpcmReformatter : public Transform {
   static std::shared_ptr<LpcmReformatter> Create(
       const AudioStreamType& in_type,
       const AudioStreamTypeSet& out_type);
+
+  // Creates a transform that runs upstream followed by a reformatter. The
+  // reformatter is called directly rather than through the Transform
+  // interface, and no packet hop is required between the two. in_type is the
+  // type upstream produces.
+  static std::shared_ptr<Transform> CreateFused(
+      std::shared_ptr<Transform> upstream,
+      const AudioStreamType& in_type,
+      const AudioStreamTypeSet& out_type);
 };
 
 }  // namespace media
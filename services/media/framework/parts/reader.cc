@@ -0,0 +1,35 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <vector>
+
+#include "base/logging.h"
+#include "services/media/framework/parts/reader.h"
+
+namespace mojo {
+namespace media {
+
+void Reader::ViewAt(size_t position,
+                    size_t max_bytes,
+                    const ViewAtCallback& callback) {
+  DCHECK(max_bytes > 0);
+
+  std::shared_ptr<std::vector<uint8_t>> buffer =
+      std::make_shared<std::vector<uint8_t>>(max_bytes);
+
+  ReadAt(position, buffer->data(), max_bytes,
+         [buffer, callback](Result result, size_t bytes_read) {
+           if (result != Result::kOk) {
+             callback(result, nullptr, 0);
+             return;
+           }
+
+           callback(result,
+                    std::shared_ptr<const uint8_t>(buffer, buffer->data()),
+                    bytes_read);
+         });
+}
+
+}  // namespace media
+}  // namespace mojo
@@ -20,6 +20,8 @@ class Reader {
   using DescribeCallback =
       std::function<void(Result result, size_t size, bool can_seek)>;
   using ReadAtCallback = std::function<void(Result result, size_t bytes_read)>;
+  using ViewAtCallback = std::function<
+      void(Result result, std::shared_ptr<const uint8_t> data, size_t size)>;
 
   static constexpr size_t kUnknownSize = std::numeric_limits<size_t>::max();
 
@@ -37,6 +39,18 @@ class Reader {
                       uint8_t* buffer,
                       size_t bytes_to_read,
                       const ReadAtCallback& callback) = 0;
+
+  // Lends out up to max_bytes of content from the specified position without
+  // copying it, if the reader holds the content in memory (a cached region or
+  // a mapped file, for example). Returns a result, the content and its size
+  // via the callback. data shares ownership of the memory holding the
+  // content, which remains valid and unchanged as long as references to data
+  // exist. The size may be less than max_bytes even if the end of the content
+  // hasn't been reached, so callers that need more call ViewAt again. The
+  // default implementation reads into a new buffer using ReadAt.
+  virtual void ViewAt(size_t position,
+                      size_t max_bytes,
+                      const ViewAtCallback& callback);
 };
 
 }  // namespace media
@@ -2,33 +2,95 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
 #include "base/logging.h"
 #include "services/media/framework/parts/reader_cache.h"
 
 namespace mojo {
 namespace media {
 
+namespace {
+
+// Maximum number of reads outstanding to the upstream reader at one time.
+const size_t kMaxIntakeReads = 4;
+
+// Limits on the size of the read-ahead window. The window starts at the
+// minimum and returns to it when a read request seeks outside the window.
+// Neither limit exceeds half the cache's capacity.
+const size_t kMinReadAheadWindow = 128 * 1024;
+const size_t kMaxReadAheadWindow = 16 * 1024 * 1024;
+
+// Number of recent seek positions whose content is kept in preference to
+// other content. Each seek position keeps the minimum read-ahead window.
+const size_t kMaxRecentSeeks = 4;
+
+// The cache's capacity divided by this value is the amount of content behind
+// the playhead that's kept in preference to other content.
+const size_t kKeepBehindDivisor = 8;
+
+// How much content the read-ahead window should hold, expressed as a time at
+// the observed consumption rate.
+const int64_t kReadAheadDurationMs = 2000;
+
+// Minimum time over which rates are measured before they're used.
+const int64_t kMinRateMeasurementTimeMs = 100;
+
+}  // namespace
+
 // static
 std::shared_ptr<ReaderCache> ReaderCache::Create(
     std::shared_ptr<Reader> upstream_reader) {
-  return std::shared_ptr<ReaderCache>(new ReaderCache(upstream_reader));
+  return Create(upstream_reader, kDefaultCapacity);
+}
+
+// static
+std::shared_ptr<ReaderCache> ReaderCache::Create(
+    std::shared_ptr<Reader> upstream_reader,
+    size_t capacity) {
+  return Create(upstream_reader, capacity, DiskSpill::Settings());
 }
 
-ReaderCache::ReaderCache(std::shared_ptr<Reader> upstream_reader) {
+// static
+std::shared_ptr<ReaderCache> ReaderCache::Create(
+    std::shared_ptr<Reader> upstream_reader,
+    size_t capacity,
+    const DiskSpill::Settings& spill_settings) {
+  return std::shared_ptr<ReaderCache>(
+      new ReaderCache(upstream_reader, capacity, spill_settings));
+}
+
+ReaderCache::ReaderCache(std::shared_ptr<Reader> upstream_reader,
+                         size_t capacity,
+                         const DiskSpill::Settings& spill_settings)
+    : store_(capacity, spill_settings) {
+  if (!spill_settings.path.empty()) {
+    // Not the default scheduler: its capped blocking threads may all be taken
+    // by consumers waiting for this cache to deliver content.
+    spill_sequence_.reset(new Scheduler::Sequence(Scheduler::Create(1, 1)));
+  }
+
   upstream_reader->Describe(
       [this, upstream_reader](Result result, size_t size, bool can_seek) {
-        store_.Initialize(result, size, can_seek);
-
-        describe_is_complete_.Occur();
+        store_.Initialize(result, size, can_seek, spill_sequence_.get());
 
         if (result == Result::kOk) {
           intake_.Start(&store_, upstream_reader);
         }
+
+        // Intake must be started before pending read requests are added.
+        describe_is_complete_.Occur();
       });
 }
 
 ReaderCache::~ReaderCache() {}
 
+ReaderCache::Counters ReaderCache::GetCounters() {
+  return store_.GetCounters();
+}
+
 void ReaderCache::Describe(const DescribeCallback& callback) {
   describe_is_complete_.When([this, callback]() { store_.Describe(callback); });
 }
@@ -40,60 +102,157 @@ void ReaderCache::ReadAt(size_t position,
   DCHECK(buffer);
   DCHECK(bytes_to_read > 0);
 
-  read_at_request_.Start(position, buffer, bytes_to_read, callback);
+  std::shared_ptr<ReadAtRequest> request = std::make_shared<ReadAtRequest>(
+      position, buffer, bytes_to_read, callback);
+
+  describe_is_complete_.When([this, request]() {
+    if (store_.AddReadAtRequest(request)) {
+      intake_.Continue();
+    }
+  });
+}
+
+void ReaderCache::ViewAt(size_t position,
+                         size_t max_bytes,
+                         const ViewAtCallback& callback) {
+  DCHECK(max_bytes > 0);
+
+  std::shared_ptr<ReadAtRequest> request =
+      std::make_shared<ReadAtRequest>(position, max_bytes, callback);
 
-  describe_is_complete_.When(
-      [this]() { store_.SetReadAtRequest(&read_at_request_); });
+  describe_is_complete_.When([this, request]() {
+    if (store_.AddReadAtRequest(request)) {
+      intake_.Continue();
+    }
+  });
 }
 
-ReaderCache::ReadAtRequest::ReadAtRequest() {
-  in_progress_ = false;
+ReaderCache::Counters::Counters()
+    : requests(0),
+      hits(0),
+      upstream_reads(0),
+      upstream_bytes(0),
+      read_ahead_window(0),
+      cached_bytes(0),
+      evicted_bytes(0),
+      spilled_bytes(0),
+      spill_bytes_read(0) {}
+
+double ReaderCache::Counters::hit_ratio() const {
+  return requests == 0 ? 0.0 : static_cast<double>(hits) / requests;
 }
 
+ReaderCache::ReadAtRequest::ReadAtRequest(size_t position,
+                                          uint8_t* buffer,
+                                          size_t bytes_to_read,
+                                          const ReadAtCallback& callback)
+    : position_(position),
+      buffer_(buffer),
+      bytes_read_(0),
+      remaining_bytes_to_read_(bytes_to_read),
+      callback_(callback) {
+  DCHECK(buffer);
+}
+
+ReaderCache::ReadAtRequest::ReadAtRequest(size_t position,
+                                          size_t max_bytes,
+                                          const ViewAtCallback& callback)
+    : position_(position),
+      buffer_(nullptr),
+      bytes_read_(0),
+      remaining_bytes_to_read_(max_bytes),
+      view_callback_(callback) {}
+
 ReaderCache::ReadAtRequest::~ReadAtRequest() {}
 
-void ReaderCache::ReadAtRequest::Start(size_t position,
-                                       uint8_t* buffer,
-                                       size_t bytes_to_read,
-                                       const ReadAtCallback& callback) {
-  DCHECK(!in_progress_) << "concurrent calls to ReadAt are not allowed";
-  in_progress_ = true;
-  position_ = position;
-  buffer_ = buffer;
-  original_bytes_to_read_ = bytes_to_read;
-  remaining_bytes_to_read_ = bytes_to_read;
-  callback_ = callback;
+void ReaderCache::ReadAtRequest::LimitTo(size_t end) {
+  DCHECK(position_ < end);
+  if (position_ + remaining_bytes_to_read_ > end) {
+    remaining_bytes_to_read_ = end - position_;
+  }
 }
 
 void ReaderCache::ReadAtRequest::CopyFrom(uint8_t* source, size_t byte_count) {
   DCHECK(source);
+  DCHECK(!is_view());
   DCHECK(byte_count <= remaining_bytes_to_read_);
 
   std::memcpy(buffer_, source, byte_count);
 
   position_ += byte_count;
   buffer_ += byte_count;
+  bytes_read_ += byte_count;
   remaining_bytes_to_read_ -= byte_count;
 }
 
+void ReaderCache::ReadAtRequest::ShareFrom(std::shared_ptr<const uint8_t> data,
+                                           size_t byte_count) {
+  DCHECK(data);
+  DCHECK(is_view());
+  DCHECK(bytes_read_ == 0);
+  DCHECK(byte_count <= remaining_bytes_to_read_);
+
+  view_data_ = data;
+
+  position_ += byte_count;
+  bytes_read_ = byte_count;
+  remaining_bytes_to_read_ = 0;
+}
+
 void ReaderCache::ReadAtRequest::Complete(Result result) {
-  DCHECK(original_bytes_to_read_ >= remaining_bytes_to_read_);
-  size_t bytes_read = original_bytes_to_read_ - remaining_bytes_to_read_;
+  // A short read is successful.
+  if (bytes_read_ != 0) {
+    result = Result::kOk;
+  }
 
   // If we've read 0 bytes, something must be wrong.
-  DCHECK((bytes_read == 0) == (result != Result::kOk));
+  DCHECK((bytes_read_ == 0) == (result != Result::kOk));
+
+  if (is_view()) {
+    ViewAtCallback callback;
+    view_callback_.swap(callback);
+    std::shared_ptr<const uint8_t> data;
+    view_data_.swap(data);
+    callback(result, data, bytes_read_);
+    return;
+  }
 
   ReadAtCallback callback;
   callback_.swap(callback);
-  in_progress_ = false;
-  callback(result, bytes_read);
+  callback(result, bytes_read_);
 }
 
-ReaderCache::Store::Store() {}
+ReaderCache::Store::Store(size_t capacity,
+                          const DiskSpill::Settings& spill_settings)
+    : capacity_(capacity),
+      spill_settings_(spill_settings),
+      max_read_ahead_window_(
+          std::max(std::min(kMaxReadAheadWindow, capacity / 2),
+                   static_cast<size_t>(kDefaultReadSize))),
+      min_read_ahead_window_(
+          std::min(kMinReadAheadWindow, max_read_ahead_window_)),
+      read_ahead_window_(min_read_ahead_window_) {
+  DCHECK(capacity > 0);
+}
 
-ReaderCache::Store::~Store() {}
+ReaderCache::Store::~Store() {
+  if (!spill_ || spill_settings_.cleanup != DiskSpill::Cleanup::kKeep) {
+    return;
+  }
+
+  // Spill what's cached in memory so it's available to later sessions.
+  base::AutoLock lock(lock_);
+  for (SparseByteBuffer::Region region = sparse_byte_buffer_.first_region();
+       region != sparse_byte_buffer_.null_region();
+       region = sparse_byte_buffer_.NextRegion(region)) {
+    spill_->Write(region.position(), region.data(), region.size());
+  }
+}
 
-void ReaderCache::Store::Initialize(Result result, size_t size, bool can_seek) {
+void ReaderCache::Store::Initialize(Result result,
+                                    size_t size,
+                                    bool can_seek,
+                                    Scheduler::Sequence* spill_sequence) {
   base::AutoLock lock(lock_);
 
   result_ = result;
@@ -102,9 +261,16 @@ void ReaderCache::Store::Initialize(Result result, size_t size, bool can_seek) {
 
   // Create one hole spanning the entire asset.
   sparse_byte_buffer_.Initialize(size_);
-  intake_hole_ = sparse_byte_buffer_.FindHoleContaining(0);
-  read_hole_ = sparse_byte_buffer_.null_hole();
-  read_region_ = sparse_byte_buffer_.null_region();
+  consumption_start_time_ = base::TimeTicks::Now();
+
+  // Content from the spill would leave a gap in the sequence of upstream reads
+  // if the upstream reader can't seek.
+  if (result_ == Result::kOk && size_ != kUnknownSize && size_ != 0 &&
+      can_seek_ && !spill_settings_.path.empty()) {
+    DCHECK(spill_sequence);
+    spill_ = DiskSpill::Create(spill_settings_, size_);
+    spill_sequence_ = spill_sequence;
+  }
 }
 
 void ReaderCache::Store::Describe(const DescribeCallback& callback) {
@@ -118,22 +284,68 @@ void ReaderCache::Store::Describe(const DescribeCallback& callback) {
   callback(result, size_, can_seek_);
 }
 
-void ReaderCache::Store::SetReadAtRequest(ReadAtRequest* request) {
-  base::AutoLock lock(lock_);
+bool ReaderCache::Store::AddReadAtRequest(
+    std::shared_ptr<ReadAtRequest> request) {
+  std::vector<std::shared_ptr<ReadAtRequest>> completed;
+  Result result;
+  bool continue_intake;
+
+  {
+    base::AutoLock lock(lock_);
+
+    DCHECK(request->position() < size_);
+    DCHECK(request->remaining_bytes_to_read() > 0);
+
+    request->LimitTo(size_);
+
+    base::TimeTicks now = base::TimeTicks::Now();
+    size_t position = request->position();
+
+    // A request is a seek if it starts outside the read-ahead window.
+    bool seek = position + read_ahead_window_ < read_ahead_position_ ||
+                position > read_ahead_position_ + read_ahead_window_;
+    if (seek) {
+      read_ahead_window_ = min_read_ahead_window_;
+      consumption_start_time_ = now;
+      consumption_start_position_ = position;
+
+      seek_positions_.push_back(position);
+      if (seek_positions_.size() > kMaxRecentSeeks) {
+        seek_positions_.pop_front();
+      }
+    }
+
+    read_ahead_position_ = position + request->remaining_bytes_to_read();
+
+    requests_.push_back(request);
+    ServeRequests(&completed);
+
+    if (completed.empty() || completed.back() != request) {
+      // The request has to wait for intake.
+      request->set_stall_start_time(now);
+      if (!seek) {
+        // Intake isn't keeping up with sequential consumption.
+        read_ahead_window_ =
+            std::min(read_ahead_window_ * 2, max_read_ahead_window_);
+      }
+    } else if (result_ == Result::kOk) {
+      ++counters_.hits;
+    }
 
-  DCHECK(read_request_ == nullptr);
-  DCHECK(request->position() < size_);
-  DCHECK(request->remaining_bytes_to_read() > 0);
+    counters_.requests += completed.size();
+    for (const std::shared_ptr<ReadAtRequest>& done : completed) {
+      RecordStall(done.get(), now);
+    }
 
-  read_request_ = request;
-  read_request_position_ = request->position();
-  read_request_remaining_bytes_ = request->remaining_bytes_to_read();
+    UpdateReadAheadWindow(now);
 
-  if (read_request_position_ + read_request_remaining_bytes_ > size_) {
-    read_request_remaining_bytes_ = size_ - read_request_position_;
+    result = result_;
+    continue_intake = result_ == Result::kOk;
   }
 
-  ServeRequest();
+  CompleteRequests(completed, result);
+
+  return continue_intake;
 }
 
 size_t ReaderCache::Store::GetIntakePositionAndSize(size_t* size_out) {
@@ -141,108 +353,508 @@ size_t ReaderCache::Store::GetIntakePositionAndSize(size_t* size_out) {
 
   base::AutoLock lock(lock_);
 
-  size_t size = kDefaultReadSize;
-
-  if (read_hole_ != sparse_byte_buffer_.null_hole()) {
-    // To serve the read request, we need to intake starting at the beginning
-    // of read_hole_;
-    DCHECK(read_request_);
-    intake_hole_ = read_hole_;
-    read_hole_ = sparse_byte_buffer_.null_hole();
-    size = read_request_remaining_bytes_;
-  } else if (intake_hole_ == sparse_byte_buffer_.null_hole()) {
-    *size_out = 0;
+  *size_out = 0;
+
+  // Only one read at a time if the upstream reader can't seek.
+  if (result_ != Result::kOk ||
+      intake_reads_.size() >= (can_seek_ ? kMaxIntakeReads : 1)) {
     return kUnknownSize;
   }
 
-  if (size > intake_hole_.size()) {
-    size = intake_hole_.size();
+  size_t size;
+  size_t position = kUnknownSize;
+
+  if (!can_seek_) {
+    // The upstream reader can only continue from where it left off.
+    size = GetSequentialIntakeSize();
+    if (size == 0) {
+      return kUnknownSize;
+    }
+
+    position = upstream_position_;
+  } else {
+    // Serve pending requests first, oldest first.
+    for (const std::shared_ptr<ReadAtRequest>& request : requests_) {
+      size_t request_end =
+          request->position() + request->remaining_bytes_to_read();
+      position = FindIntakeGap(request->position(), request_end, &size);
+      if (position != kUnknownSize) {
+        // Read at least as much as we would when reading ahead.
+        size_t read_size = std::max(request_end - position,
+                                    static_cast<size_t>(kDefaultReadSize));
+        size_t gap_end = std::min(size_, position + read_size);
+        FindIntakeGap(position, gap_end, &size);
+        break;
+      }
+    }
+
+    if (position == kUnknownSize) {
+      // Read ahead. Reads are sized so the window can be filled by the maximum
+      // number of concurrent reads.
+      size_t window_end =
+          std::min(size_, read_ahead_position_ + read_ahead_window_);
+      position = FindIntakeGap(read_ahead_position_, window_end, &size);
+      if (position == kUnknownSize) {
+        return kUnknownSize;
+      }
+
+      size = std::min(size, std::max(read_ahead_window_ / kMaxIntakeReads,
+                                     static_cast<size_t>(kDefaultReadSize)));
+    }
+  }
+
+  DCHECK(size > 0);
+
+  base::TimeTicks now = base::TimeTicks::Now();
+  if (intake_reads_.empty()) {
+    intake_busy_start_time_ = now;
   }
 
+  intake_reads_[position] = IntakeRead{size, now};
+
   *size_out = size;
 
-  return intake_hole_.position();
+  return position;
+}
+
+bool ReaderCache::Store::IntakeFromSpill(size_t position,
+                                         size_t* size_in_out) {
+  DCHECK(size_in_out);
+  DCHECK(*size_in_out > 0);
+  DCHECK(spill_);
+  DCHECK(spill_sequence_->RunsTasksOnCurrentThread());
+
+  std::vector<uint8_t> buffer(*size_in_out);
+  size_t bytes_read = spill_->Read(position, buffer.data(), buffer.size());
+  if (bytes_read == 0) {
+    // Don't read spilled content from upstream. If content was spilled at
+    // position since the read attempt, the size is left alone.
+    size_t missing_size = spill_->GetMissingSize(position, *size_in_out);
+    if (missing_size != 0 && missing_size != *size_in_out) {
+      *size_in_out = missing_size;
+
+      // Let intake read the spilled content while the upstream read is
+      // outstanding.
+      base::AutoLock lock(lock_);
+      auto iter = intake_reads_.find(position);
+      DCHECK(iter != intake_reads_.end());
+      iter->second.size = missing_size;
+    }
+
+    return false;
+  }
+
+  buffer.resize(bytes_read);
+  PutBuffer(position, std::move(buffer), true);
+  return true;
 }
 
 void ReaderCache::Store::PutIntakeBuffer(size_t position,
                                          std::vector<uint8_t>&& buffer) {
-  base::AutoLock lock(lock_);
+  PutBuffer(position, std::move(buffer), false);
+}
+
+void ReaderCache::Store::PutBuffer(size_t position,
+                                   std::vector<uint8_t>&& buffer,
+                                   bool from_spill) {
+  std::vector<std::shared_ptr<ReadAtRequest>> completed;
+  std::vector<EvictedRegion> evicted;
+  Result result;
 
-  DCHECK(intake_hole_ != sparse_byte_buffer_.null_hole());
-  DCHECK(position == intake_hole_.position());
-  DCHECK(buffer.size() != 0);
-  DCHECK(buffer.size() <= intake_hole_.size());
+  {
+    base::AutoLock lock(lock_);
 
-  if (read_hole_ != sparse_byte_buffer_.null_hole() &&
-      read_hole_.position() >= position &&
-      read_hole_.position() < position + buffer.size()) {
-    // read_hole_ was set after the termination of GetIntakePositionAndSize
-    // and before this point. We're in the process of delivering the requested
-    // data, so we don't need read_hole_ to be set anymore.
-    read_hole_ = sparse_byte_buffer_.null_hole();
-  }
+    auto iter = intake_reads_.find(position);
+    DCHECK(iter != intake_reads_.end());
+    DCHECK(buffer.size() != 0);
+    DCHECK(buffer.size() <= iter->second.size);
+
+    base::TimeTicks now = base::TimeTicks::Now();
+
+    if (from_spill) {
+      counters_.spill_bytes_read += buffer.size();
+    } else {
+      base::TimeDelta latency = now - iter->second.start_time;
+      intake_latency_ = intake_latency_ == base::TimeDelta()
+                            ? latency
+                            : (intake_latency_ * 7 + latency) / 8;
+      ++counters_.upstream_reads;
+      counters_.upstream_bytes += buffer.size();
+
+      if (!can_seek_) {
+        DCHECK(position == upstream_position_);
+        upstream_position_ += buffer.size();
+      }
+    }
+
+    intake_reads_.erase(iter);
+    if (intake_reads_.empty()) {
+      intake_busy_time_ += now - intake_busy_start_time_;
+    }
 
-  intake_hole_ = sparse_byte_buffer_.Fill(intake_hole_, std::move(buffer));
+    MakeRoom(buffer.size(), spill_ ? &evicted : nullptr);
+    counters_.cached_bytes += buffer.size();
 
-  if (read_request_ != nullptr) {
-    ServeRequest();
+    // The span being filled is a hole, because intake never reads content
+    // that's cached or already being read.
+    sparse_byte_buffer_.Fill(sparse_byte_buffer_.FindOrCreateHole(
+                                 position, sparse_byte_buffer_.null_hole()),
+                             std::move(buffer));
+
+    ServeRequests(&completed);
+
+    counters_.requests += completed.size();
+    for (const std::shared_ptr<ReadAtRequest>& done : completed) {
+      RecordStall(done.get(), now);
+    }
+
+    UpdateReadAheadWindow(now);
+
+    result = result_;
+  }
+
+  CompleteRequests(completed, result);
+
+  if (!evicted.empty()) {
+    std::shared_ptr<std::vector<EvictedRegion>> regions =
+        std::make_shared<std::vector<EvictedRegion>>(std::move(evicted));
+    spill_sequence_->Post([this, regions]() {
+      for (const EvictedRegion& region : *regions) {
+        spill_->Write(region.position, region.buffer.data(),
+                      region.buffer.size());
+      }
+    });
   }
 }
 
-void ReaderCache::Store::ReportIntakeError(Result result) {
+void ReaderCache::Store::ReportIntakeError(size_t position, Result result) {
   DCHECK(result != Result::kOk);
 
+  std::vector<std::shared_ptr<ReadAtRequest>> completed;
+
+  {
+    base::AutoLock lock(lock_);
+
+    base::TimeTicks now = base::TimeTicks::Now();
+    intake_reads_.erase(position);
+    ++counters_.upstream_reads;
+    if (intake_reads_.empty()) {
+      intake_busy_time_ += now - intake_busy_start_time_;
+    }
+
+    result_ = result;
+
+    ServeRequests(&completed);
+
+    counters_.requests += completed.size();
+    for (const std::shared_ptr<ReadAtRequest>& done : completed) {
+      RecordStall(done.get(), now);
+    }
+  }
+
+  CompleteRequests(completed, result);
+}
+
+ReaderCache::Counters ReaderCache::Store::GetCounters() {
   base::AutoLock lock(lock_);
-  result_ = result;
+  Counters counters = counters_;
+  counters.read_ahead_window = read_ahead_window_;
+  return counters;
+}
+
+size_t ReaderCache::Store::GetSequentialIntakeSize() {
+  lock_.AssertAcquired();
+  DCHECK(!can_seek_);
+
+  if (upstream_position_ >= size_) {
+    return 0;
+  }
+
+  size_t remaining_size = size_ - upstream_position_;
+
+  // Read up to the end of the furthest pending request, but in pieces no
+  // larger than the read-ahead window can get, so a distant request doesn't
+  // require one huge read.
+  size_t needed_end = 0;
+  for (const std::shared_ptr<ReadAtRequest>& request : requests_) {
+    needed_end = std::max(
+        needed_end, request->position() + request->remaining_bytes_to_read());
+  }
+
+  if (needed_end > upstream_position_) {
+    size_t size = std::max(needed_end - upstream_position_,
+                           static_cast<size_t>(kDefaultReadSize));
+    return std::min(std::min(size, max_read_ahead_window_), remaining_size);
+  }
 
-  if (read_request_ != nullptr) {
-    ServeRequest();
+  // Read ahead.
+  size_t window_end =
+      std::min(size_, read_ahead_position_ + read_ahead_window_);
+  if (window_end <= upstream_position_) {
+    return 0;
   }
+
+  return std::min(window_end - upstream_position_,
+                  std::max(read_ahead_window_ / kMaxIntakeReads,
+                           static_cast<size_t>(kDefaultReadSize)));
+}
+
+size_t ReaderCache::Store::FindIntakeGap(size_t position,
+                                         size_t end,
+                                         size_t* size_out) {
+  lock_.AssertAcquired();
+  DCHECK(size_out);
+
+  SparseByteBuffer::Region region = sparse_byte_buffer_.null_region();
+
+  while (position < end) {
+    region = sparse_byte_buffer_.FindRegionContaining(position, region);
+    if (region != sparse_byte_buffer_.null_region()) {
+      // Cached. Skip to the end of the region.
+      position = region.position() + region.size();
+      continue;
+    }
+
+    auto iter = intake_reads_.upper_bound(position);
+    if (iter != intake_reads_.begin()) {
+      auto prev = std::prev(iter);
+      if (prev->first + prev->second.size > position) {
+        // Being read. Skip to the end of the read.
+        position = prev->first + prev->second.size;
+        continue;
+      }
+    }
+
+    // Found a gap. It ends at the next region or outstanding read.
+    SparseByteBuffer::Hole hole = sparse_byte_buffer_.FindHoleContaining(
+        position);
+    DCHECK(hole != sparse_byte_buffer_.null_hole());
+    size_t gap_end = std::min(end, hole.position() + hole.size());
+    if (iter != intake_reads_.end()) {
+      gap_end = std::min(gap_end, iter->first);
+    }
+
+    DCHECK(gap_end > position);
+    *size_out = gap_end - position;
+    return position;
+  }
+
+  *size_out = 0;
+  return kUnknownSize;
 }
 
-void ReaderCache::Store::ServeRequest() {
+void ReaderCache::Store::ServeRequests(
+    std::vector<std::shared_ptr<ReadAtRequest>>* completed) {
   lock_.AssertAcquired();
+  DCHECK(completed);
+
+  auto iter = requests_.begin();
+  while (iter != requests_.end()) {
+    ReadAtRequest* request = iter->get();
+    SparseByteBuffer::Region region = sparse_byte_buffer_.null_region();
+
+    while (result_ == Result::kOk && request->remaining_bytes_to_read() != 0u) {
+      region = sparse_byte_buffer_.FindRegionContaining(request->position(),
+                                                        region);
+      if (region == sparse_byte_buffer_.null_region()) {
+        // There's no region in the store for this position. Intake will fill
+        // this need.
+        break;
+      }
+
+      // Perform the copy.
+      DCHECK(region.position() <= request->position());
+      DCHECK(region.position() + region.size() > request->position());
+
+      size_t bytes_to_copy =
+          (region.position() + region.size()) - request->position();
+      if (bytes_to_copy > request->remaining_bytes_to_read()) {
+        bytes_to_copy = request->remaining_bytes_to_read();
+      }
+      DCHECK(bytes_to_copy > 0);
+
+      size_t offset = request->position() - region.position();
+      if (request->is_view()) {
+        // Lend out the region's content rather than copying it.
+        std::shared_ptr<const uint8_t> data = region.shared_data();
+        request->ShareFrom(
+            std::shared_ptr<const uint8_t>(data, data.get() + offset),
+            bytes_to_copy);
+      } else {
+        request->CopyFrom(region.data() + offset, bytes_to_copy);
+      }
+    }
+
+    if (result_ == Result::kOk && request->remaining_bytes_to_read() != 0u) {
+      ++iter;
+      continue;
+    }
+
+    // Done with this request.
+    completed->push_back(*iter);
+    iter = requests_.erase(iter);
+  }
+}
+
+void ReaderCache::Store::RecordStall(ReadAtRequest* request,
+                                     base::TimeTicks now) {
+  lock_.AssertAcquired();
+  DCHECK(request);
+
+  if (!request->stall_start_time().is_null()) {
+    counters_.stall_time += now - request->stall_start_time();
+  }
+}
 
-  while (result_ == Result::kOk && read_request_remaining_bytes_ != 0u) {
-    read_region_ = sparse_byte_buffer_.FindRegionContaining(
-        read_request_position_, read_region_);
-    if (read_region_ == sparse_byte_buffer_.null_region()) {
-      // There's no region in the store for this position. Arrange for intake
-      // to fill this need.
-      read_hole_ = sparse_byte_buffer_.FindOrCreateHole(read_request_position_,
-                                                        intake_hole_);
+void ReaderCache::Store::UpdateReadAheadWindow(base::TimeTicks now) {
+  lock_.AssertAcquired();
+
+  const base::TimeDelta min_measurement_time =
+      base::TimeDelta::FromMilliseconds(kMinRateMeasurementTimeMs);
+  double target = 0.0;
+
+  // Hold kReadAheadDurationMs of content at the consumption rate.
+  base::TimeDelta consumption_time = now - consumption_start_time_;
+  if (consumption_time >= min_measurement_time &&
+      read_ahead_position_ > consumption_start_position_) {
+    double bytes_per_second =
+        (read_ahead_position_ - consumption_start_position_) /
+        consumption_time.InSecondsF();
+    target = bytes_per_second * kReadAheadDurationMs / 1000.0;
+  }
+
+  // Hold twice the upstream bandwidth-delay product, so intake has enough
+  // reads outstanding to cover upstream latency.
+  base::TimeDelta busy_time = intake_busy_time_;
+  if (!intake_reads_.empty()) {
+    busy_time += now - intake_busy_start_time_;
+  }
+
+  if (busy_time >= min_measurement_time) {
+    double bytes_per_second = counters_.upstream_bytes / busy_time.InSecondsF();
+    target = std::max(
+        target, 2.0 * bytes_per_second * intake_latency_.InSecondsF());
+  }
+
+  // Grow by at most a factor of two at a time.
+  if (target > read_ahead_window_) {
+    read_ahead_window_ = static_cast<size_t>(
+        std::min(target, static_cast<double>(std::min(
+                             read_ahead_window_ * 2, max_read_ahead_window_))));
+  }
+}
+
+void ReaderCache::Store::MakeRoom(size_t byte_count,
+                                  std::vector<EvictedRegion>* evicted) {
+  lock_.AssertAcquired();
+
+  // Intake can't go back for evicted content if the upstream reader can't
+  // seek.
+  if (!can_seek_) {
+    return;
+  }
+
+  while (counters_.cached_bytes + byte_count > capacity_) {
+    SparseByteBuffer::Region region = FindEvictionCandidate();
+    if (region == sparse_byte_buffer_.null_region()) {
+      // Everything that's cached is needed by pending requests.
       return;
     }
 
-    // Perform the copy.
-    DCHECK(read_region_.position() <= read_request_position_);
-    DCHECK(read_region_.position() + read_region_.size() >
-           read_request_position_);
+    counters_.cached_bytes -= region.size();
+    counters_.evicted_bytes += region.size();
 
-    size_t bytes_to_copy = (read_region_.position() + read_region_.size()) -
-                           read_request_position_;
-    if (bytes_to_copy > read_request_remaining_bytes_) {
-      bytes_to_copy = read_request_remaining_bytes_;
+    if (evicted == nullptr) {
+      sparse_byte_buffer_.Free(region, nullptr);
+      continue;
     }
-    DCHECK(bytes_to_copy > 0);
 
-    read_request_->CopyFrom(read_region_.data() + (read_request_position_ -
-                                                   read_region_.position()),
-                            bytes_to_copy);
+    counters_.spilled_bytes += region.size();
+    evicted->emplace_back();
+    evicted->back().position = region.position();
+    sparse_byte_buffer_.Free(region, &evicted->back().buffer);
+  }
+}
+
+SparseByteBuffer::Region ReaderCache::Store::FindEvictionCandidate() {
+  lock_.AssertAcquired();
 
-    read_request_position_ += bytes_to_copy;
-    read_request_remaining_bytes_ -= bytes_to_copy;
+  size_t playhead = read_ahead_position_;
+  size_t keep_behind = std::min(playhead, capacity_ / kKeepBehindDivisor);
+  size_t keep_start = playhead - keep_behind;
+  size_t keep_end = playhead + read_ahead_window_;
+
+  // Candidates are ranked first by tier, lower tiers being evicted first, and
+  // then by distance from the playhead.
+  SparseByteBuffer::Region candidate = sparse_byte_buffer_.null_region();
+  int candidate_tier = 0;
+  size_t candidate_distance = 0;
+
+  for (SparseByteBuffer::Region region = sparse_byte_buffer_.first_region();
+       region != sparse_byte_buffer_.null_region();
+       region = sparse_byte_buffer_.NextRegion(region)) {
+    size_t start = region.position();
+    size_t end = start + region.size();
+
+    if (OverlapsRequest(start, end)) {
+      continue;
+    }
+
+    int tier = 0;
+    if (end > keep_start && start < keep_end) {
+      tier = 2;
+    } else {
+      for (size_t seek_position : seek_positions_) {
+        if (end > seek_position &&
+            start < seek_position + min_read_ahead_window_) {
+          tier = 1;
+          break;
+        }
+      }
+    }
+
+    size_t distance = 0;
+    if (end <= playhead) {
+      distance = (playhead - end) * 2;
+    } else if (start > playhead) {
+      distance = start - playhead;
+    }
+
+    if (candidate == sparse_byte_buffer_.null_region() ||
+        tier < candidate_tier ||
+        (tier == candidate_tier && distance > candidate_distance)) {
+      candidate = region;
+      candidate_tier = tier;
+      candidate_distance = distance;
+    }
   }
 
-  // Done with this request. Complete it.
-  ReadAtRequest* read_request = read_request_;
-  read_request_ = nullptr;
+  return candidate;
+}
 
-  base::AutoUnlock unlock(lock_);
-  read_request->Complete(result_);
+bool ReaderCache::Store::OverlapsRequest(size_t position, size_t end) {
+  lock_.AssertAcquired();
+
+  for (const std::shared_ptr<ReadAtRequest>& request : requests_) {
+    if (end > request->position() &&
+        position < request->position() + request->remaining_bytes_to_read()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// static
+void ReaderCache::Store::CompleteRequests(
+    const std::vector<std::shared_ptr<ReadAtRequest>>& completed,
+    Result result) {
+  for (const std::shared_ptr<ReadAtRequest>& request : completed) {
+    request->Complete(result);
+  }
 }
 
-ReaderCache::Intake::Intake() {}
+ReaderCache::Intake::Intake() : store_(nullptr) {}
 
 ReaderCache::Intake::~Intake() {}
 
@@ -257,33 +869,57 @@ void ReaderCache::Intake::Start(Store* store,
 }
 
 void ReaderCache::Intake::Continue() {
-  size_t size;
-  size_t position = store_->GetIntakePositionAndSize(&size);
-  if (position == kUnknownSize) {
-    return;
-  }
+  DCHECK(store_ != nullptr);
 
-  DCHECK(size > 0);
+  while (true) {
+    size_t size;
+    size_t position = store_->GetIntakePositionAndSize(&size);
+    if (position == kUnknownSize) {
+      return;
+    }
+
+    DCHECK(size > 0);
 
-  DCHECK(buffer_.size() == 0);
-  buffer_.resize(size);
+    Scheduler::Sequence* spill_sequence = store_->spill_sequence();
+    if (spill_sequence == nullptr) {
+      ReadUpstream(position, size);
+      continue;
+    }
+
+    // Try the spill first. Spill writes are posted to the same sequence, so
+    // content that has been evicted is found there.
+    spill_sequence->Post([this, position, size]() {
+      size_t upstream_size = size;
+      if (store_->IntakeFromSpill(position, &upstream_size)) {
+        Continue();
+      } else {
+        ReadUpstream(position, upstream_size);
+      }
+    });
+  }
+}
 
-  upstream_reader_->ReadAt(position, buffer_.data(), size,
-                           [this, position](Result result, size_t bytes_read) {
-                             if (result != Result::kOk) {
-                               LOG(ERROR) << "ReadAt failed";
-                               store_->ReportIntakeError(result);
-                               return;
-                             }
+void ReaderCache::Intake::ReadUpstream(size_t position, size_t size) {
+  std::shared_ptr<std::vector<uint8_t>> buffer =
+      std::make_shared<std::vector<uint8_t>>(size);
+
+  upstream_reader_->ReadAt(
+      position, buffer->data(), size,
+      [this, position, buffer](Result result, size_t bytes_read) {
+        if (result != Result::kOk) {
+          LOG(ERROR) << "ReadAt failed";
+          store_->ReportIntakeError(position, result);
+          return;
+        }
 
-                             DCHECK(bytes_read != 0);
+        DCHECK(bytes_read != 0);
+        DCHECK(bytes_read <= buffer->size());
 
-                             store_->PutIntakeBuffer(position,
-                                                     std::move(buffer_));
-                             DCHECK(buffer_.size() == 0);
+        buffer->resize(bytes_read);
+        store_->PutIntakeBuffer(position, std::move(*buffer));
 
-                             Continue();
-                           });
+        Continue();
+      });
 }
 
 }  // namespace media
@@ -5,13 +5,17 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_PARTS_READER_CACHE_H_
 #define SERVICES_MEDIA_FRAMEWORK_PARTS_READER_CACHE_H_
 
-#include <atomic>
+#include <deque>
+#include <list>
 #include <map>
 #include <vector>
 
 #include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "services/media/framework/parts/disk_spill.h"
 #include "services/media/framework/parts/reader.h"
 #include "services/media/framework/parts/sparse_byte_buffer.h"
+#include "services/media/framework/scheduler.h"
 #include "services/media/framework/util/incident.h"
 
 namespace mojo {
@@ -19,35 +23,109 @@ namespace media {
 
 // Store for reading.
 //
-// ReaderCache is an Reader filter that reads an entire asset from an
-// Reader into memory and implements Reader against the cache.
-// Currently, there is no support for throttling the intake rate or for
-// limiting the amount of memory used by the cache. The entire asset is read
-// into memory and remains there until the cache is deleted.
-// TODO(dalesat): Devise and implement a management policy.
+// ReaderCache is an Reader filter that caches content from an upstream Reader
+// in memory and implements Reader against the cache. The memory used for
+// content is limited to a capacity specified at creation. When intake needs
+// room, regions are evicted, least useful first:
+//   1) regions far from the playhead (the position at which the most recent
+//      ReadAt call ended), with regions behind the playhead considered twice
+//      as far as those ahead of it,
+//   2) regions at the positions of recent seeks,
+//   3) regions around the playhead, which extend from a short distance behind
+//      it to the end of the read-ahead window.
+// Regions that pending ReadAt calls still need aren't evicted, so the
+// capacity can be exceeded only by ReadAt calls that are larger than it.
+// Evicted content becomes a hole again and is read again if it's needed. If
+// the upstream reader can't seek, evicted content couldn't be read again, so
+// nothing is evicted, and the capacity doesn't apply.
+//
+// Optionally, evicted regions are spilled to disk (see DiskSpill). Intake
+// then reads content from disk when it can rather than from upstream. Disk IO
+// runs on a thread of the cache's own, so it doesn't hold up the threads that
+// call ReadAt or deliver upstream content, and readers blocked on the cache,
+// wherever they run, can't keep it from running.
 //
 // ReaderCache is implemented using a collection of holes (spans of the asset
 // that haven't been read) and regions (spans of the asset that have been read).
-// Holes can be indefinitely large, and no two holes are adjacent to each other.
-// Regions represent successful past reads and can be any non-zero size.
+// Holes can be indefinitely large. Regions represent successful past reads and
+// can be any non-zero size.
+//
+// The intake side of ReaderCache keeps several reads of the upstream reader
+// outstanding at once, so throughput isn't bounded by the latency of the
+// upstream reader. Content needed to satisfy pending ReadAt calls is read
+// first. Otherwise, intake reads ahead of the position at which the most
+// recent ReadAt call ended, up to the limit of the read-ahead window. The
+// window grows with the observed consumption rate and upstream bandwidth and
+// when ReadAt calls have to wait for intake. It shrinks when ReadAt calls seek
+// outside of it. Intake is idle when the window is full.
+//
+// If the upstream reader can't seek, intake issues one read at a time, each
+// starting where the previous one ended, and reads past content nobody has
+// asked for to reach content that's needed. There's no disk spill in that
+// case.
+//
+// Any number of ReadAt calls may be pending at once. They're completed as the
+// content they need becomes available, not necessarily in order.
 //
-// The intake side of ReaderCache chooses a hole to work on, reading regions
-// and shrinking the hole from front to back. If the outlet side (the
-// ReadAt implementation) needs content from a different part of the asset,
-// the intake side finds the hole that starts at that position or creates one
-// (by splitting an existing hole) and starts working on that. Once a hole is
-// completely filled, intake moves to the next hole in order, wrapping around
-// at the end of the asset. Once the entire asset is read, the intake side
-// shuts down.
+// ViewAt lends out cached content rather than copying it. A view covers at
+// most one region, so it may be shorter than requested. Content that's lent
+// out stays in memory when its region is evicted until the view is released,
+// and it isn't counted against the capacity in the meantime.
 // TODO(dalesat): Provide methods for discovering what parts of the asset are
 // cached.
 class ReaderCache : public Reader {
  public:
+  // Counters describing the performance of a ReaderCache.
+  struct Counters {
+    Counters();
+
+    // Fraction of completed ReadAt calls that were hits.
+    double hit_ratio() const;
+
+    // Number of ReadAt calls completed.
+    uint64_t requests;
+    // Number of ReadAt calls that were satisfied from the cache immediately.
+    uint64_t hits;
+    // Total time ReadAt calls spent waiting for intake.
+    base::TimeDelta stall_time;
+    // Number of reads issued to the upstream reader and the bytes they
+    // produced.
+    uint64_t upstream_reads;
+    uint64_t upstream_bytes;
+    // Current size of the read-ahead window in bytes.
+    size_t read_ahead_window;
+    // Bytes of content currently cached and bytes evicted so far.
+    size_t cached_bytes;
+    uint64_t evicted_bytes;
+    // Bytes of evicted content passed to the disk spill and bytes read back
+    // from it.
+    uint64_t spilled_bytes;
+    uint64_t spill_bytes_read;
+  };
+
+  // Capacity used by the Create overload that doesn't specify one.
+  static constexpr size_t kDefaultCapacity = 32 * 1024 * 1024;
+
   static std::shared_ptr<ReaderCache> Create(
       std::shared_ptr<Reader> upstream_reader);
 
+  // Creates a ReaderCache that holds at most capacity bytes of content.
+  static std::shared_ptr<ReaderCache> Create(
+      std::shared_ptr<Reader> upstream_reader,
+      size_t capacity);
+
+  // Creates a ReaderCache that holds at most capacity bytes of content in
+  // memory and spills evicted content to disk as specified by spill_settings.
+  static std::shared_ptr<ReaderCache> Create(
+      std::shared_ptr<Reader> upstream_reader,
+      size_t capacity,
+      const DiskSpill::Settings& spill_settings);
+
   ~ReaderCache() override;
 
+  // Returns the cache's counters.
+  Counters GetCounters();
+
   // Reader implementation.
   void Describe(const DescribeCallback& callback) override;
 
@@ -56,22 +134,32 @@ class ReaderCache : public Reader {
               size_t bytes_to_read,
               const ReadAtCallback& callback) override;
 
+  void ViewAt(size_t position,
+              size_t max_bytes,
+              const ViewAtCallback& callback) override;
+
  private:
   static constexpr size_t kDefaultReadSize = 32 * 1024;
 
-  // Represents a pending ReadAt call. The buffer associated with the request
-  // can be filled in sequential fragments using the CopyFrom method.
+  // Represents a pending ReadAt or ViewAt call. The buffer associated with a
+  // ReadAt request can be filled in sequential fragments using the CopyFrom
+  // method. A ViewAt request is satisfied with one fragment using the
+  // ShareFrom method.
   class ReadAtRequest {
    public:
-    ReadAtRequest();
+    ReadAtRequest(size_t position,
+                  uint8_t* buffer,
+                  size_t bytes_to_read,
+                  const ReadAtCallback& callback);
+
+    ReadAtRequest(size_t position,
+                  size_t max_bytes,
+                  const ViewAtCallback& callback);
 
     ~ReadAtRequest();
 
-    // Initializes the request.
-    void Start(size_t position,
-               uint8_t* buffer,
-               size_t bytes_to_read,
-               const ReadAtCallback& callback);
+    // Indicates whether this request is for a ViewAt call.
+    bool is_view() { return buffer_ == nullptr; }
 
     // Gets the current read position.
     size_t position() { return position_; }
@@ -79,72 +167,194 @@ class ReaderCache : public Reader {
     // Gets the remaining number of bytes to read.
     size_t remaining_bytes_to_read() { return remaining_bytes_to_read_; }
 
+    // Gets the time at which the request started waiting for intake, or a null
+    // time if it hasn't waited.
+    base::TimeTicks stall_start_time() { return stall_start_time_; }
+
+    // Sets the time at which the request started waiting for intake.
+    void set_stall_start_time(base::TimeTicks time) {
+      stall_start_time_ = time;
+    }
+
+    // Reduces the number of bytes to read so the request doesn't extend
+    // beyond the indicated end position.
+    void LimitTo(size_t end);
+
     // Delivers all or part of the data indicated by position and
     // remaining_bytes_to_read.
     void CopyFrom(uint8_t* source, size_t byte_count);
 
-    // Completes the request with the indicated result.
+    // Delivers the first byte_count bytes of the data indicated by position
+    // and remaining_bytes_to_read by lending out data. No more data is
+    // delivered after this. Only for ViewAt requests.
+    void ShareFrom(std::shared_ptr<const uint8_t> data, size_t byte_count);
+
+    // Completes the request with the indicated result. If some data has been
+    // delivered, the request completes successfully regardless of result.
     void Complete(Result result);
 
    private:
-    std::atomic_bool in_progress_;
-    size_t position_;  // Updated by CopyFrom.
-    uint8_t* buffer_;  // Updated by CopyFrom.
-    size_t original_bytes_to_read_;
-    size_t remaining_bytes_to_read_;  // Updated by CopyFrom.
+    size_t position_;  // Updated by CopyFrom and ShareFrom.
+    uint8_t* buffer_;  // Updated by CopyFrom. Null for ViewAt requests.
+    size_t bytes_read_;  // Updated by CopyFrom and ShareFrom.
+    size_t remaining_bytes_to_read_;  // Updated by CopyFrom and ShareFrom.
     ReadAtCallback callback_;
+    ViewAtCallback view_callback_;
+    std::shared_ptr<const uint8_t> view_data_;  // Set by ShareFrom.
+    base::TimeTicks stall_start_time_;
   };
 
   // Maintains the cached data in an in-memory data structure. Handles
-  // fulfillment of at most one ReadAtRequest. Interacts with Intake to arrange
-  // for the acquisition of data from the upstream reader. By default, intake
-  // proceeds from the start of the asset to the end. The store deviates from
-  // this order when a ReadAtRequest is submitted for data that isn't yet
-  // cached. In that case, intake skips to the position of the ReadAtRequest
-  // and proceeds from there, skipping filled regions and wrapping around as
-  // needed until the entire asset is cached.
+  // fulfillment of ReadAtRequests. Interacts with Intake to arrange for the
+  // acquisition of data from the upstream reader. Intake reads are chosen to
+  // satisfy pending ReadAtRequests first, then to fill the read-ahead window.
+  // Evicts regions as needed to stay within its capacity, spilling them to
+  // disk if a disk spill is configured.
   class Store {
    public:
-    Store();
+    Store(size_t capacity, const DiskSpill::Settings& spill_settings);
 
     ~Store();
 
-    // Initializes the store.
-    void Initialize(Result result, size_t size, bool can_seek);
+    // Initializes the store. spill_sequence runs disk spill IO and is null if
+    // there's no disk spill configured.
+    void Initialize(Result result,
+                    size_t size,
+                    bool can_seek,
+                    Scheduler::Sequence* spill_sequence);
 
     // Calls the callback immediately with description values.
     void Describe(const DescribeCallback& callback);
 
-    // Sets a read request to fulfill.
-    void SetReadAtRequest(ReadAtRequest* request);
+    // Adds a read request to fulfill. The request is completed immediately if
+    // the store can satisfy it. Returns true if intake should be continued.
+    bool AddReadAtRequest(std::shared_ptr<ReadAtRequest> request);
+
+    // Returns the sequence on which disk spill IO runs, or nullptr if there's
+    // no disk spill. Stable after Initialize.
+    Scheduler::Sequence* spill_sequence() {
+      return spill_ ? spill_sequence_ : nullptr;
+    }
 
-    // Determines what data intake should produce next. Returns kUnknownSize if
-    // intake isn't required.
+    // Determines what data intake should produce next and registers the read
+    // as outstanding. Returns kUnknownSize if no intake is required.
     size_t GetIntakePositionAndSize(size_t* size_out);
 
-    // Submits intaken data.
+    // Attempts to satisfy the outstanding intake read at position from the
+    // disk spill. If the spill has content at position, the content is
+    // submitted and true is returned. Otherwise, false is returned, and
+    // size_in_out is reduced so an upstream read doesn't cover spilled
+    // content. Called on the spill sequence, because it performs blocking file
+    // IO.
+    bool IntakeFromSpill(size_t position, size_t* size_in_out);
+
+    // Submits intaken data for the outstanding read at position. buffer may be
+    // smaller than the read that was requested.
     void PutIntakeBuffer(size_t position, std::vector<uint8_t>&& buffer);
 
-    // Reports an intake error.
-    void ReportIntakeError(Result result);
+    // Reports an intake error for the outstanding read at position.
+    void ReportIntakeError(size_t position, Result result);
+
+    // Returns the store's counters.
+    Counters GetCounters();
 
    private:
-    // Attempts to progress satisfaction of the current read request.
-    void ServeRequest();
+    // An outstanding read of the upstream reader.
+    struct IntakeRead {
+      size_t size;
+      base::TimeTicks start_time;
+    };
+
+    // A region evicted from memory, to be spilled to disk.
+    struct EvictedRegion {
+      size_t position;
+      std::vector<uint8_t> buffer;
+    };
+
+    // Submits intaken data for the outstanding read at position. If evictions
+    // are required, evicted regions are spilled on the spill sequence.
+    void PutBuffer(size_t position,
+                   std::vector<uint8_t>&& buffer,
+                   bool from_spill);
+
+    // Returns the size of the next intake read if the upstream reader can't
+    // seek, or 0 if no intake is required. The read starts at
+    // upstream_position_.
+    size_t GetSequentialIntakeSize();
+
+    // Finds the first byte in the range [position, end) that's neither cached
+    // nor being read by intake. Returns the position of that byte and the size
+    // of the uncached span it starts, limited to end, or kUnknownSize if there
+    // is no such byte.
+    size_t FindIntakeGap(size_t position, size_t end, size_t* size_out);
+
+    // Attempts to progress satisfaction of the pending read requests. Requests
+    // that are done are moved to completed.
+    void ServeRequests(
+        std::vector<std::shared_ptr<ReadAtRequest>>* completed);
+
+    // Records the completion of a request that waited for intake.
+    void RecordStall(ReadAtRequest* request, base::TimeTicks now);
+
+    // Grows the read-ahead window if consumption or upstream bandwidth call
+    // for it.
+    void UpdateReadAheadWindow(base::TimeTicks now);
+
+    // Evicts regions until there's room for byte_count more bytes or nothing
+    // more can be evicted. If evicted isn't null, evicted regions are moved
+    // there. Does nothing if the upstream reader can't seek.
+    void MakeRoom(size_t byte_count, std::vector<EvictedRegion>* evicted);
+
+    // Returns the region that should be evicted first, or null_region() if
+    // no region may be evicted.
+    SparseByteBuffer::Region FindEvictionCandidate();
+
+    // Determines whether the range [position, end) overlaps a pending
+    // request.
+    bool OverlapsRequest(size_t position, size_t end);
+
+    // Completes the requests in completed with the indicated result.
+    static void CompleteRequests(
+        const std::vector<std::shared_ptr<ReadAtRequest>>& completed,
+        Result result);
+
+    // These fields are stable after construction.
+    size_t capacity_;
+    DiskSpill::Settings spill_settings_;
+    size_t max_read_ahead_window_;
+    size_t min_read_ahead_window_;
 
     // These fields are stable after Initialize.
     size_t size_ = kUnknownSize;
     bool can_seek_ = false;
+    std::unique_ptr<DiskSpill> spill_;
+    Scheduler::Sequence* spill_sequence_ = nullptr;
 
     mutable base::Lock lock_;
     Result result_ = Result::kOk;
     SparseByteBuffer sparse_byte_buffer_;
-    SparseByteBuffer::Hole intake_hole_;
-    SparseByteBuffer::Hole read_hole_;
-    SparseByteBuffer::Region read_region_;
-    ReadAtRequest* read_request_ = nullptr;
-    size_t read_request_position_;
-    size_t read_request_remaining_bytes_;
+    std::list<std::shared_ptr<ReadAtRequest>> requests_;
+    // Outstanding intake reads by position.
+    std::map<size_t, IntakeRead> intake_reads_;
+    // Position at which the most recent read request ended. Read-ahead starts
+    // here.
+    size_t read_ahead_position_ = 0;
+    size_t read_ahead_window_;
+    // Position at which the next upstream read starts if the upstream reader
+    // can't seek.
+    size_t upstream_position_ = 0;
+    // Consumption since the last seek, used to estimate the consumption rate.
+    base::TimeTicks consumption_start_time_;
+    size_t consumption_start_position_ = 0;
+    // Time intake has spent with reads outstanding, used with
+    // counters_.upstream_bytes to estimate upstream bandwidth.
+    base::TimeDelta intake_busy_time_;
+    base::TimeTicks intake_busy_start_time_;
+    // Smoothed latency of intake reads.
+    base::TimeDelta intake_latency_;
+    // Positions of recent seeks, most recent last.
+    std::deque<size_t> seek_positions_;
+    Counters counters_;
   };
 
   // Reads from the upstream reader into the store.
@@ -156,21 +366,30 @@ class ReaderCache : public Reader {
 
     void Start(Store* store, std::shared_ptr<Reader> upstream_reader);
 
-   private:
+    // Issues upstream reads until the store needs no more.
     void Continue();
 
+   private:
+    // Reads size bytes at position from the upstream reader into the store.
+    void ReadUpstream(size_t position, size_t size);
+
     Store* store_;
     std::shared_ptr<Reader> upstream_reader_;
-    std::vector<uint8_t> buffer_;
   };
 
-  ReaderCache(std::shared_ptr<Reader> upstream_reader);
+  ReaderCache(std::shared_ptr<Reader> upstream_reader,
+              size_t capacity,
+              const DiskSpill::Settings& spill_settings);
 
-  ReadAtRequest read_at_request_;
   Store store_;
   Intake intake_;
 
   ThreadsafeIncident describe_is_complete_;
+
+  // Runs disk spill IO on a scheduler of its own. Declared last, so it's
+  // destroyed first, waiting for the task in progress while the members that
+  // task uses are intact.
+  std::unique_ptr<Scheduler::Sequence> spill_sequence_;
 };
 
 }  // namespace media
@@ -0,0 +1,183 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "base/logging.h"
+#include "services/media/framework/parts/replay_source.h"
+
+namespace mojo {
+namespace media {
+
+ReplaySource::ReplaySource(std::shared_ptr<FlowRecording> recording,
+                           size_t track,
+                           Timing timing)
+    : recording_(recording),
+      track_(recording->tracks()[track]),
+      timing_(timing),
+      condition_variable_(&lock_),
+      allocator_(nullptr),
+      demand_(Demand::kNegative),
+      next_event_(0),
+      packets_supplied_(0),
+      task_posted_(false),
+      busy_(false),
+      sequence_(new Scheduler::Sequence(Scheduler::GetDefault())) {
+  DCHECK(track < recording->tracks().size());
+  SkipToPacket();
+}
+
+ReplaySource::~ReplaySource() {}
+
+size_t ReplaySource::packets_supplied() {
+  base::AutoLock lock(lock_);
+  return packets_supplied_;
+}
+
+bool ReplaySource::ended() {
+  base::AutoLock lock(lock_);
+  return next_event_ == track_.events.size();
+}
+
+base::TimeDelta ReplaySource::total_lateness() {
+  base::AutoLock lock(lock_);
+  return total_lateness_;
+}
+
+bool ReplaySource::can_accept_allocator() const {
+  return true;
+}
+
+void ReplaySource::set_allocator(PayloadAllocator* allocator) {
+  base::AutoLock lock(lock_);
+  allocator_ = allocator;
+}
+
+void ReplaySource::SetSupplyCallback(const SupplyCallback& supply_callback) {
+  base::AutoLock lock(lock_);
+  supply_callback_ = supply_callback;
+}
+
+void ReplaySource::SetDownstreamDemand(Demand demand) {
+  base::AutoLock lock(lock_);
+  demand_ = demand;
+
+  if (demand_ != Demand::kNegative && !task_posted_ &&
+      next_event_ != track_.events.size()) {
+    task_posted_ = true;
+    sequence_->Post([this]() { SupplyNextPacket(); });
+  }
+}
+
+void ReplaySource::Flush() {
+  DCHECK(!sequence_->RunsTasksOnCurrentThread())
+      << "Flush called from supply callback";
+
+  base::AutoLock lock(lock_);
+  demand_ = Demand::kNegative;
+
+  // Wait for the packet in progress, if any, to be supplied.
+  while (busy_) {
+    condition_variable_.Wait();
+  }
+
+  // Keep to the recorded timing from the next packet on.
+  start_time_ = base::TimeTicks();
+}
+
+void ReplaySource::SupplyNextPacket() {
+  base::AutoLock lock(lock_);
+  task_posted_ = false;
+
+  if (demand_ == Demand::kNegative || next_event_ == track_.events.size() ||
+      allocator_ == nullptr || !supply_callback_) {
+    return;
+  }
+
+  const FlowRecording::Event& event = track_.events[next_event_];
+  DCHECK(event.type == FlowRecording::EventType::kPacket);
+  ++next_event_;
+  SkipToPacket();
+
+  // Don't supply another packet until downstream asks for it.
+  Demand demand = demand_;
+  demand_ = Demand::kNegative;
+  SupplyCallback supply_callback = supply_callback_;
+  PayloadAllocator* allocator = allocator_;
+  busy_ = true;
+
+  base::TimeDelta delay;
+  if (timing_ == Timing::kRecorded) {
+    base::TimeTicks now = base::TimeTicks::Now();
+    if (start_time_.is_null()) {
+      start_time_ = now - event.time;
+    }
+
+    base::TimeTicks due_time = start_time_ + event.time;
+    if (due_time > now) {
+      delay = due_time - now;
+    } else {
+      total_lateness_ += now - due_time;
+    }
+  }
+
+  bool supplied;
+  {
+    base::AutoUnlock unlock(lock_);
+
+    if (delay > base::TimeDelta()) {
+      std::this_thread::sleep_for(
+          std::chrono::microseconds(delay.InMicroseconds()));
+    }
+
+    void* payload = nullptr;
+    if (event.size != 0) {
+      payload = allocator->AllocatePayloadBuffer(event.size);
+      if (payload == nullptr) {
+        LOG(WARNING) << "allocator starved replaying packet";
+      } else {
+        memset(payload, 0, event.size);
+      }
+    }
+
+    supplied = event.size == 0 || payload != nullptr;
+    if (supplied) {
+      supply_callback(Packet::Create(event.pts, event.end_of_stream, event.size,
+                                     payload, allocator));
+    }
+  }
+
+  busy_ = false;
+  condition_variable_.Broadcast();
+
+  if (supplied) {
+    ++packets_supplied_;
+    return;
+  }
+
+  // The packet was dropped, so downstream won't ask again. Move on to the next
+  // packet unless demand has changed in the meantime.
+  if (demand_ == Demand::kNegative) {
+    demand_ = demand;
+  }
+
+  if (demand_ != Demand::kNegative && !task_posted_ &&
+      next_event_ != track_.events.size()) {
+    task_posted_ = true;
+    sequence_->Post([this]() { SupplyNextPacket(); });
+  }
+}
+
+void ReplaySource::SkipToPacket() {
+  while (next_event_ != track_.events.size() &&
+         track_.events[next_event_].type !=
+             FlowRecording::EventType::kPacket) {
+    ++next_event_;
+  }
+}
+
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,109 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_PARTS_REPLAY_SOURCE_H_
+#define SERVICES_MEDIA_FRAMEWORK_PARTS_REPLAY_SOURCE_H_
+
+#include <memory>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "services/media/framework/flow_recording.h"
+#include "services/media/framework/models/active_source.h"
+#include "services/media/framework/scheduler.h"
+
+namespace mojo {
+namespace media {
+
+// Source that re-emits the packets recorded on one track of a flow recording,
+// so the parts downstream of the recorded connection can be run offline
+// against a production trace. Packets have the recorded PTSes, sizes and
+// end-of-stream flags. Their payloads are zero-filled, because payloads aren't
+// recorded. Packets are produced as blocking tasks on the process-wide
+// scheduler, one packet per demand signal from downstream.
+class ReplaySource : public ActiveSource {
+ public:
+  enum class Timing {
+    // Packets are supplied as soon as there's demand for them.
+    kAsFastAsPossible,
+    // Packets are supplied no earlier than their recorded times, relative to
+    // the first packet. A packet held back by demand is supplied late, and
+    // the lateness is reported by total_lateness.
+    kRecorded
+  };
+
+  static std::shared_ptr<ReplaySource> Create(
+      std::shared_ptr<FlowRecording> recording,
+      size_t track,
+      Timing timing) {
+    return std::shared_ptr<ReplaySource>(
+        new ReplaySource(recording, track, timing));
+  }
+
+  ~ReplaySource() override;
+
+  // Number of packets supplied so far.
+  size_t packets_supplied();
+
+  // Determines whether all the recorded packets have been supplied.
+  bool ended();
+
+  // Total time by which packets were supplied after their recorded times.
+  // Always zero for Timing::kAsFastAsPossible.
+  base::TimeDelta total_lateness();
+
+  // ActiveSource implementation.
+  bool can_accept_allocator() const override;
+
+  void set_allocator(PayloadAllocator* allocator) override;
+
+  void SetSupplyCallback(const SupplyCallback& supply_callback) override;
+
+  void SetDownstreamDemand(Demand demand) override;
+
+  // Part implementation. Recorded packets that haven't been supplied are
+  // supplied after the flush.
+  void Flush() override;
+
+ private:
+  ReplaySource(std::shared_ptr<FlowRecording> recording,
+               size_t track,
+               Timing timing);
+
+  // Supplies the next packet, waiting until it's due if timing_ is
+  // Timing::kRecorded. Runs on sequence_.
+  void SupplyNextPacket();
+
+  // Advances next_event_ past events that aren't packets. Called with lock_
+  // held.
+  void SkipToPacket();
+
+  std::shared_ptr<FlowRecording> recording_;
+  const FlowRecording::Track& track_;
+  Timing timing_;
+
+  base::Lock lock_;
+  base::ConditionVariable condition_variable_;
+  // The following fields are protected by lock_.
+  SupplyCallback supply_callback_;
+  PayloadAllocator* allocator_;
+  Demand demand_;
+  // Index in track_.events of the next packet to supply.
+  size_t next_event_;
+  // Time at which a packet recorded at time zero would be due.
+  base::TimeTicks start_time_;
+  size_t packets_supplied_;
+  base::TimeDelta total_lateness_;
+  bool task_posted_;
+  bool busy_;
+
+  // Declared last so it's destroyed first, waiting for a running task.
+  std::unique_ptr<Scheduler::Sequence> sequence_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_PARTS_REPLAY_SOURCE_H_
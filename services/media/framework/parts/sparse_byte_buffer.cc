@@ -15,18 +15,33 @@ SparseByteBuffer::Hole::Hole(std::map<size_t, size_t>::iterator iter)
 
 SparseByteBuffer::Hole::Hole(const Hole& other) : iter_(other.iter_) {}
 
+SparseByteBuffer::Hole& SparseByteBuffer::Hole::operator=(const Hole& other) {
+  iter_ = other.iter_;
+  return *this;
+}
+
 SparseByteBuffer::Hole::~Hole() {}
 
 SparseByteBuffer::Region::Region() {}
 
 SparseByteBuffer::Region::Region(
-    std::map<size_t, std::vector<uint8_t>>::iterator iter)
+    std::map<size_t, std::shared_ptr<std::vector<uint8_t>>>::iterator iter)
     : iter_(iter) {}
 
 SparseByteBuffer::Region::Region(const Region& other) : iter_(other.iter_) {}
 
+SparseByteBuffer::Region& SparseByteBuffer::Region::operator=(
+    const Region& other) {
+  iter_ = other.iter_;
+  return *this;
+}
+
 SparseByteBuffer::Region::~Region() {}
 
+std::shared_ptr<const uint8_t> SparseByteBuffer::Region::shared_data() {
+  return std::shared_ptr<const uint8_t>(iter_->second, iter_->second->data());
+}
+
 SparseByteBuffer::SparseByteBuffer() {}
 
 SparseByteBuffer::~SparseByteBuffer() {}
@@ -47,24 +62,28 @@ SparseByteBuffer::Region SparseByteBuffer::FindRegionContaining(size_t position,
   RegionsIter iter = hint.iter_;
 
   if (iter != regions_.end() && iter->first <= position) {
-    if (iter->first + iter->second.size() <= position) {
+    if (iter->first + iter->second->size() <= position) {
       // iter is too close to the front. See if the next region is correct.
       ++iter;
       if (iter != regions_.end() && iter->first <= position &&
-          position < iter->first + iter->second.size()) {
+          position < iter->first + iter->second->size()) {
         return Region(iter);
       }
-    } else if (position < iter->first + iter->second.size()) {
+    } else if (position < iter->first + iter->second->size()) {
       return Region(iter);
     }
   }
 
   iter = regions_.lower_bound(position);
-  if (iter != regions_.begin() &&
-      (iter == regions_.end() || iter->first > position)) {
+  if (iter == regions_.end() || iter->first > position) {
+    if (iter == regions_.begin()) {
+      // All regions are after position.
+      return Region(regions_.end());
+    }
+
     --iter;
     DCHECK(iter->first <= position);
-    if (iter->first + iter->second.size() <= position) {
+    if (iter->first + iter->second->size() <= position) {
       iter = regions_.end();
     }
   }
@@ -114,11 +133,15 @@ SparseByteBuffer::Hole SparseByteBuffer::FindOrCreateHole(size_t position,
 SparseByteBuffer::Hole SparseByteBuffer::FindHoleContaining(size_t position) {
   DCHECK(size_ > 0u);
   HolesIter iter = holes_.lower_bound(position);
-  if (iter != holes_.begin() &&
-      (iter == holes_.end() || iter->first > position)) {
+  if (iter == holes_.end() || iter->first > position) {
+    if (iter == holes_.begin()) {
+      // All holes are after position.
+      return Hole(holes_.end());
+    }
+
     --iter;
     DCHECK(iter->first <= position);
-    if (iter->first + iter->second < position) {
+    if (iter->first + iter->second <= position) {
       iter = holes_.end();
     }
   }
@@ -138,7 +161,8 @@ SparseByteBuffer::Hole SparseByteBuffer::Fill(Hole hole,
   size_t buffer_size = buffer.size();
   size_t position = holes_iter->first;
 
-  regions_.emplace(std::make_pair(position, std::move(buffer)));
+  regions_.emplace(std::make_pair(
+      position, std::make_shared<std::vector<uint8_t>>(std::move(buffer))));
 
   // Remove the region from holes_.
   while (buffer_size != 0) {
@@ -173,6 +197,55 @@ SparseByteBuffer::Hole SparseByteBuffer::Fill(Hole hole,
   return Hole(holes_iter);
 }
 
+SparseByteBuffer::Hole SparseByteBuffer::Free(
+    Region region,
+    std::vector<uint8_t>* buffer_out) {
+  DCHECK(size_ > 0u);
+  DCHECK(region.iter_ != regions_.end());
+
+  size_t position = region.iter_->first;
+  size_t size = region.iter_->second->size();
+  if (buffer_out != nullptr) {
+    if (region.iter_->second.use_count() == 1) {
+      *buffer_out = std::move(*region.iter_->second);
+    } else {
+      // The buffer is shared, so it can't be moved.
+      *buffer_out = *region.iter_->second;
+    }
+  }
+
+  regions_.erase(region.iter_);
+
+  HolesIter iter =
+      holes_.insert(std::pair<size_t, size_t>(position, size)).first;
+
+  // Merge with the following hole, if it's adjacent.
+  HolesIter next = iter;
+  ++next;
+  if (next != holes_.end() && next->first == position + size) {
+    iter->second += next->second;
+    holes_.erase(next);
+  }
+
+  // Merge with the preceding hole, if it's adjacent.
+  if (iter != holes_.begin()) {
+    HolesIter prev = iter;
+    --prev;
+    if (prev->first + prev->second == position) {
+      prev->second += iter->second;
+      holes_.erase(iter);
+      iter = prev;
+    }
+  }
+
+  return Hole(iter);
+}
+
+SparseByteBuffer::Region SparseByteBuffer::NextRegion(Region region) {
+  DCHECK(region.iter_ != regions_.end());
+  return Region(++region.iter_);
+}
+
 bool operator==(const SparseByteBuffer::Hole& a,
                 const SparseByteBuffer::Hole& b) {
   return a.iter_ == b.iter_;
@@ -6,6 +6,7 @@
 #define SERVICES_MEDIA_FRAMEWORK_PARTS_SPARSE_BYTE_BUFFER_H_
 
 #include <map>
+#include <memory>
 #include <vector>
 
 namespace mojo {
@@ -16,6 +17,7 @@ class SparseByteBuffer {
   struct Hole {
     Hole();
     Hole(const Hole& other);
+    Hole& operator=(const Hole& other);
     ~Hole();
 
     size_t position() { return iter_->first; }
@@ -34,16 +36,22 @@ class SparseByteBuffer {
   struct Region {
     Region();
     Region(const Region& other);
+    Region& operator=(const Region& other);
     ~Region();
 
     size_t position() { return iter_->first; }
-    size_t size() { return iter_->second.size(); }
-    uint8_t* data() { return iter_->second.data(); }
+    size_t size() { return iter_->second->size(); }
+    uint8_t* data() { return iter_->second->data(); }
+
+    // Returns a pointer to the region's content that shares ownership of it.
+    // The content outlives the region (see Free) while such pointers exist.
+    std::shared_ptr<const uint8_t> shared_data();
 
    private:
-    explicit Region(std::map<size_t, std::vector<uint8_t>>::iterator iter);
+    explicit Region(
+        std::map<size_t, std::shared_ptr<std::vector<uint8_t>>>::iterator iter);
 
-    std::map<size_t, std::vector<uint8_t>>::iterator iter_;
+    std::map<size_t, std::shared_ptr<std::vector<uint8_t>>>::iterator iter_;
 
     friend bool operator==(const Region& a, const Region& b);
     friend bool operator!=(const Region& a, const Region& b);
@@ -80,13 +88,32 @@ class SparseByteBuffer {
   // return null_hole().
   Hole Fill(Hole hole, std::vector<uint8_t>&& buffer);
 
+  // Removes a region, returning its content to holes. The new hole is merged
+  // with adjacent holes, so holes obtained previously may be invalidated. Free
+  // returns the hole that now covers the region. If buffer_out isn't null, the
+  // region's buffer is moved there, or copied if pointers obtained from
+  // Region::shared_data still refer to it.
+  Hole Free(Region region, std::vector<uint8_t>* buffer_out);
+
+  // Returns the first region in position order or null_region() if there are
+  // no regions.
+  Region first_region() { return Region(regions_.begin()); }
+
+  // Returns the region following the specified region in position order or
+  // null_region() if there is none.
+  Region NextRegion(Region region);
+
  private:
   using HolesIter = std::map<size_t, size_t>::iterator;
-  using RegionsIter = std::map<size_t, std::vector<uint8_t>>::iterator;
+  using RegionsIter =
+      std::map<size_t, std::shared_ptr<std::vector<uint8_t>>>::iterator;
 
   size_t size_ = 0u;
-  std::map<size_t, size_t> holes_;                  // Hole sizes by position.
-  std::map<size_t, std::vector<uint8_t>> regions_;  // Buffers by position.
+  // Hole sizes by position.
+  std::map<size_t, size_t> holes_;
+  // Buffers by position. Buffers are shared so region content can be lent
+  // out (see Region::shared_data).
+  std::map<size_t, std::shared_ptr<std::vector<uint8_t>>> regions_;
 };
 
 bool operator==(const SparseByteBuffer::Hole& a,
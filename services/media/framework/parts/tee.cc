@@ -0,0 +1,22 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/logging.h"
+#include "services/media/framework/parts/tee.h"
+
+namespace mojo {
+namespace media {
+
+Tee::Tee(size_t output_count) : output_count_(output_count) {
+  DCHECK(output_count_ != 0);
+}
+
+Tee::~Tee() {}
+
+size_t Tee::output_count() const {
+  return output_count_;
+}
+
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,36 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_PARTS_TEE_H_
+#define SERVICES_MEDIA_FRAMEWORK_PARTS_TEE_H_
+
+#include <memory>
+
+#include "services/media/framework/models/fan_out.h"
+
+namespace mojo {
+namespace media {
+
+// Fan-out with a fixed number of outputs.
+class Tee : public FanOut {
+ public:
+  static std::shared_ptr<Tee> Create(size_t output_count) {
+    return std::shared_ptr<Tee>(new Tee(output_count));
+  }
+
+  ~Tee() override;
+
+  // FanOut implementation.
+  size_t output_count() const override;
+
+ private:
+  explicit Tee(size_t output_count);
+
+  size_t output_count_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_PARTS_TEE_H_
@@ -0,0 +1,128 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/logging.h"
+#include "services/media/framework/parts/threaded_transform.h"
+
+namespace mojo {
+namespace media {
+
+ThreadedTransform::ThreadedTransform(std::shared_ptr<Transform> transform,
+                                     size_t max_packets_in_flight)
+    : transform_(transform),
+      max_packets_in_flight_(max_packets_in_flight),
+      generation_(0),
+      transform_generation_(0),
+      sequence_(new Scheduler::Sequence(Scheduler::GetDefault())) {
+  DCHECK(transform_);
+  DCHECK(max_packets_in_flight_ != 0);
+}
+
+ThreadedTransform::~ThreadedTransform() {}
+
+size_t ThreadedTransform::max_packets_in_flight() const {
+  return max_packets_in_flight_;
+}
+
+void ThreadedTransform::SetOutputCallback(
+    const OutputCallback& output_callback) {
+  base::AutoLock lock(lock_);
+  output_callback_ = output_callback;
+}
+
+void ThreadedTransform::TransformPacket(PacketPtr input,
+                                        PayloadAllocator* allocator) {
+  DCHECK(input);
+  DCHECK(allocator);
+
+  {
+    base::AutoLock lock(lock_);
+    DCHECK(jobs_.size() < max_packets_in_flight_);
+    jobs_.push_back(Job{std::move(input), allocator, generation_});
+  }
+
+  sequence_->Post([this]() { RunJob(); });
+}
+
+void ThreadedTransform::Flush() {
+  {
+    base::AutoLock lock(lock_);
+    jobs_.clear();
+    ++generation_;
+  }
+
+  // A job in progress, if any, stops at its next output. transform_ is flushed
+  // once that job is done.
+  sequence_->Post([this]() { CatchUpWithFlushes(); });
+}
+
+void ThreadedTransform::RunJob() {
+  Job job;
+  OutputCallback output_callback;
+  bool flush_transform;
+
+  {
+    base::AutoLock lock(lock_);
+    if (jobs_.empty()) {
+      // The job was flushed.
+      return;
+    }
+
+    job = std::move(jobs_.front());
+    jobs_.pop_front();
+    output_callback = output_callback_;
+
+    // Flush clears jobs_ when it advances the generation, so the job is from
+    // the current generation. If the task Flush posted hasn't run yet,
+    // transform_ needs flushing before it gets the job.
+    flush_transform = job.generation != transform_generation_;
+    transform_generation_ = job.generation;
+  }
+
+  if (flush_transform) {
+    transform_->Flush();
+  }
+
+  bool new_input = true;
+  bool input_consumed = false;
+  while (!input_consumed) {
+    PacketPtr output;
+    input_consumed = transform_->TransformPacket(job.input, new_input,
+                                                 job.allocator, &output);
+    new_input = false;
+
+    if (output || input_consumed) {
+      bool flushed;
+      {
+        base::AutoLock lock(lock_);
+        flushed = job.generation != generation_;
+      }
+
+      if (flushed) {
+        // Stale output. The caller discards any output delivered after the
+        // flush, so this just saves work.
+        break;
+      }
+
+      DCHECK(output_callback);
+      output_callback(std::move(output), input_consumed);
+    }
+  }
+}
+
+void ThreadedTransform::CatchUpWithFlushes() {
+  {
+    base::AutoLock lock(lock_);
+    if (transform_generation_ == generation_) {
+      return;
+    }
+
+    transform_generation_ = generation_;
+  }
+
+  transform_->Flush();
+}
+
+}  // namespace media
+}  // namespace mojo
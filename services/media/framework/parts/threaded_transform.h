@@ -0,0 +1,85 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_PARTS_THREADED_TRANSFORM_H_
+#define SERVICES_MEDIA_FRAMEWORK_PARTS_THREADED_TRANSFORM_H_
+
+#include <deque>
+#include <memory>
+
+#include "base/synchronization/lock.h"
+#include "services/media/framework/models/async_transform.h"
+#include "services/media/framework/models/transform.h"
+#include "services/media/framework/scheduler.h"
+
+namespace mojo {
+namespace media {
+
+// Async transform that runs a synchronous transform as a sequence of blocking
+// tasks on the process-wide scheduler (see Scheduler::GetDefault). This allows
+// a transform that does a lot of work per packet, such as a video decoder, to
+// run without holding up the engine, and the scheduler caps the number of
+// threads doing such work.
+class ThreadedTransform : public AsyncTransform {
+ public:
+  // Creates a ThreadedTransform hosting transform. max_packets_in_flight is the
+  // number of input packets that may be queued for processing.
+  static std::shared_ptr<ThreadedTransform> Create(
+      std::shared_ptr<Transform> transform,
+      size_t max_packets_in_flight) {
+    return std::shared_ptr<ThreadedTransform>(
+        new ThreadedTransform(transform, max_packets_in_flight));
+  }
+
+  ~ThreadedTransform() override;
+
+  // AsyncTransform implementation.
+  size_t max_packets_in_flight() const override;
+
+  void SetOutputCallback(const OutputCallback& output_callback) override;
+
+  void TransformPacket(PacketPtr input, PayloadAllocator* allocator) override;
+
+  void Flush() override;
+
+ private:
+  ThreadedTransform(std::shared_ptr<Transform> transform,
+                    size_t max_packets_in_flight);
+
+  // An input packet waiting to be transformed.
+  struct Job {
+    PacketPtr input;
+    PayloadAllocator* allocator;
+    // The value of generation_ when the job was queued.
+    uint64_t generation;
+  };
+
+  // Transforms the oldest queued input packet. Runs on sequence_.
+  void RunJob();
+
+  // Flushes transform_ if Flush has been called since it was last flushed.
+  // Runs on sequence_, so the flush is serialized with the jobs.
+  void CatchUpWithFlushes();
+
+  std::shared_ptr<Transform> transform_;
+  size_t max_packets_in_flight_;
+
+  base::Lock lock_;
+  // The following fields are protected by lock_.
+  OutputCallback output_callback_;
+  std::deque<Job> jobs_;
+  // Incremented by Flush. A running job whose generation is stale stops
+  // producing output.
+  uint64_t generation_;
+  // The generation as of the last time transform_ was flushed.
+  uint64_t transform_generation_;
+
+  // Declared last so it's destroyed first, waiting for a running job.
+  std::unique_ptr<Scheduler::Sequence> sequence_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_PARTS_THREADED_TRANSFORM_H_
@@ -0,0 +1,185 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_PARTS_TRANSFORM_PIPELINE_H_
+#define SERVICES_MEDIA_FRAMEWORK_PARTS_TRANSFORM_PIPELINE_H_
+
+#include <memory>
+#include <utility>
+
+#include "base/logging.h"
+#include "services/media/framework/models/transform.h"
+
+namespace mojo {
+namespace media {
+
+// Transform that runs a fixed sequence of transforms whose types are known at
+// compile time. Ts are the types of the transforms, most upstream first.
+//
+// The transforms are held by value, so calls to them aren't virtual and can be
+// inlined, and packets pass from one to the next without the engine's
+// involvement. Adding the transforms to a graph separately costs a virtual
+// call, a shared_ptr and a packet hop per transform.
+//
+// A type in Ts needn't derive from Transform, but it must provide Flush and
+// TransformPacket with the same meanings, and it must be movable or copyable.
+// DynamicTransform wraps a transform whose type is only known at run time,
+// such as a decoder.
+//
+// The last transform uses the allocator passed to TransformPacket. The others
+// use the allocator passed to SetIntermediateAllocator, which the hosting
+// stage sets to its default allocator, or PayloadAllocator::GetDefault() if
+// none has been set.
+template <typename... Ts>
+class TransformPipeline;
+
+// Pipeline element that delegates to a transform whose type is only known at
+// run time.
+class DynamicTransform {
+ public:
+  explicit DynamicTransform(std::shared_ptr<Transform> transform)
+      : transform_(transform) {
+    DCHECK(transform_);
+  }
+
+  void Flush() { transform_->Flush(); }
+
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) {
+    return transform_->TransformPacket(input, new_input, allocator, output);
+  }
+
+ private:
+  std::shared_ptr<Transform> transform_;
+};
+
+// Pipeline consisting of a single transform.
+template <typename T>
+class TransformPipeline<T> : public Transform {
+ public:
+  explicit TransformPipeline(T transform) : transform_(std::move(transform)) {}
+
+  ~TransformPipeline() override {}
+
+  // Transform implementation.
+  void Flush() override { transform_.Flush(); }
+
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) override {
+    return transform_.TransformPacket(input, new_input, allocator, output);
+  }
+
+ private:
+  T transform_;
+};
+
+// Pipeline consisting of a transform (the head) followed by a pipeline of one
+// or more transforms (the tail).
+template <typename T, typename... Ts>
+class TransformPipeline<T, Ts...> : public Transform {
+ public:
+  TransformPipeline(T head, Ts... tail)
+      : head_(std::move(head)),
+        tail_(std::move(tail)...),
+        input_is_new_(true),
+        input_consumed_(true),
+        tail_input_is_new_(true),
+        intermediate_allocator_(PayloadAllocator::GetDefault()) {}
+
+  ~TransformPipeline() override {}
+
+  // Transform implementation.
+  void Flush() override {
+    head_.Flush();
+    tail_.Flush();
+    tail_input_.reset();
+    tail_input_is_new_ = true;
+    input_is_new_ = true;
+    input_consumed_ = true;
+  }
+
+  void SetIntermediateAllocator(PayloadAllocator* allocator) override {
+    DCHECK(allocator);
+    intermediate_allocator_ = allocator;
+    tail_.SetIntermediateAllocator(allocator);
+  }
+
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) override {
+    DCHECK(input);
+    DCHECK(allocator);
+    DCHECK(output);
+
+    if (new_input) {
+      input_is_new_ = true;
+      input_consumed_ = false;
+    }
+
+    while (true) {
+      // Drain the tail first, so at most one packet waits between the head and
+      // the tail.
+      if (tail_input_) {
+        bool tail_input_consumed = tail_.TransformPacket(
+            tail_input_, tail_input_is_new_, allocator, output);
+        tail_input_is_new_ = tail_input_consumed;
+        if (tail_input_consumed) {
+          tail_input_.reset();
+        }
+
+        if (*output) {
+          // The input is done with only if nothing derived from it remains.
+          return input_consumed_ && !tail_input_;
+        }
+
+        if (!tail_input_consumed) {
+          // No progress was made.
+          return false;
+        }
+
+        continue;
+      }
+
+      if (input_consumed_) {
+        return true;
+      }
+
+      PacketPtr head_output;
+      input_consumed_ = head_.TransformPacket(
+          input, input_is_new_, intermediate_allocator_, &head_output);
+      input_is_new_ = false;
+
+      if (!head_output) {
+        // Either the input is done with, or no progress was made.
+        return input_consumed_;
+      }
+
+      tail_input_ = std::move(head_output);
+    }
+  }
+
+ private:
+  T head_;
+  TransformPipeline<Ts...> tail_;
+  // Whether the input hasn't been passed to head_ yet.
+  bool input_is_new_;
+  // Whether head_ is done with the input.
+  bool input_consumed_;
+  // Output of head_ waiting to be processed by tail_.
+  PacketPtr tail_input_;
+  // Whether tail_input_ hasn't been passed to tail_ yet.
+  bool tail_input_is_new_;
+  // Allocator for head_'s output packets.
+  PayloadAllocator* intermediate_allocator_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_PARTS_TRANSFORM_PIPELINE_H_
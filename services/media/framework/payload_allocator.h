@@ -13,7 +13,8 @@ namespace media {
 // Abstract base class for objects that allocate buffers for packets.
 class PayloadAllocator {
  public:
-  // Gets the default allocator, which allocates vanilla memory from the heap.
+  // Gets the default allocator, which allocates memory from the heap and
+  // recycles it by size class. See SlabAllocator.
   static PayloadAllocator* GetDefault();
 
   // Allocates and returns a buffer of the indicated size or returns nullptr
@@ -78,6 +78,11 @@ const InputRef& OutputRef::mate() const {
   return actual().mate();
 }
 
+bool OutputRef::copies_payloads() const {
+  DCHECK(valid());
+  return actual().copy_allocator() != nullptr;
+}
+
 OutputRef::OutputRef(Stage* stage, size_t index)
     : stage_(stage), index_(index) {
   DCHECK(valid());
@@ -136,6 +136,11 @@ class OutputRef {
   // an invalid reference if this output isn't connected to an input.
   const InputRef& mate() const;
 
+  // Indicates whether this output copies the payloads of the packets it
+  // supplies, because the part can't use the allocator required by the
+  // connected input. Only meaningful once the output is prepared.
+  bool copies_payloads() const;
+
  private:
   OutputRef(Stage* stage, size_t index);
 
@@ -0,0 +1,289 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "services/media/framework/scheduler.h"
+
+namespace mojo {
+namespace media {
+
+Scheduler::Queue::Queue(std::shared_ptr<Scheduler> scheduler, uint32_t weight)
+    : scheduler_(scheduler),
+      weight_(weight),
+      virtual_time_(0),
+      ready_(false),
+      running_(false) {
+  DCHECK(scheduler_);
+  DCHECK(weight_ != 0);
+}
+
+Scheduler::Queue::~Queue() {
+  base::AutoLock lock(scheduler_->lock_);
+  while (ready_ || running_ || !tasks_.empty() || !deferred_tasks_.empty()) {
+    scheduler_->idle_condition_variable_.Wait();
+  }
+}
+
+void Scheduler::Queue::SetWeight(uint32_t weight) {
+  DCHECK(weight != 0);
+  base::AutoLock lock(scheduler_->lock_);
+  weight_ = weight;
+}
+
+void Scheduler::Queue::Post(const Task& task) {
+  DCHECK(task);
+  base::AutoLock lock(scheduler_->lock_);
+  tasks_.push_back(task);
+  scheduler_->MakeReady(this);
+}
+
+void Scheduler::Queue::PostDeferred(const Task& task) {
+  DCHECK(task);
+  base::AutoLock lock(scheduler_->lock_);
+  deferred_tasks_.push_back(task);
+  scheduler_->MakeReady(this);
+}
+
+Scheduler::Sequence::Sequence(std::shared_ptr<Scheduler> scheduler)
+    : scheduler_(scheduler), ready_(false), running_(false) {
+  DCHECK(scheduler_);
+}
+
+Scheduler::Sequence::~Sequence() {
+  DCHECK(!RunsTasksOnCurrentThread()) << "sequence destroyed by its own task";
+
+  base::AutoLock lock(scheduler_->lock_);
+  tasks_.clear();
+  while (running_) {
+    scheduler_->idle_condition_variable_.Wait();
+  }
+
+  // The task that was running may have posted more tasks.
+  tasks_.clear();
+
+  if (ready_) {
+    std::deque<Sequence*>& ready_sequences = scheduler_->ready_sequences_;
+    ready_sequences.erase(
+        std::find(ready_sequences.begin(), ready_sequences.end(), this));
+    ready_ = false;
+  }
+}
+
+void Scheduler::Sequence::Post(const Task& task) {
+  DCHECK(task);
+  base::AutoLock lock(scheduler_->lock_);
+  tasks_.push_back(task);
+  scheduler_->MakeReady(this);
+}
+
+bool Scheduler::Sequence::RunsTasksOnCurrentThread() const {
+  base::AutoLock lock(scheduler_->lock_);
+  return running_ && thread_id_ == std::this_thread::get_id();
+}
+
+// static
+const base::TimeDelta Scheduler::kTimeSlice =
+    base::TimeDelta::FromMilliseconds(2);
+
+// static
+std::shared_ptr<Scheduler> Scheduler::Create(size_t worker_count,
+                                             size_t blocking_thread_count) {
+  return std::shared_ptr<Scheduler>(
+      new Scheduler(worker_count, blocking_thread_count));
+}
+
+// static
+std::shared_ptr<Scheduler> Scheduler::GetDefault() {
+  // Intentionally leaked, so the threads aren't joined during static
+  // destruction.
+  static std::shared_ptr<Scheduler>* default_scheduler =
+      new std::shared_ptr<Scheduler>(Create(0, 0));
+  return *default_scheduler;
+}
+
+Scheduler::Scheduler(size_t worker_count, size_t blocking_thread_count)
+    : queue_condition_variable_(&lock_),
+      sequence_condition_variable_(&lock_),
+      idle_condition_variable_(&lock_),
+      virtual_time_(0),
+      terminating_(false) {
+  size_t hardware_thread_count =
+      std::max(std::thread::hardware_concurrency(), 1u);
+
+  if (worker_count == 0) {
+    worker_count = hardware_thread_count;
+  }
+
+  if (blocking_thread_count == 0) {
+    blocking_thread_count = hardware_thread_count;
+  }
+
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(&Scheduler::RunQueues, this);
+  }
+
+  for (size_t i = 0; i < blocking_thread_count; ++i) {
+    blocking_threads_.emplace_back(&Scheduler::RunSequences, this);
+  }
+}
+
+Scheduler::~Scheduler() {
+  // Queues and sequences keep the scheduler alive, so none remain.
+  {
+    base::AutoLock lock(lock_);
+    DCHECK(ready_queues_.empty());
+    DCHECK(ready_sequences_.empty());
+    terminating_ = true;
+  }
+
+  queue_condition_variable_.Broadcast();
+  sequence_condition_variable_.Broadcast();
+
+  std::thread::id id = std::this_thread::get_id();
+  for (std::thread& thread : workers_) {
+    DCHECK(thread.get_id() != id) << "scheduler destroyed by one of its tasks";
+    thread.join();
+  }
+
+  for (std::thread& thread : blocking_threads_) {
+    DCHECK(thread.get_id() != id) << "scheduler destroyed by one of its tasks";
+    thread.join();
+  }
+}
+
+void Scheduler::MakeReady(Queue* queue) {
+  DCHECK(queue);
+
+  if (queue->ready_ || queue->running_) {
+    // A worker will get to the new task.
+    return;
+  }
+
+  queue->virtual_time_ = std::max(queue->virtual_time_, virtual_time_);
+  ready_queues_.emplace(queue->virtual_time_, queue);
+  queue->ready_ = true;
+  queue_condition_variable_.Signal();
+}
+
+void Scheduler::MakeReady(Sequence* sequence) {
+  DCHECK(sequence);
+
+  if (sequence->ready_ || sequence->running_) {
+    return;
+  }
+
+  ready_sequences_.push_back(sequence);
+  sequence->ready_ = true;
+  sequence_condition_variable_.Signal();
+}
+
+void Scheduler::RunQueues() {
+  base::AutoLock lock(lock_);
+
+  while (true) {
+    while (!terminating_ && ready_queues_.empty()) {
+      queue_condition_variable_.Wait();
+    }
+
+    if (ready_queues_.empty()) {
+      DCHECK(terminating_);
+      return;
+    }
+
+    // Take the queue that's had the least time.
+    auto iter = ready_queues_.begin();
+    Queue* queue = iter->second;
+    virtual_time_ = iter->first;
+    ready_queues_.erase(iter);
+    queue->ready_ = false;
+    queue->running_ = true;
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    base::TimeDelta elapsed;
+
+    while (true) {
+      Task task;
+      if (!queue->tasks_.empty()) {
+        task = std::move(queue->tasks_.front());
+        queue->tasks_.pop_front();
+      } else if (!queue->deferred_tasks_.empty()) {
+        task = std::move(queue->deferred_tasks_.front());
+        queue->deferred_tasks_.pop_front();
+      } else {
+        break;
+      }
+
+      {
+        base::AutoUnlock unlock(lock_);
+        task();
+        task = nullptr;
+      }
+
+      elapsed = base::TimeTicks::Now() - start;
+      if (elapsed >= kTimeSlice && !ready_queues_.empty()) {
+        // Other queues are waiting. Give them a turn.
+        break;
+      }
+    }
+
+    // Charge the queue for the time it got, scaled by its weight. The queue is
+    // always charged something, so queues with very short tasks take turns.
+    uint64_t charge =
+        static_cast<uint64_t>(std::max(elapsed.InNanoseconds(), int64_t(1)));
+    queue->virtual_time_ += std::max(charge / queue->weight_, uint64_t(1));
+    queue->running_ = false;
+
+    if (!queue->tasks_.empty() || !queue->deferred_tasks_.empty()) {
+      MakeReady(queue);
+    } else {
+      idle_condition_variable_.Broadcast();
+    }
+  }
+}
+
+void Scheduler::RunSequences() {
+  base::AutoLock lock(lock_);
+
+  while (true) {
+    while (!terminating_ && ready_sequences_.empty()) {
+      sequence_condition_variable_.Wait();
+    }
+
+    if (ready_sequences_.empty()) {
+      DCHECK(terminating_);
+      return;
+    }
+
+    Sequence* sequence = ready_sequences_.front();
+    ready_sequences_.pop_front();
+    sequence->ready_ = false;
+    sequence->running_ = true;
+    sequence->thread_id_ = std::this_thread::get_id();
+
+    DCHECK(!sequence->tasks_.empty());
+    Task task = std::move(sequence->tasks_.front());
+    sequence->tasks_.pop_front();
+
+    {
+      base::AutoUnlock unlock(lock_);
+      task();
+      task = nullptr;
+    }
+
+    sequence->running_ = false;
+    sequence->thread_id_ = std::thread::id();
+
+    // Other sequences go first if they're waiting.
+    if (!sequence->tasks_.empty()) {
+      MakeReady(sequence);
+    }
+
+    idle_condition_variable_.Broadcast();
+  }
+}
+
+}  // namespace media
+}  // namespace mojo
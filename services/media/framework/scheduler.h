@@ -0,0 +1,171 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_SCHEDULER_H_
+#define SERVICES_MEDIA_FRAMEWORK_SCHEDULER_H_
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+
+namespace mojo {
+namespace media {
+
+//
+// Scheduler runs the work of many graphs on a fixed set of threads.
+//
+// Graph updates are posted to queues, one per graph (see
+// Graph::UseScheduler). A fixed pool of workers runs the queues. A worker takes
+// the queue that has received the least weighted time so far and runs its
+// tasks for up to a time slice before moving on, so a busy graph can't starve
+// the others, and a graph with twice the weight gets twice the time when
+// graphs compete. Only one worker runs a given queue at a time.
+//
+// Blocking work, such as file I/O and decoding, is posted to sequences. Tasks
+// posted to a sequence run in order, one at a time, on a separate set of
+// threads whose size is capped, so the number of threads doing this work
+// doesn't grow with the number of graphs. Sequences take turns one task at a
+// time.
+//
+// Tasks must not block waiting for other tasks. Work that waits indefinitely
+// on other threads, like the ffmpeg demux's synchronous reads, runs on threads
+// of its own.
+//
+class Scheduler {
+ public:
+  using Task = std::function<void()>;
+
+  // Tasks for one client (typically a graph), scheduled fairly with respect to
+  // other queues. Destroying a queue waits until all the tasks posted to it,
+  // including tasks posted by those tasks, have run. A queue must not be
+  // destroyed by one of its own tasks.
+  class Queue {
+   public:
+    Queue(std::shared_ptr<Scheduler> scheduler, uint32_t weight);
+
+    ~Queue();
+
+    // Sets the weight of this queue relative to other queues. weight must be
+    // non-zero.
+    void SetWeight(uint32_t weight);
+
+    // Posts a task to the queue.
+    void Post(const Task& task);
+
+    // Posts a task that runs after the tasks posted with Post that are queued
+    // at the time it's reached.
+    void PostDeferred(const Task& task);
+
+   private:
+    std::shared_ptr<Scheduler> scheduler_;
+
+    // The following fields are protected by scheduler_->lock_.
+    std::deque<Task> tasks_;
+    std::deque<Task> deferred_tasks_;
+    uint32_t weight_;
+    // Run time received so far divided by weight_, in nanoseconds.
+    uint64_t virtual_time_;
+    bool ready_;
+    bool running_;
+
+    friend class Scheduler;
+  };
+
+  // Tasks that block, run in order one at a time. Destroying a sequence
+  // discards the tasks that haven't started and waits for a running task to
+  // complete. A sequence must not be destroyed by one of its own tasks.
+  class Sequence {
+   public:
+    explicit Sequence(std::shared_ptr<Scheduler> scheduler);
+
+    ~Sequence();
+
+    // Posts a task to the sequence.
+    void Post(const Task& task);
+
+    // Determines whether the calling thread is running a task from this
+    // sequence.
+    bool RunsTasksOnCurrentThread() const;
+
+   private:
+    std::shared_ptr<Scheduler> scheduler_;
+
+    // The following fields are protected by scheduler_->lock_.
+    std::deque<Task> tasks_;
+    bool ready_;
+    bool running_;
+    std::thread::id thread_id_;
+
+    friend class Scheduler;
+  };
+
+  // Creates a scheduler with worker_count threads for running queues and at
+  // most blocking_thread_count threads for running sequences. If either count
+  // is zero, the number of hardware threads is used.
+  static std::shared_ptr<Scheduler> Create(size_t worker_count,
+                                           size_t blocking_thread_count);
+
+  // Returns the process-wide scheduler, creating it if necessary.
+  static std::shared_ptr<Scheduler> GetDefault();
+
+  ~Scheduler();
+
+  // Returns the number of threads running queues.
+  size_t worker_count() const { return workers_.size(); }
+
+  // Returns the number of threads running sequences.
+  size_t blocking_thread_count() const { return blocking_threads_.size(); }
+
+ private:
+  // Longest time a worker runs one queue while other queues are waiting.
+  static const base::TimeDelta kTimeSlice;
+
+  Scheduler(size_t worker_count, size_t blocking_thread_count);
+
+  // Makes the queue ready to run. Called with lock_ held.
+  void MakeReady(Queue* queue);
+
+  // Makes the sequence ready to run. Called with lock_ held.
+  void MakeReady(Sequence* sequence);
+
+  // Runs on each of workers_.
+  void RunQueues();
+
+  // Runs on each of blocking_threads_.
+  void RunSequences();
+
+  base::Lock lock_;
+  // Signalled when a queue becomes ready or terminating_ is set.
+  base::ConditionVariable queue_condition_variable_;
+  // Signalled when a sequence becomes ready or terminating_ is set.
+  base::ConditionVariable sequence_condition_variable_;
+  // Signalled when a queue or sequence stops running.
+  base::ConditionVariable idle_condition_variable_;
+
+  // The following fields are protected by lock_.
+  // Ready queues ordered by virtual time. Queues with the same virtual time are
+  // in the order they became ready.
+  std::multimap<uint64_t, Queue*> ready_queues_;
+  // Virtual time of the queue most recently started. A queue that becomes
+  // ready after being idle starts no earlier than this, so idle time doesn't
+  // accumulate as credit.
+  uint64_t virtual_time_;
+  std::deque<Sequence*> ready_sequences_;
+  bool terminating_;
+
+  std::vector<std::thread> workers_;
+  std::vector<std::thread> blocking_threads_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_SCHEDULER_H_
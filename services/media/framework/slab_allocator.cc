@@ -0,0 +1,371 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "base/bits.h"
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+#include "services/media/framework/slab_allocator.h"
+#include "services/media/framework/types/audio_stream_type.h"
+#include "services/media/framework/types/video_stream_type.h"
+
+namespace mojo {
+namespace media {
+
+namespace {
+
+// Sizes up to this are all rounded up to this.
+static constexpr size_t kMinSlabSize = 64;
+static constexpr size_t kMinSlabSizeLog2 = 6;
+
+// Size classes per power of two.
+static constexpr size_t kClassesPerDoubling = 4;
+
+// Number of size classes, enough to reach SlabAllocator::kMaxSlabSize.
+static constexpr size_t kMaxSlabSizeLog2 = 24;
+static constexpr size_t kClassCount =
+    (kMaxSlabSizeLog2 - kMinSlabSizeLog2) * kClassesPerDoubling + 1;
+static_assert(SlabAllocator::kMaxSlabSize == 1u << kMaxSlabSizeLog2,
+              "kMaxSlabSizeLog2 doesn't match kMaxSlabSize");
+
+// A thread cache keeps at most this many bytes of buffers per size class...
+static constexpr size_t kThreadCacheBytesPerClass = 1024 * 1024;
+
+// ...and no more than this many buffers.
+static constexpr size_t kMaxThreadCacheBuffersPerClass = 32;
+static_assert(SlabAllocator::kMaxThreadCacheSize <=
+                  kThreadCacheBytesPerClass / 2,
+              "Thread caches must hold at least two buffers per class");
+
+// For prewarming from an audio stream type, the duration of a typical packet
+// from a decoder as a fraction of a second. 1/40 of a second is 1200 frames at
+// 48kHz, which is in the same size class as most decoders' output.
+static constexpr uint32_t kTypicalAudioPacketsPerSecond = 40;
+
+// Returns the size class for the given size, which must not exceed
+// SlabAllocator::kMaxSlabSize.
+size_t ClassForSize(size_t size) {
+  DCHECK(size <= SlabAllocator::kMaxSlabSize);
+  if (size <= kMinSlabSize) {
+    return 0;
+  }
+
+  // Class sizes from 2^n (exclusive) to 2^(n+1) (inclusive) are 2^n * 5/4,
+  // 2^n * 6/4, 2^n * 7/4 and 2^(n+1).
+  size_t log2 = base::bits::Log2Floor(static_cast<uint32_t>(size - 1));
+  size_t quarters = (size - 1) >> (log2 - 2);  // 4..7
+  return (log2 - kMinSlabSizeLog2) * kClassesPerDoubling + quarters - 3;
+}
+
+// Returns the buffer size for the given size class.
+size_t SizeForClass(size_t size_class) {
+  DCHECK(size_class < kClassCount);
+  if (size_class == 0) {
+    return kMinSlabSize;
+  }
+
+  size_t log2 = (size_class - 1) / kClassesPerDoubling + kMinSlabSizeLog2;
+  size_t quarters = (size_class - 1) % kClassesPerDoubling + 5;  // 5..8
+  return (static_cast<size_t>(1) << (log2 - 2)) * quarters;
+}
+
+// Returns the number of buffers a thread cache keeps for the size class, which
+// is zero for classes larger than SlabAllocator::kMaxThreadCacheSize.
+size_t ThreadCacheCapacity(size_t size_class) {
+  size_t size = SizeForClass(size_class);
+  if (size > SlabAllocator::kMaxThreadCacheSize) {
+    return 0;
+  }
+
+  return std::min(kMaxThreadCacheBuffersPerClass,
+                  kThreadCacheBytesPerClass / size);
+}
+
+}  // namespace
+
+constexpr size_t SlabAllocator::kMaxSlabSize;
+constexpr size_t SlabAllocator::kDefaultMaxRetainedBytes;
+constexpr size_t SlabAllocator::kMaxThreadCacheSize;
+constexpr size_t SlabAllocator::kMaxThreadCacheBytes;
+
+// Free lists shared by all threads.
+class SlabAllocator::Central {
+ public:
+  explicit Central(size_t max_retained_bytes)
+      : max_retained_bytes_(max_retained_bytes),
+        retained_bytes_(0),
+        closed_(false) {}
+
+  ~Central() {
+    for (size_t size_class = 0; size_class < kClassCount; ++size_class) {
+      for (void* buffer : free_lists_[size_class]) {
+        std::free(buffer);
+      }
+    }
+  }
+
+  // Indicates whether the allocator that owns this object has been deleted.
+  bool closed() const { return closed_; }
+
+  void Close() { closed_ = true; }
+
+  size_t retained_bytes() {
+    base::AutoLock lock(lock_);
+    return retained_bytes_;
+  }
+
+  // Moves up to count buffers of the indicated class to buffers. Returns the
+  // number of buffers moved.
+  size_t Take(size_t size_class, size_t count, std::vector<void*>* buffers) {
+    DCHECK(buffers);
+    base::AutoLock lock(lock_);
+    std::vector<void*>& free_list = free_lists_[size_class];
+    count = std::min(count, free_list.size());
+    buffers->insert(buffers->end(), free_list.end() - count, free_list.end());
+    free_list.resize(free_list.size() - count);
+    retained_bytes_ -= count * SizeForClass(size_class);
+    return count;
+  }
+
+  // Moves the last count buffers of the indicated class from buffers to the
+  // free list, freeing the ones that would exceed the retention limit.
+  void Give(size_t size_class, size_t count, std::vector<void*>* buffers) {
+    DCHECK(buffers);
+    DCHECK(count <= buffers->size());
+    size_t size = SizeForClass(size_class);
+
+    base::AutoLock lock(lock_);
+    std::vector<void*>& free_list = free_lists_[size_class];
+    while (count != 0) {
+      void* buffer = buffers->back();
+      buffers->pop_back();
+      --count;
+
+      if (retained_bytes_ + size > max_retained_bytes_) {
+        std::free(buffer);
+      } else {
+        free_list.push_back(buffer);
+        retained_bytes_ += size;
+      }
+    }
+  }
+
+ private:
+  const size_t max_retained_bytes_;
+
+  base::Lock lock_;
+  std::vector<void*> free_lists_[kClassCount];  // Protected by lock_.
+  size_t retained_bytes_;                        // Protected by lock_.
+
+  std::atomic_bool closed_;
+};
+
+// A thread's buffers for one allocator.
+class SlabAllocator::ThreadCache {
+ public:
+  explicit ThreadCache(std::shared_ptr<Central> central)
+      : central_(central), cached_bytes_(0) {}
+
+  ~ThreadCache() {
+    for (size_t size_class = 0; size_class < kClassCount; ++size_class) {
+      std::vector<void*>& buffers = buffers_[size_class];
+      if (central_->closed()) {
+        for (void* buffer : buffers) {
+          std::free(buffer);
+        }
+      } else {
+        central_->Give(size_class, buffers.size(), &buffers);
+      }
+    }
+  }
+
+  const std::shared_ptr<Central>& central() const { return central_; }
+
+  void* Allocate(size_t size_class) {
+    std::vector<void*>& buffers = buffers_[size_class];
+    size_t size = SizeForClass(size_class);
+
+    if (buffers.empty()) {
+      // Take one buffer to return and, space permitting, half a cache's worth
+      // to keep.
+      size_t count = std::min(ThreadCacheCapacity(size_class) / 2,
+                              (kMaxThreadCacheBytes - cached_bytes_) / size);
+      count = central_->Take(size_class, count + 1, &buffers);
+      if (count == 0) {
+        return std::malloc(size);
+      }
+
+      cached_bytes_ += count * size;
+    }
+
+    void* buffer = buffers.back();
+    buffers.pop_back();
+    cached_bytes_ -= size;
+    return buffer;
+  }
+
+  void Release(size_t size_class, void* buffer) {
+    std::vector<void*>& buffers = buffers_[size_class];
+    size_t size = SizeForClass(size_class);
+    size_t capacity = ThreadCacheCapacity(size_class);
+
+    if (capacity != 0 && buffers.size() >= capacity) {
+      // Give half the cache back, so alternating allocations and releases
+      // don't move buffers back and forth.
+      central_->Give(size_class, capacity / 2, &buffers);
+      cached_bytes_ -= capacity / 2 * size;
+    }
+
+    buffers.push_back(buffer);
+    cached_bytes_ += size;
+
+    if (buffers.size() > capacity || cached_bytes_ > kMaxThreadCacheBytes) {
+      // The buffer doesn't fit in the cache.
+      central_->Give(size_class, 1, &buffers);
+      cached_bytes_ -= size;
+    }
+  }
+
+ private:
+  std::shared_ptr<Central> central_;
+  std::vector<void*> buffers_[kClassCount];
+  // Total size of the buffers in buffers_.
+  size_t cached_bytes_;
+};
+
+// All of a thread's caches. Destroyed when the thread exits.
+class SlabAllocator::ThreadCacheList {
+ public:
+  ThreadCache* Get(const std::shared_ptr<Central>& central) {
+    for (auto iter = caches_.begin(); iter != caches_.end();) {
+      if ((*iter)->central() == central) {
+        return iter->get();
+      }
+
+      if ((*iter)->central()->closed()) {
+        // The allocator is gone. Free the buffers we were keeping for it.
+        iter = caches_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+
+    caches_.emplace_back(new ThreadCache(central));
+    return caches_.back().get();
+  }
+
+ private:
+  std::vector<std::unique_ptr<ThreadCache>> caches_;
+};
+
+// static
+std::shared_ptr<SlabAllocator> SlabAllocator::Create(
+    size_t max_retained_bytes) {
+  return std::make_shared<SlabAllocator>(max_retained_bytes);
+}
+
+// static
+size_t SlabAllocator::RoundUpSize(size_t size) {
+  if (size > kMaxSlabSize) {
+    return size;
+  }
+
+  return SizeForClass(ClassForSize(size));
+}
+
+SlabAllocator::SlabAllocator(size_t max_retained_bytes)
+    : central_(std::make_shared<Central>(max_retained_bytes)) {}
+
+SlabAllocator::~SlabAllocator() {
+  // Thread caches may still refer to central_. They'll free their buffers
+  // rather than returning them.
+  central_->Close();
+}
+
+void SlabAllocator::Prewarm(size_t size, size_t count) {
+  if (size == 0 || size > kMaxSlabSize) {
+    return;
+  }
+
+  size_t size_class = ClassForSize(size);
+  std::vector<void*> buffers;
+  buffers.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    buffers.push_back(std::malloc(SizeForClass(size_class)));
+  }
+
+  central_->Give(size_class, count, &buffers);
+}
+
+void SlabAllocator::Prewarm(const StreamType& stream_type, size_t count) {
+  switch (stream_type.medium()) {
+    case StreamType::Medium::kAudio: {
+      const AudioStreamType* audio = stream_type.audio();
+      DCHECK(audio);
+      Prewarm(audio->min_buffer_size(audio->frames_per_second() /
+                                     kTypicalAudioPacketsPerSecond),
+              count);
+      break;
+    }
+    case StreamType::Medium::kVideo: {
+      const VideoStreamType* video = stream_type.video();
+      DCHECK(video);
+      if (video->pixel_format() == VideoStreamType::PixelFormat::kUnknown) {
+        break;
+      }
+
+      const VideoStreamType::PixelFormatInfo& info =
+          video->GetPixelFormatInfo();
+      if (info.plane_count <= VideoStreamType::kUPlaneIndex) {
+        // BuildFrameLayout only handles planar formats.
+        break;
+      }
+
+      VideoStreamType::FrameLayout frame_layout;
+      info.BuildFrameLayout(VideoStreamType::Extent(video->coded_width(),
+                                                    video->coded_height()),
+                            &frame_layout);
+      Prewarm(frame_layout.size, count);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+size_t SlabAllocator::retained_bytes() const {
+  return central_->retained_bytes();
+}
+
+void* SlabAllocator::AllocatePayloadBuffer(size_t size) {
+  DCHECK(size > 0);
+
+  if (size > kMaxSlabSize) {
+    return std::malloc(size);
+  }
+
+  return GetThreadCache()->Allocate(ClassForSize(size));
+}
+
+void SlabAllocator::ReleasePayloadBuffer(size_t size, void* buffer) {
+  DCHECK(size > 0);
+  DCHECK(buffer);
+
+  if (size > kMaxSlabSize) {
+    std::free(buffer);
+    return;
+  }
+
+  GetThreadCache()->Release(ClassForSize(size), buffer);
+}
+
+SlabAllocator::ThreadCache* SlabAllocator::GetThreadCache() {
+  static thread_local ThreadCacheList thread_caches;
+  return thread_caches.Get(central_);
+}
+
+}  // namespace media
+}  // namespace mojo
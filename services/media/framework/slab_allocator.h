@@ -0,0 +1,102 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_SLAB_ALLOCATOR_H_
+#define SERVICES_MEDIA_FRAMEWORK_SLAB_ALLOCATOR_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "services/media/framework/payload_allocator.h"
+#include "services/media/framework/types/stream_type.h"
+
+namespace mojo {
+namespace media {
+
+// Payload allocator that recycles buffers by size class.
+//
+// Requested sizes are rounded up to one of a set of size classes spaced four
+// to a power of two, so no more than 20% of a buffer is wasted. Released
+// buffers are kept for reuse rather than being returned to the heap. Each
+// thread has a small cache of buffers per size class, so allocations and
+// releases usually take no locks. Thread caches exchange buffers with a shared
+// per-class free list in batches. The shared free lists retain at most
+// max_retained_bytes, and buffers beyond that go back to the heap.
+//
+// Thread caches aren't counted against max_retained_bytes, so they're kept
+// small: buffers larger than kMaxThreadCacheSize bypass them, and a thread
+// keeps at most kMaxThreadCacheBytes for any one allocator.
+//
+// Media streams tend to use the same payload size over and over, so in steady
+// state this allocator rarely touches the heap. Sizes above kMaxSlabSize are
+// allocated straight from the heap.
+class SlabAllocator : public PayloadAllocator {
+ public:
+  // Largest size that's recycled.
+  static constexpr size_t kMaxSlabSize = 16 * 1024 * 1024;
+
+  // Default limit on the bytes retained in the shared free lists.
+  static constexpr size_t kDefaultMaxRetainedBytes = 64 * 1024 * 1024;
+
+  // Largest size that's cached per thread. Larger buffers are recycled via
+  // the shared free lists only.
+  static constexpr size_t kMaxThreadCacheSize = 256 * 1024;
+
+  // Most bytes a thread caches for one allocator.
+  static constexpr size_t kMaxThreadCacheBytes = 4 * 1024 * 1024;
+
+  // Creates a slab allocator.
+  static std::shared_ptr<SlabAllocator> Create(
+      size_t max_retained_bytes = kDefaultMaxRetainedBytes);
+
+  // Returns the size of the buffer allocated for a payload of the indicated
+  // size, which is the size of its size class, or size itself if it exceeds
+  // kMaxSlabSize.
+  static size_t RoundUpSize(size_t size);
+
+  explicit SlabAllocator(size_t max_retained_bytes);
+
+  // All buffers allocated by this allocator must be released before it's
+  // deleted.
+  ~SlabAllocator();
+
+  // Allocates count buffers for payloads of the indicated size and puts them
+  // in the free list, so the first count allocations of that size don't
+  // touch the heap.
+  void Prewarm(size_t size, size_t count);
+
+  // Like Prewarm(size, count), using the payload size expected for the
+  // indicated stream type. For video, this is the size of an uncompressed
+  // frame. For audio, it's an estimate based on typical decoder output. Does
+  // nothing for other media.
+  void Prewarm(const StreamType& stream_type, size_t count);
+
+  // Returns the number of bytes retained in the shared free lists. Buffers
+  // cached by threads aren't included.
+  size_t retained_bytes() const;
+
+  // PayloadAllocator implementation.
+  void* AllocatePayloadBuffer(size_t size) override;
+
+  void ReleasePayloadBuffer(size_t size, void* buffer) override;
+
+ private:
+  class Central;
+  class ThreadCache;
+  class ThreadCacheList;
+
+  // Returns the calling thread's cache for this allocator, creating it if
+  // necessary.
+  ThreadCache* GetThreadCache();
+
+  // Shared state. Held by reference from thread caches, which may outlive the
+  // allocator.
+  std::shared_ptr<Central> central_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_SLAB_ALLOCATOR_H_
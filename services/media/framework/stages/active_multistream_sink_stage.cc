@@ -20,6 +20,10 @@ ActiveMultistreamSinkStage::~ActiveMultistreamSinkStage() {
   base::AutoLock lock(lock_);
 }
 
+const char* ActiveMultistreamSinkStage::type_name() const {
+  return "ActiveMultistreamSinkStage";
+}
+
 size_t ActiveMultistreamSinkStage::input_count() const {
   base::AutoLock lock(lock_);
   return inputs_.size();
@@ -60,15 +64,16 @@ void ActiveMultistreamSinkStage::Update(Engine* engine) {
   for (auto iter = pending_inputs_.begin(); iter != pending_inputs_.end();) {
     DCHECK(*iter < inputs_.size());
     StageInput* input = inputs_[*iter].get();
-    if (input->input_.packet_from_upstream()) {
+    while (input->demand_ != Demand::kNegative &&
+           input->input_.packet_from_upstream()) {
       input->demand_ = sink_->SupplyPacket(
           input->index_, std::move(input->input_.packet_from_upstream()));
+    }
 
-      if (input->demand_ == Demand::kNegative) {
-        auto remove_iter = iter;
-        ++iter;
-        pending_inputs_.erase(remove_iter);
-      }
+    if (input->demand_ == Demand::kNegative) {
+      auto remove_iter = iter;
+      ++iter;
+      pending_inputs_.erase(remove_iter);
     } else {
       ++iter;
     }
@@ -84,8 +89,9 @@ void ActiveMultistreamSinkStage::FlushInput(
 
   sink_->Flush();
 
+  // The input's demand is left alone. The flush may reach the sink after it's
+  // been restarted.
   base::AutoLock lock(lock_);
-  inputs_[index]->demand_ = Demand::kNegative;
   inputs_[index]->input_.Flush();
 
   pending_inputs_.remove(index);
@@ -25,6 +25,8 @@ class ActiveMultistreamSinkStage : public Stage,
   ~ActiveMultistreamSinkStage() override;
 
   // Stage implementation.
+  const char* type_name() const override;
+
   size_t input_count() const override;
 
   Input& input(size_t index) override;
@@ -3,47 +3,81 @@
 // found in the LICENSE file.
 
 #include "services/media/framework/stages/active_multistream_source_stage.h"
-#include "services/media/framework/stages/util.h"
 
 namespace mojo {
 namespace media {
 
+constexpr size_t ActiveMultistreamSourceStage::kMaxPacketsPerRequest;
+
 ActiveMultistreamSourceStage::ActiveMultistreamSourceStage(
     std::shared_ptr<ActiveMultistreamSource> source)
-    : source_(source) {
+    : source_(source), buffers_(source->stream_count()) {
   DCHECK(source);
   outputs_.resize(source->stream_count());
 
   supply_function_ = [this](size_t output_index, PacketPtr packet) {
-    lock_.Acquire();
-    DCHECK(!cached_packet_) << "source supplied unrequested packet";
-    DCHECK(output_index < outputs_.size());
-    DCHECK(packet);
-    DCHECK(packet_request_outstanding_);
+    {
+      base::AutoLock lock(lock_);
+      DCHECK(output_index < outputs_.size());
+      DCHECK(packet);
+      DCHECK(packet_request_outstanding_);
 
-    packet_request_outstanding_ = false;
+      packet_request_outstanding_ = false;
 
-    cached_packet_output_index_ = output_index;
-    cached_packet_ = std::move(packet);
+      if (packet->end_of_stream()) {
+        ended_streams_++;
+      }
 
-    if (cached_packet_->end_of_stream()) {
-      ended_streams_++;
+      buffers_[output_index].Push(std::move(packet));
     }
 
-    Output& output = outputs_[cached_packet_output_index_];
-    if (output.demand() != Demand::kNegative) {
-      lock_.Release();
-      RequestUpdate();
-    } else {
-      lock_.Release();
+    // Even if this packet's output won't accept it, another stream may be
+    // waiting for a packet.
+    RequestUpdate();
+  };
+
+  batch_supply_function_ = [this](std::vector<StreamPacket> packets) {
+    {
+      base::AutoLock lock(lock_);
+      DCHECK(!packets.empty());
+      DCHECK(packets.size() <= kMaxPacketsPerRequest);
+      DCHECK(packet_request_outstanding_);
+
+      packet_request_outstanding_ = false;
+
+      for (StreamPacket& supplied : packets) {
+        DCHECK(supplied.stream_index < outputs_.size());
+        DCHECK(supplied.packet);
+
+        if (supplied.packet->end_of_stream()) {
+          ended_streams_++;
+        }
+
+        buffers_[supplied.stream_index].Push(std::move(supplied.packet));
+      }
     }
+
+    // One update handles the whole batch.
+    RequestUpdate();
   };
 
   source_->SetSupplyCallback(supply_function_);
+  source_->SetBatchSupplyCallback(batch_supply_function_);
 }
 
 ActiveMultistreamSourceStage::~ActiveMultistreamSourceStage() {}
 
+void ActiveMultistreamSourceStage::SetStreamBufferLimit(size_t limit) {
+  base::AutoLock lock(lock_);
+  for (StreamBuffer& buffer : buffers_) {
+    buffer.set_limit(limit);
+  }
+}
+
+const char* ActiveMultistreamSourceStage::type_name() const {
+  return "ActiveMultistreamSourceStage";
+}
+
 size_t ActiveMultistreamSourceStage::input_count() const {
   return 0;
 };
@@ -73,10 +107,11 @@ void ActiveMultistreamSourceStage::PrepareOutput(
     const UpstreamCallback& callback) {
   DCHECK(index < outputs_.size());
 
-  if (allocator != nullptr) {
-    // Currently, we don't support a source that uses provided allocators. If
-    // we're provided an allocator, the output must have it so supplied packets
-    // can be copied.
+  if (source_->can_accept_allocator(index)) {
+    source_->set_allocator(index, allocator);
+  } else if (allocator != nullptr) {
+    // The source can't use the provided allocator, so the output must copy
+    // packets.
     outputs_[index].SetCopyAllocator(allocator);
   }
 }
@@ -85,6 +120,11 @@ void ActiveMultistreamSourceStage::UnprepareOutput(
     size_t index,
     const UpstreamCallback& callback) {
   DCHECK(index < outputs_.size());
+
+  if (source_->can_accept_allocator(index)) {
+    source_->set_allocator(index, nullptr);
+  }
+
   outputs_[index].SetCopyAllocator(nullptr);
 }
 
@@ -92,18 +132,22 @@ void ActiveMultistreamSourceStage::Update(Engine* engine) {
   base::AutoLock lock(lock_);
   DCHECK(engine);
 
-  if (cached_packet_) {
-    Output& output = outputs_[cached_packet_output_index_];
-    if (output.demand() != Demand::kNegative) {
-      // cached_packet_ is intended for an output which will accept packets.
-      output.SupplyPacket(std::move(cached_packet_), engine);
-    }
+  bool starved = false;
+  bool out_of_credit = false;
+
+  for (size_t index = 0; index < outputs_.size(); ++index) {
+    StreamBuffer& buffer = buffers_[index];
+    buffer.Drain(&outputs_[index], engine);
+    starved = starved || buffer.Starved(outputs_[index]);
+    out_of_credit = out_of_credit || !buffer.has_credit();
   }
 
-  if (!cached_packet_ && HasPositiveDemand(outputs_) &&
-      !packet_request_outstanding_) {
-    // We have no cached packet and positive demand. Request a packet.
-    source_->RequestPacket();
+  if (starved && !out_of_credit && !packet_request_outstanding_ &&
+      ended_streams_ != outputs_.size()) {
+    // A stream needs a packet, and every stream has room for one. Request
+    // packets. A batch may take a stream past its limit by up to
+    // kMaxPacketsPerRequest - 1 packets.
+    source_->RequestPackets(kMaxPacketsPerRequest);
     packet_request_outstanding_ = true;
   }
 }
@@ -119,8 +163,9 @@ void ActiveMultistreamSourceStage::FlushOutput(size_t index) {
   DCHECK(index < outputs_.size());
   DCHECK(source_);
   outputs_[index].Flush();
-  cached_packet_.reset(nullptr);
-  cached_packet_output_index_ = 0;
+  for (StreamBuffer& buffer : buffers_) {
+    buffer.Flush();
+  }
   ended_streams_ = 0;
   packet_request_outstanding_ = false;
 }
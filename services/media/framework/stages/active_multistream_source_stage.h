@@ -10,6 +10,7 @@
 #include "base/synchronization/lock.h"
 #include "services/media/framework/models/active_multistream_source.h"
 #include "services/media/framework/stages/stage.h"
+#include "services/media/framework/stages/stream_buffer.h"
 
 namespace mojo {
 namespace media {
@@ -17,11 +18,18 @@ namespace media {
 // A stage that hosts an ActiveMultistreamSource.
 class ActiveMultistreamSourceStage : public Stage {
  public:
+  // Maximum number of packets requested from the source at a time.
+  static constexpr size_t kMaxPacketsPerRequest = 16;
+
   ActiveMultistreamSourceStage(std::shared_ptr<ActiveMultistreamSource> source);
 
   ~ActiveMultistreamSourceStage() override;
 
   // Stage implementation.
+  void SetStreamBufferLimit(size_t limit) override;
+
+  const char* type_name() const override;
+
   size_t input_count() const override;
 
   Input& input(size_t index) override;
@@ -48,10 +56,10 @@ class ActiveMultistreamSourceStage : public Stage {
   std::vector<Output> outputs_;
   std::shared_ptr<ActiveMultistreamSource> source_;
   ActiveMultistreamSource::SupplyCallback supply_function_;
+  ActiveMultistreamSource::BatchSupplyCallback batch_supply_function_;
 
   mutable base::Lock lock_;
-  PacketPtr cached_packet_;
-  size_t cached_packet_output_index_;
+  std::vector<StreamBuffer> buffers_;
   size_t ended_streams_ = 0;
   bool packet_request_outstanding_ = false;
 };
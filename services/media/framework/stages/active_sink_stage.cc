@@ -12,9 +12,13 @@ ActiveSinkStage::ActiveSinkStage(std::shared_ptr<ActiveSink> sink)
   DCHECK(sink_);
 
   demand_function_ = [this](Demand demand) {
+    lock_.Acquire();
     if (sink_demand_ != demand) {
       sink_demand_ = demand;
+      lock_.Release();
       RequestUpdate();
+    } else {
+      lock_.Release();
     }
   };
 
@@ -23,6 +27,10 @@ ActiveSinkStage::ActiveSinkStage(std::shared_ptr<ActiveSink> sink)
 
 ActiveSinkStage::~ActiveSinkStage() {}
 
+const char* ActiveSinkStage::type_name() const {
+  return "ActiveSinkStage";
+}
+
 size_t ActiveSinkStage::input_count() const {
   return 1;
 };
@@ -43,6 +51,12 @@ Output& ActiveSinkStage::output(size_t index) {
 
 PayloadAllocator* ActiveSinkStage::PrepareInput(size_t index) {
   DCHECK_EQ(index, 0u);
+
+  size_t queue_depth = sink_->input_queue_depth();
+  if (queue_depth > input_.queue_depth()) {
+    input_.set_queue_depth(queue_depth);
+  }
+
   return sink_->allocator();
 }
 
@@ -56,20 +70,46 @@ void ActiveSinkStage::Update(Engine* engine) {
   DCHECK(engine);
   DCHECK(sink_);
 
-  if (input_.packet_from_upstream()) {
-    sink_demand_ =
-        sink_->SupplyPacket(std::move(input_.packet_from_upstream()));
+  Demand demand;
+
+  {
+    base::AutoLock lock(lock_);
+    demand = sink_demand_;
+  }
+
+  size_t batch_size = sink_->supply_batch_size();
+  DCHECK(batch_size != 0);
+
+  // Drain the queue for as long as the sink will take packets.
+  while (demand != Demand::kNegative && input_.packet_from_upstream()) {
+    if (batch_size == 1) {
+      demand = sink_->SupplyPacket(std::move(input_.packet_from_upstream()));
+    } else {
+      while (batch_.size() < batch_size && input_.packet_from_upstream()) {
+        batch_.push_back(std::move(input_.packet_from_upstream()));
+      }
+
+      demand = sink_->SupplyPackets(&batch_);
+
+      // Return any packets the sink didn't take to the input. The sink leaves
+      // packets only when its demand is negative, ending the loop.
+      input_.PutBackPackets(&batch_);
+    }
+
+    base::AutoLock lock(lock_);
+    sink_demand_ = demand;
   }
 
-  input_.SetDemand(sink_demand_, engine);
+  input_.SetDemand(demand, engine);
 }
 
 void ActiveSinkStage::FlushInput(size_t index,
                                  const DownstreamCallback& callback) {
   DCHECK(sink_);
   input_.Flush();
+  // The sink's demand is left alone. The flush may reach the sink after it's
+  // been restarted.
   sink_->Flush();
-  sink_demand_ = Demand::kNegative;
 }
 
 void ActiveSinkStage::FlushOutput(size_t index) {
@@ -6,7 +6,9 @@
 #define SERVICES_MEDIA_FRAMEWORK_STAGES_ACTIVE_SINK_STAGE_H_
 
 #include <deque>
+#include <vector>
 
+#include "base/synchronization/lock.h"
 #include "services/media/framework/models/active_sink.h"
 #include "services/media/framework/stages/stage.h"
 
@@ -21,6 +23,8 @@ class ActiveSinkStage : public Stage {
   ~ActiveSinkStage() override;
 
   // Stage implementation.
+  const char* type_name() const override;
+
   size_t input_count() const override;
 
   Input& input(size_t index) override;
@@ -45,6 +49,10 @@ class ActiveSinkStage : public Stage {
   Input input_;
   std::shared_ptr<ActiveSink> sink_;
   ActiveSink::DemandCallback demand_function_;
+  // Packets being supplied to the sink with SupplyPackets.
+  std::vector<PacketPtr> batch_;
+
+  mutable base::Lock lock_;
   Demand sink_demand_ = Demand::kNegative;
 };
 
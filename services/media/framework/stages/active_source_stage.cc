@@ -12,8 +12,11 @@ ActiveSourceStage::ActiveSourceStage(std::shared_ptr<ActiveSource> source)
   DCHECK(source_);
 
   supply_function_ = [this](PacketPtr packet) {
+    lock_.Acquire();
     bool packets_was_empty_ = packets_.empty();
     packets_.push_back(std::move(packet));
+    lock_.Release();
+
     if (packets_was_empty_ && prepared_) {
       RequestUpdate();
     }
@@ -24,6 +27,10 @@ ActiveSourceStage::ActiveSourceStage(std::shared_ptr<ActiveSource> source)
 
 ActiveSourceStage::~ActiveSourceStage() {}
 
+const char* ActiveSourceStage::type_name() const {
+  return "ActiveSourceStage";
+}
+
 size_t ActiveSourceStage::input_count() const {
   return 0;
 };
@@ -56,7 +63,7 @@ void ActiveSourceStage::PrepareOutput(size_t index,
   if (source_->can_accept_allocator()) {
     // Give the source the provided allocator or the default if non was
     // provided.
-    source_->set_allocator(allocator == nullptr ? PayloadAllocator::GetDefault()
+    source_->set_allocator(allocator == nullptr ? default_allocator()
                                                 : allocator);
   } else if (allocator) {
     // The source can't use the provided allocator, so the output must copy
@@ -83,6 +90,7 @@ void ActiveSourceStage::Update(Engine* engine) {
 
   source_->SetDownstreamDemand(demand);
 
+  base::AutoLock lock(lock_);
   if (demand != Demand::kNegative && !packets_.empty()) {
     output_.SupplyPacket(std::move(packets_.front()), engine);
     packets_.pop_front();
@@ -98,6 +106,7 @@ void ActiveSourceStage::FlushOutput(size_t index) {
   DCHECK(source_);
   output_.Flush();
   source_->Flush();
+  base::AutoLock lock(lock_);
   packets_.clear();
 }
 
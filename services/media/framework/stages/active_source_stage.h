@@ -5,8 +5,10 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_STAGES_ACTIVE_SOURCE_STAGE_H_
 #define SERVICES_MEDIA_FRAMEWORK_STAGES_ACTIVE_SOURCE_STAGE_H_
 
+#include <atomic>
 #include <deque>
 
+#include "base/synchronization/lock.h"
 #include "services/media/framework/models/active_source.h"
 #include "services/media/framework/stages/stage.h"
 
@@ -21,6 +23,8 @@ class ActiveSourceStage : public Stage {
   ~ActiveSourceStage() override;
 
   // Stage implementation.
+  const char* type_name() const override;
+
   size_t input_count() const override;
 
   Input& input(size_t index) override;
@@ -46,8 +50,13 @@ class ActiveSourceStage : public Stage {
  private:
   Output output_;
   std::shared_ptr<ActiveSource> source_;
-  bool prepared_;
+  // Read by the supply callback, which may be called on any thread, and
+  // written when the output is prepared, which may happen again while the
+  // source is running if the graph is reconfigured.
+  std::atomic_bool prepared_;
   ActiveSource::SupplyCallback supply_function_;
+
+  mutable base::Lock lock_;
   std::deque<PacketPtr> packets_;
 };
 
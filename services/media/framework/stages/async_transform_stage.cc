@@ -0,0 +1,177 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/stages/async_transform_stage.h"
+
+namespace mojo {
+namespace media {
+
+AsyncTransformStage::AsyncTransformStage(
+    std::shared_ptr<AsyncTransform> transform)
+    : transform_(transform),
+      callback_target_(new CallbackTarget()),
+      max_packets_in_flight_(transform->max_packets_in_flight()),
+      allocator_(nullptr),
+      packets_in_flight_(0),
+      flush_generation_(0) {
+  DCHECK(transform_);
+  DCHECK(max_packets_in_flight_ != 0);
+
+  callback_target_->stage = this;
+  transform_->SetOutputCallback(MakeOutputCallback(flush_generation_));
+}
+
+AsyncTransformStage::~AsyncTransformStage() {
+  transform_->SetOutputCallback(nullptr);
+  transform_->Flush();
+
+  // Make sure the transform won't call back into this stage. This waits for a
+  // callback in progress, which is safe, because stages aren't deleted with
+  // engine locks held.
+  base::AutoLock lock(callback_target_->lock);
+  callback_target_->stage = nullptr;
+}
+
+const char* AsyncTransformStage::type_name() const {
+  return "AsyncTransformStage";
+}
+
+size_t AsyncTransformStage::input_count() const {
+  return 1;
+};
+
+Input& AsyncTransformStage::input(size_t index) {
+  DCHECK_EQ(index, 0u);
+  return input_;
+}
+
+size_t AsyncTransformStage::output_count() const {
+  return 1;
+}
+
+Output& AsyncTransformStage::output(size_t index) {
+  DCHECK_EQ(index, 0u);
+  return output_;
+}
+
+PayloadAllocator* AsyncTransformStage::PrepareInput(size_t index) {
+  DCHECK_EQ(index, 0u);
+  return nullptr;
+}
+
+void AsyncTransformStage::PrepareOutput(size_t index,
+                                        PayloadAllocator* allocator,
+                                        const UpstreamCallback& callback) {
+  DCHECK_EQ(index, 0u);
+  allocator_ = allocator == nullptr ? default_allocator() : allocator;
+  callback(0);
+}
+
+void AsyncTransformStage::UnprepareOutput(size_t index,
+                                          const UpstreamCallback& callback) {
+  DCHECK_EQ(index, 0u);
+  allocator_ = nullptr;
+  callback(0);
+}
+
+void AsyncTransformStage::Update(Engine* engine) {
+  DCHECK(engine);
+
+  bool can_start = false;
+
+  {
+    base::AutoLock lock(lock_);
+
+    while (!output_packets_.empty() && output_.demand() != Demand::kNegative) {
+      output_.SupplyPacket(std::move(output_packets_.front()), engine);
+      output_packets_.pop_front();
+    }
+
+    // Don't start new work while output packets are backed up.
+    can_start = output_packets_.empty() &&
+                output_.demand() != Demand::kNegative &&
+                packets_in_flight_ < max_packets_in_flight_;
+  }
+
+  while (can_start && input_.packet_from_upstream()) {
+    DCHECK(allocator_);
+
+    {
+      base::AutoLock lock(lock_);
+      ++packets_in_flight_;
+      can_start = packets_in_flight_ < max_packets_in_flight_;
+    }
+
+    // The lock isn't held here, because the transform may call back on
+    // another thread before TransformPacket returns.
+    transform_->TransformPacket(std::move(input_.packet_from_upstream()),
+                                allocator_);
+  }
+
+  input_.SetDemand(can_start ? output_.demand() : Demand::kNegative, engine);
+}
+
+void AsyncTransformStage::FlushInput(size_t index,
+                                     const DownstreamCallback& callback) {
+  DCHECK_EQ(index, 0u);
+  input_.Flush();
+  callback(0);
+}
+
+void AsyncTransformStage::FlushOutput(size_t index) {
+  DCHECK_EQ(index, 0u);
+  output_.Flush();
+
+  uint64_t generation;
+
+  {
+    base::AutoLock lock(lock_);
+    output_packets_.clear();
+    packets_in_flight_ = 0;
+    generation = ++flush_generation_;
+  }
+
+  // The transform may still deliver output for the packets it had, using
+  // callbacks from the old generation. HandleOutput discards that output.
+  transform_->SetOutputCallback(MakeOutputCallback(generation));
+  transform_->Flush();
+}
+
+AsyncTransform::OutputCallback AsyncTransformStage::MakeOutputCallback(
+    uint64_t generation) {
+  std::shared_ptr<CallbackTarget> target = callback_target_;
+  return [target, generation](PacketPtr output, bool input_consumed) {
+    base::AutoLock lock(target->lock);
+    if (target->stage != nullptr) {
+      target->stage->HandleOutput(generation, std::move(output),
+                                  input_consumed);
+    }
+  };
+}
+
+void AsyncTransformStage::HandleOutput(uint64_t generation,
+                                       PacketPtr output,
+                                       bool input_consumed) {
+  {
+    base::AutoLock lock(lock_);
+    if (generation != flush_generation_) {
+      // Output from before a flush.
+      return;
+    }
+
+    if (output) {
+      output_packets_.push_back(std::move(output));
+    }
+
+    if (input_consumed) {
+      DCHECK(packets_in_flight_ != 0);
+      --packets_in_flight_;
+    }
+  }
+
+  RequestUpdate();
+}
+
+}  // namespace media
+}  // namespace mojo
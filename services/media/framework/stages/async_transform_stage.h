@@ -0,0 +1,91 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_STAGES_ASYNC_TRANSFORM_STAGE_H_
+#define SERVICES_MEDIA_FRAMEWORK_STAGES_ASYNC_TRANSFORM_STAGE_H_
+
+#include <deque>
+
+#include "base/synchronization/lock.h"
+#include "services/media/framework/models/async_transform.h"
+#include "services/media/framework/stages/stage.h"
+
+namespace mojo {
+namespace media {
+
+// A stage that hosts an AsyncTransform. Up to the transform's
+// max_packets_in_flight() input packets are handed to the transform at once.
+// Output packets are queued as they arrive and supplied downstream on the next
+// update. Flushing doesn't wait for the transform. Output the transform
+// delivers for packets given before a flush is discarded.
+class AsyncTransformStage : public Stage {
+ public:
+  AsyncTransformStage(std::shared_ptr<AsyncTransform> transform);
+
+  ~AsyncTransformStage() override;
+
+  // Stage implementation.
+  const char* type_name() const override;
+
+  size_t input_count() const override;
+
+  Input& input(size_t index) override;
+
+  size_t output_count() const override;
+
+  Output& output(size_t index) override;
+
+  PayloadAllocator* PrepareInput(size_t index) override;
+
+  void PrepareOutput(size_t index,
+                     PayloadAllocator* allocator,
+                     const UpstreamCallback& callback) override;
+
+  void UnprepareOutput(size_t index, const UpstreamCallback& callback) override;
+
+  void Update(Engine* engine) override;
+
+  void FlushInput(size_t index, const DownstreamCallback& callback) override;
+
+  void FlushOutput(size_t index) override;
+
+ private:
+  // Shared by the stage and the output callbacks it gives the transform, so
+  // callbacks that arrive after the stage is deleted can be ignored.
+  struct CallbackTarget {
+    base::Lock lock;
+    // The stage, or nullptr once it's deleted. Protected by lock, which is
+    // held for the duration of each callback.
+    AsyncTransformStage* stage;
+  };
+
+  // Returns an output callback for the transform that tags output with
+  // generation.
+  AsyncTransform::OutputCallback MakeOutputCallback(uint64_t generation);
+
+  // Handles output from the transform. Output from a generation before
+  // flush_generation_ is discarded.
+  void HandleOutput(uint64_t generation, PacketPtr output, bool input_consumed);
+
+  Input input_;
+  Output output_;
+  std::shared_ptr<AsyncTransform> transform_;
+  std::shared_ptr<CallbackTarget> callback_target_;
+  size_t max_packets_in_flight_;
+  PayloadAllocator* allocator_;
+
+  mutable base::Lock lock_;
+  // Output packets not yet supplied downstream. Protected by lock_.
+  std::deque<PacketPtr> output_packets_;
+  // Input packets given to the transform and not yet consumed. Protected by
+  // lock_.
+  size_t packets_in_flight_;
+  // Incremented by FlushOutput. Protected by lock_.
+  uint64_t flush_generation_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_STAGES_ASYNC_TRANSFORM_STAGE_H_
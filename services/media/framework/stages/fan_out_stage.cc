@@ -0,0 +1,268 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "services/media/framework/stages/fan_out_stage.h"
+
+namespace mojo {
+namespace media {
+
+namespace {
+
+// A packet shared by several branch packets. The packet is released when the
+// last branch packet is released.
+class SharedPacket {
+ public:
+  static SharedPacket* Create(PacketPtr packet,
+                              size_t ref_count,
+                              std::shared_ptr<PacketPool> pool) {
+    DCHECK(pool);
+    void* block = pool->AllocateBlock(sizeof(SharedPacket));
+    return new (block) SharedPacket(std::move(packet), ref_count, pool);
+  }
+
+  const PacketPtr& packet() const { return packet_; }
+
+  const std::shared_ptr<PacketPool>& pool() const { return pool_; }
+
+  // Drops a reference, releasing the packet if it's the last one.
+  void Release() {
+    if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+
+    std::shared_ptr<PacketPool> pool = std::move(pool_);
+    this->~SharedPacket();
+    pool->ReleaseBlock(this);
+  }
+
+ private:
+  SharedPacket(PacketPtr packet,
+               size_t ref_count,
+               std::shared_ptr<PacketPool> pool)
+      : packet_(std::move(packet)), ref_count_(ref_count), pool_(pool) {}
+
+  ~SharedPacket() {}
+
+  PacketPtr packet_;
+  std::atomic_size_t ref_count_;
+  std::shared_ptr<PacketPool> pool_;
+};
+
+// Packet supplied to one output. Refers to the payload of the shared packet.
+class BranchPacket : public Packet {
+ public:
+  static PacketPtr Create(SharedPacket* shared) {
+    DCHECK(shared);
+    void* block = shared->pool()->AllocateBlock(sizeof(BranchPacket));
+    return PacketPtr(new (block) BranchPacket(shared));
+  }
+
+  bool payload_shared() const override { return true; }
+
+ protected:
+  ~BranchPacket() override {}
+
+  void Release() override {
+    // shared_ keeps the pool alive.
+    SharedPacket* shared = shared_;
+    this->~BranchPacket();
+    shared->pool()->ReleaseBlock(this);
+    shared->Release();
+  }
+
+ private:
+  BranchPacket(SharedPacket* shared)
+      : Packet(shared->packet()->pts(),
+               shared->packet()->end_of_stream(),
+               shared->packet()->size(),
+               shared->packet()->payload()),
+        shared_(shared) {
+    const std::unique_ptr<StreamType>& revised_stream_type =
+        shared->packet()->revised_stream_type();
+    if (revised_stream_type) {
+      SetRevisedStreamType(revised_stream_type->Clone());
+    }
+  }
+
+  SharedPacket* shared_;
+};
+
+}  // namespace
+
+FanOutStage::FanOutStage(std::shared_ptr<FanOut> fan_out)
+    : fan_out_(fan_out),
+      input_allocator_(nullptr),
+      prepared_output_count_(0),
+      packet_pool_(PacketPool::Create(
+          std::max(sizeof(SharedPacket), sizeof(BranchPacket)))) {
+  DCHECK(fan_out_);
+  outputs_.resize(fan_out_->output_count());
+}
+
+FanOutStage::~FanOutStage() {}
+
+const char* FanOutStage::type_name() const {
+  return "FanOutStage";
+}
+
+size_t FanOutStage::input_count() const {
+  return 1;
+}
+
+Input& FanOutStage::input(size_t index) {
+  DCHECK_EQ(index, 0u);
+  return input_;
+}
+
+size_t FanOutStage::output_count() const {
+  return outputs_.size();
+}
+
+Output& FanOutStage::output(size_t index) {
+  DCHECK(index < outputs_.size());
+  return outputs_[index];
+}
+
+PayloadAllocator* FanOutStage::PrepareInput(size_t index) {
+  DCHECK_EQ(index, 0u);
+  return input_allocator_;
+}
+
+void FanOutStage::PrepareOutput(size_t index,
+                                PayloadAllocator* allocator,
+                                const UpstreamCallback& callback) {
+  DCHECK(index < outputs_.size());
+
+  if (allocator != nullptr) {
+    if (input_allocator_ == nullptr && !input_.prepared()) {
+      // Ask upstream to use this output's allocator. Outputs that have no
+      // allocator requirement can share those payloads too.
+      input_allocator_ = allocator;
+    } else if (allocator != input_allocator_) {
+      // Upstream can only use one allocator, so this output has to copy.
+      outputs_[index].SetCopyAllocator(allocator);
+    }
+  }
+
+  ++prepared_output_count_;
+
+  if (input_.prepared()) {
+    // This output was connected after the rest of the graph was prepared.
+    return;
+  }
+
+  // Prepare the input once all the connected outputs are prepared.
+  size_t connected_output_count = 0;
+  for (const Output& output : outputs_) {
+    if (output.connected()) {
+      ++connected_output_count;
+    }
+  }
+
+  if (prepared_output_count_ == connected_output_count) {
+    callback(0);
+  }
+}
+
+void FanOutStage::UnprepareOutput(size_t index,
+                                  const UpstreamCallback& callback) {
+  DCHECK(index < outputs_.size());
+  DCHECK(prepared_output_count_ != 0);
+
+  outputs_[index].SetCopyAllocator(nullptr);
+
+  if (--prepared_output_count_ == 0) {
+    input_allocator_ = nullptr;
+    callback(0);
+  }
+}
+
+void FanOutStage::Update(Engine* engine) {
+  DCHECK(engine);
+
+  while (input_.packet_from_upstream() &&
+         AggregateDemand() != Demand::kNegative) {
+    SupplyPacketToOutputs(std::move(input_.packet_from_upstream()), engine);
+  }
+
+  input_.SetDemand(AggregateDemand(), engine);
+}
+
+void FanOutStage::FlushInput(size_t index, const DownstreamCallback& callback) {
+  DCHECK_EQ(index, 0u);
+  input_.Flush();
+
+  for (size_t output_index = 0; output_index < outputs_.size();
+       ++output_index) {
+    if (outputs_[output_index].connected()) {
+      callback(output_index);
+    }
+  }
+}
+
+void FanOutStage::FlushOutput(size_t index) {
+  DCHECK(index < outputs_.size());
+  outputs_[index].Flush();
+}
+
+Demand FanOutStage::AggregateDemand() const {
+  Demand result = Demand::kNegative;
+
+  for (const Output& output : outputs_) {
+    if (!output.connected()) {
+      continue;
+    }
+
+    Demand demand = output.demand();
+    if (demand == Demand::kNegative) {
+      // The slowest branch sets the pace.
+      return Demand::kNegative;
+    }
+
+    if (result != Demand::kPositive) {
+      result = demand;
+    }
+  }
+
+  return result;
+}
+
+void FanOutStage::SupplyPacketToOutputs(PacketPtr packet, Engine* engine) {
+  DCHECK(packet);
+
+  size_t connected_output_count = 0;
+  Output* connected_output = nullptr;
+  for (Output& output : outputs_) {
+    if (output.connected()) {
+      ++connected_output_count;
+      connected_output = &output;
+    }
+  }
+
+  if (connected_output_count == 0) {
+    return;
+  }
+
+  if (connected_output_count == 1) {
+    // No need to share.
+    connected_output->SupplyPacket(std::move(packet), engine);
+    return;
+  }
+
+  SharedPacket* shared = SharedPacket::Create(
+      std::move(packet), connected_output_count, packet_pool_);
+
+  for (Output& output : outputs_) {
+    if (output.connected()) {
+      output.SupplyPacket(BranchPacket::Create(shared), engine);
+    }
+  }
+}
+
+}  // namespace media
+}  // namespace mojo
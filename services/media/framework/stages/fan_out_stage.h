@@ -0,0 +1,72 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_STAGES_FAN_OUT_STAGE_H_
+#define SERVICES_MEDIA_FRAMEWORK_STAGES_FAN_OUT_STAGE_H_
+
+#include <vector>
+
+#include "services/media/framework/models/fan_out.h"
+#include "services/media/framework/packet_pool.h"
+#include "services/media/framework/stages/stage.h"
+
+namespace mojo {
+namespace media {
+
+// A stage that hosts a FanOut.
+class FanOutStage : public Stage {
+ public:
+  FanOutStage(std::shared_ptr<FanOut> fan_out);
+
+  ~FanOutStage() override;
+
+  // Stage implementation.
+  const char* type_name() const override;
+
+  size_t input_count() const override;
+
+  Input& input(size_t index) override;
+
+  size_t output_count() const override;
+
+  Output& output(size_t index) override;
+
+  PayloadAllocator* PrepareInput(size_t index) override;
+
+  void PrepareOutput(size_t index,
+                     PayloadAllocator* allocator,
+                     const UpstreamCallback& callback) override;
+
+  void UnprepareOutput(size_t index, const UpstreamCallback& callback) override;
+
+  void Update(Engine* engine) override;
+
+  void FlushInput(size_t index, const DownstreamCallback& callback) override;
+
+  void FlushOutput(size_t index) override;
+
+ private:
+  // Returns the demand to signal upstream given the demand on the outputs.
+  Demand AggregateDemand() const;
+
+  // Supplies a packet to all connected outputs.
+  void SupplyPacketToOutputs(PacketPtr packet, Engine* engine);
+
+  Input input_;
+  std::vector<Output> outputs_;
+  std::shared_ptr<FanOut> fan_out_;
+
+  // Allocator upstream is required to use, which is the allocator required by
+  // the first output that required one.
+  PayloadAllocator* input_allocator_;
+  size_t prepared_output_count_;
+
+  // Recycles the packets supplied to the outputs.
+  std::shared_ptr<PacketPool> packet_pool_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_STAGES_FAN_OUT_STAGE_H_
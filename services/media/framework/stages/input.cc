@@ -2,6 +2,9 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+
+#include "base/trace_event/trace_event.h"
 #include "services/media/framework/engine.h"
 #include "services/media/framework/stages/input.h"
 #include "services/media/framework/stages/stage.h"
@@ -9,7 +12,15 @@
 namespace mojo {
 namespace media {
 
-Input::Input() : prepared_(false) {}
+constexpr size_t Input::kDefaultQueueDepth;
+
+Input::Counters::Counters() : packet_count(0), timed_packet_count(0) {}
+
+Input::Input()
+    : prepared_(false),
+      queue_depth_(kDefaultQueueDepth),
+      packet_supplied_(false),
+      generation_(0) {}
 
 Input::~Input() {}
 
@@ -17,6 +28,16 @@ void Input::Connect(const OutputRef& output) {
   DCHECK(output.valid());
   DCHECK(!mate_);
   mate_ = output;
+  generation_ = output.actual().generation();
+
+  // Packets retained from a previous connection now belong to this one.
+  if (packet_from_upstream_) {
+    packet_from_upstream_->set_generation(generation_);
+  }
+
+  for (PacketPtr& packet : queued_packets_) {
+    packet->set_generation(generation_);
+  }
 }
 
 Output& Input::actual_mate() const {
@@ -24,24 +45,173 @@ Output& Input::actual_mate() const {
   return mate_.actual();
 }
 
-void Input::SetDemand(Demand demand, Engine* engine) const {
+void Input::set_queue_depth(size_t queue_depth) {
+  DCHECK(!prepared_);
+  DCHECK(queue_depth != 0);
+  queue_depth_ = queue_depth;
+}
+
+PacketPtr& Input::packet_from_upstream() {
+  if (!packet_from_upstream_) {
+    RecordDeparture();
+
+    if (!queued_packets_.empty()) {
+      packet_from_upstream_ = std::move(queued_packets_.front());
+      queued_packets_.pop_front();
+      arrival_time_ = queued_arrival_times_.front();
+      queued_arrival_times_.pop_front();
+    }
+  }
+
+  return packet_from_upstream_;
+}
+
+void Input::PutBackPackets(std::vector<PacketPtr>* packets) {
+  DCHECK(packets);
+
+  for (auto iter = packets->rbegin(); iter != packets->rend(); ++iter) {
+    if (!*iter) {
+      continue;
+    }
+
+    if (packet_from_upstream_) {
+      queued_packets_.push_front(std::move(packet_from_upstream_));
+      queued_arrival_times_.push_front(arrival_time_);
+    } else {
+      RecordDeparture();
+    }
+
+    // The packet's wait was recorded when it was first obtained.
+    packet_from_upstream_ = std::move(*iter);
+    arrival_time_ = base::TimeTicks();
+  }
+
+  packets->clear();
+}
+
+int64_t Input::next_packet_pts() const {
+  if (packet_from_upstream_) {
+    return packet_from_upstream_->pts();
+  }
+
+  if (!queued_packets_.empty()) {
+    return queued_packets_.front()->pts();
+  }
+
+  return Packet::kUnknownPts;
+}
+
+void Input::SetDemand(Demand demand, Engine* engine) {
   DCHECK(engine);
   DCHECK(connected());
 
-  if (actual_mate().UpdateDemandFromInput(demand)) {
+  if (!packet_from_upstream_) {
+    RecordDeparture();
+  }
+
+  bool mate_needs_update = actual_mate().UpdateDemandFromInput(demand);
+
+  if (packet_supplied_ && !full()) {
+    // There's room in the queue, so the mate may be able to supply another
+    // packet, even if demand hasn't changed. A single-threaded engine would
+    // have revisited the mate anyway, but a multithreaded engine relies on
+    // this.
+    packet_supplied_ = false;
+    mate_needs_update = true;
+  }
+
+  if (mate_needs_update) {
     engine->PushToDemandBacklog(mate().stage_);
   }
 }
 
-bool Input::SupplyPacketFromOutput(PacketPtr packet) {
+bool Input::SupplyPacketFromOutput(PacketPtr packet,
+                                   base::TimeTicks arrival_time) {
   DCHECK(packet);
-  DCHECK(!packet_from_upstream_);
-  packet_from_upstream_ = std::move(packet);
+  DCHECK(!full());
+  Enqueue(std::move(packet), arrival_time);
+  ++counters_.packet_count;
+  packet_supplied_ = true;
   return true;
 }
 
+void Input::TakePackets(Input* other) {
+  DCHECK(other);
+  DCHECK(other != this);
+
+  if (other->packet_from_upstream_) {
+    other->packet_from_upstream_->set_generation(generation_);
+    Enqueue(std::move(other->packet_from_upstream_), other->arrival_time_);
+    other->arrival_time_ = base::TimeTicks();
+  }
+
+  while (!other->queued_packets_.empty()) {
+    other->queued_packets_.front()->set_generation(generation_);
+    Enqueue(std::move(other->queued_packets_.front()),
+            other->queued_arrival_times_.front());
+    other->queued_packets_.pop_front();
+    other->queued_arrival_times_.pop_front();
+  }
+
+  if (packet_count() != 0) {
+    packet_supplied_ = true;
+  }
+}
+
+bool Input::generation_advanced() const {
+  return connected() && actual_mate().generation() != generation_;
+}
+
+void Input::CatchUpGeneration() {
+  DCHECK(connected());
+  generation_ = actual_mate().generation();
+}
+
 void Input::Flush() {
-  packet_from_upstream_.reset(nullptr);
+  if (packet_from_upstream_ &&
+      packet_from_upstream_->generation() < generation_) {
+    packet_from_upstream_.reset(nullptr);
+    arrival_time_ = base::TimeTicks();
+  }
+
+  while (!queued_packets_.empty() &&
+         queued_packets_.front()->generation() < generation_) {
+    queued_packets_.pop_front();
+    queued_arrival_times_.pop_front();
+  }
+
+  if (packet_count() == 0) {
+    packet_supplied_ = false;
+  }
+}
+
+void Input::Enqueue(PacketPtr packet, base::TimeTicks arrival_time) {
+  if (packet_from_upstream_ || !queued_packets_.empty()) {
+    queued_packets_.push_back(std::move(packet));
+    queued_arrival_times_.push_back(arrival_time);
+  } else {
+    RecordDeparture();
+    packet_from_upstream_ = std::move(packet);
+    arrival_time_ = arrival_time;
+  }
+}
+
+void Input::RecordDeparture() {
+  DCHECK(!packet_from_upstream_);
+
+  if (arrival_time_.is_null()) {
+    return;
+  }
+
+  base::TimeDelta wait_time = base::TimeTicks::Now() - arrival_time_;
+  arrival_time_ = base::TimeTicks();
+
+  ++counters_.timed_packet_count;
+  counters_.total_wait_time += wait_time;
+  counters_.max_wait_time = std::max(counters_.max_wait_time, wait_time);
+
+  TRACE_COUNTER_ID1("media", "Input wait (us)", this,
+                    wait_time.InMicroseconds());
 }
 
 }  // namespace media
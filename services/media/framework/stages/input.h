@@ -5,6 +5,10 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_STAGES_INPUT_H_
 #define SERVICES_MEDIA_FRAMEWORK_STAGES_INPUT_H_
 
+#include <deque>
+#include <vector>
+
+#include "base/time/time.h"
 #include "services/media/framework/models/demand.h"
 #include "services/media/framework/packet.h"
 #include "services/media/framework/refs.h"
@@ -19,6 +23,22 @@ class Output;
 // Represents a stage's connector to an adjacent upstream stage.
 class Input {
  public:
+  // Number of packets an input holds unless configured otherwise.
+  static constexpr size_t kDefaultQueueDepth = 1;
+
+  // Counters describing the packets that have passed through the input.
+  struct Counters {
+    Counters();
+
+    // Number of packets supplied from upstream.
+    uint64_t packet_count;
+    // Number of packets whose time waiting in the input was measured.
+    uint64_t timed_packet_count;
+    // Total and maximum time measured packets waited to be consumed.
+    base::TimeDelta total_wait_time;
+    base::TimeDelta max_wait_time;
+  };
+
   Input();
 
   ~Input();
@@ -26,7 +46,8 @@ class Input {
   // The output to which this input is connected.
   const OutputRef& mate() const { return mate_; }
 
-  // Establishes a connection.
+  // Establishes a connection. Packets the input retains from a previous
+  // connection join the output's current generation.
   void Connect(const OutputRef& output);
 
   // Breaks a connection. Called only by the engine.
@@ -47,24 +68,93 @@ class Input {
   // Changes the prepared state of the input.
   void set_prepared(bool prepared) { prepared_ = prepared; }
 
-  // A packet supplied from upstream.
-  PacketPtr& packet_from_upstream() { return packet_from_upstream_; }
+  // The maximum number of packets this input holds. Upstream demand goes
+  // negative when this many packets are waiting to be consumed.
+  size_t queue_depth() const { return queue_depth_; }
 
-  // Updates mate's demand. Called only by Stage::Update implementations.
-  void SetDemand(Demand demand, Engine* engine) const;
+  // Sets the queue depth. Must be called before the input is prepared.
+  void set_queue_depth(size_t queue_depth);
+
+  // The number of packets supplied from upstream that haven't been consumed.
+  size_t packet_count() const {
+    return (packet_from_upstream_ ? 1 : 0) + queued_packets_.size();
+  }
+
+  // The PTS of the oldest packet supplied from upstream that hasn't been
+  // consumed or Packet::kUnknownPts if there is no such packet.
+  int64_t next_packet_pts() const;
 
-  // Updates packet_from_upstream. Return value indicates whether the stage for
-  // this input should be added to the supply backlog. Called only by
-  // Output instances.
-  bool SupplyPacketFromOutput(PacketPtr packet);
+  // Determines whether the input is holding as many packets as it can.
+  bool full() const { return packet_count() >= queue_depth_; }
 
-  // Flushes retained media.
+  // The oldest packet supplied from upstream that hasn't been consumed. The
+  // stage consumes the packet by moving it out or resetting it, after which
+  // this method returns the next queued packet, if any.
+  PacketPtr& packet_from_upstream();
+
+  // Returns packets obtained from packet_from_upstream that the stage couldn't
+  // consume to the front of the queue, in the same order, so they're obtained
+  // again next. Null entries in packets, which were consumed, are skipped.
+  // Leaves packets empty.
+  void PutBackPackets(std::vector<PacketPtr>* packets);
+
+  // Updates mate's demand. Called only by Stage::Update implementations.
+  void SetDemand(Demand demand, Engine* engine);
+
+  // Queues a packet from upstream. arrival_time is the time the packet was
+  // supplied or a null time if the time the packet waits in the input isn't
+  // to be measured. Return value indicates whether the stage for this input
+  // should be added to the supply backlog. Called only by Output instances.
+  bool SupplyPacketFromOutput(PacketPtr packet, base::TimeTicks arrival_time);
+
+  // Moves the packets waiting in other to the back of this input's queue, so
+  // the stage consumes them next after its own. The packets join this input's
+  // current generation. The queue may temporarily hold more packets than its
+  // depth. Called only by the engine when reconfiguring a prepared graph.
+  void TakePackets(Input* other);
+
+  // The flush generation of the packets this input accepts.
+  uint64_t generation() const { return generation_; }
+
+  // Determines whether the connected output has started a flush generation
+  // this input hasn't caught up with.
+  bool generation_advanced() const;
+
+  // Adopts the connected output's generation. Called only by the engine, which
+  // then flushes the input.
+  void CatchUpGeneration();
+
+  // Discards retained packets from generations before the current one. Packets
+  // are supplied in order, so the packets that remain, if any, were supplied
+  // after the output advanced its generation.
   void Flush();
 
+  // Counters for the packets that have passed through the input.
+  const Counters& counters() const { return counters_; }
+
  private:
+  // Called when packet_from_upstream_ is found to be empty. If the packet that
+  // was consumed had an arrival time, records how long it waited.
+  void RecordDeparture();
+
+  // Adds a packet to the back of the queue.
+  void Enqueue(PacketPtr packet, base::TimeTicks arrival_time);
+
   OutputRef mate_;
   bool prepared_;
+  size_t queue_depth_;
   PacketPtr packet_from_upstream_;
+  // Packets that arrived while packet_from_upstream_ was occupied, oldest
+  // first.
+  std::deque<PacketPtr> queued_packets_;
+  // Arrival times of packet_from_upstream_ and of the queued packets.
+  base::TimeTicks arrival_time_;
+  std::deque<base::TimeTicks> queued_arrival_times_;
+  Counters counters_;
+  // Indicates that the mate supplied a packet since the last call to
+  // SetDemand that found room in the queue.
+  bool packet_supplied_;
+  uint64_t generation_;
 };
 
 }  // namespace media
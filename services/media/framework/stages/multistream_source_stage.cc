@@ -3,20 +3,31 @@
 // found in the LICENSE file.
 
 #include "services/media/framework/stages/multistream_source_stage.h"
-#include "services/media/framework/stages/util.h"
 
 namespace mojo {
 namespace media {
 
+constexpr size_t MultistreamSourceStage::kMaxPacketsPerPull;
+
 MultistreamSourceStage::MultistreamSourceStage(
     std::shared_ptr<MultistreamSource> source)
-    : source_(source), ended_streams_(0) {
+    : source_(source), buffers_(source->stream_count()), ended_streams_(0) {
   DCHECK(source);
   outputs_.resize(source->stream_count());
 }
 
 MultistreamSourceStage::~MultistreamSourceStage() {}
 
+void MultistreamSourceStage::SetStreamBufferLimit(size_t limit) {
+  for (StreamBuffer& buffer : buffers_) {
+    buffer.set_limit(limit);
+  }
+}
+
+const char* MultistreamSourceStage::type_name() const {
+  return "MultistreamSourceStage";
+}
+
 size_t MultistreamSourceStage::input_count() const {
   return 0;
 };
@@ -63,18 +74,19 @@ void MultistreamSourceStage::Update(Engine* engine) {
   DCHECK(engine);
 
   while (true) {
-    if (cached_packet_ && HasPositiveDemand(outputs_)) {
-      DCHECK(cached_packet_output_index_ < outputs_.size());
-      Output& output = outputs_[cached_packet_output_index_];
-
-      if (output.demand() != Demand::kNegative) {
-        // cached_packet_ is intended for an output which will accept packets.
-        output.SupplyPacket(std::move(cached_packet_), engine);
-      }
+    bool starved = false;
+    bool out_of_credit = false;
+
+    for (size_t index = 0; index < outputs_.size(); ++index) {
+      StreamBuffer& buffer = buffers_[index];
+      buffer.Drain(&outputs_[index], engine);
+      starved = starved || buffer.Starved(outputs_[index]);
+      out_of_credit = out_of_credit || !buffer.has_credit();
     }
 
-    if (cached_packet_) {
-      // There's still a cached packet. We're done for now.
+    if (!starved || out_of_credit) {
+      // Either no stream needs a packet, or the next packet could be for a
+      // stream with no room for it. We're done for now.
       return;
     }
 
@@ -83,14 +95,24 @@ void MultistreamSourceStage::Update(Engine* engine) {
       return;
     }
 
-    // Pull a packet from the source.
-    cached_packet_ = source_->PullPacket(&cached_packet_output_index_);
-    DCHECK(cached_packet_);
-    DCHECK(cached_packet_output_index_ < outputs_.size());
+    // Pull packets from the source. A batch may take a stream past its limit
+    // by up to kMaxPacketsPerPull - 1 packets.
+    source_->PullPackets(kMaxPacketsPerPull, &pulled_packets_);
+    DCHECK(!pulled_packets_.empty());
+    DCHECK(pulled_packets_.size() <= kMaxPacketsPerPull);
+
+    for (StreamPacket& pulled : pulled_packets_) {
+      DCHECK(pulled.packet);
+      DCHECK(pulled.stream_index < outputs_.size());
+
+      if (pulled.packet->end_of_stream()) {
+        ended_streams_++;
+      }
 
-    if (cached_packet_->end_of_stream()) {
-      ended_streams_++;
+      buffers_[pulled.stream_index].Push(std::move(pulled.packet));
     }
+
+    pulled_packets_.clear();
   }
 }
 
@@ -104,8 +126,9 @@ void MultistreamSourceStage::FlushOutput(size_t index) {
   DCHECK(source_);
   outputs_[index].Flush();
   source_->Flush();
-  cached_packet_.reset(nullptr);
-  cached_packet_output_index_ = 0;
+  for (StreamBuffer& buffer : buffers_) {
+    buffer.Flush();
+  }
   ended_streams_ = 0;
 }
 
@@ -9,19 +9,29 @@
 
 #include "services/media/framework/models/multistream_source.h"
 #include "services/media/framework/stages/stage.h"
+#include "services/media/framework/stages/stream_buffer.h"
 
 namespace mojo {
 namespace media {
 
-// A stage that hosts a MultistreamSource.
+// A stage that hosts a MultistreamSource. Each output has its own buffer, so
+// packets for a stream whose output is backed up don't prevent the source from
+// supplying other streams. See StreamBuffer.
 // TODO(dalesat): May need to grow the list of outputs dynamically.
 class MultistreamSourceStage : public Stage {
  public:
+  // Maximum number of packets pulled from the source at a time.
+  static constexpr size_t kMaxPacketsPerPull = 16;
+
   MultistreamSourceStage(std::shared_ptr<MultistreamSource> source);
 
   ~MultistreamSourceStage() override;
 
   // Stage implementation.
+  void SetStreamBufferLimit(size_t limit) override;
+
+  const char* type_name() const override;
+
   size_t input_count() const override;
 
   Input& input(size_t index) override;
@@ -47,9 +57,10 @@ class MultistreamSourceStage : public Stage {
  private:
   std::vector<Output> outputs_;
   std::shared_ptr<MultistreamSource> source_;
-  PacketPtr cached_packet_;
-  size_t cached_packet_output_index_;
+  std::vector<StreamBuffer> buffers_;
   size_t ended_streams_;
+  // Packets pulled from the source and not yet buffered.
+  std::vector<StreamPacket> pulled_packets_;
 };
 
 }  // namespace media
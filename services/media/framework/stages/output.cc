@@ -2,14 +2,22 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "services/media/framework/budget_allocator.h"
 #include "services/media/framework/engine.h"
+#include "services/media/framework/flow_recording.h"
 #include "services/media/framework/stages/output.h"
 #include "services/media/framework/stages/stage.h"
 
 namespace mojo {
 namespace media {
 
-Output::Output() : demand_(Demand::kNegative), copy_allocator_(nullptr) {}
+Output::Output()
+    : demand_(Demand::kNegative),
+      copy_allocator_(nullptr),
+      budget_(nullptr),
+      recorder_track_(0),
+      packet_count_(0),
+      generation_(0) {}
 
 Output::~Output() {}
 
@@ -29,19 +37,31 @@ void Output::SetCopyAllocator(PayloadAllocator* copy_allocator) {
   copy_allocator_ = copy_allocator;
 }
 
+void Output::SetRecorder(std::shared_ptr<FlowRecorder> recorder,
+                         size_t track) {
+  recorder_ = recorder;
+  recorder_track_ = track;
+}
+
 Demand Output::demand() const {
   DCHECK(connected());
 
-  // Return negative demand if mate() already has a packet.
+  // Return negative demand if mate()'s queue is full.
   // We check demand_ here to possibly avoid the second check.
-  if (demand_ == Demand::kNegative || actual_mate().packet_from_upstream()) {
+  if (demand_ == Demand::kNegative || actual_mate().full()) {
+    return Demand::kNegative;
+  }
+
+  // Hold off production while the graph is using too much memory. The engine
+  // updates the stage again when the budget resumes.
+  if (budget_ != nullptr && budget_->throttled()) {
     return Demand::kNegative;
   }
 
   return demand_;
 }
 
-void Output::SupplyPacket(PacketPtr packet, Engine* engine) const {
+void Output::SupplyPacket(PacketPtr packet, Engine* engine) {
   DCHECK(packet);
   DCHECK(engine);
   DCHECK(connected());
@@ -66,7 +86,19 @@ void Output::SupplyPacket(PacketPtr packet, Engine* engine) const {
                             buffer, copy_allocator_);
   }
 
-  if (actual_mate().SupplyPacketFromOutput(std::move(packet))) {
+  ++packet_count_;
+  packet->set_generation(generation_);
+
+  if (recorder_) {
+    recorder_->RecordPacket(recorder_track_, *packet);
+  }
+
+  base::TimeTicks arrival_time;
+  if (engine->profiling_enabled()) {
+    arrival_time = base::TimeTicks::Now();
+  }
+
+  if (actual_mate().SupplyPacketFromOutput(std::move(packet), arrival_time)) {
     engine->PushToSupplyBacklog(mate_.stage_);
   }
 }
@@ -76,6 +108,11 @@ bool Output::UpdateDemandFromInput(Demand demand) {
     return false;
   }
   demand_ = demand;
+
+  if (recorder_) {
+    recorder_->RecordDemand(recorder_track_, demand);
+  }
+
   return true;
 }
 
@@ -12,6 +12,8 @@
 namespace mojo {
 namespace media {
 
+class BudgetAllocator;
+class FlowRecorder;
 class Stage;
 class Engine;
 class Input;
@@ -43,12 +45,38 @@ class Output {
   // allocator be used, but the stage can't use it.
   void SetCopyAllocator(PayloadAllocator* copy_allocator);
 
+  // The allocator the output uses to copy the payload of output packets or
+  // nullptr if the output doesn't copy.
+  PayloadAllocator* copy_allocator() const { return copy_allocator_; }
+
+  // Sets the memory budget that holds back this output. May be nullptr. Only
+  // the outputs of sources are held back.
+  void SetBudget(const BudgetAllocator* budget) { budget_ = budget; }
+
+  // Causes the packets supplied via this output and the demand changes
+  // signalled to it to be recorded as track in recorder. If recorder is
+  // nullptr, recording stops. Called only by the graph with no updates in
+  // progress.
+  void SetRecorder(std::shared_ptr<FlowRecorder> recorder, size_t track);
+
   // Demand signalled from downstream, or kNegative if the downstream input
-  // is currently holding a packet.
+  // is currently holding as many packets as its queue depth allows or the
+  // memory budget is throttled.
   Demand demand() const;
 
   // Supplies a packet to mate. Called only by Stage::Update implementations.
-  void SupplyPacket(PacketPtr packet, Engine* engine) const;
+  void SupplyPacket(PacketPtr packet, Engine* engine);
+
+  // Number of packets supplied via this output.
+  uint64_t packet_count() const { return packet_count_; }
+
+  // The flush generation of this output. Packets supplied via the output are
+  // stamped with it, and the connected input discards packets from earlier
+  // generations once it catches up.
+  uint64_t generation() const { return generation_; }
+
+  // Starts a new flush generation. Called only by the engine.
+  void AdvanceGeneration() { ++generation_; }
 
   // Updates packet demand. Called only by Input instances.
   bool UpdateDemandFromInput(Demand demand);
@@ -60,6 +88,11 @@ class Output {
   InputRef mate_;
   Demand demand_;
   PayloadAllocator* copy_allocator_;
+  const BudgetAllocator* budget_;
+  std::shared_ptr<FlowRecorder> recorder_;
+  size_t recorder_track_;
+  uint64_t packet_count_;
+  uint64_t generation_;
 };
 
 }  // namespace media
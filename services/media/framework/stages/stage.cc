@@ -8,10 +8,37 @@
 namespace mojo {
 namespace media {
 
-Stage::Stage() : in_supply_backlog_(false), in_demand_backlog_(false) {}
+Stage::Stage()
+    : default_allocator_(nullptr),
+      in_supply_backlog_(false),
+      in_demand_backlog_(false),
+      has_deadlines_(false),
+      update_count_(0),
+      update_state_(kIdle),
+      throttled_(false) {}
 
 Stage::~Stage() {}
 
+TransformStage* Stage::AsTransformStage() {
+  return nullptr;
+}
+
+void Stage::SetStreamBufferLimit(size_t limit) {
+  CHECK(false) << "SetStreamBufferLimit called on stage without stream buffers";
+}
+
+void Stage::SetBudget(const BudgetAllocator* budget) {
+  // Only sources are held back. Other stages may need to consume packets for
+  // the graph to drain, and holding them back would stall it for good.
+  if (input_count() != 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < output_count(); ++i) {
+    output(i).SetBudget(budget);
+  }
+}
+
 void Stage::UnprepareInput(size_t index) {}
 
 void Stage::UnprepareOutput(size_t index, const UpstreamCallback& callback) {}
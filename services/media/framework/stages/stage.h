@@ -5,8 +5,11 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_STAGES_STAGE_H_
 #define SERVICES_MEDIA_FRAMEWORK_STAGES_STAGE_H_
 
+#include <atomic>
 #include <vector>
 
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
 #include "services/media/framework/packet.h"
 #include "services/media/framework/payload_allocator.h"
 #include "services/media/framework/stages/input.h"
@@ -15,7 +18,9 @@
 namespace mojo {
 namespace media {
 
+class BudgetAllocator;
 class Engine;
+class TransformStage;
 
 // Host for a source, sink or transform.
 class Stage {
@@ -23,6 +28,8 @@ class Stage {
   using UpstreamCallback = std::function<void(size_t input_index)>;
   using DownstreamCallback = std::function<void(size_t output_index)>;
   using UpdateCallback = std::function<void(Stage* stage)>;
+  // Maps the PTS of a packet to the time by which it must be presented.
+  using DeadlineFunction = std::function<int64_t(int64_t pts)>;
 
   Stage();
 
@@ -32,6 +39,44 @@ class Stage {
     update_callback_ = update_callback;
   }
 
+  // Sets the allocator the stage uses for its outputs when downstream has no
+  // allocator requirement. If allocator is nullptr, the stage uses
+  // PayloadAllocator::GetDefault().
+  void SetDefaultAllocator(PayloadAllocator* allocator) {
+    default_allocator_ = allocator;
+  }
+
+  // Sets the memory budget that holds back the stage's outputs if the stage is
+  // a source. May be nullptr.
+  void SetBudget(const BudgetAllocator* budget);
+
+  // Returns the name of the stage's class. Used for diagnostics.
+  virtual const char* type_name() const = 0;
+
+  // Returns the allocator to use for an output when downstream has no
+  // allocator requirement.
+  PayloadAllocator* default_allocator() const {
+    return default_allocator_ == nullptr ? PayloadAllocator::GetDefault()
+                                         : default_allocator_;
+  }
+
+  // Number of times the engine has updated this stage.
+  uint64_t update_count() const { return update_count_; }
+
+  // Total and maximum time spent updating this stage while profiling was
+  // enabled.
+  base::TimeDelta total_update_time() const { return total_update_time_; }
+  base::TimeDelta max_update_time() const { return max_update_time_; }
+
+  // Returns this stage as a TransformStage or nullptr if it isn't one. The
+  // default implementation returns nullptr.
+  virtual TransformStage* AsTransformStage();
+
+  // Sets the limit on the number of bytes the stage buffers for each of its
+  // outputs. Only stages hosting multistream sources buffer per output. The
+  // default implementation fails.
+  virtual void SetStreamBufferLimit(size_t limit);
+
   // Returns the number of input connections.
   virtual size_t input_count() const = 0;
 
@@ -46,7 +91,9 @@ class Stage {
 
   // Prepares the input for operation. Returns nullptr unless the connected
   // output must use a specific allocator, in which case it returns that
-  // allocator.
+  // allocator. The engine may call this again on a prepared input to learn
+  // whether the requirement has changed, for example when the graph is
+  // reconfigured.
   virtual PayloadAllocator* PrepareInput(size_t index) = 0;
 
   // Prepares the output for operation, passing an allocator that must be used
@@ -68,11 +115,13 @@ class Stage {
   // Performs processing.
   virtual void Update(Engine* engine) = 0;
 
-  // Flushes an input. The callback is used to indicate what outputs are ready
-  // to be flushed as a consequence of flushing the input.
+  // Flushes an input after the connected output has advanced its flush
+  // generation. Packets from the new generation may already be waiting in the
+  // input and must be retained. The callback is used to indicate what outputs
+  // are to be flushed as a consequence of flushing the input.
   virtual void FlushInput(size_t index, const DownstreamCallback& callback) = 0;
 
-  // Flushes an output.
+  // Flushes an output. The engine advances the output's generation afterwards.
   virtual void FlushOutput(size_t index) = 0;
 
  protected:
@@ -82,10 +131,44 @@ class Stage {
   }
 
  private:
+  // Values for update_state_, which is used only by multithreaded engines.
+  enum UpdateState : uint32_t {
+    kIdle,             // Not queued or running.
+    kQueued,           // Queued for update.
+    kRunning,          // Update in progress.
+    kRunningAndDirty,  // Update in progress, another update required after.
+    kRemoved           // Queued for update, but removed from the graph.
+  };
+
   UpdateCallback update_callback_;
+  PayloadAllocator* default_allocator_;
   bool in_supply_backlog_;
   bool in_demand_backlog_;
 
+  // Presentation deadlines of this stage, if it's a sink, and of the sinks
+  // downstream of it. Maintained by the engine with its lock held.
+  std::vector<std::shared_ptr<const DeadlineFunction>> deadline_functions_;
+
+  // Indicates whether deadline_functions_ is non-empty. Read by multithreaded
+  // engines without the engine lock.
+  std::atomic<bool> has_deadlines_;
+
+  // Maintained by the engine.
+  uint64_t update_count_;
+  base::TimeDelta total_update_time_;
+  base::TimeDelta max_update_time_;
+
+  // Used by multithreaded engines to track scheduling of this stage.
+  std::atomic<uint32_t> update_state_;
+
+  // Indicates that the stage is waiting for the memory budget to resume.
+  // Protected by the engine's throttle lock.
+  bool throttled_;
+
+  // Taken by multithreaded engines for the duration of an update of this
+  // stage or any adjacent stage.
+  base::Lock update_lock_;
+
   friend class Engine;
 };
 
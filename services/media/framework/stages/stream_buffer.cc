@@ -0,0 +1,64 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/stages/stream_buffer.h"
+
+namespace mojo {
+namespace media {
+
+// static
+const size_t StreamBuffer::kDefaultLimit = 4 * 1024 * 1024;
+
+StreamBuffer::StreamBuffer()
+    : size_(0), limit_(kDefaultLimit), ended_(false) {}
+
+StreamBuffer::~StreamBuffer() {}
+
+void StreamBuffer::Push(PacketPtr packet) {
+  DCHECK(packet);
+  DCHECK(!ended_) << "packet supplied after end-of-stream";
+
+  if (packet->end_of_stream()) {
+    ended_ = true;
+  }
+
+  size_ += Charge(packet);
+  packets_.push_back(std::move(packet));
+}
+
+void StreamBuffer::Drain(Output* output, Engine* engine) {
+  DCHECK(output);
+  DCHECK(engine);
+
+  if (!output->connected()) {
+    packets_.clear();
+    size_ = 0;
+    return;
+  }
+
+  while (!packets_.empty() && output->demand() != Demand::kNegative) {
+    size_ -= Charge(packets_.front());
+    output->SupplyPacket(std::move(packets_.front()), engine);
+    packets_.pop_front();
+  }
+}
+
+bool StreamBuffer::Starved(const Output& output) const {
+  return packets_.empty() && !ended_ && output.connected() &&
+         output.demand() == Demand::kPositive;
+}
+
+void StreamBuffer::Flush() {
+  packets_.clear();
+  size_ = 0;
+  ended_ = false;
+}
+
+// static
+size_t StreamBuffer::Charge(const PacketPtr& packet) {
+  return packet->size() + sizeof(Packet);
+}
+
+}  // namespace media
+}  // namespace mojo
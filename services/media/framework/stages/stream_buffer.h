@@ -0,0 +1,74 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_STAGES_STREAM_BUFFER_H_
+#define SERVICES_MEDIA_FRAMEWORK_STAGES_STREAM_BUFFER_H_
+
+#include <deque>
+
+#include "services/media/framework/models/demand.h"
+#include "services/media/framework/packet.h"
+#include "services/media/framework/stages/output.h"
+
+namespace mojo {
+namespace media {
+
+class Engine;
+
+// Packets produced by a multistream source for one of its streams, waiting to
+// be supplied to the stream's output. A stream's credit is the number of bytes
+// its buffer may still accept. Multistream sources produce packets for their
+// streams in an order of their choosing, so a stream that runs out of credit
+// stops the source. Until then, streams whose outputs are backed up don't
+// prevent other streams from being supplied.
+class StreamBuffer {
+ public:
+  // Default limit on the number of bytes buffered for a stream.
+  static const size_t kDefaultLimit;
+
+  StreamBuffer();
+
+  ~StreamBuffer();
+
+  // Sets the limit on the number of bytes buffered for the stream.
+  void set_limit(size_t limit) { limit_ = limit; }
+
+  // Number of bytes buffered for the stream, including a per-packet charge so
+  // empty packets count against the limit too.
+  size_t size() const { return size_; }
+
+  // Determines whether the buffer can accept another packet.
+  bool has_credit() const { return size_ < limit_; }
+
+  // Determines whether the stream's end-of-stream packet has been buffered.
+  bool ended() const { return ended_; }
+
+  // Adds a packet to the end of the buffer.
+  void Push(PacketPtr packet);
+
+  // Supplies buffered packets to output until the buffer is empty or the
+  // output's demand is negative. Packets for an unconnected output are
+  // discarded.
+  void Drain(Output* output, Engine* engine);
+
+  // Determines whether output has positive demand that this buffer can't
+  // satisfy without more packets from the source.
+  bool Starved(const Output& output) const;
+
+  // Discards all buffered packets.
+  void Flush();
+
+ private:
+  static size_t Charge(const PacketPtr& packet);
+
+  std::deque<PacketPtr> packets_;
+  size_t size_;
+  size_t limit_;
+  bool ended_;
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_STAGES_STREAM_BUFFER_H_
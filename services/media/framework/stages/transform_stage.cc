@@ -2,18 +2,46 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <iterator>
+
 #include "services/media/framework/stages/transform_stage.h"
 
 namespace mojo {
 namespace media {
 
+TransformStage::Element::Element(std::shared_ptr<Transform> transform)
+    : transform(transform), allocator(nullptr), input_packet_is_new(true) {}
+
 TransformStage::TransformStage(std::shared_ptr<Transform> transform)
-    : transform_(transform), allocator_(nullptr), input_packet_is_new_(true) {
-  DCHECK(transform_);
+    : input_allocator_(nullptr) {
+  DCHECK(transform);
+  elements_.emplace_back(transform);
 }
 
 TransformStage::~TransformStage() {}
 
+void TransformStage::FuseUpstream(TransformStage* upstream_stage) {
+  DCHECK(upstream_stage);
+  DCHECK(upstream_stage != this);
+  DCHECK(!input_.connected());
+  DCHECK(!upstream_stage->output_.connected());
+  DCHECK(!input_.prepared());
+  DCHECK(!upstream_stage->input_.prepared());
+
+  elements_.insert(elements_.begin(),
+                   std::make_move_iterator(upstream_stage->elements_.begin()),
+                   std::make_move_iterator(upstream_stage->elements_.end()));
+  upstream_stage->elements_.clear();
+}
+
+TransformStage* TransformStage::AsTransformStage() {
+  return this;
+}
+
+const char* TransformStage::type_name() const {
+  return "TransformStage";
+}
+
 size_t TransformStage::input_count() const {
   return 1;
 };
@@ -34,7 +62,10 @@ Output& TransformStage::output(size_t index) {
 
 PayloadAllocator* TransformStage::PrepareInput(size_t index) {
   DCHECK_EQ(index, 0u);
-  return nullptr;
+
+  // The output is prepared before the input, so input_allocator_ reflects the
+  // requirement downstream by now.
+  return input_allocator_;
 }
 
 void TransformStage::PrepareOutput(size_t index,
@@ -42,41 +73,106 @@ void TransformStage::PrepareOutput(size_t index,
                                    const UpstreamCallback& callback) {
   DCHECK_EQ(index, 0u);
 
-  allocator_ =
-      allocator == nullptr ? PayloadAllocator::GetDefault() : allocator;
+  // Only the last transform's output packets leave the stage, so only it has
+  // to use the allocator required downstream, unless it passes payloads
+  // through. In that case, the requirement moves upstream to the transform
+  // before it and, from the first transform, to the part upstream.
+  PayloadAllocator* required_allocator = allocator;
+  for (auto iter = elements_.rbegin(); iter != elements_.rend(); ++iter) {
+    iter->allocator = required_allocator == nullptr ? default_allocator()
+                                                    : required_allocator;
+    iter->transform->SetIntermediateAllocator(default_allocator());
+
+    if (!iter->transform->passes_payloads_through()) {
+      required_allocator = nullptr;
+    }
+  }
+
+  input_allocator_ = required_allocator;
 
   callback(0);
 }
 
 void TransformStage::UnprepareOutput(size_t index,
                                      const UpstreamCallback& callback) {
-  allocator_ = nullptr;
+  for (Element& element : elements_) {
+    element.allocator = nullptr;
+  }
+
+  input_allocator_ = nullptr;
+
   callback(0);
 }
 
 void TransformStage::Update(Engine* engine) {
   DCHECK(engine);
-  DCHECK(allocator_);
 
-  if (input_.packet_from_upstream() && output_.demand() != Demand::kNegative) {
-    PacketPtr output_packet;
-    if (transform_->TransformPacket(input_.packet_from_upstream(),
-                                    input_packet_is_new_, allocator_,
-                                    &output_packet)) {
-      input_.packet_from_upstream().reset();
-      input_packet_is_new_ = true;
-    } else {
-      input_packet_is_new_ = false;
+  size_t last_index = elements_.size() - 1;
+
+  // Keep transforming until there's nothing left to transform or the output
+  // queue is full, so queued packets don't each require a trip through the
+  // engine.
+  while (output_.demand() != Demand::kNegative) {
+    // Find the most downstream transform that has a packet waiting. Draining
+    // from the downstream end keeps at most one packet between transforms.
+    size_t index = elements_.size();
+    while (index != 0 && !input_packet(index - 1)) {
+      --index;
     }
 
+    if (index == 0) {
+      break;
+    }
+
+    --index;
+    PacketPtr output_packet;
+    bool input_consumed = TransformElementPacket(index, &output_packet);
     if (output_packet) {
-      output_.SupplyPacket(std::move(output_packet), engine);
+      if (index == last_index) {
+        output_.SupplyPacket(std::move(output_packet), engine);
+      } else {
+        // The next transform's input is empty, because we started with the
+        // most downstream packet.
+        DCHECK(!elements_[index + 1].input_packet);
+        elements_[index + 1].input_packet = std::move(output_packet);
+      }
+    } else if (!input_consumed) {
+      // No progress was made. Wait for the engine to visit us again.
+      break;
     }
   }
 
   input_.SetDemand(output_.demand(), engine);
 }
 
+bool TransformStage::TransformElementPacket(size_t index,
+                                            PacketPtr* output_packet) {
+  DCHECK(index < elements_.size());
+  DCHECK(output_packet);
+
+  Element& element = elements_[index];
+  PacketPtr& packet = input_packet(index);
+  DCHECK(packet);
+  DCHECK(element.allocator);
+
+  if (element.transform->passes_payloads_through() &&
+      !packet->payload_shared()) {
+    element.transform->TransformPacketInPlace(packet.get());
+    *output_packet = std::move(packet);
+    element.input_packet_is_new = true;
+    return true;
+  }
+
+  bool input_consumed = element.transform->TransformPacket(
+      packet, element.input_packet_is_new, element.allocator, output_packet);
+  if (input_consumed) {
+    packet.reset();
+  }
+
+  element.input_packet_is_new = input_consumed;
+  return input_consumed;
+}
+
 void TransformStage::FlushInput(size_t index,
                                 const DownstreamCallback& callback) {
   DCHECK_EQ(index, 0u);
@@ -86,10 +182,13 @@ void TransformStage::FlushInput(size_t index,
 
 void TransformStage::FlushOutput(size_t index) {
   DCHECK_EQ(index, 0u);
-  DCHECK(transform_);
   output_.Flush();
-  transform_->Flush();
-  input_packet_is_new_ = true;
+  for (Element& element : elements_) {
+    DCHECK(element.transform);
+    element.transform->Flush();
+    element.input_packet.reset();
+    element.input_packet_is_new = true;
+  }
 }
 
 }  // namespace media
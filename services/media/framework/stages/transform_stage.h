@@ -5,20 +5,43 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_STAGES_TRANSFORM_STAGE_H_
 #define SERVICES_MEDIA_FRAMEWORK_STAGES_TRANSFORM_STAGE_H_
 
+#include <vector>
+
 #include "services/media/framework/models/transform.h"
 #include "services/media/framework/stages/stage.h"
 
 namespace mojo {
 namespace media {
 
-// A stage that hosts a Transform.
+// A stage that hosts a Transform or a chain of fused Transforms. Packets pass
+// between fused transforms directly rather than via the engine.
 class TransformStage : public Stage {
  public:
   TransformStage(std::shared_ptr<Transform> transform);
 
   ~TransformStage() override;
 
+  // Returns the number of transforms hosted by this stage.
+  size_t transform_count() const { return elements_.size(); }
+
+  // Returns the indicated transform. Transform 0 is the most upstream.
+  const std::shared_ptr<Transform>& transform(size_t index) const {
+    DCHECK(index < elements_.size());
+    return elements_[index].transform;
+  }
+
+  // Moves the transforms hosted by upstream_stage ahead of the transforms
+  // hosted by this stage. upstream_stage must be disconnected from this stage,
+  // and neither stage may be prepared. Called only by the graph, which is
+  // responsible for reconnecting this stage's input and deleting
+  // upstream_stage.
+  void FuseUpstream(TransformStage* upstream_stage);
+
   // Stage implementation.
+  TransformStage* AsTransformStage() override;
+
+  const char* type_name() const override;
+
   size_t input_count() const override;
 
   Input& input(size_t index) override;
@@ -42,11 +65,36 @@ class TransformStage : public Stage {
   void FlushOutput(size_t index) override;
 
  private:
+  // A transform and its state.
+  struct Element {
+    explicit Element(std::shared_ptr<Transform> transform);
+
+    std::shared_ptr<Transform> transform;
+    // Allocator for the transform's output packets.
+    PayloadAllocator* allocator;
+    // Packet waiting to be transformed. Unused for the first element, whose
+    // input packets come from input_.
+    PacketPtr input_packet;
+    bool input_packet_is_new;
+  };
+
+  // Transforms the packet waiting for the indicated element, setting
+  // *output_packet to the packet produced, if any. Returns true if the input
+  // packet was consumed.
+  bool TransformElementPacket(size_t index, PacketPtr* output_packet);
+
+  // Returns the packet waiting to be transformed by the indicated element.
+  PacketPtr& input_packet(size_t index) {
+    return index == 0 ? input_.packet_from_upstream()
+                      : elements_[index].input_packet;
+  }
+
   Input input_;
   Output output_;
-  std::shared_ptr<Transform> transform_;
-  PayloadAllocator* allocator_;
-  bool input_packet_is_new_;
+  std::vector<Element> elements_;
+  // Allocator required of upstream, because the transforms at the front of the
+  // chain pass payloads through to a part downstream that requires it.
+  PayloadAllocator* input_allocator_;
 };
 
 }  // namespace media
@@ -0,0 +1,315 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstdlib>
+#include <cstring>
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/models/active_multistream_source.h"
+#include "services/media/framework/parts/tee.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class AllocatorTest : public TestBase {};
+
+// Allocator a sink can require, so the graph has to get payloads into it.
+class FakeAllocator : public PayloadAllocator {
+ public:
+  void* AllocatePayloadBuffer(size_t size) override { return malloc(size); }
+
+  void ReleasePayloadBuffer(size_t size, void* buffer) override {
+    free(buffer);
+  }
+};
+
+static constexpr int64_t kPacketCount = 4;
+static constexpr size_t kPayloadSize = 16;
+
+// Transform that adds one to each byte of its payloads, in place if it can.
+class IncrementingTransform : public Transform {
+ public:
+  IncrementingTransform() : in_place_count_(0), copy_count_(0) {}
+
+  // The number of packets transformed in place.
+  size_t in_place_count() const { return in_place_count_; }
+
+  // The number of packets transformed by copying.
+  size_t copy_count() const { return copy_count_; }
+
+  // Transform implementation.
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) override {
+    DCHECK(input);
+    DCHECK(allocator);
+    DCHECK(output);
+
+    ++copy_count_;
+    void* payload = allocator->AllocatePayloadBuffer(input->size());
+    DCHECK(payload);
+    memcpy(payload, input->payload(), input->size());
+    Increment(payload, input->size());
+    *output = Packet::Create(input->pts(), input->end_of_stream(),
+                             input->size(), payload, allocator);
+    return true;
+  }
+
+  bool passes_payloads_through() const override { return true; }
+
+  void TransformPacketInPlace(Packet* packet) override {
+    DCHECK(packet);
+    ++in_place_count_;
+    Increment(packet->payload(), packet->size());
+  }
+
+ private:
+  static void Increment(void* payload, size_t size) {
+    uint8_t* bytes = static_cast<uint8_t*>(payload);
+    for (size_t i = 0; i < size; ++i) {
+      ++bytes[i];
+    }
+  }
+
+  size_t in_place_count_;
+  size_t copy_count_;
+};
+
+// Sink that checks that each payload it's supplied holds the bytes expected.
+// Its demand is positive once Start is called.
+class CheckingSink : public ActiveSink {
+ public:
+  CheckingSink(PayloadAllocator* allocator, uint8_t expected_byte)
+      : allocator_(allocator), expected_byte_(expected_byte), count_(0) {}
+
+  // Signals positive demand.
+  void Start() {
+    DCHECK(demand_callback_);
+    demand_callback_(Demand::kPositive);
+  }
+
+  // The number of packets supplied so far.
+  size_t count() const { return count_; }
+
+  // ActiveSink implementation.
+  PayloadAllocator* allocator() override { return allocator_; }
+
+  void SetDemandCallback(const DemandCallback& demand_callback) override {
+    demand_callback_ = demand_callback;
+  }
+
+  Demand SupplyPacket(PacketPtr packet) override {
+    DCHECK(packet);
+    const uint8_t* bytes = static_cast<const uint8_t*>(packet->payload());
+    for (size_t i = 0; i < packet->size(); ++i) {
+      EXPECT_EQ(expected_byte_, bytes[i]);
+    }
+
+    ++count_;
+    return Demand::kPositive;
+  }
+
+ private:
+  PayloadAllocator* allocator_;
+  uint8_t expected_byte_;
+  DemandCallback demand_callback_;
+  size_t count_;
+};
+
+// Multistream source whose streams accept allocators or not, as indicated.
+// Produces no packets.
+class AcceptingMultistreamSource : public ActiveMultistreamSource {
+ public:
+  explicit AcceptingMultistreamSource(const std::vector<bool>& accepts)
+      : accepts_(accepts), allocators_(accepts.size(), nullptr) {}
+
+  // Returns the allocator set for the indicated stream.
+  PayloadAllocator* allocator(size_t stream_index) const {
+    return allocators_[stream_index];
+  }
+
+  // ActiveMultistreamSource implementation.
+  size_t stream_count() const override { return accepts_.size(); }
+
+  bool can_accept_allocator(size_t stream_index) const override {
+    return accepts_[stream_index];
+  }
+
+  void set_allocator(size_t stream_index,
+                     PayloadAllocator* allocator) override {
+    allocators_[stream_index] = allocator;
+  }
+
+  void SetSupplyCallback(const SupplyCallback& supply_callback) override {}
+
+  void RequestPacket() override {}
+
+ private:
+  std::vector<bool> accepts_;
+  std::vector<PayloadAllocator*> allocators_;
+};
+
+// Supplies kPacketCount packets with kPayloadSize-byte zeroed payloads from
+// source.
+void SupplyZeroedPackets(FakeSource* source) {
+  DCHECK(source);
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    PacketPtr packet = source->CreatePacket(pts, kPayloadSize);
+    memset(packet->payload(), 0, kPayloadSize);
+    source->Supply(std::move(packet));
+  }
+}
+
+// Tests whether a source that can't accept an allocator is reported as copying
+// into the allocator its sink requires.
+TEST_F(AllocatorTest, CopyingConnectionReported) {
+  FakeAllocator allocator;
+  Graph graph;
+  graph.ConnectParts(graph.Add(FakeSource::Create(false)),
+                     graph.Add(FakeSink::Create(&allocator)));
+  graph.Prepare();
+
+  GraphSnapshot snapshot = graph.GetSnapshot();
+  ASSERT_EQ(1u, snapshot.connections.size());
+  EXPECT_EQ(&allocator, snapshot.connections[0].copy_allocator);
+
+  std::vector<OutputRef> copying_outputs = graph.GetCopyingOutputs();
+  ASSERT_EQ(1u, copying_outputs.size());
+  EXPECT_TRUE(copying_outputs[0].copies_payloads());
+}
+
+// Tests whether a source that accepts the allocator its sink requires isn't
+// reported as copying.
+TEST_F(AllocatorTest, AcceptedAllocatorNotReported) {
+  FakeAllocator allocator;
+  Graph graph;
+  graph.ConnectParts(graph.Add(FakeSource::Create()),
+                     graph.Add(FakeSink::Create(&allocator)));
+  graph.Prepare();
+
+  GraphSnapshot snapshot = graph.GetSnapshot();
+  ASSERT_EQ(1u, snapshot.connections.size());
+  EXPECT_EQ(nullptr, snapshot.connections[0].copy_allocator);
+  EXPECT_TRUE(graph.GetCopyingOutputs().empty());
+}
+
+// Tests whether a transform allocates from the allocator its sink requires,
+// so neither of its connections copies, and whether the sink gets packets.
+TEST_F(AllocatorTest, TransformUsesRequiredAllocator) {
+  FakeAllocator allocator;
+  Graph graph;
+  std::shared_ptr<FakeSource> source = FakeSource::Create(false);
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create(&allocator);
+  transform->Open();
+
+  PartRef transform_part = graph.Add(transform);
+  graph.ConnectParts(graph.Add(source), transform_part);
+  graph.ConnectParts(transform_part, graph.Add(sink));
+  graph.Prepare();
+
+  GraphSnapshot snapshot = graph.GetSnapshot();
+  ASSERT_EQ(2u, snapshot.connections.size());
+  EXPECT_EQ(nullptr, snapshot.connections[0].copy_allocator);
+  EXPECT_EQ(nullptr, snapshot.connections[1].copy_allocator);
+
+  sink->Start();
+  source->Supply(CreateTestPacket(0));
+  ASSERT_TRUE(sink->WaitForPackets(1));
+  EXPECT_EQ(std::vector<int64_t>{0}, sink->pts());
+}
+
+// Tests whether the allocator a sink requires is pushed upstream past a
+// transform that passes payloads through, so the source's payloads reach the
+// sink without being copied.
+TEST_F(AllocatorTest, RequirementPassesThroughTransform) {
+  FakeAllocator allocator;
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<IncrementingTransform> transform =
+      std::make_shared<IncrementingTransform>();
+  std::shared_ptr<CheckingSink> sink =
+      std::make_shared<CheckingSink>(&allocator, 1);
+
+  Graph graph;
+  PartRef transform_part = graph.Add(transform);
+  graph.ConnectParts(graph.Add(source), transform_part);
+  graph.ConnectParts(transform_part, graph.Add(sink));
+  graph.Prepare();
+
+  EXPECT_TRUE(graph.GetCopyingOutputs().empty());
+
+  sink->Start();
+  SupplyZeroedPackets(source.get());
+
+  EXPECT_EQ(static_cast<size_t>(kPacketCount), sink->count());
+  EXPECT_EQ(static_cast<size_t>(kPacketCount), transform->in_place_count());
+  EXPECT_EQ(0u, transform->copy_count());
+}
+
+// Tests whether a transform that passes payloads through copies payloads that
+// are shared with another branch of a tee rather than modifying them.
+TEST_F(AllocatorTest, SharedPayloadsNotModifiedInPlace) {
+  FakeAllocator allocator;
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<IncrementingTransform> transform =
+      std::make_shared<IncrementingTransform>();
+  std::shared_ptr<CheckingSink> transformed_sink =
+      std::make_shared<CheckingSink>(&allocator, 1);
+  std::shared_ptr<CheckingSink> untransformed_sink =
+      std::make_shared<CheckingSink>(&allocator, 0);
+
+  Graph graph;
+  PartRef tee_part = graph.Add(Tee::Create(2));
+  PartRef transform_part = graph.Add(transform);
+  graph.ConnectParts(graph.Add(source), tee_part);
+  graph.Connect(tee_part.output(0), transform_part.input());
+  graph.ConnectParts(transform_part, graph.Add(transformed_sink));
+  graph.Connect(tee_part.output(1), graph.Add(untransformed_sink).input());
+  graph.Prepare();
+
+  EXPECT_TRUE(graph.GetCopyingOutputs().empty());
+
+  transformed_sink->Start();
+  untransformed_sink->Start();
+  SupplyZeroedPackets(source.get());
+
+  EXPECT_EQ(static_cast<size_t>(kPacketCount), transformed_sink->count());
+  EXPECT_EQ(static_cast<size_t>(kPacketCount), untransformed_sink->count());
+  EXPECT_EQ(0u, transform->in_place_count());
+  EXPECT_EQ(static_cast<size_t>(kPacketCount), transform->copy_count());
+}
+
+// Tests whether a multistream source is given the allocators required by the
+// streams that can accept them and whether the others are reported as
+// copying.
+TEST_F(AllocatorTest, MultistreamSourceAcceptsAllocator) {
+  FakeAllocator allocator;
+  std::shared_ptr<AcceptingMultistreamSource> source =
+      std::make_shared<AcceptingMultistreamSource>(
+          std::vector<bool>{true, false});
+
+  Graph graph;
+  PartRef source_part = graph.Add(source);
+  for (size_t i = 0; i < 2; ++i) {
+    graph.ConnectOutputToPart(source_part.output(i),
+                              graph.Add(FakeSink::Create(&allocator)));
+  }
+
+  graph.Prepare();
+
+  EXPECT_EQ(&allocator, source->allocator(0));
+  EXPECT_EQ(nullptr, source->allocator(1));
+
+  std::vector<OutputRef> copying_outputs = graph.GetCopyingOutputs();
+  ASSERT_EQ(1u, copying_outputs.size());
+  EXPECT_TRUE(copying_outputs[0].copies_payloads());
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
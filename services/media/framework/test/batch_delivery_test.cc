@@ -0,0 +1,250 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/models/multistream_source.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class BatchDeliveryTest : public TestBase {};
+
+static constexpr size_t kBatchSize = 4;
+static constexpr size_t kStreamCount = 2;
+static constexpr int64_t kPacketsPerStream = 20;
+static constexpr int64_t kSplitCount = 2 * kBatchSize;
+
+// Transform that produces kSplitCount packets for each input packet, so the
+// sink's input queue fills before the sink is supplied.
+class SplittingTransform : public Transform {
+ public:
+  SplittingTransform() : produced_count_(0) {}
+
+  ~SplittingTransform() override {}
+
+  // Transform implementation.
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) override {
+    DCHECK(input);
+    DCHECK(output);
+
+    if (new_input) {
+      produced_count_ = 0;
+    }
+
+    *output = CreateTestPacket(input->pts() * kSplitCount + produced_count_);
+    return ++produced_count_ == kSplitCount;
+  }
+
+ private:
+  int64_t produced_count_;
+};
+
+// Sink that accepts packets in batches of up to kBatchSize and records the
+// PTS of the packets it takes and the number it takes from each batch. If it
+// has a take limit, it takes at most that many packets from a batch and then
+// signals negative demand. The sink must be used in a single-threaded graph.
+class BatchingSink : public ActiveSink {
+ public:
+  explicit BatchingSink(size_t take_limit) : take_limit_(take_limit) {}
+
+  ~BatchingSink() override {}
+
+  // Signals positive demand.
+  void Start() {
+    DCHECK(demand_callback_);
+    demand_callback_(Demand::kPositive);
+  }
+
+  const std::vector<int64_t>& pts() const { return pts_; }
+
+  const std::vector<size_t>& taken_counts() const { return taken_counts_; }
+
+  // ActiveSink implementation.
+  PayloadAllocator* allocator() override { return nullptr; }
+
+  size_t input_queue_depth() override { return kBatchSize; }
+
+  void SetDemandCallback(const DemandCallback& demand_callback) override {
+    demand_callback_ = demand_callback;
+  }
+
+  Demand SupplyPacket(PacketPtr packet) override {
+    CHECK(false) << "SupplyPacket called on batching sink";
+    return Demand::kNegative;
+  }
+
+  size_t supply_batch_size() override { return kBatchSize; }
+
+  Demand SupplyPackets(std::vector<PacketPtr>* packets) override {
+    DCHECK(packets);
+    DCHECK(!packets->empty());
+    DCHECK(packets->size() <= kBatchSize);
+
+    size_t taken_count = 0;
+    for (PacketPtr& packet : *packets) {
+      if (take_limit_ != 0 && taken_count == take_limit_) {
+        break;
+      }
+
+      PacketPtr taken = std::move(packet);
+      pts_.push_back(taken->pts());
+      ++taken_count;
+    }
+
+    taken_counts_.push_back(taken_count);
+    return taken_count == take_limit_ ? Demand::kNegative : Demand::kPositive;
+  }
+
+ private:
+  size_t take_limit_;
+  DemandCallback demand_callback_;
+  std::vector<int64_t> pts_;
+  std::vector<size_t> taken_counts_;
+};
+
+// Multistream source that produces kPacketsPerStream packets for each of
+// kStreamCount streams, taking the streams in turn, as many as it's asked for
+// at a time.
+class BatchingSource : public MultistreamSource {
+ public:
+  BatchingSource() : pulled_count_(0), pull_count_(0) {}
+
+  ~BatchingSource() override {}
+
+  // The number of calls to PullPackets so far.
+  size_t pull_count() const { return pull_count_; }
+
+  // MultistreamSource implementation.
+  size_t stream_count() const override { return kStreamCount; }
+
+  PacketPtr PullPacket(size_t* stream_index_out) override {
+    CHECK(false) << "PullPacket called on batching source";
+    return nullptr;
+  }
+
+  void PullPackets(size_t max_count,
+                   std::vector<StreamPacket>* packets_out) override {
+    DCHECK(max_count != 0);
+    DCHECK(packets_out);
+    DCHECK(pulled_count_ <
+           kPacketsPerStream * static_cast<int64_t>(kStreamCount));
+
+    ++pull_count_;
+    for (size_t i = 0; i < max_count; ++i) {
+      size_t stream_index = pulled_count_ % kStreamCount;
+      int64_t pts = pulled_count_ / kStreamCount;
+      ++pulled_count_;
+      packets_out->emplace_back(
+          stream_index,
+          Packet::CreateNoAllocator(pts, pts + 1 == kPacketsPerStream, 0,
+                                    nullptr));
+      if (pulled_count_ == kPacketsPerStream * kStreamCount) {
+        break;
+      }
+    }
+  }
+
+ private:
+  int64_t pulled_count_;
+  size_t pull_count_;
+};
+
+// Returns the PTS values 0 through count - 1.
+std::vector<int64_t> ExpectedPts(int64_t count) {
+  std::vector<int64_t> result;
+  for (int64_t pts = 0; pts < count; ++pts) {
+    result.push_back(pts);
+  }
+
+  return result;
+}
+
+// Connects a source, a SplittingTransform and sink to graph, starts the sink
+// and supplies one packet.
+void SupplySplitPacket(Graph* graph, std::shared_ptr<BatchingSink> sink) {
+  DCHECK(graph);
+  DCHECK(sink);
+
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  PartRef transform_part = graph->Add(std::make_shared<SplittingTransform>());
+  graph->ConnectParts(graph->Add(source), transform_part);
+  graph->ConnectParts(transform_part, graph->Add(sink));
+  graph->Prepare();
+  sink->Start();
+
+  source->Supply(CreateTestPacket(0));
+}
+
+// Tests whether a sink that takes batches is supplied the packets queued
+// ahead of it in one call.
+TEST_F(BatchDeliveryTest, SinkTakesQueuedBatches) {
+  std::shared_ptr<BatchingSink> sink = std::make_shared<BatchingSink>(0);
+  Graph graph;
+  SupplySplitPacket(&graph, sink);
+
+  EXPECT_EQ(ExpectedPts(kSplitCount), sink->pts());
+  EXPECT_EQ(std::vector<size_t>({kBatchSize, kBatchSize}),
+            sink->taken_counts());
+}
+
+// Tests whether packets a sink leaves in a batch are supplied again, in
+// order, when the sink's demand is positive again.
+TEST_F(BatchDeliveryTest, SinkLeavesPackets) {
+  static constexpr size_t kTakeLimit = kBatchSize - 1;
+  std::shared_ptr<BatchingSink> sink =
+      std::make_shared<BatchingSink>(kTakeLimit);
+  Graph graph;
+  SupplySplitPacket(&graph, sink);
+
+  EXPECT_EQ(ExpectedPts(kTakeLimit), sink->pts());
+
+  // Each restart takes at most kTakeLimit more packets.
+  for (int64_t i = 0;
+       i < kSplitCount && sink->pts() != ExpectedPts(kSplitCount); ++i) {
+    sink->Start();
+  }
+
+  EXPECT_EQ(ExpectedPts(kSplitCount), sink->pts());
+  for (size_t taken_count : sink->taken_counts()) {
+    EXPECT_GE(kTakeLimit, taken_count);
+  }
+}
+
+// Tests whether a multistream source that produces packets in batches
+// delivers every packet to the right stream in order, taking fewer calls than
+// there are packets.
+TEST_F(BatchDeliveryTest, SourcePullsBatches) {
+  std::shared_ptr<BatchingSource> source = std::make_shared<BatchingSource>();
+  std::shared_ptr<FakeSink> sinks[kStreamCount];
+
+  Graph graph;
+  PartRef source_part = graph.Add(source);
+  for (size_t i = 0; i < kStreamCount; ++i) {
+    sinks[i] = FakeSink::Create();
+    graph.ConnectOutputToPart(source_part.output(i), graph.Add(sinks[i]));
+  }
+
+  graph.Prepare();
+
+  for (size_t i = 0; i < kStreamCount; ++i) {
+    sinks[i]->Start();
+  }
+
+  for (size_t i = 0; i < kStreamCount; ++i) {
+    ASSERT_TRUE(sinks[i]->WaitForPackets(kPacketsPerStream));
+    EXPECT_EQ(ExpectedPts(kPacketsPerStream), sinks[i]->pts());
+  }
+
+  EXPECT_GT(static_cast<size_t>(kPacketsPerStream), source->pull_count());
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,115 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/budget_allocator.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class BudgetAllocatorTest : public TestBase {};
+
+static constexpr size_t kSoftLimit = 8 * 1024;
+static constexpr size_t kHardLimit = 16 * 1024;
+static constexpr size_t kBufferSize = 1024;
+
+// Tests whether the budget throttles above the soft limit, resumes once usage
+// falls to the resume level and refuses allocations over the hard limit.
+TEST_F(BudgetAllocatorTest, Limits) {
+  std::shared_ptr<BudgetAllocator> under_test =
+      BudgetAllocator::Create(nullptr, kSoftLimit, kHardLimit);
+  size_t resume_calls = 0;
+  under_test->SetResumeCallback([&resume_calls]() { ++resume_calls; });
+
+  std::vector<void*> buffers;
+  while (!under_test->throttled()) {
+    void* buffer = under_test->AllocatePayloadBuffer(kBufferSize);
+    ASSERT_NE(nullptr, buffer);
+    buffers.push_back(buffer);
+  }
+
+  EXPECT_GT(under_test->current_bytes(), kSoftLimit);
+
+  while (under_test->current_bytes() + kBufferSize <= kHardLimit) {
+    void* buffer = under_test->AllocatePayloadBuffer(kBufferSize);
+    ASSERT_NE(nullptr, buffer);
+    buffers.push_back(buffer);
+  }
+
+  EXPECT_EQ(nullptr, under_test->AllocatePayloadBuffer(kBufferSize));
+  EXPECT_EQ(kHardLimit, under_test->peak_bytes());
+
+  while (under_test->throttled()) {
+    ASSERT_FALSE(buffers.empty());
+    under_test->ReleasePayloadBuffer(kBufferSize, buffers.back());
+    buffers.pop_back();
+  }
+
+  EXPECT_LE(under_test->current_bytes(),
+            kSoftLimit / 8 * BudgetAllocator::kResumeEighths);
+  EXPECT_EQ(1u, resume_calls);
+  EXPECT_EQ(1u, under_test->resume_count());
+
+  for (void* buffer : buffers) {
+    under_test->ReleasePayloadBuffer(kBufferSize, buffer);
+  }
+
+  under_test->SetResumeCallback(nullptr);
+}
+
+// Tests whether the resume callback can allocate and release buffers, as an
+// update of the graph does.
+TEST_F(BudgetAllocatorTest, CallbackAllocates) {
+  std::shared_ptr<BudgetAllocator> under_test =
+      BudgetAllocator::Create(nullptr, kSoftLimit, kHardLimit);
+  BudgetAllocator* budget = under_test.get();
+  size_t resume_calls = 0;
+  under_test->SetResumeCallback([budget, &resume_calls]() {
+    ++resume_calls;
+    void* buffer = budget->AllocatePayloadBuffer(kBufferSize);
+    EXPECT_NE(nullptr, buffer);
+    budget->ReleasePayloadBuffer(kBufferSize, buffer);
+  });
+
+  void* buffer = under_test->AllocatePayloadBuffer(kSoftLimit + 1);
+  ASSERT_NE(nullptr, buffer);
+  EXPECT_TRUE(under_test->throttled());
+
+  under_test->ReleasePayloadBuffer(kSoftLimit + 1, buffer);
+  EXPECT_FALSE(under_test->throttled());
+  EXPECT_EQ(1u, resume_calls);
+  EXPECT_EQ(0u, under_test->current_bytes());
+
+  under_test->SetResumeCallback(nullptr);
+}
+
+// Tests whether accounts count their own allocations as well as the budget's.
+TEST_F(BudgetAllocatorTest, Accounts) {
+  std::shared_ptr<BudgetAllocator> under_test =
+      BudgetAllocator::Create(nullptr, kSoftLimit, kHardLimit);
+  BudgetAllocator::Account* a = under_test->CreateAccount();
+  BudgetAllocator::Account* b = under_test->CreateAccount();
+
+  void* a_buffer = a->AllocatePayloadBuffer(kBufferSize);
+  void* b_buffer = b->AllocatePayloadBuffer(2 * kBufferSize);
+  ASSERT_NE(nullptr, a_buffer);
+  ASSERT_NE(nullptr, b_buffer);
+
+  EXPECT_EQ(kBufferSize, a->current_bytes());
+  EXPECT_EQ(2 * kBufferSize, b->current_bytes());
+  EXPECT_EQ(3 * kBufferSize, under_test->current_bytes());
+
+  a->ReleasePayloadBuffer(kBufferSize, a_buffer);
+  b->ReleasePayloadBuffer(2 * kBufferSize, b_buffer);
+
+  EXPECT_EQ(0u, a->current_bytes());
+  EXPECT_EQ(kBufferSize, a->peak_bytes());
+  EXPECT_EQ(0u, under_test->current_bytes());
+  EXPECT_EQ(3 * kBufferSize, under_test->peak_bytes());
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,87 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/parts/threaded_transform.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class DeadlineTest : public TestBase {};
+
+static constexpr int64_t kPacketCount = 10;
+
+// Builds a graph with two source -> transform -> sink branches under the
+// deadline policy, the sinks having different deadlines, and checks that
+// packets supplied to both sources reach the sinks in order.
+void PassPacketsWithDeadlines(Graph* graph) {
+  DCHECK(graph);
+
+  std::shared_ptr<FakeSource> sources[2];
+  std::shared_ptr<FakeSink> sinks[2];
+
+  graph->SetSchedulingPolicy(SchedulingPolicy::kDeadline);
+
+  for (int i = 0; i < 2; ++i) {
+    std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+    transform->Open();
+    sources[i] = FakeSource::Create();
+    sinks[i] = FakeSink::Create();
+
+    PartRef source_part = graph->Add(sources[i]);
+    PartRef transform_part =
+        graph->Add(ThreadedTransform::Create(transform, 2));
+    PartRef sink_part = graph->Add(sinks[i]);
+    graph->ConnectParts(source_part, transform_part);
+    graph->ConnectParts(transform_part, sink_part);
+
+    int64_t offset = i == 0 ? 1000 : 0;
+    graph->SetPresentationDeadline(
+        sink_part, [offset](int64_t pts) { return pts + offset; });
+  }
+
+  graph->Prepare();
+
+  for (int i = 0; i < 2; ++i) {
+    sinks[i]->Start();
+  }
+
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    for (int i = 0; i < 2; ++i) {
+      sources[i]->Supply(CreateTestPacket(pts));
+    }
+  }
+
+  std::vector<int64_t> expected_pts;
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    expected_pts.push_back(pts);
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(sinks[i]->WaitForPackets(kPacketCount));
+    EXPECT_EQ(expected_pts, sinks[i]->pts());
+  }
+}
+
+// Tests whether a single-threaded graph under the deadline policy passes
+// packets.
+TEST_F(DeadlineTest, SingleThreaded) {
+  Graph graph;
+  PassPacketsWithDeadlines(&graph);
+}
+
+// Tests whether a multithreaded graph under the deadline policy passes
+// packets.
+TEST_F(DeadlineTest, Multithreaded) {
+  Graph graph;
+  graph.EnableMultithreading(2);
+  PassPacketsWithDeadlines(&graph);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
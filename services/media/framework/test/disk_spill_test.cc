@@ -0,0 +1,99 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <vector>
+
+#include "base/files/scoped_temp_dir.h"
+#include "base/logging.h"
+#include "services/media/framework/parts/disk_spill.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class DiskSpillTest : public TestBase {};
+
+static constexpr size_t kAssetSize = 8 * DiskSpill::kBlockSize;
+static constexpr size_t kContentSize = 3 * DiskSpill::kBlockSize;
+
+// Returns the value of the asset byte at position.
+uint8_t ContentAt(size_t position) {
+  return static_cast<uint8_t>((position * 7) >> 2);
+}
+
+// Returns settings for a kept spill in temp_dir with the indicated key.
+DiskSpill::Settings KeptSettings(const base::ScopedTempDir& temp_dir,
+                                 const std::string& asset_key) {
+  DiskSpill::Settings settings;
+  settings.path = temp_dir.path().Append("spill").value();
+  settings.capacity = kAssetSize;
+  settings.cleanup = DiskSpill::Cleanup::kKeep;
+  settings.asset_key = asset_key;
+  return settings;
+}
+
+// Writes content at the start of the asset to a spill created with settings
+// and deletes the spill.
+void WriteContent(const DiskSpill::Settings& settings) {
+  std::unique_ptr<DiskSpill> spill = DiskSpill::Create(settings, kAssetSize);
+  ASSERT_TRUE(spill);
+
+  std::vector<uint8_t> content(kContentSize);
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = ContentAt(i);
+  }
+
+  spill->Write(0, content.data(), content.size());
+  EXPECT_EQ(kContentSize, spill->stored_bytes());
+}
+
+// Returns the number of bytes a spill created with settings has at the start
+// of the asset, checking the content.
+size_t ReadContent(const DiskSpill::Settings& settings) {
+  std::unique_ptr<DiskSpill> spill = DiskSpill::Create(settings, kAssetSize);
+  DCHECK(spill);
+
+  std::vector<uint8_t> buffer(kContentSize);
+  size_t bytes_read = spill->Read(0, buffer.data(), buffer.size());
+  for (size_t i = 0; i < bytes_read; ++i) {
+    EXPECT_EQ(ContentAt(i), buffer[i]) << "at " << i;
+  }
+
+  return bytes_read;
+}
+
+// Tests whether a kept spill is reused for the same asset key.
+TEST_F(DiskSpillTest, ReusedForSameKey) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  WriteContent(KeptSettings(temp_dir, "http://host/asset etag1"));
+  EXPECT_EQ(kContentSize,
+            ReadContent(KeptSettings(temp_dir, "http://host/asset etag1")));
+}
+
+// Tests whether a kept spill isn't reused for a different asset key, as when
+// the asset at the same URL has changed.
+TEST_F(DiskSpillTest, NotReusedForDifferentKey) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  WriteContent(KeptSettings(temp_dir, "http://host/asset etag1"));
+  EXPECT_EQ(0u,
+            ReadContent(KeptSettings(temp_dir, "http://host/asset etag2")));
+}
+
+// Tests whether a kept spill isn't reused when there's no asset key.
+TEST_F(DiskSpillTest, NotReusedWithoutKey) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  WriteContent(KeptSettings(temp_dir, ""));
+  EXPECT_EQ(0u, ReadContent(KeptSettings(temp_dir, "")));
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
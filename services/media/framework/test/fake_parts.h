@@ -0,0 +1,279 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_SERVICES_MEDIA_FRAMEWORK_TEST_FAKE_PARTS_H_
+#define MOJO_SERVICES_MEDIA_FRAMEWORK_TEST_FAKE_PARTS_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "services/media/framework/models/active_sink.h"
+#include "services/media/framework/models/active_source.h"
+#include "services/media/framework/models/transform.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+// How long tests wait for something to happen on another thread before
+// giving up.
+constexpr std::chrono::seconds kFakePartTimeout(10);
+
+// Creates a packet with no payload.
+inline PacketPtr CreateTestPacket(int64_t pts) {
+  return Packet::CreateNoAllocator(pts, false, 0, nullptr);
+}
+
+// Source that supplies the packets the test gives it. By default, it accepts an
+// allocator, so the test can allocate payloads the way a real source would.
+class FakeSource : public ActiveSource {
+ public:
+  static std::shared_ptr<FakeSource> Create(bool can_accept_allocator = true) {
+    return std::shared_ptr<FakeSource>(new FakeSource(can_accept_allocator));
+  }
+
+  ~FakeSource() override {}
+
+  // Supplies a packet downstream.
+  void Supply(PacketPtr packet) {
+    DCHECK(supply_callback_);
+    supply_callback_(std::move(packet));
+  }
+
+  // Creates a packet with a payload of the indicated size allocated from the
+  // allocator the source was given. Returns nullptr if the allocation fails.
+  PacketPtr CreatePacket(int64_t pts, size_t size) {
+    PayloadAllocator* allocator;
+
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      allocator = allocator_;
+    }
+
+    DCHECK(allocator);
+    void* payload = allocator->AllocatePayloadBuffer(size);
+    if (payload == nullptr) {
+      return nullptr;
+    }
+
+    return Packet::Create(pts, false, size, payload, allocator);
+  }
+
+  // The number of times Flush has been called.
+  size_t flush_count() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return flush_count_;
+  }
+
+  // ActiveSource implementation.
+  bool can_accept_allocator() const override { return can_accept_allocator_; }
+
+  void set_allocator(PayloadAllocator* allocator) override {
+    std::lock_guard<std::mutex> locker(mutex_);
+    allocator_ = allocator;
+  }
+
+  void SetSupplyCallback(const SupplyCallback& supply_callback) override {
+    supply_callback_ = supply_callback;
+  }
+
+  void SetDownstreamDemand(Demand demand) override {}
+
+  void Flush() override {
+    std::lock_guard<std::mutex> locker(mutex_);
+    ++flush_count_;
+  }
+
+ private:
+  explicit FakeSource(bool can_accept_allocator)
+      : can_accept_allocator_(can_accept_allocator),
+        allocator_(nullptr),
+        flush_count_(0) {}
+
+  bool can_accept_allocator_;
+  SupplyCallback supply_callback_;
+  std::mutex mutex_;
+  PayloadAllocator* allocator_;
+  size_t flush_count_;
+};
+
+// Sink that records the PTS of the packets it's supplied. Its demand is
+// positive once Start is called and until it's flushed. If it's given an
+// allocator, it requires its packets' payloads to be allocated from it.
+class FakeSink : public ActiveSink {
+ public:
+  static std::shared_ptr<FakeSink> Create(
+      PayloadAllocator* allocator = nullptr) {
+    return std::shared_ptr<FakeSink>(new FakeSink(allocator));
+  }
+
+  ~FakeSink() override {}
+
+  // Signals positive demand.
+  void Start() {
+    DCHECK(demand_callback_);
+    demand_callback_(Demand::kPositive);
+  }
+
+  // Returns the PTS of the packets supplied so far.
+  std::vector<int64_t> pts() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return pts_;
+  }
+
+  // Returns the payload pointers of the packets supplied so far.
+  std::vector<const void*> payloads() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return payloads_;
+  }
+
+  // Returns the encodings of the revised stream types of the packets supplied
+  // so far, with an empty string for packets that have none.
+  std::vector<std::string> revised_encodings() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return revised_encodings_;
+  }
+
+  // Waits until count packets have been supplied. Returns false if that
+  // doesn't happen within kFakePartTimeout.
+  bool WaitForPackets(size_t count) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    return condition_variable_.wait_for(locker, kFakePartTimeout, [this,
+                                                                   count]() {
+      return pts_.size() >= count;
+    });
+  }
+
+  // The number of times Flush has been called.
+  size_t flush_count() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return flush_count_;
+  }
+
+  // ActiveSink implementation.
+  PayloadAllocator* allocator() override { return allocator_; }
+
+  void SetDemandCallback(const DemandCallback& demand_callback) override {
+    demand_callback_ = demand_callback;
+  }
+
+  Demand SupplyPacket(PacketPtr packet) override {
+    DCHECK(packet);
+    std::lock_guard<std::mutex> locker(mutex_);
+    pts_.push_back(packet->pts());
+    payloads_.push_back(packet->payload());
+    revised_encodings_.push_back(packet->revised_stream_type()
+                                     ? packet->revised_stream_type()->encoding()
+                                     : std::string());
+    condition_variable_.notify_all();
+    return Demand::kPositive;
+  }
+
+  void Flush() override {
+    std::lock_guard<std::mutex> locker(mutex_);
+    ++flush_count_;
+  }
+
+ private:
+  explicit FakeSink(PayloadAllocator* allocator)
+      : allocator_(allocator), flush_count_(0) {}
+
+  PayloadAllocator* allocator_;
+  DemandCallback demand_callback_;
+  std::mutex mutex_;
+  std::condition_variable condition_variable_;
+  std::vector<int64_t> pts_;
+  std::vector<const void*> payloads_;
+  std::vector<std::string> revised_encodings_;
+  size_t flush_count_;
+};
+
+// Transform that copies packets, blocking in TransformPacket until the test
+// opens its gate. Output payloads are allocated from the allocator passed to
+// TransformPacket, as a decoder's are. Used to hold packets inside a threaded
+// transform.
+class GatedTransform : public Transform {
+ public:
+  static std::shared_ptr<GatedTransform> Create() {
+    return std::shared_ptr<GatedTransform>(new GatedTransform());
+  }
+
+  ~GatedTransform() override {}
+
+  // Allows TransformPacket calls to proceed.
+  void Open() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    open_ = true;
+    condition_variable_.notify_all();
+  }
+
+  // Waits until TransformPacket has been called count times. Returns false if
+  // that doesn't happen within kFakePartTimeout.
+  bool WaitForCalls(size_t count) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    return condition_variable_.wait_for(locker, kFakePartTimeout, [this,
+                                                                   count]() {
+      return call_count_ >= count;
+    });
+  }
+
+  // The number of times Flush has been called.
+  size_t flush_count() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return flush_count_;
+  }
+
+  // Transform implementation.
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) override {
+    DCHECK(input);
+    DCHECK(output);
+
+    std::unique_lock<std::mutex> locker(mutex_);
+    ++call_count_;
+    condition_variable_.notify_all();
+    condition_variable_.wait(locker, [this]() { return open_; });
+
+    locker.unlock();
+
+    if (input->size() == 0) {
+      *output = CreateTestPacket(input->pts());
+      return true;
+    }
+
+    DCHECK(allocator);
+    void* payload = allocator->AllocatePayloadBuffer(input->size());
+    DCHECK(payload);
+    memcpy(payload, input->payload(), input->size());
+    *output = Packet::Create(input->pts(), input->end_of_stream(),
+                             input->size(), payload, allocator);
+    return true;
+  }
+
+  void Flush() override {
+    std::lock_guard<std::mutex> locker(mutex_);
+    ++flush_count_;
+  }
+
+ private:
+  GatedTransform() : open_(false), call_count_(0), flush_count_(0) {}
+
+  std::mutex mutex_;
+  std::condition_variable condition_variable_;
+  bool open_;
+  size_t call_count_;
+  size_t flush_count_;
+};
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
+
+#endif  // MOJO_SERVICES_MEDIA_FRAMEWORK_TEST_FAKE_PARTS_H_
@@ -0,0 +1,157 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <atomic>
+#include <cstdlib>
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/parts/tee.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+#include "services/media/framework/types/audio_stream_type.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class FanOutTest : public TestBase {};
+
+static constexpr int64_t kPacketCount = 10;
+static constexpr size_t kPayloadSize = 64;
+
+// Allocator that counts allocations and releases.
+class CountingAllocator : public PayloadAllocator {
+ public:
+  CountingAllocator() : allocation_count_(0), release_count_(0) {}
+
+  size_t allocation_count() const { return allocation_count_; }
+
+  size_t release_count() const { return release_count_; }
+
+  void* AllocatePayloadBuffer(size_t size) override {
+    ++allocation_count_;
+    return malloc(size);
+  }
+
+  void ReleasePayloadBuffer(size_t size, void* buffer) override {
+    ++release_count_;
+    free(buffer);
+  }
+
+ private:
+  std::atomic<size_t> allocation_count_;
+  std::atomic<size_t> release_count_;
+};
+
+// Tests whether a tee supplies every packet to both its outputs, sharing the
+// payload rather than copying it, and releases the payload once.
+TEST_F(FanOutTest, SharesPayloads) {
+  CountingAllocator allocator;
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<FakeSink> sinks[2] = {FakeSink::Create(),
+                                        FakeSink::Create()};
+
+  {
+    Graph graph;
+    graph.SetDefaultAllocator(std::shared_ptr<PayloadAllocator>(
+        &allocator, [](PayloadAllocator* allocator) {}));
+    PartRef tee_part = graph.Add(Tee::Create(2));
+    graph.ConnectParts(graph.Add(source), tee_part);
+    for (size_t i = 0; i < 2; ++i) {
+      graph.Connect(tee_part.output(i), graph.Add(sinks[i]).input());
+    }
+    graph.Prepare();
+
+    for (size_t i = 0; i < 2; ++i) {
+      sinks[i]->Start();
+    }
+
+    std::vector<int64_t> expected_pts;
+    for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+      source->Supply(source->CreatePacket(pts, kPayloadSize));
+      expected_pts.push_back(pts);
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+      ASSERT_TRUE(sinks[i]->WaitForPackets(kPacketCount));
+      EXPECT_EQ(expected_pts, sinks[i]->pts());
+    }
+  }
+
+  EXPECT_EQ(sinks[0]->payloads(), sinks[1]->payloads());
+  EXPECT_EQ(static_cast<size_t>(kPacketCount), allocator.allocation_count());
+  EXPECT_EQ(static_cast<size_t>(kPacketCount), allocator.release_count());
+}
+
+// Tests whether a tee holds packets back from all its outputs while one of
+// them has negative demand.
+TEST_F(FanOutTest, WaitsForSlowestOutput) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<FakeSink> sinks[2] = {FakeSink::Create(),
+                                        FakeSink::Create()};
+
+  Graph graph;
+  PartRef tee_part = graph.Add(Tee::Create(2));
+  graph.ConnectParts(graph.Add(source), tee_part);
+  for (size_t i = 0; i < 2; ++i) {
+    graph.Connect(tee_part.output(i), graph.Add(sinks[i]).input());
+  }
+  graph.Prepare();
+
+  // Only one sink is started, so nothing reaches either. The graph is
+  // single-threaded, so supplying a packet runs the graph to completion.
+  sinks[0]->Start();
+  std::vector<int64_t> expected_pts;
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    source->Supply(CreateTestPacket(pts));
+    expected_pts.push_back(pts);
+  }
+
+  EXPECT_TRUE(sinks[0]->pts().empty());
+  EXPECT_TRUE(sinks[1]->pts().empty());
+
+  sinks[1]->Start();
+  for (size_t i = 0; i < 2; ++i) {
+    ASSERT_TRUE(sinks[i]->WaitForPackets(kPacketCount));
+    EXPECT_EQ(expected_pts, sinks[i]->pts());
+  }
+}
+
+// Tests whether a tee passes each packet's revised stream type to both its
+// outputs.
+TEST_F(FanOutTest, ForwardsRevisedStreamType) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<FakeSink> sinks[2] = {FakeSink::Create(),
+                                        FakeSink::Create()};
+
+  Graph graph;
+  PartRef tee_part = graph.Add(Tee::Create(2));
+  graph.ConnectParts(graph.Add(source), tee_part);
+  for (size_t i = 0; i < 2; ++i) {
+    graph.Connect(tee_part.output(i), graph.Add(sinks[i]).input());
+  }
+  graph.Prepare();
+
+  for (size_t i = 0; i < 2; ++i) {
+    sinks[i]->Start();
+  }
+
+  source->Supply(CreateTestPacket(0));
+  PacketPtr packet = CreateTestPacket(1);
+  packet->SetRevisedStreamType(AudioStreamType::Create(
+      StreamType::kAudioEncodingLpcm, nullptr,
+      AudioStreamType::SampleFormat::kSigned16, 2, 48000));
+  source->Supply(std::move(packet));
+
+  std::vector<std::string> expected_encodings = {
+      std::string(), StreamType::kAudioEncodingLpcm};
+  for (size_t i = 0; i < 2; ++i) {
+    ASSERT_TRUE(sinks[i]->WaitForPackets(2));
+    EXPECT_EQ(expected_encodings, sinks[i]->revised_encodings());
+  }
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
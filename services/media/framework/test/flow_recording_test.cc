@@ -0,0 +1,76 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/flow_recording.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class FlowRecordingTest : public TestBase {};
+
+// Tests whether a recording that stays under its maximum size reads back
+// intact.
+TEST_F(FlowRecordingTest, RoundTrip) {
+  std::shared_ptr<FlowRecorder> recorder = FlowRecorder::Create();
+  size_t track = recorder->AddTrack("0.0->1.0");
+  recorder->RecordDemand(track, Demand::kPositive);
+  for (int64_t pts = 0; pts < 10; ++pts) {
+    recorder->RecordPacket(track, *CreateTestPacket(pts * 1000));
+  }
+
+  EXPECT_FALSE(recorder->truncated());
+
+  std::shared_ptr<FlowRecording> recording =
+      FlowRecording::Create(recorder->GetData());
+  ASSERT_TRUE(recording);
+  ASSERT_EQ(1u, recording->tracks().size());
+
+  const FlowRecording::Track& recorded_track = recording->tracks()[0];
+  EXPECT_EQ("0.0->1.0", recorded_track.label);
+  ASSERT_EQ(11u, recorded_track.events.size());
+  EXPECT_EQ(FlowRecording::EventType::kDemand,
+            recorded_track.events[0].type);
+  EXPECT_EQ(Demand::kPositive, recorded_track.events[0].demand);
+  for (int64_t pts = 0; pts < 10; ++pts) {
+    const FlowRecording::Event& event = recorded_track.events[pts + 1];
+    EXPECT_EQ(FlowRecording::EventType::kPacket, event.type);
+    EXPECT_EQ(pts * 1000, event.pts);
+  }
+}
+
+// Tests whether a recording stops growing at its maximum size and whether what
+// it holds is a valid prefix of the traffic.
+TEST_F(FlowRecordingTest, MaxSize) {
+  static const size_t kMaxSize = 256;
+  std::shared_ptr<FlowRecorder> recorder = FlowRecorder::Create(kMaxSize);
+  size_t track = recorder->AddTrack("track");
+  for (int64_t pts = 0; pts < 1000; ++pts) {
+    recorder->RecordPacket(track, *CreateTestPacket(pts));
+  }
+
+  EXPECT_TRUE(recorder->truncated());
+
+  std::vector<uint8_t> data = recorder->GetData();
+  // The last record may extend a little past the maximum.
+  EXPECT_LT(data.size(), kMaxSize + 32);
+
+  std::shared_ptr<FlowRecording> recording = FlowRecording::Create(data);
+  ASSERT_TRUE(recording);
+  ASSERT_EQ(1u, recording->tracks().size());
+
+  const std::vector<FlowRecording::Event>& events =
+      recording->tracks()[0].events;
+  EXPECT_LT(0u, events.size());
+  EXPECT_GT(1000u, events.size());
+  for (size_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(static_cast<int64_t>(i), events[i].pts);
+  }
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,78 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/parts/threaded_transform.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class FlushTest : public TestBase {};
+
+// Builds a source -> transform -> transform -> sink graph, passes a packet
+// through it, flushes the source's output and restarts the sink right away, as
+// MediaSinkImpl does after a seek. Checks that the flush has reached the sink
+// by the time FlushOutput returns and that the restarted sink gets the packets
+// supplied after the flush.
+void FlushAndRestart(Graph* graph) {
+  DCHECK(graph);
+
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<GatedTransform> threaded_transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+  transform->Open();
+  threaded_transform->Open();
+
+  PartRef source_part = graph->Add(source);
+  PartRef transform_part = graph->Add(transform);
+  PartRef threaded_transform_part =
+      graph->Add(ThreadedTransform::Create(threaded_transform, 1));
+  PartRef sink_part = graph->Add(sink);
+  graph->ConnectParts(source_part, transform_part);
+  graph->ConnectParts(transform_part, threaded_transform_part);
+  graph->ConnectParts(threaded_transform_part, sink_part);
+  graph->Prepare();
+  sink->Start();
+
+  source->Supply(CreateTestPacket(0));
+  ASSERT_TRUE(sink->WaitForPackets(1));
+
+  for (int64_t pts = 1; pts < 4; ++pts) {
+    graph->FlushOutput(source_part.output());
+    EXPECT_EQ(static_cast<size_t>(pts), source->flush_count());
+
+    // The flush may reach the sink after this, which mustn't leave it without
+    // demand.
+    sink->Start();
+    source->Supply(CreateTestPacket(pts));
+    ASSERT_TRUE(sink->WaitForPackets(pts + 1));
+    EXPECT_EQ(static_cast<size_t>(pts), transform->flush_count());
+    EXPECT_EQ(static_cast<size_t>(pts), sink->flush_count());
+  }
+
+  EXPECT_EQ(std::vector<int64_t>({0, 1, 2, 3}), sink->pts());
+}
+
+// Tests whether a flush reaches the sink ahead of the packets that follow it,
+// without losing the sink's demand, in single-threaded mode.
+TEST_F(FlushTest, SinkFlushedSingleThreaded) {
+  Graph graph;
+  FlushAndRestart(&graph);
+}
+
+// Tests whether a flush reaches the sink ahead of the packets that follow it,
+// without losing the sink's demand, in multithreaded mode.
+TEST_F(FlushTest, SinkFlushedMultithreaded) {
+  Graph graph;
+  graph.EnableMultithreading(2);
+  FlushAndRestart(&graph);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,83 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class FusionTest : public TestBase {};
+
+static constexpr size_t kChainLength = 3;
+static constexpr int64_t kPacketCount = 10;
+
+// Connects a source, a chain of kChainLength open transforms and a sink, fuses
+// the chain and checks that it's fused in order and passes packets through
+// every transform.
+void FuseChain(bool multithreaded) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+  std::vector<std::shared_ptr<GatedTransform>> transforms;
+
+  Graph graph;
+  if (multithreaded) {
+    graph.EnableMultithreading(2);
+  }
+
+  OutputRef output = graph.Add(source).output();
+  for (size_t i = 0; i < kChainLength; ++i) {
+    transforms.push_back(GatedTransform::Create());
+    transforms.back()->Open();
+    output = graph.ConnectOutputToPart(output, graph.Add(transforms.back()))
+                 .output();
+  }
+
+  graph.ConnectOutputToPart(output, graph.Add(sink));
+
+  // A lone transform elsewhere in the graph isn't a chain.
+  std::shared_ptr<GatedTransform> lone_transform = GatedTransform::Create();
+  graph.Add(lone_transform);
+
+  graph.FuseTransforms();
+
+  std::vector<std::vector<std::shared_ptr<Transform>>> fused =
+      graph.GetFusedTransforms();
+  ASSERT_EQ(1u, fused.size());
+  ASSERT_EQ(kChainLength, fused[0].size());
+  for (size_t i = 0; i < kChainLength; ++i) {
+    EXPECT_EQ(transforms[i], fused[0][i]);
+  }
+
+  graph.Prepare();
+  sink->Start();
+
+  std::vector<int64_t> expected_pts;
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    source->Supply(CreateTestPacket(pts));
+    expected_pts.push_back(pts);
+  }
+
+  ASSERT_TRUE(sink->WaitForPackets(kPacketCount));
+  EXPECT_EQ(expected_pts, sink->pts());
+  for (const std::shared_ptr<GatedTransform>& transform : transforms) {
+    EXPECT_TRUE(transform->WaitForCalls(kPacketCount));
+  }
+}
+
+// Tests whether a fused chain delivers packets in a single-threaded graph.
+TEST_F(FusionTest, FuseChainSingleThreaded) {
+  FuseChain(false);
+}
+
+// Tests whether a fused chain delivers packets in a multithreaded graph.
+TEST_F(FusionTest, FuseChainMultithreaded) {
+  FuseChain(true);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,162 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sstream>
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/graph_snapshot.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class GraphSnapshotTest : public TestBase {};
+
+static constexpr int64_t kPacketCount = 10;
+
+// A source -> transform -> sink graph, not yet prepared.
+class TestGraph {
+ public:
+  TestGraph()
+      : source_(FakeSource::Create()),
+        transform_(GatedTransform::Create()),
+        sink_(FakeSink::Create()) {
+    transform_->Open();
+    PartRef transform_part = graph_.Add(transform_);
+    graph_.ConnectParts(graph_.Add(source_), transform_part);
+    graph_.ConnectParts(transform_part, graph_.Add(sink_));
+  }
+
+  Graph& graph() { return graph_; }
+
+  // Prepares the graph and passes kPacketCount packets through it. Returns
+  // false if they don't reach the sink.
+  bool PassPackets() {
+    graph_.Prepare();
+    sink_->Start();
+    for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+      source_->Supply(CreateTestPacket(pts));
+    }
+
+    return sink_->WaitForPackets(kPacketCount);
+  }
+
+ private:
+  Graph graph_;
+  std::shared_ptr<FakeSource> source_;
+  std::shared_ptr<GatedTransform> transform_;
+  std::shared_ptr<FakeSink> sink_;
+};
+
+// Returns the index in snapshot of the part of the indicated type.
+size_t PartIndex(const GraphSnapshot& snapshot, const std::string& type) {
+  for (size_t i = 0; i < snapshot.parts.size(); ++i) {
+    if (snapshot.parts[i].type == type) {
+      return i;
+    }
+  }
+
+  ADD_FAILURE() << "no part of type " << type;
+  return snapshot.parts.size();
+}
+
+// Tests whether a snapshot reflects the topology of the graph and whether its
+// parts and connections are prepared.
+TEST_F(GraphSnapshotTest, Topology) {
+  TestGraph test_graph;
+
+  GraphSnapshot snapshot = test_graph.graph().GetSnapshot();
+  ASSERT_EQ(3u, snapshot.parts.size());
+  ASSERT_EQ(2u, snapshot.connections.size());
+
+  size_t source = PartIndex(snapshot, "ActiveSourceStage");
+  size_t transform = PartIndex(snapshot, "TransformStage");
+  size_t sink = PartIndex(snapshot, "ActiveSinkStage");
+
+  for (const GraphSnapshot::Part& part : snapshot.parts) {
+    EXPECT_FALSE(part.prepared);
+    EXPECT_EQ(0u, part.unconnected_inputs);
+    EXPECT_EQ(0u, part.unconnected_outputs);
+  }
+
+  for (const GraphSnapshot::Connection& connection : snapshot.connections) {
+    EXPECT_FALSE(connection.prepared);
+    if (connection.output_part == source) {
+      EXPECT_EQ(transform, connection.input_part);
+    } else {
+      EXPECT_EQ(transform, connection.output_part);
+      EXPECT_EQ(sink, connection.input_part);
+    }
+  }
+
+  ASSERT_TRUE(test_graph.PassPackets());
+
+  snapshot = test_graph.graph().GetSnapshot();
+  for (const GraphSnapshot::Part& part : snapshot.parts) {
+    EXPECT_TRUE(part.prepared);
+  }
+
+  for (const GraphSnapshot::Connection& connection : snapshot.connections) {
+    EXPECT_TRUE(connection.prepared);
+  }
+}
+
+// Tests whether a snapshot reports the packets that have passed through the
+// graph.
+TEST_F(GraphSnapshotTest, PacketCounts) {
+  TestGraph test_graph;
+  ASSERT_TRUE(test_graph.PassPackets());
+
+  const uint64_t packet_count = static_cast<uint64_t>(kPacketCount);
+
+  GraphSnapshot snapshot = test_graph.graph().GetSnapshot();
+  for (const GraphSnapshot::Part& part : snapshot.parts) {
+    EXPECT_LT(0u, part.update_count);
+    EXPECT_EQ(part.input_count == 0 ? 0u : packet_count, part.packets_in);
+    EXPECT_EQ(part.output_count == 0 ? 0u : packet_count, part.packets_out);
+  }
+
+  for (const GraphSnapshot::Connection& connection : snapshot.connections) {
+    EXPECT_EQ(packet_count, connection.packets_supplied);
+    EXPECT_EQ(0u, connection.packet_count);
+    EXPECT_EQ(connection.output_generation, connection.input_generation);
+  }
+}
+
+// Tests whether ToJson and ToDot describe every part and connection.
+TEST_F(GraphSnapshotTest, Export) {
+  TestGraph test_graph;
+  GraphSnapshot unprepared_snapshot = test_graph.graph().GetSnapshot();
+  ASSERT_TRUE(test_graph.PassPackets());
+  GraphSnapshot snapshot = test_graph.graph().GetSnapshot();
+
+  std::string json = snapshot.ToJson();
+  EXPECT_EQ('{', json.front());
+  EXPECT_EQ('}', json.back());
+  EXPECT_NE(std::string::npos, json.find("\"parts\":["));
+  EXPECT_NE(std::string::npos, json.find("\"connections\":["));
+  for (const GraphSnapshot::Part& part : snapshot.parts) {
+    EXPECT_NE(std::string::npos,
+              json.find("\"type\":\"" + part.type + "\""));
+  }
+
+  std::string dot = snapshot.ToDot();
+  EXPECT_EQ(0u, dot.find("digraph "));
+  for (const GraphSnapshot::Connection& connection : snapshot.connections) {
+    std::ostringstream edge;
+    edge << "p" << connection.output_part << " -> p"
+         << connection.input_part;
+    EXPECT_NE(std::string::npos, dot.find(edge.str()));
+  }
+
+  EXPECT_EQ(std::string::npos, dot.find("style=dashed"));
+  EXPECT_NE(std::string::npos,
+            unprepared_snapshot.ToDot().find("style=dashed"));
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,123 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <thread>
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/parts/threaded_transform.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class MemoryBudgetTest : public TestBase {};
+
+static constexpr size_t kPacketSize = 1024;
+static constexpr size_t kSoftLimit = kPacketSize * 5 / 2;
+static constexpr size_t kHardLimit = kPacketSize * 64;
+static constexpr size_t kMaxPacketsInFlight = 4;
+static constexpr int64_t kPacketCount = 20;
+
+// Waits until the first part added to graph has supplied count packets
+// downstream. Returns false if that doesn't happen within kFakePartTimeout.
+bool WaitForSourcePacketsOut(Graph* graph, uint64_t count) {
+  auto deadline = std::chrono::steady_clock::now() + kFakePartTimeout;
+  while (graph->GetPartProfiles().front().packets_out < count) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return true;
+}
+
+// Fills a source -> threaded transform -> sink graph past its soft limit while
+// the transform is blocked, then unblocks the transform and checks that the
+// graph recovers. The transform allocates its output as a decoder would, so
+// the bytes stay over the resume level until its stage supplies the output
+// downstream. That stage mustn't be held back, or the graph stalls for good.
+// The source supplies a packet only once the previous one has left its stage,
+// as a source responding to demand would.
+void FillAndRecover(Graph* graph) {
+  DCHECK(graph);
+
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+
+  graph->SetMemoryBudget(kSoftLimit, kHardLimit);
+  PartRef source_part = graph->Add(source);
+  PartRef transform_part =
+      graph->Add(ThreadedTransform::Create(transform, kMaxPacketsInFlight));
+  PartRef sink_part = graph->Add(sink);
+  graph->ConnectParts(source_part, transform_part);
+  graph->ConnectParts(transform_part, sink_part);
+  graph->Prepare();
+  sink->Start();
+
+  const std::shared_ptr<BudgetAllocator>& budget = graph->memory_budget();
+
+  // Supply packets until the budget is throttled. They go to the transform,
+  // which holds on to them, except for the last, which the source's stage
+  // holds on to.
+  int64_t pts = 0;
+  while (true) {
+    ASSERT_LT(pts, static_cast<int64_t>(kMaxPacketsInFlight));
+    PacketPtr packet = source->CreatePacket(pts++, kPacketSize);
+    ASSERT_TRUE(packet);
+    source->Supply(std::move(packet));
+
+    if (budget->throttled()) {
+      break;
+    }
+
+    ASSERT_TRUE(WaitForSourcePacketsOut(graph, pts));
+  }
+
+  EXPECT_GT(budget->current_bytes(), kSoftLimit);
+  EXPECT_TRUE(sink->pts().empty());
+
+  transform->Open();
+
+  ASSERT_TRUE(WaitForSourcePacketsOut(graph, pts));
+
+  while (pts < kPacketCount) {
+    PacketPtr packet = source->CreatePacket(pts++, kPacketSize);
+    ASSERT_TRUE(packet);
+    source->Supply(std::move(packet));
+    ASSERT_TRUE(WaitForSourcePacketsOut(graph, pts));
+  }
+
+  ASSERT_TRUE(sink->WaitForPackets(kPacketCount));
+
+  std::vector<int64_t> expected_pts;
+  for (int64_t i = 0; i < kPacketCount; ++i) {
+    expected_pts.push_back(i);
+  }
+
+  EXPECT_EQ(expected_pts, sink->pts());
+  EXPECT_NE(0u, budget->resume_count());
+}
+
+// Tests whether a single-threaded graph recovers after reaching its soft
+// limit.
+TEST_F(MemoryBudgetTest, RecoversSingleThreaded) {
+  Graph graph;
+  FillAndRecover(&graph);
+}
+
+// Tests whether a multithreaded graph recovers after reaching its soft limit.
+TEST_F(MemoryBudgetTest, RecoversMultithreaded) {
+  Graph graph;
+  graph.EnableMultithreading(2);
+  FillAndRecover(&graph);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
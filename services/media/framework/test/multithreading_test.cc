@@ -0,0 +1,101 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class MultithreadingTest : public TestBase {};
+
+static constexpr size_t kBranchCount = 4;
+static constexpr int64_t kPacketCount = 100;
+
+// Independent source -> transform -> sink branches in one graph.
+struct Branches {
+  std::shared_ptr<FakeSource> sources[kBranchCount];
+  std::shared_ptr<GatedTransform> transforms[kBranchCount];
+  std::shared_ptr<FakeSink> sinks[kBranchCount];
+};
+
+// Adds branch_count branches to graph, prepares it and starts the sinks.
+void BuildBranches(Graph* graph, size_t branch_count, Branches* branches) {
+  DCHECK(graph);
+  DCHECK(branch_count <= kBranchCount);
+  DCHECK(branches);
+
+  for (size_t i = 0; i < branch_count; ++i) {
+    branches->sources[i] = FakeSource::Create();
+    branches->transforms[i] = GatedTransform::Create();
+    branches->sinks[i] = FakeSink::Create();
+
+    PartRef transform_part = graph->Add(branches->transforms[i]);
+    graph->ConnectParts(graph->Add(branches->sources[i]), transform_part);
+    graph->ConnectParts(transform_part, graph->Add(branches->sinks[i]));
+  }
+
+  graph->Prepare();
+
+  for (size_t i = 0; i < branch_count; ++i) {
+    branches->sinks[i]->Start();
+  }
+}
+
+// Tests whether independent branches of a multithreaded graph are updated
+// concurrently, so a transform that blocks holds up only its own branch.
+TEST_F(MultithreadingTest, BranchesRunConcurrently) {
+  Graph graph;
+  graph.EnableMultithreading(2);
+  Branches branches;
+  BuildBranches(&graph, 2, &branches);
+
+  // Each transform blocks the worker that calls it, so both can only be
+  // called if the branches are updated on different workers.
+  for (size_t i = 0; i < 2; ++i) {
+    branches.sources[i]->Supply(CreateTestPacket(0));
+  }
+
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_TRUE(branches.transforms[i]->WaitForCalls(1));
+  }
+
+  for (size_t i = 0; i < 2; ++i) {
+    branches.transforms[i]->Open();
+    ASSERT_TRUE(branches.sinks[i]->WaitForPackets(1));
+  }
+}
+
+// Tests whether every branch of a multithreaded graph gets all of its packets
+// in order while packets are supplied to all the branches at once.
+TEST_F(MultithreadingTest, PacketsArriveInOrder) {
+  Graph graph;
+  graph.EnableMultithreading(kBranchCount);
+  Branches branches;
+  BuildBranches(&graph, kBranchCount, &branches);
+
+  for (size_t i = 0; i < kBranchCount; ++i) {
+    branches.transforms[i]->Open();
+  }
+
+  std::vector<int64_t> expected_pts;
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    for (size_t i = 0; i < kBranchCount; ++i) {
+      branches.sources[i]->Supply(CreateTestPacket(pts));
+    }
+
+    expected_pts.push_back(pts);
+  }
+
+  for (size_t i = 0; i < kBranchCount; ++i) {
+    ASSERT_TRUE(branches.sinks[i]->WaitForPackets(kPacketCount));
+    EXPECT_EQ(expected_pts, branches.sinks[i]->pts());
+  }
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
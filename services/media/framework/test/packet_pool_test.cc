@@ -0,0 +1,104 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "services/media/framework/packet_pool.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class PacketPoolTest : public TestBase {};
+
+static constexpr size_t kThreadCount = 4;
+static constexpr size_t kIterations = 10000;
+static constexpr size_t kBlocksHeld = 16;
+
+// Contents of a block, written when it's allocated and checked when it's
+// released, so blocks handed out twice are detected.
+struct TestBlock {
+  uint64_t owner;
+  uint64_t sequence;
+};
+
+// Allocates blocks from pool, holding up to kBlocksHeld of them at a time, and
+// checks that no other thread writes to them.
+void AllocateAndRelease(PacketPool* pool,
+                        uint64_t owner,
+                        std::atomic<size_t>* error_count) {
+  std::vector<TestBlock*> blocks;
+  for (uint64_t sequence = 0; sequence < kIterations; ++sequence) {
+    TestBlock* block =
+        static_cast<TestBlock*>(pool->AllocateBlock(sizeof(TestBlock)));
+    block->owner = owner;
+    block->sequence = sequence;
+    blocks.push_back(block);
+
+    if (blocks.size() == kBlocksHeld || sequence + 1 == kIterations) {
+      for (TestBlock* held : blocks) {
+        if (held->owner != owner) {
+          ++*error_count;
+        }
+        pool->ReleaseBlock(held);
+      }
+      blocks.clear();
+    }
+  }
+}
+
+// Tests whether blocks allocated and released concurrently on several threads
+// are never handed out twice and whether the counters add up.
+TEST_F(PacketPoolTest, ConcurrentAllocateAndRelease) {
+  std::shared_ptr<PacketPool> pool = PacketPool::Create(sizeof(TestBlock));
+  std::atomic<size_t> error_count(0);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back(AllocateAndRelease, pool.get(), i, &error_count);
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(0u, error_count.load());
+
+  PacketPool::Counters counters = pool->counters();
+  EXPECT_EQ(kThreadCount * kIterations, counters.allocation_count);
+  EXPECT_EQ(0u, counters.outstanding_count);
+  EXPECT_LE(counters.high_water_mark, kThreadCount * kBlocksHeld);
+  // Nearly all allocations are satisfied by recycled blocks.
+  EXPECT_GT(counters.hit_rate(), 0.9);
+}
+
+// Tests whether blocks allocated on one thread can be released on another.
+TEST_F(PacketPoolTest, ReleaseOnAnotherThread) {
+  std::shared_ptr<PacketPool> pool = PacketPool::Create(sizeof(TestBlock));
+
+  for (size_t round = 0; round < 100; ++round) {
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < kBlocksHeld; ++i) {
+      blocks.push_back(pool->AllocateBlock(sizeof(TestBlock)));
+    }
+
+    std::thread thread([&pool, &blocks]() {
+      for (void* block : blocks) {
+        pool->ReleaseBlock(block);
+      }
+    });
+    thread.join();
+  }
+
+  PacketPool::Counters counters = pool->counters();
+  EXPECT_EQ(0u, counters.outstanding_count);
+  EXPECT_EQ(kBlocksHeld, counters.high_water_mark);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,75 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class ProfilingTest : public TestBase {};
+
+static constexpr int64_t kPacketCount = 10;
+
+// Passes kPacketCount packets through a source -> transform -> sink graph
+// with profiling enabled or not and checks the counters the graph reports.
+void CountPackets(bool profiling_enabled) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+  transform->Open();
+
+  Graph graph;
+  graph.EnableProfiling(profiling_enabled);
+  PartRef transform_part = graph.Add(transform);
+  graph.ConnectParts(graph.Add(source), transform_part);
+  graph.ConnectParts(transform_part, graph.Add(sink));
+  graph.Prepare();
+  sink->Start();
+
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    source->Supply(CreateTestPacket(pts));
+  }
+
+  ASSERT_TRUE(sink->WaitForPackets(kPacketCount));
+
+  const uint64_t packet_count = static_cast<uint64_t>(kPacketCount);
+
+  std::vector<PartProfile> part_profiles = graph.GetPartProfiles();
+  ASSERT_EQ(3u, part_profiles.size());
+  for (const PartProfile& profile : part_profiles) {
+    // Counts are kept whether profiling is enabled or not.
+    EXPECT_LT(0u, profile.update_count);
+    EXPECT_EQ(profile.part.input_count() == 0 ? 0u : packet_count,
+              profile.packets_in);
+    EXPECT_EQ(profile.part.output_count() == 0 ? 0u : packet_count,
+              profile.packets_out);
+  }
+
+  std::vector<ConnectionProfile> connection_profiles =
+      graph.GetConnectionProfiles();
+  ASSERT_EQ(2u, connection_profiles.size());
+  for (const ConnectionProfile& profile : connection_profiles) {
+    EXPECT_EQ(packet_count, profile.packet_count);
+    // Latency is measured only while profiling is enabled.
+    EXPECT_EQ(profiling_enabled ? packet_count : 0u,
+              profile.timed_packet_count);
+  }
+}
+
+// Tests whether update and packet counts are kept with profiling disabled.
+TEST_F(ProfilingTest, Disabled) {
+  CountPackets(false);
+}
+
+// Tests whether packet latencies are measured with profiling enabled.
+TEST_F(ProfilingTest, Enabled) {
+  CountPackets(true);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
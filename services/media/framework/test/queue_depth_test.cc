@@ -0,0 +1,99 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class QueueDepthTest : public TestBase {};
+
+// Number of packets the transform below produces per input packet.
+static constexpr int64_t kSplitCount = 8;
+
+// Transform that produces kSplitCount packets for each input packet, noting
+// how many packets the sink has received when it produces each one.
+class SplittingTransform : public Transform {
+ public:
+  explicit SplittingTransform(std::shared_ptr<FakeSink> sink)
+      : sink_(sink), produced_count_(0) {}
+
+  ~SplittingTransform() override {}
+
+  // The number of packets the sink had received when each packet was
+  // produced.
+  const std::vector<size_t>& sink_counts() const { return sink_counts_; }
+
+  // Transform implementation.
+  bool TransformPacket(const PacketPtr& input,
+                       bool new_input,
+                       PayloadAllocator* allocator,
+                       PacketPtr* output) override {
+    DCHECK(input);
+    DCHECK(output);
+
+    if (new_input) {
+      produced_count_ = 0;
+    }
+
+    sink_counts_.push_back(sink_->pts().size());
+    *output = CreateTestPacket(input->pts() * kSplitCount + produced_count_);
+    return ++produced_count_ == kSplitCount;
+  }
+
+ private:
+  std::shared_ptr<FakeSink> sink_;
+  int64_t produced_count_;
+  std::vector<size_t> sink_counts_;
+};
+
+// Connects a transform that produces several packets per input to a sink
+// with a queue of the indicated depth and checks that the transform fills the
+// queue before the sink gets any of the packets in it.
+void FillQueue(size_t queue_depth) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+  std::shared_ptr<SplittingTransform> transform =
+      std::make_shared<SplittingTransform>(sink);
+
+  Graph graph;
+  PartRef transform_part = graph.Add(transform);
+  PartRef sink_part = graph.Add(sink);
+  graph.ConnectParts(graph.Add(source), transform_part);
+  graph.Connect(transform_part.output(), sink_part.input(), queue_depth);
+  graph.Prepare();
+  sink->Start();
+
+  source->Supply(CreateTestPacket(0));
+  ASSERT_TRUE(sink->WaitForPackets(kSplitCount));
+
+  std::vector<int64_t> expected_pts;
+  std::vector<size_t> expected_sink_counts;
+  for (int64_t pts = 0; pts < kSplitCount; ++pts) {
+    expected_pts.push_back(pts);
+    // The queue is drained only when it's full.
+    expected_sink_counts.push_back(pts / queue_depth * queue_depth);
+  }
+
+  EXPECT_EQ(expected_pts, sink->pts());
+  EXPECT_EQ(expected_sink_counts, transform->sink_counts());
+}
+
+// Tests whether an input with the default depth holds one packet.
+TEST_F(QueueDepthTest, DefaultDepth) {
+  FillQueue(Input::kDefaultQueueDepth);
+}
+
+// Tests whether an input with a deeper queue holds as many packets as its
+// depth.
+TEST_F(QueueDepthTest, DeepQueue) {
+  FillQueue(4);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
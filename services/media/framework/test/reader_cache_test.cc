@@ -0,0 +1,319 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "base/files/scoped_temp_dir.h"
+#include "base/logging.h"
+#include "services/media/framework/parts/reader_cache.h"
+#include "services/media/framework/scheduler.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class ReaderCacheTest : public TestBase {};
+
+static constexpr size_t kAssetSize = 1024 * 1024;
+static constexpr size_t kReadSize = 1000;
+
+// Returns the value of the asset byte at position.
+uint8_t ContentAt(size_t position) {
+  return static_cast<uint8_t>((position * 31) >> 3);
+}
+
+// Reader that produces synthetic content synchronously. If it can't seek, it
+// fails reads that don't start where the previous read ended, as a reader of a
+// stream does.
+class FakeReader : public Reader {
+ public:
+  static std::shared_ptr<FakeReader> Create(size_t size, bool can_seek) {
+    return std::shared_ptr<FakeReader>(new FakeReader(size, can_seek));
+  }
+
+  ~FakeReader() override {}
+
+  // The positions of the reads issued so far.
+  const std::vector<size_t>& read_positions() { return read_positions_; }
+
+  // The number of reads that were failed for not being sequential.
+  size_t non_sequential_reads() { return non_sequential_reads_; }
+
+  // Reader implementation.
+  void Describe(const DescribeCallback& callback) override {
+    callback(Result::kOk, size_, can_seek_);
+  }
+
+  void ReadAt(size_t position,
+              uint8_t* buffer,
+              size_t bytes_to_read,
+              const ReadAtCallback& callback) override {
+    DCHECK(buffer);
+    DCHECK(bytes_to_read > 0);
+    DCHECK(position < size_);
+
+    read_positions_.push_back(position);
+
+    if (!can_seek_ && position != next_position_) {
+      ++non_sequential_reads_;
+      callback(Result::kInvalidArgument, 0);
+      return;
+    }
+
+    size_t bytes_read = std::min(bytes_to_read, size_ - position);
+    for (size_t i = 0; i < bytes_read; ++i) {
+      buffer[i] = ContentAt(position + i);
+    }
+
+    next_position_ = position + bytes_read;
+    callback(Result::kOk, bytes_read);
+  }
+
+ private:
+  FakeReader(size_t size, bool can_seek)
+      : size_(size),
+        can_seek_(can_seek),
+        next_position_(0),
+        non_sequential_reads_(0) {}
+
+  size_t size_;
+  bool can_seek_;
+  size_t next_position_;
+  size_t non_sequential_reads_;
+  std::vector<size_t> read_positions_;
+};
+
+// Reads size bytes at position from reader, waits for the read to complete
+// and checks the content read. Reads are completed on other threads when
+// content comes from a disk spill.
+void ExpectRead(Reader* reader, size_t position, size_t size) {
+  DCHECK(reader);
+
+  std::vector<uint8_t> buffer(size);
+  std::mutex mutex;
+  std::condition_variable condition_variable;
+  bool called = false;
+  reader->ReadAt(position, buffer.data(), size,
+                 [&mutex, &condition_variable, &called, size](
+                     Result result, size_t bytes_read) {
+                   EXPECT_EQ(Result::kOk, result);
+                   EXPECT_EQ(size, bytes_read);
+                   std::lock_guard<std::mutex> locker(mutex);
+                   called = true;
+                   condition_variable.notify_all();
+                 });
+
+  {
+    std::unique_lock<std::mutex> locker(mutex);
+    ASSERT_TRUE(condition_variable.wait_for(locker, std::chrono::seconds(10),
+                                            [&called]() { return called; }));
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    ASSERT_EQ(ContentAt(position + i), buffer[i]) << "at " << position + i;
+  }
+}
+
+// Reads size bytes at position from cache as ExpectRead does and returns
+// whether the read was satisfied from the cache immediately.
+bool ReadIsHit(ReaderCache* cache, size_t position, size_t size) {
+  DCHECK(cache);
+
+  uint64_t hits = cache->GetCounters().hits;
+  ExpectRead(cache, position, size);
+  return cache->GetCounters().hits != hits;
+}
+
+// Reads the asset sequentially from start to end, checking the content.
+void ReadSequentially(ReaderCache* cache, size_t start, size_t end) {
+  DCHECK(cache);
+
+  for (size_t position = start; position < end; position += kReadSize) {
+    ExpectRead(cache, position, std::min(kReadSize, end - position));
+  }
+}
+
+// Tests whether content far from the playhead is evicted before content at
+// recent seek positions and content around the playhead.
+TEST_F(ReaderCacheTest, EvictionOrder) {
+  static constexpr size_t kCapacity = 2 * 1024 * 1024;
+  static constexpr size_t kSize = 8 * kCapacity;
+  static constexpr size_t kFarPosition = 6 * kCapacity;
+  static constexpr size_t kPlayhead = 3 * kCapacity / 2;
+  std::shared_ptr<FakeReader> upstream = FakeReader::Create(kSize, true);
+  std::shared_ptr<ReaderCache> under_test =
+      ReaderCache::Create(upstream, kCapacity);
+
+  // Seek far ahead, then back to the start, and read more than the capacity.
+  ExpectRead(under_test.get(), kFarPosition, kReadSize);
+  ReadSequentially(under_test.get(), 0, kPlayhead);
+  EXPECT_NE(0u, under_test->GetCounters().evicted_bytes);
+  EXPECT_GE(kCapacity, under_test->GetCounters().cached_bytes);
+
+  // Content behind the playhead, at the seek positions and ahead of the
+  // playhead is still cached.
+  EXPECT_TRUE(ReadIsHit(under_test.get(), kPlayhead - kReadSize, kReadSize));
+  EXPECT_TRUE(ReadIsHit(under_test.get(), kPlayhead, kReadSize));
+  EXPECT_TRUE(ReadIsHit(under_test.get(), kFarPosition, kReadSize));
+  EXPECT_TRUE(ReadIsHit(under_test.get(), 0, kReadSize));
+
+  // Content just past what's kept for the seek to the start is further behind
+  // the playhead than the capacity, so it was evicted and is read again.
+  EXPECT_FALSE(ReadIsHit(under_test.get(), kCapacity / 4, kReadSize));
+}
+
+// Tests whether the cache stays within its capacity when read requests seek
+// all over the asset.
+TEST_F(ReaderCacheTest, SeekStorm) {
+  static constexpr size_t kCapacity = 1024 * 1024;
+  static constexpr size_t kSize = 16 * kCapacity;
+  std::shared_ptr<FakeReader> upstream = FakeReader::Create(kSize, true);
+  std::shared_ptr<ReaderCache> under_test =
+      ReaderCache::Create(upstream, kCapacity);
+
+  uint32_t seed = 1;
+  for (size_t i = 0; i < 500; ++i) {
+    seed = seed * 1103515245 + 12345;
+    size_t position = (static_cast<size_t>(seed) >> 4) % (kSize - kReadSize);
+    ExpectRead(under_test.get(), position, kReadSize);
+    ASSERT_GE(kCapacity, under_test->GetCounters().cached_bytes);
+  }
+
+  EXPECT_NE(0u, under_test->GetCounters().evicted_bytes);
+}
+
+// Tests whether evicted content is read again when it's needed.
+TEST_F(ReaderCacheTest, RefetchesEvictedContent) {
+  static constexpr size_t kCapacity = 256 * 1024;
+  static constexpr size_t kSize = 8 * kCapacity;
+  std::shared_ptr<FakeReader> upstream = FakeReader::Create(kSize, true);
+  std::shared_ptr<ReaderCache> under_test =
+      ReaderCache::Create(upstream, kCapacity);
+
+  ReadSequentially(under_test.get(), 0, kSize);
+  EXPECT_NE(0u, under_test->GetCounters().evicted_bytes);
+  uint64_t upstream_bytes = under_test->GetCounters().upstream_bytes;
+
+  ReadSequentially(under_test.get(), 0, kSize);
+  EXPECT_LT(upstream_bytes, under_test->GetCounters().upstream_bytes);
+  EXPECT_GE(kCapacity, under_test->GetCounters().cached_bytes);
+}
+
+// Tests whether evicted content is read back from the disk spill rather than
+// from upstream.
+TEST_F(ReaderCacheTest, SpillServesEvictedContent) {
+  static constexpr size_t kCapacity = 256 * 1024;
+  static constexpr size_t kSize = 8 * kCapacity;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  DiskSpill::Settings spill_settings;
+  spill_settings.path = temp_dir.path().Append("spill").value();
+  spill_settings.capacity = kSize;
+  std::shared_ptr<FakeReader> upstream = FakeReader::Create(kSize, true);
+  std::shared_ptr<ReaderCache> under_test =
+      ReaderCache::Create(upstream, kCapacity, spill_settings);
+
+  ReadSequentially(under_test.get(), 0, kSize);
+  EXPECT_NE(0u, under_test->GetCounters().evicted_bytes);
+  uint64_t upstream_bytes = under_test->GetCounters().upstream_bytes;
+
+  // Spill writes are queued ahead of the spill reads, so the start of the
+  // asset has been spilled by the time it's read again.
+  ReadSequentially(under_test.get(), 0, kCapacity);
+  EXPECT_NE(0u, under_test->GetCounters().spill_bytes_read);
+  EXPECT_EQ(upstream_bytes, under_test->GetCounters().upstream_bytes);
+}
+
+// Tests whether the disk spill keeps working while all the blocking threads of
+// the default scheduler are taken, as they are when consumers of the cache
+// block on it there.
+TEST_F(ReaderCacheTest, SpillIndependentOfDefaultScheduler) {
+  static constexpr size_t kCapacity = 256 * 1024;
+  static constexpr size_t kSize = 4 * kCapacity;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  DiskSpill::Settings spill_settings;
+  spill_settings.path = temp_dir.path().Append("spill").value();
+  spill_settings.capacity = kSize;
+  std::shared_ptr<FakeReader> upstream = FakeReader::Create(kSize, true);
+  std::shared_ptr<ReaderCache> under_test =
+      ReaderCache::Create(upstream, kCapacity, spill_settings);
+
+  std::mutex mutex;
+  std::condition_variable condition_variable;
+  size_t blocked_count = 0;
+  bool released = false;
+  std::shared_ptr<Scheduler> scheduler = Scheduler::GetDefault();
+  std::vector<std::unique_ptr<Scheduler::Sequence>> blockers;
+  for (size_t i = 0; i < scheduler->blocking_thread_count(); ++i) {
+    blockers.emplace_back(new Scheduler::Sequence(scheduler));
+    blockers.back()->Post(
+        [&mutex, &condition_variable, &blocked_count, &released]() {
+          std::unique_lock<std::mutex> locker(mutex);
+          ++blocked_count;
+          condition_variable.notify_all();
+          condition_variable.wait(locker, [&released]() { return released; });
+        });
+  }
+
+  {
+    std::unique_lock<std::mutex> locker(mutex);
+    condition_variable.wait(locker, [&blocked_count, &blockers]() {
+      return blocked_count == blockers.size();
+    });
+  }
+
+  ReadSequentially(under_test.get(), 0, kSize);
+  ReadSequentially(under_test.get(), 0, kCapacity);
+  EXPECT_NE(0u, under_test->GetCounters().spill_bytes_read);
+
+  {
+    std::lock_guard<std::mutex> locker(mutex);
+    released = true;
+    condition_variable.notify_all();
+  }
+
+  blockers.clear();
+}
+
+// Tests whether a cache of a reader that can't seek keeps all the content it
+// reads, so it can serve reads behind the upstream position.
+TEST_F(ReaderCacheTest, NonSeekableUpstreamKeepsContent) {
+  static constexpr size_t kCapacity = 128 * 1024;
+  std::shared_ptr<FakeReader> upstream = FakeReader::Create(kAssetSize, false);
+  std::shared_ptr<ReaderCache> under_test =
+      ReaderCache::Create(upstream, kCapacity);
+
+  ReadSequentially(under_test.get(), 0, kAssetSize);
+  EXPECT_TRUE(ReadIsHit(under_test.get(), 0, kReadSize));
+  EXPECT_TRUE(ReadIsHit(under_test.get(), kAssetSize / 2, kReadSize));
+
+  EXPECT_EQ(0u, under_test->GetCounters().evicted_bytes);
+  EXPECT_EQ(kAssetSize, under_test->GetCounters().cached_bytes);
+  EXPECT_EQ(0u, upstream->non_sequential_reads());
+}
+
+// Tests whether a cache of a reader that can't seek reads it sequentially when
+// read requests seek forward and backward.
+TEST_F(ReaderCacheTest, NonSeekableUpstream) {
+  std::shared_ptr<FakeReader> upstream = FakeReader::Create(kAssetSize, false);
+  std::shared_ptr<ReaderCache> under_test = ReaderCache::Create(upstream);
+
+  ExpectRead(under_test.get(), 0, kReadSize);
+  ExpectRead(under_test.get(), kAssetSize / 2, kReadSize);
+  ExpectRead(under_test.get(), kReadSize * 3, kReadSize);
+  ExpectRead(under_test.get(), kAssetSize - kReadSize, kReadSize);
+
+  EXPECT_EQ(0u, upstream->non_sequential_reads());
+  EXPECT_EQ(0u, upstream->read_positions().front());
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,163 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/logging.h"
+#include "services/media/framework/graph.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class ReconfigurationTest : public TestBase {};
+
+static constexpr int64_t kPacketCount = 5;
+
+// Returns an open GatedTransform.
+std::shared_ptr<GatedTransform> CreateOpenTransform() {
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  transform->Open();
+  return transform;
+}
+
+// A running source -> transform -> sink graph.
+class RunningGraph {
+ public:
+  explicit RunningGraph(bool multithreaded)
+      : source_(FakeSource::Create()),
+        transform_(CreateOpenTransform()),
+        sink_(FakeSink::Create()),
+        next_pts_(0) {
+    if (multithreaded) {
+      graph_.EnableMultithreading(2);
+    }
+
+    transform_part_ = graph_.Add(transform_);
+    graph_.ConnectParts(graph_.Add(source_), transform_part_);
+    graph_.ConnectParts(transform_part_, graph_.Add(sink_));
+    graph_.Prepare();
+    sink_->Start();
+  }
+
+  Graph& graph() { return graph_; }
+
+  FakeSink& sink() { return *sink_; }
+
+  PartRef transform_part() const { return transform_part_; }
+
+  // Supplies kPacketCount packets and waits for them to reach the sink.
+  // Returns false if they don't.
+  bool PassPackets() {
+    for (int64_t i = 0; i < kPacketCount; ++i) {
+      source_->Supply(CreateTestPacket(next_pts_++));
+    }
+
+    return sink_->WaitForPackets(static_cast<size_t>(next_pts_));
+  }
+
+  // Returns the PTS of all the packets supplied so far.
+  std::vector<int64_t> supplied_pts() const {
+    std::vector<int64_t> result;
+    for (int64_t pts = 0; pts < next_pts_; ++pts) {
+      result.push_back(pts);
+    }
+
+    return result;
+  }
+
+ private:
+  Graph graph_;
+  std::shared_ptr<FakeSource> source_;
+  std::shared_ptr<GatedTransform> transform_;
+  std::shared_ptr<FakeSink> sink_;
+  PartRef transform_part_;
+  int64_t next_pts_;
+};
+
+// Tests whether a part inserted into a running graph sees the packets that
+// follow.
+void InsertPart(bool multithreaded) {
+  RunningGraph running(multithreaded);
+  ASSERT_TRUE(running.PassPackets());
+
+  std::shared_ptr<GatedTransform> inserted = CreateOpenTransform();
+  running.graph().InsertPart(running.transform_part().output(),
+                             running.graph().Add(inserted));
+
+  ASSERT_TRUE(running.PassPackets());
+  EXPECT_TRUE(inserted->WaitForCalls(kPacketCount));
+  EXPECT_EQ(running.supplied_pts(), running.sink().pts());
+  EXPECT_EQ(0u, running.sink().flush_count());
+}
+
+// Tests whether packets keep flowing after a part is extracted from a running
+// graph.
+void ExtractPart(bool multithreaded) {
+  RunningGraph running(multithreaded);
+  PartRef inserted = running.graph().InsertPart(
+      running.transform_part().output(),
+      running.graph().Add(CreateOpenTransform()));
+  ASSERT_TRUE(running.PassPackets());
+
+  running.graph().ExtractPart(inserted);
+
+  ASSERT_TRUE(running.PassPackets());
+  EXPECT_EQ(running.supplied_pts(), running.sink().pts());
+  EXPECT_EQ(0u, running.sink().flush_count());
+}
+
+// Tests whether a replacement part in a running graph sees the packets that
+// follow and whether the subgraph downstream is flushed if requested.
+void ReplacePart(bool multithreaded, bool flush_downstream) {
+  RunningGraph running(multithreaded);
+  ASSERT_TRUE(running.PassPackets());
+
+  std::shared_ptr<GatedTransform> replacement = CreateOpenTransform();
+  running.graph().ReplacePart(running.transform_part(),
+                              running.graph().Add(replacement),
+                              flush_downstream);
+
+  // The flush reaches the sink ahead of the replacement's packets.
+  ASSERT_TRUE(running.PassPackets());
+  EXPECT_TRUE(replacement->WaitForCalls(kPacketCount));
+  EXPECT_EQ(running.supplied_pts(), running.sink().pts());
+  EXPECT_EQ(flush_downstream ? 1u : 0u, running.sink().flush_count());
+}
+
+TEST_F(ReconfigurationTest, InsertPartSingleThreaded) {
+  InsertPart(false);
+}
+
+TEST_F(ReconfigurationTest, InsertPartMultithreaded) {
+  InsertPart(true);
+}
+
+TEST_F(ReconfigurationTest, ExtractPartSingleThreaded) {
+  ExtractPart(false);
+}
+
+TEST_F(ReconfigurationTest, ExtractPartMultithreaded) {
+  ExtractPart(true);
+}
+
+TEST_F(ReconfigurationTest, ReplacePartSingleThreaded) {
+  ReplacePart(false, false);
+}
+
+TEST_F(ReconfigurationTest, ReplacePartMultithreaded) {
+  ReplacePart(true, false);
+}
+
+TEST_F(ReconfigurationTest, ReplacePartFlushingSingleThreaded) {
+  ReplacePart(false, true);
+}
+
+TEST_F(ReconfigurationTest, ReplacePartFlushingMultithreaded) {
+  ReplacePart(true, true);
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,159 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/scheduler.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class SchedulerTest : public TestBase {};
+
+static constexpr size_t kTaskCount = 1000;
+static constexpr int64_t kPacketCount = 100;
+
+// A source -> transform -> sink graph operated by a shared scheduler.
+class ScheduledGraph {
+ public:
+  ScheduledGraph(std::shared_ptr<Scheduler> scheduler, uint32_t weight)
+      : source_(FakeSource::Create()),
+        transform_(GatedTransform::Create()),
+        sink_(FakeSink::Create()) {
+    graph_.UseScheduler(scheduler, weight);
+    PartRef transform_part = graph_.Add(transform_);
+    graph_.ConnectParts(graph_.Add(source_), transform_part);
+    graph_.ConnectParts(transform_part, graph_.Add(sink_));
+    graph_.Prepare();
+    sink_->Start();
+  }
+
+  GatedTransform& transform() { return *transform_; }
+
+  // Supplies kPacketCount packets.
+  void SupplyPackets() {
+    for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+      source_->Supply(CreateTestPacket(pts));
+    }
+  }
+
+  // Waits for the packets supplied by SupplyPackets to reach the sink and
+  // checks that they arrived in order.
+  void ExpectPackets() {
+    ASSERT_TRUE(sink_->WaitForPackets(kPacketCount));
+
+    std::vector<int64_t> expected_pts;
+    for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+      expected_pts.push_back(pts);
+    }
+
+    EXPECT_EQ(expected_pts, sink_->pts());
+  }
+
+ private:
+  Graph graph_;
+  std::shared_ptr<FakeSource> source_;
+  std::shared_ptr<GatedTransform> transform_;
+  std::shared_ptr<FakeSink> sink_;
+};
+
+// Tests whether destroying a queue waits for the tasks posted to it, including
+// tasks posted by those tasks.
+TEST_F(SchedulerTest, QueueRunsAllTasks) {
+  std::shared_ptr<Scheduler> scheduler = Scheduler::Create(2, 1);
+  std::atomic<size_t> run_count(0);
+
+  {
+    Scheduler::Queue queue(scheduler, 1);
+    for (size_t i = 0; i < kTaskCount; ++i) {
+      queue.Post([&queue, &run_count]() {
+        ++run_count;
+        queue.PostDeferred([&run_count]() { ++run_count; });
+      });
+    }
+  }
+
+  EXPECT_EQ(2 * kTaskCount, run_count);
+}
+
+// Tests whether tasks posted to a sequence run in order, one at a time.
+TEST_F(SchedulerTest, SequenceRunsTasksInOrder) {
+  std::shared_ptr<Scheduler> scheduler = Scheduler::Create(1, 2);
+  std::vector<size_t> order;
+  std::atomic<bool> on_sequence(true);
+  std::mutex mutex;
+  std::condition_variable condition_variable;
+
+  {
+    Scheduler::Sequence sequence(scheduler);
+    EXPECT_FALSE(sequence.RunsTasksOnCurrentThread());
+
+    for (size_t i = 0; i < kTaskCount; ++i) {
+      sequence.Post([&sequence, &order, &on_sequence, &mutex,
+                     &condition_variable, i]() {
+        if (!sequence.RunsTasksOnCurrentThread()) {
+          on_sequence = false;
+        }
+
+        std::lock_guard<std::mutex> locker(mutex);
+        order.push_back(i);
+        condition_variable.notify_all();
+      });
+    }
+
+    std::unique_lock<std::mutex> locker(mutex);
+    ASSERT_TRUE(condition_variable.wait_for(
+        locker, kFakePartTimeout,
+        [&order]() { return order.size() == kTaskCount; }));
+  }
+
+  EXPECT_TRUE(on_sequence);
+  for (size_t i = 0; i < kTaskCount; ++i) {
+    EXPECT_EQ(i, order[i]);
+  }
+}
+
+// Tests whether graphs with different weights sharing a scheduler both get
+// all their packets in order.
+TEST_F(SchedulerTest, GraphsShareScheduler) {
+  std::shared_ptr<Scheduler> scheduler = Scheduler::Create(2, 1);
+  ScheduledGraph light_graph(scheduler, 1);
+  ScheduledGraph heavy_graph(scheduler, 3);
+  light_graph.transform().Open();
+  heavy_graph.transform().Open();
+
+  light_graph.SupplyPackets();
+  heavy_graph.SupplyPackets();
+
+  light_graph.ExpectPackets();
+  heavy_graph.ExpectPackets();
+}
+
+// Tests whether a graph whose update is blocked on one of the scheduler's
+// workers doesn't hold up another graph sharing the scheduler.
+TEST_F(SchedulerTest, BlockedGraphDoesNotStallOthers) {
+  std::shared_ptr<Scheduler> scheduler = Scheduler::Create(2, 1);
+  ScheduledGraph blocked_graph(scheduler, 1);
+  ScheduledGraph other_graph(scheduler, 1);
+  other_graph.transform().Open();
+
+  blocked_graph.SupplyPackets();
+  ASSERT_TRUE(blocked_graph.transform().WaitForCalls(1));
+
+  other_graph.SupplyPackets();
+  other_graph.ExpectPackets();
+
+  blocked_graph.transform().Open();
+  blocked_graph.ExpectPackets();
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,106 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <thread>
+#include <vector>
+
+#include "services/media/framework/slab_allocator.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class SlabAllocatorTest : public TestBase {};
+
+// Allocates count buffers of the indicated size and then releases them.
+void AllocateAndRelease(SlabAllocator* allocator, size_t size, size_t count) {
+  std::vector<void*> buffers;
+  for (size_t i = 0; i < count; ++i) {
+    buffers.push_back(allocator->AllocatePayloadBuffer(size));
+    EXPECT_NE(nullptr, buffers.back());
+  }
+
+  for (void* buffer : buffers) {
+    allocator->ReleasePayloadBuffer(size, buffer);
+  }
+}
+
+// Tests whether sizes are rounded up to the expected size classes.
+TEST_F(SlabAllocatorTest, SizeClasses) {
+  EXPECT_EQ(64u, SlabAllocator::RoundUpSize(1));
+  EXPECT_EQ(64u, SlabAllocator::RoundUpSize(64));
+  EXPECT_EQ(80u, SlabAllocator::RoundUpSize(65));
+  EXPECT_EQ(80u, SlabAllocator::RoundUpSize(80));
+  EXPECT_EQ(96u, SlabAllocator::RoundUpSize(81));
+  EXPECT_EQ(128u, SlabAllocator::RoundUpSize(127));
+  EXPECT_EQ(160u, SlabAllocator::RoundUpSize(129));
+  EXPECT_EQ(SlabAllocator::kMaxSlabSize,
+            SlabAllocator::RoundUpSize(SlabAllocator::kMaxSlabSize));
+  EXPECT_EQ(SlabAllocator::kMaxSlabSize + 1,
+            SlabAllocator::RoundUpSize(SlabAllocator::kMaxSlabSize + 1));
+
+  // Classes above the minimum waste no more than a fifth of a buffer, and
+  // class sizes map to themselves.
+  for (size_t size = 65; size <= SlabAllocator::kMaxSlabSize;
+       size += size / 7 + 1) {
+    size_t rounded = SlabAllocator::RoundUpSize(size);
+    EXPECT_LE(size, rounded);
+    EXPECT_LE(rounded - size, rounded / 5);
+    EXPECT_EQ(rounded, SlabAllocator::RoundUpSize(rounded));
+  }
+}
+
+// Tests whether the shared free lists retain no more than max_retained_bytes.
+TEST_F(SlabAllocatorTest, RetentionLimit) {
+  static const size_t kSize = 512 * 1024;
+  SlabAllocator allocator(2 * kSize);
+
+  allocator.Prewarm(kSize, 4);
+  EXPECT_EQ(2 * kSize, allocator.retained_bytes());
+}
+
+// Tests whether buffers too large for thread caches go to the shared free
+// lists when they're released.
+TEST_F(SlabAllocatorTest, LargeBuffersBypassThreadCache) {
+  static const size_t kSize = 1024 * 1024;
+  static_assert(kSize > SlabAllocator::kMaxThreadCacheSize,
+                "kSize must exceed kMaxThreadCacheSize");
+  SlabAllocator allocator(SlabAllocator::kDefaultMaxRetainedBytes);
+
+  AllocateAndRelease(&allocator, kSize, 4);
+  EXPECT_EQ(4 * kSize, allocator.retained_bytes());
+}
+
+// Tests whether a thread caches no more than kMaxThreadCacheBytes.
+TEST_F(SlabAllocatorTest, ThreadCacheBounded) {
+  SlabAllocator allocator(SlabAllocator::kDefaultMaxRetainedBytes);
+
+  size_t released_bytes = 0;
+  for (size_t size = 1024; size <= SlabAllocator::kMaxThreadCacheSize;
+       size *= 2) {
+    AllocateAndRelease(&allocator, size, 64);
+    released_bytes += 64 * size;
+  }
+
+  EXPECT_LE(released_bytes,
+            allocator.retained_bytes() + SlabAllocator::kMaxThreadCacheBytes);
+}
+
+// Tests whether a thread's cached buffers go to the shared free lists when
+// the thread exits.
+TEST_F(SlabAllocatorTest, ThreadExitReturnsBuffers) {
+  static const size_t kSize = 1024;
+  SlabAllocator allocator(SlabAllocator::kDefaultMaxRetainedBytes);
+
+  std::thread thread(
+      [&allocator]() { AllocateAndRelease(&allocator, kSize, 100); });
+  thread.join();
+
+  EXPECT_EQ(100 * kSize, allocator.retained_bytes());
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <vector>
+
 #include "services/media/framework/parts/sparse_byte_buffer.h"
 #include "services/media/framework/test/test_base.h"
 
@@ -251,6 +253,95 @@ TEST_F(SparseByteBufferTest, RegionHints) {
   }
 }
 
+// Fills a region in the middle and looks up positions before and after it.
+TEST_F(SparseByteBufferTest, MiddleRegion) {
+  SparseByteBuffer::Hole hole =
+      under_test_.FindOrCreateHole(kSize / 2, under_test_.null_hole());
+  under_test_.Fill(hole, CreateBuffer(kSize / 2, kSize / 4));
+
+  // No region before the filled one.
+  for (size_t position = 0; position < kSize / 2; position++) {
+    ExpectNullRegion(
+        under_test_.FindRegionContaining(position, under_test_.null_region()));
+    ExpectHole(0, kSize / 2, under_test_.FindHoleContaining(position));
+  }
+
+  for (size_t position = kSize / 2; position < kSize * 3 / 4; position++) {
+    ExpectRegion(
+        kSize / 2, kSize / 4,
+        under_test_.FindRegionContaining(position, under_test_.null_region()));
+    ExpectNullHole(under_test_.FindHoleContaining(position));
+  }
+
+  // No region after the filled one.
+  for (size_t position = kSize * 3 / 4; position < kSize; position++) {
+    ExpectNullRegion(
+        under_test_.FindRegionContaining(position, under_test_.null_region()));
+    ExpectHole(kSize * 3 / 4, kSize / 4,
+               under_test_.FindHoleContaining(position));
+  }
+}
+
+// Frees regions and verifies that holes are merged.
+TEST_F(SparseByteBufferTest, FreeRegions) {
+  // Fill the buffer with four regions.
+  SparseByteBuffer::Hole hole =
+      under_test_.FindOrCreateHole(0, under_test_.null_hole());
+  for (size_t position = 0; position < kSize; position += kSize / 4) {
+    hole = under_test_.Fill(hole, CreateBuffer(position, kSize / 4));
+  }
+
+  ExpectNullHole(hole);
+  ExpectRegion(0, kSize / 4, under_test_.first_region());
+
+  // Free the second region.
+  ExpectHole(kSize / 4, kSize / 4,
+             under_test_.Free(under_test_.FindRegionContaining(
+                                  kSize / 4, under_test_.null_region()),
+                              nullptr));
+
+  // Free the fourth region.
+  ExpectHole(kSize * 3 / 4, kSize / 4,
+             under_test_.Free(under_test_.FindRegionContaining(
+                                  kSize * 3 / 4, under_test_.null_region()),
+                              nullptr));
+
+  // Two regions remain.
+  SparseByteBuffer::Region region = under_test_.first_region();
+  ExpectRegion(0, kSize / 4, region);
+  region = under_test_.NextRegion(region);
+  ExpectRegion(kSize / 2, kSize / 4, region);
+  ExpectNullRegion(under_test_.NextRegion(region));
+
+  // Free the third region. The hole it leaves merges with both neighbors.
+  std::vector<uint8_t> buffer;
+  ExpectHole(kSize / 4, kSize * 3 / 4, under_test_.Free(region, &buffer));
+  EXPECT_EQ(CreateBuffer(kSize / 2, kSize / 4), buffer);
+  for (size_t position = kSize / 4; position < kSize; position++) {
+    ExpectHole(kSize / 4, kSize * 3 / 4,
+               under_test_.FindHoleContaining(position));
+  }
+}
+
+// Verifies that shared region content outlives the region.
+TEST_F(SparseByteBufferTest, SharedData) {
+  SparseByteBuffer::Hole hole =
+      under_test_.FindOrCreateHole(0, under_test_.null_hole());
+  under_test_.Fill(hole, CreateBuffer(0, kSize / 2));
+
+  SparseByteBuffer::Region region =
+      under_test_.FindRegionContaining(0, under_test_.null_region());
+  std::shared_ptr<const uint8_t> data = region.shared_data();
+  EXPECT_EQ(region.data(), data.get());
+
+  // Free the region. The buffer is copied, because it's shared.
+  std::vector<uint8_t> buffer;
+  ExpectHole(0, kSize, under_test_.Free(region, &buffer));
+  EXPECT_EQ(CreateBuffer(0, kSize / 2), buffer);
+  EXPECT_EQ(CreateBuffer(0, kSize / 2),
+            std::vector<uint8_t>(data.get(), data.get() + kSize / 2));
+}
+
 // Verifies that FindOrCreateHole works regardless of the hints it's given.
 TEST_F(SparseByteBufferTest, HoleHints) {
   static const size_t hole_count = 11u;
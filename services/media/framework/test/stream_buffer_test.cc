@@ -0,0 +1,98 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/models/multistream_source.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class StreamBufferTest : public TestBase {};
+
+static constexpr size_t kStreamCount = 2;
+static constexpr int64_t kPacketsPerStream = 20;
+
+// Multistream source that produces kPacketsPerStream packets for each of
+// kStreamCount streams, taking the streams in turn.
+class InterleavingSource : public MultistreamSource {
+ public:
+  InterleavingSource() : pulled_count_(0) {}
+
+  ~InterleavingSource() override {}
+
+  // MultistreamSource implementation.
+  size_t stream_count() const override { return kStreamCount; }
+
+  PacketPtr PullPacket(size_t* stream_index_out) override {
+    DCHECK(stream_index_out);
+    *stream_index_out = pulled_count_ % kStreamCount;
+    int64_t pts = pulled_count_ / kStreamCount;
+    ++pulled_count_;
+    return Packet::CreateNoAllocator(pts, pts + 1 == kPacketsPerStream, 0,
+                                     nullptr);
+  }
+
+ private:
+  int64_t pulled_count_;
+};
+
+// Connects an InterleavingSource with the indicated per-stream buffer limit
+// (or the default if zero) to a sink per stream, starts only the sink for the
+// last stream and returns the number of packets it receives. The graph is
+// single-threaded, so starting a sink runs the graph until it stalls. All the
+// packets for both streams must arrive once the other sink is started.
+size_t PassPacketsToOneStream(size_t limit) {
+  std::shared_ptr<FakeSink> sinks[kStreamCount];
+
+  Graph graph;
+  PartRef source_part = graph.Add(std::make_shared<InterleavingSource>());
+  if (limit != 0) {
+    graph.SetStreamBufferLimit(source_part, limit);
+  }
+
+  for (size_t i = 0; i < kStreamCount; ++i) {
+    sinks[i] = FakeSink::Create();
+    graph.ConnectOutputToPart(source_part.output(i), graph.Add(sinks[i]));
+  }
+
+  graph.Prepare();
+
+  sinks[kStreamCount - 1]->Start();
+  size_t received_count = sinks[kStreamCount - 1]->pts().size();
+
+  for (size_t i = 0; i < kStreamCount - 1; ++i) {
+    sinks[i]->Start();
+  }
+
+  std::vector<int64_t> expected_pts;
+  for (int64_t pts = 0; pts < kPacketsPerStream; ++pts) {
+    expected_pts.push_back(pts);
+  }
+
+  for (size_t i = 0; i < kStreamCount; ++i) {
+    EXPECT_TRUE(sinks[i]->WaitForPackets(kPacketsPerStream));
+    EXPECT_EQ(expected_pts, sinks[i]->pts());
+  }
+
+  return received_count;
+}
+
+// Tests whether a stream whose sink isn't consuming packets doesn't stall
+// another stream from the same source while its buffer has room.
+TEST_F(StreamBufferTest, BackedUpStreamDoesNotStallOthers) {
+  EXPECT_EQ(static_cast<size_t>(kPacketsPerStream), PassPacketsToOneStream(0));
+}
+
+// Tests whether a stream whose buffer is full stops the source.
+TEST_F(StreamBufferTest, FullBufferStopsSource) {
+  // A limit of one byte lets each stream buffer only one packet.
+  EXPECT_GT(static_cast<size_t>(kPacketsPerStream), PassPacketsToOneStream(1));
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
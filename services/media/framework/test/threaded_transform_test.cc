@@ -0,0 +1,133 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/parts/threaded_transform.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class ThreadedTransformTest : public TestBase {};
+
+// Tests whether packets pass through a threaded transform.
+TEST_F(ThreadedTransformTest, PassesPackets) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+  transform->Open();
+
+  Graph graph;
+  PartRef source_part = graph.Add(source);
+  PartRef transform_part = graph.Add(ThreadedTransform::Create(transform, 1));
+  PartRef sink_part = graph.Add(sink);
+  graph.ConnectParts(source_part, transform_part);
+  graph.ConnectParts(transform_part, sink_part);
+  graph.Prepare();
+  sink->Start();
+
+  for (int64_t pts = 0; pts < 3; ++pts) {
+    source->Supply(CreateTestPacket(pts));
+    ASSERT_TRUE(sink->WaitForPackets(pts + 1));
+  }
+
+  EXPECT_EQ(std::vector<int64_t>({0, 1, 2}), sink->pts());
+}
+
+// Tests whether flushing the transform's output while a packet is being
+// transformed returns without waiting for the packet, discards the packet's
+// output and flushes the hosted transform before it gets the next packet.
+TEST_F(ThreadedTransformTest, FlushOutputWhileRunning) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+
+  Graph graph;
+  PartRef source_part = graph.Add(source);
+  PartRef transform_part = graph.Add(ThreadedTransform::Create(transform, 1));
+  PartRef sink_part = graph.Add(sink);
+  graph.ConnectParts(source_part, transform_part);
+  graph.ConnectParts(transform_part, sink_part);
+  graph.Prepare();
+  sink->Start();
+
+  source->Supply(CreateTestPacket(0));
+  ASSERT_TRUE(transform->WaitForCalls(1));
+
+  // The transform is blocked on packet 0, so this would never return if the
+  // flush waited for it.
+  graph.FlushOutput(transform_part.output());
+  EXPECT_EQ(0u, transform->flush_count());
+
+  source->Supply(CreateTestPacket(1));
+  transform->Open();
+
+  ASSERT_TRUE(sink->WaitForPackets(1));
+  EXPECT_EQ(std::vector<int64_t>({1}), sink->pts());
+  EXPECT_EQ(1u, sink->flush_count());
+  EXPECT_EQ(1u, transform->flush_count());
+}
+
+// Tests whether flushing upstream of the transform, which flushes the
+// transform when it catches up with the flush, doesn't wait for the packet
+// being transformed.
+TEST_F(ThreadedTransformTest, FlushUpstreamWhileRunning) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+
+  Graph graph;
+  PartRef source_part = graph.Add(source);
+  PartRef transform_part = graph.Add(ThreadedTransform::Create(transform, 1));
+  PartRef sink_part = graph.Add(sink);
+  graph.ConnectParts(source_part, transform_part);
+  graph.ConnectParts(transform_part, sink_part);
+  graph.Prepare();
+  sink->Start();
+
+  source->Supply(CreateTestPacket(0));
+  ASSERT_TRUE(transform->WaitForCalls(1));
+
+  graph.FlushOutput(source_part.output());
+  EXPECT_EQ(1u, source->flush_count());
+
+  source->Supply(CreateTestPacket(1));
+  transform->Open();
+
+  ASSERT_TRUE(sink->WaitForPackets(1));
+  EXPECT_EQ(std::vector<int64_t>({1}), sink->pts());
+}
+
+// Tests whether a graph holding a threaded transform that's blocked on a
+// packet can be deleted once the transform is unblocked.
+TEST_F(ThreadedTransformTest, DeleteAfterFlush) {
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<GatedTransform> transform = GatedTransform::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create();
+
+  {
+    Graph graph;
+    PartRef source_part = graph.Add(source);
+    PartRef transform_part =
+        graph.Add(ThreadedTransform::Create(transform, 1));
+    PartRef sink_part = graph.Add(sink);
+    graph.ConnectParts(source_part, transform_part);
+    graph.ConnectParts(transform_part, sink_part);
+    graph.Prepare();
+    sink->Start();
+
+    source->Supply(CreateTestPacket(0));
+    ASSERT_TRUE(transform->WaitForCalls(1));
+    graph.FlushOutput(transform_part.output());
+    transform->Open();
+  }
+
+  EXPECT_TRUE(sink->pts().empty());
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
@@ -0,0 +1,127 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <atomic>
+#include <cstdlib>
+
+#include "services/media/framework/graph.h"
+#include "services/media/framework/parts/transform_pipeline.h"
+#include "services/media/framework/test/fake_parts.h"
+#include "services/media/framework/test/test_base.h"
+
+namespace mojo {
+namespace media {
+namespace {
+
+class TransformPipelineTest : public TestBase {};
+
+static constexpr int64_t kPacketCount = 10;
+static constexpr size_t kPayloadSize = 16;
+
+// Allocator that counts allocations.
+class CountingAllocator : public PayloadAllocator {
+ public:
+  CountingAllocator() : allocation_count_(0) {}
+
+  size_t allocation_count() const { return allocation_count_; }
+
+  void* AllocatePayloadBuffer(size_t size) override {
+    ++allocation_count_;
+    return malloc(size);
+  }
+
+  void ReleasePayloadBuffer(size_t size, void* buffer) override {
+    free(buffer);
+  }
+
+ private:
+  std::atomic<size_t> allocation_count_;
+};
+
+// How the two transforms between the source and the sink are arranged.
+enum class Arrangement {
+  // Each transform is a part.
+  kSeparate,
+  // Each transform is a part, and the graph fuses them.
+  kFusedByGraph,
+  // The transforms are combined in a TransformPipeline.
+  kPipeline
+};
+
+// Passes packets through two copying transforms, standing in for a decoder and
+// a reformatter, arranged as indicated. The graph's default allocator and the
+// allocator the sink requires count the payloads allocated from them.
+void PassPackets(Arrangement arrangement,
+                 CountingAllocator* default_allocator,
+                 CountingAllocator* sink_allocator) {
+  DCHECK(default_allocator);
+  DCHECK(sink_allocator);
+
+  std::shared_ptr<GatedTransform> transforms[2];
+  for (std::shared_ptr<GatedTransform>& transform : transforms) {
+    transform = GatedTransform::Create();
+    transform->Open();
+  }
+
+  std::shared_ptr<FakeSource> source = FakeSource::Create();
+  std::shared_ptr<FakeSink> sink = FakeSink::Create(sink_allocator);
+
+  Graph graph;
+  graph.SetDefaultAllocator(std::shared_ptr<PayloadAllocator>(
+      default_allocator, [](PayloadAllocator* allocator) {}));
+  PartRef source_part = graph.Add(source);
+  PartRef sink_part = graph.Add(sink);
+
+  if (arrangement == Arrangement::kPipeline) {
+    PartRef pipeline_part = graph.Add(
+        std::make_shared<TransformPipeline<DynamicTransform, DynamicTransform>>(
+            DynamicTransform(transforms[0]), DynamicTransform(transforms[1])));
+    graph.ConnectParts(source_part, pipeline_part);
+    graph.ConnectParts(pipeline_part, sink_part);
+  } else {
+    PartRef first_part = graph.Add(transforms[0]);
+    PartRef second_part = graph.Add(transforms[1]);
+    graph.ConnectParts(source_part, first_part);
+    graph.ConnectParts(first_part, second_part);
+    graph.ConnectParts(second_part, sink_part);
+    if (arrangement == Arrangement::kFusedByGraph) {
+      graph.FuseTransforms();
+    }
+  }
+
+  graph.Prepare();
+  sink->Start();
+
+  std::vector<int64_t> expected_pts;
+  for (int64_t pts = 0; pts < kPacketCount; ++pts) {
+    source->Supply(source->CreatePacket(pts, kPayloadSize));
+    expected_pts.push_back(pts);
+  }
+
+  ASSERT_TRUE(sink->WaitForPackets(kPacketCount));
+  EXPECT_EQ(expected_pts, sink->pts());
+}
+
+// Tests whether separate, graph-fused and pipelined transforms deliver the
+// same packets and allocate intermediate payloads from the graph's default
+// allocator and final payloads from the sink's allocator.
+TEST_F(TransformPipelineTest, FusedMatchesUnfused) {
+  for (Arrangement arrangement :
+       {Arrangement::kSeparate, Arrangement::kFusedByGraph,
+        Arrangement::kPipeline}) {
+    CountingAllocator default_allocator;
+    CountingAllocator sink_allocator;
+    PassPackets(arrangement, &default_allocator, &sink_allocator);
+
+    // The source's payloads and the first transform's.
+    EXPECT_EQ(static_cast<size_t>(2 * kPacketCount),
+              default_allocator.allocation_count());
+    EXPECT_EQ(static_cast<size_t>(kPacketCount),
+              sink_allocator.allocation_count());
+  }
+}
+
+}  // namespace
+}  // namespace media
+}  // namespace mojo
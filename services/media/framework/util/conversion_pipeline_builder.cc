@@ -18,6 +18,16 @@ enum class AddResult {
   kFinished     // Done adding conversion transforms.
 };
 
+// Adds a transform to the pipeline.
+void AddTransform(std::shared_ptr<Transform> transform,
+                  Graph* graph,
+                  OutputRef* output) {
+  DCHECK(transform);
+  DCHECK(graph);
+  DCHECK(output);
+  *output = graph->ConnectOutputToPart(*output, graph->Add(transform)).output();
+}
+
 // Produces a score for in_type with respect to out_type_set. The score
 // is used to compare type sets to see which represents the best goal for
 // conversion. Higher scores are preferred. A score of zero indicates that
@@ -94,15 +104,20 @@ const std::unique_ptr<StreamTypeSet>* FindBestLpcm(
 // Attempts to add transforms to the pipeline given an input compressed audio
 // stream type with (in_type) and the set of output types we need to convert to
 // (out_type_sets). If the call succeeds, *out_type is set to the new output
-// type. Otherwise, *out_type is set to nullptr.
+// type. Otherwise, *out_type is set to nullptr. A decoder isn't added to the
+// pipeline right away. Instead, it's delivered via *pending_transform, so it
+// can be fused with the transform that follows it.
 AddResult AddTransformsForCompressedAudio(
     const AudioStreamType& in_type,
     const std::vector<std::unique_ptr<StreamTypeSet>>& out_type_sets,
     Graph* graph,
     OutputRef* output,
+    std::shared_ptr<Transform>* pending_transform,
     std::unique_ptr<StreamType>* out_type) {
   DCHECK(out_type);
   DCHECK(graph);
+  DCHECK(pending_transform);
+  DCHECK(!*pending_transform);
 
   // See if we have a matching audio type.
   for (const std::unique_ptr<StreamTypeSet>& out_type_set : out_type_sets) {
@@ -138,7 +153,7 @@ AddResult AddTransformsForCompressedAudio(
     return AddResult::kFailed;
   }
 
-  *output = graph->ConnectOutputToPart(*output, graph->Add(decoder)).output();
+  *pending_transform = decoder;
   *out_type = decoder->output_stream_type();
 
   return AddResult::kProgressed;
@@ -147,24 +162,32 @@ AddResult AddTransformsForCompressedAudio(
 // Attempts to add transforms to the pipeline given an input LPCM stream type
 // (in_type) and the output lpcm stream type set for the type we need to
 // convert to (out_type_set). If the call succeeds, *out_type is set to the new
-// output type. Otherwise, *out_type is set to nullptr.
+// output type. Otherwise, *out_type is set to nullptr. If *pending_transform
+// is set, it produces in_type, and a reformatter is fused with it.
 AddResult AddTransformsForLpcm(const AudioStreamType& in_type,
                                const AudioStreamTypeSet& out_type_set,
                                Graph* graph,
                                OutputRef* output,
+                               std::shared_ptr<Transform>* pending_transform,
                                std::unique_ptr<StreamType>* out_type) {
   DCHECK(graph);
+  DCHECK(pending_transform);
   DCHECK(out_type);
 
   // TODO(dalesat): Room for more intelligence here wrt transform ordering and
   // transforms that handle more than one conversion.
   if (in_type.sample_format() != out_type_set.sample_format() &&
       out_type_set.sample_format() != AudioStreamType::SampleFormat::kAny) {
-    *output =
-        graph
-            ->ConnectOutputToPart(*output, graph->Add(LpcmReformatter::Create(
-                                               in_type, out_type_set)))
-            .output();
+    if (*pending_transform) {
+      // Decode and reformat in a single statically typed transform.
+      AddTransform(LpcmReformatter::CreateFused(*pending_transform, in_type,
+                                                out_type_set),
+                   graph, output);
+      pending_transform->reset();
+    } else {
+      AddTransform(LpcmReformatter::Create(in_type, out_type_set), graph,
+                   output);
+    }
   }
 
   if (!out_type_set.channels().contains(in_type.channels())) {
@@ -201,6 +224,7 @@ AddResult AddTransformsForLpcm(
     const std::vector<std::unique_ptr<StreamTypeSet>>& out_type_sets,
     Graph* graph,
     OutputRef* output,
+    std::shared_ptr<Transform>* pending_transform,
     std::unique_ptr<StreamType>* out_type) {
   DCHECK(graph);
   DCHECK(out_type);
@@ -217,7 +241,7 @@ AddResult AddTransformsForLpcm(
   DCHECK_EQ((*best)->medium(), StreamType::Medium::kAudio);
 
   return AddTransformsForLpcm(in_type, *(*best)->audio(), graph, output,
-                              out_type);
+                              pending_transform, out_type);
 }
 
 // Attempts to add transforms to the pipeline given an input media type of any
@@ -229,6 +253,7 @@ AddResult AddTransforms(
     const std::vector<std::unique_ptr<StreamTypeSet>>& out_type_sets,
     Graph* graph,
     OutputRef* output,
+    std::shared_ptr<Transform>* pending_transform,
     std::unique_ptr<StreamType>* out_type) {
   DCHECK(graph);
   DCHECK(out_type);
@@ -237,10 +262,11 @@ AddResult AddTransforms(
     case StreamType::Medium::kAudio:
       if (in_type.encoding() == StreamType::kAudioEncodingLpcm) {
         return AddTransformsForLpcm(*in_type.audio(), out_type_sets, graph,
-                                    output, out_type);
+                                    output, pending_transform, out_type);
       } else {
         return AddTransformsForCompressedAudio(*in_type.audio(), out_type_sets,
-                                               graph, output, out_type);
+                                               graph, output, pending_transform,
+                                               out_type);
       }
     default:
       NOTREACHED() << "conversion not supported for medium" << in_type.medium();
@@ -264,9 +290,11 @@ bool BuildConversionPipeline(
   OutputRef out = *output;
   const StreamType* type_to_convert = &in_type;
   std::unique_ptr<StreamType> converted_type;
+  // A transform that's been created but not yet added to the pipeline.
+  std::shared_ptr<Transform> pending_transform;
   while (true) {
     switch (AddTransforms(*type_to_convert, out_type_sets, graph, &out,
-                          &converted_type)) {
+                          &pending_transform, &converted_type)) {
       case AddResult::kFailed:
         // Failed to find a suitable conversion. Return the pipeline to its
         // original state.
@@ -278,6 +306,9 @@ bool BuildConversionPipeline(
         break;
       case AddResult::kFinished:
         // No further conversion required.
+        if (pending_transform) {
+          AddTransform(pending_transform, graph, &out);
+        }
         *output = out;
         *out_type = std::move(converted_type);
         return true;
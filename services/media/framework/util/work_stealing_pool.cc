@@ -0,0 +1,158 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/logging.h"
+#include "services/media/framework/util/work_stealing_pool.h"
+
+namespace mojo {
+namespace media {
+
+WorkStealingPool::WorkStealingPool(size_t worker_count)
+    : next_worker_(0),
+      pending_task_count_(0),
+      sleeping_worker_count_(0),
+      idle_condition_variable_(&idle_lock_) {
+  if (worker_count == 0) {
+    worker_count = std::thread::hardware_concurrency();
+    if (worker_count == 0) {
+      worker_count = 1;
+    }
+  }
+
+  // All the workers need to exist before any of the threads start, because
+  // a worker may try to steal from any other worker.
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers_[i]->thread_ =
+        std::thread(std::bind(&WorkStealingPool::Run, this, i));
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  DCHECK(!IsWorkerThread()) << "pool destroyed on one of its own workers";
+
+  {
+    base::AutoLock lock(idle_lock_);
+    terminating_ = true;
+    idle_condition_variable_.Broadcast();
+  }
+
+  for (std::unique_ptr<Worker>& worker : workers_) {
+    if (worker->thread_.joinable()) {
+      worker->thread_.join();
+    }
+  }
+}
+
+void WorkStealingPool::Post(const Task& task) {
+  DCHECK(task);
+  Enqueue(task, false);
+}
+
+void WorkStealingPool::PostDeferred(const Task& task) {
+  DCHECK(task);
+  Enqueue(task, true);
+}
+
+size_t WorkStealingPool::CurrentWorkerIndex() const {
+  std::thread::id id = std::this_thread::get_id();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i]->thread_.get_id() == id) {
+      return i;
+    }
+  }
+
+  return kNotAWorker;
+}
+
+void WorkStealingPool::Enqueue(const Task& task, bool deferred) {
+  size_t worker_index = CurrentWorkerIndex();
+  if (worker_index == kNotAWorker) {
+    worker_index = next_worker_++ % workers_.size();
+    // Tasks from outside the pool are never deferred with respect to one
+    // another.
+    deferred = false;
+  }
+
+  Worker* worker = workers_[worker_index].get();
+
+  {
+    base::AutoLock lock(worker->lock_);
+    if (deferred) {
+      worker->tasks_.push_front(task);
+    } else {
+      worker->tasks_.push_back(task);
+    }
+  }
+
+  ++pending_task_count_;
+
+  // A sleeping worker increments sleeping_worker_count_ before checking
+  // pending_task_count_, so either it sees our task or we see it sleeping.
+  if (sleeping_worker_count_ != 0) {
+    base::AutoLock lock(idle_lock_);
+    idle_condition_variable_.Signal();
+  }
+}
+
+void WorkStealingPool::Run(size_t worker_index) {
+  Task task;
+
+  while (true) {
+    if (PopLocal(worker_index, &task) || Steal(worker_index, &task)) {
+      --pending_task_count_;
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    base::AutoLock lock(idle_lock_);
+    ++sleeping_worker_count_;
+    while (pending_task_count_ == 0 && !terminating_) {
+      idle_condition_variable_.Wait();
+    }
+    --sleeping_worker_count_;
+
+    if (terminating_ && pending_task_count_ == 0) {
+      return;
+    }
+  }
+}
+
+bool WorkStealingPool::PopLocal(size_t worker_index, Task* task_out) {
+  DCHECK(task_out);
+  Worker* worker = workers_[worker_index].get();
+
+  base::AutoLock lock(worker->lock_);
+  if (worker->tasks_.empty()) {
+    return false;
+  }
+
+  *task_out = std::move(worker->tasks_.back());
+  worker->tasks_.pop_back();
+  return true;
+}
+
+bool WorkStealingPool::Steal(size_t thief_index, Task* task_out) {
+  DCHECK(task_out);
+
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker* victim = workers_[(thief_index + i) % workers_.size()].get();
+
+    base::AutoLock lock(victim->lock_);
+    if (!victim->tasks_.empty()) {
+      *task_out = std::move(victim->tasks_.front());
+      victim->tasks_.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace media
+}  // namespace mojo
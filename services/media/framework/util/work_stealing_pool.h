@@ -0,0 +1,94 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SERVICES_MEDIA_FRAMEWORK_UTIL_WORK_STEALING_POOL_H_
+#define SERVICES_MEDIA_FRAMEWORK_UTIL_WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+
+namespace mojo {
+namespace media {
+
+// A fixed-size pool of worker threads that run posted tasks.
+//
+// Each worker has its own task deque. Tasks posted from a worker thread go to
+// the back of that worker's deque, and the worker takes its next task from the
+// back (newest first) so related work tends to stay on the same thread. Tasks
+// posted from other threads are distributed round-robin. A worker whose deque
+// is empty steals from the front (oldest first) of another worker's deque
+// before going to sleep.
+//
+// Destroying the pool runs all tasks that are still queued and then joins the
+// worker threads. Tasks must not destroy the pool.
+class WorkStealingPool {
+ public:
+  using Task = std::function<void()>;
+
+  // Creates a pool with the indicated number of workers. If worker_count is
+  // zero, the number of hardware threads is used.
+  explicit WorkStealingPool(size_t worker_count);
+
+  ~WorkStealingPool();
+
+  // Returns the number of worker threads.
+  size_t worker_count() const { return workers_.size(); }
+
+  // Posts a task to the pool.
+  void Post(const Task& task);
+
+  // Posts a task to the pool such that the posting worker will run its other
+  // queued tasks first. This is useful for retrying work that couldn't proceed
+  // because a resource was busy. Behaves like Post when called from a thread
+  // that isn't a worker in this pool.
+  void PostDeferred(const Task& task);
+
+  // Determines whether the calling thread is a worker in this pool.
+  bool IsWorkerThread() const { return CurrentWorkerIndex() != kNotAWorker; }
+
+ private:
+  static constexpr size_t kNotAWorker = static_cast<size_t>(-1);
+
+  struct Worker {
+    base::Lock lock_;
+    std::deque<Task> tasks_;  // Protected by lock_.
+    std::thread thread_;
+  };
+
+  // Returns the index of the calling worker thread or kNotAWorker.
+  size_t CurrentWorkerIndex() const;
+
+  // Queues a task at the back (or front, if deferred) of a worker's deque.
+  void Enqueue(const Task& task, bool deferred);
+
+  // Runs on each worker thread.
+  void Run(size_t worker_index);
+
+  // Takes a task from the back of the indicated worker's deque.
+  bool PopLocal(size_t worker_index, Task* task_out);
+
+  // Takes a task from the front of some other worker's deque.
+  bool Steal(size_t thief_index, Task* task_out);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic_size_t next_worker_;
+  std::atomic_size_t pending_task_count_;
+  std::atomic_size_t sleeping_worker_count_;
+
+  base::Lock idle_lock_;
+  base::ConditionVariable idle_condition_variable_;
+  bool terminating_ = false;  // Protected by idle_lock_.
+};
+
+}  // namespace media
+}  // namespace mojo
+
+#endif  // SERVICES_MEDIA_FRAMEWORK_UTIL_WORK_STEALING_POOL_H_
@@ -3,11 +3,14 @@
 // found in the LICENSE file.
 
 #include <condition_variable>
+#include <cstring>
 #include <map>
 #include <mutex>
+#include <new>
 #include <thread>
 
 #include "base/logging.h"
+#include "services/media/framework/packet_pool.h"
 #include "services/media/framework/util/incident.h"
 #include "services/media/framework/util/safe_clone.h"
 #include "services/media/framework_ffmpeg/av_codec_context.h"
@@ -37,10 +40,19 @@ class FfmpegDemuxImpl : public FfmpegDemux {
   // ActiveMultistreamSource implementation.
   size_t stream_count() const override;
 
+  bool can_accept_allocator(size_t stream_index) const override;
+
+  void set_allocator(size_t stream_index, PayloadAllocator* allocator) override;
+
   void SetSupplyCallback(const SupplyCallback& supply_callback) override;
 
   void RequestPacket() override;
 
+  void SetBatchSupplyCallback(
+      const BatchSupplyCallback& batch_supply_callback) override;
+
+  void RequestPackets(size_t max_count) override;
+
  private:
   static constexpr int64_t kNotSeeking = std::numeric_limits<int64_t>::max();
 
@@ -64,8 +76,11 @@ class FfmpegDemuxImpl : public FfmpegDemux {
   // Specialized packet implementation.
   class DemuxPacket : public Packet {
    public:
-    static PacketPtr Create(ffmpeg::AvPacketPtr av_packet) {
-      return PacketPtr(new DemuxPacket(std::move(av_packet)));
+    static PacketPtr Create(ffmpeg::AvPacketPtr av_packet,
+                            std::shared_ptr<PacketPool> pool) {
+      DCHECK(pool);
+      void* block = pool->AllocateBlock(sizeof(DemuxPacket));
+      return PacketPtr(new (block) DemuxPacket(std::move(av_packet), pool));
     }
 
     AVPacket& av_packet() { return *av_packet_; }
@@ -73,29 +88,57 @@ class FfmpegDemuxImpl : public FfmpegDemux {
    protected:
     ~DemuxPacket() override {}
 
-    void Release() override { delete this; }
+    void Release() override {
+      // Packets may outlive the demux, so we hold a reference to the pool.
+      std::shared_ptr<PacketPool> pool = std::move(pool_);
+      this->~DemuxPacket();
+      pool->ReleaseBlock(this);
+    }
 
    private:
-    DemuxPacket(ffmpeg::AvPacketPtr av_packet)
-        : Packet(
-              (av_packet->pts == AV_NOPTS_VALUE) ? kUnknownPts : av_packet->pts,
-              false,
-              static_cast<size_t>(av_packet->size),
-              av_packet->data),
-          av_packet_(std::move(av_packet)) {
+    DemuxPacket(ffmpeg::AvPacketPtr av_packet,
+                std::shared_ptr<PacketPool> pool)
+        : Packet(PtsFromAvPacket(*av_packet),
+                 false,
+                 static_cast<size_t>(av_packet->size),
+                 av_packet->data),
+          av_packet_(std::move(av_packet)),
+          pool_(pool) {
       DCHECK(av_packet_->size >= 0);
     }
 
     ffmpeg::AvPacketPtr av_packet_;
+    std::shared_ptr<PacketPool> pool_;
   };
 
+  // Returns the PTS of av_packet as a Packet PTS.
+  static int64_t PtsFromAvPacket(const AVPacket& av_packet) {
+    return (av_packet.pts == AV_NOPTS_VALUE) ? Packet::kUnknownPts
+                                             : av_packet.pts;
+  }
+
+  // Returns the allocator required for the indicated stream's payloads or
+  // nullptr if there's no requirement.
+  PayloadAllocator* allocator(size_t stream_index);
+
   // Runs in the ffmpeg thread doing the real work.
   void Worker();
 
-  // Produces a packet. Called from the ffmpeg thread only.
+  // Opens the input and initializes streams_ and metadata_. Called on the
+  // ffmpeg thread only.
+  void Init();
+
+  // Performs the indicated seek, if any, and produces the requested packets.
+  // Called on the ffmpeg thread only.
+  void ProcessRequests(size_t packets_requested,
+                       bool batch_requested,
+                       int64_t seek_position,
+                       const SeekCallback& seek_callback);
+
+  // Produces a packet. Called on the ffmpeg thread only.
   PacketPtr PullPacket(size_t* stream_index_out);
 
-  // Produces an end-of-stream packet for next_stream_to_end_. Called from the
+  // Produces an end-of-stream packet for next_stream_to_end_. Called on the
   // ffmpeg thread only.
   PacketPtr PullEndOfStreamPacket(size_t* stream_index_out);
 
@@ -110,7 +153,9 @@ class FfmpegDemuxImpl : public FfmpegDemux {
   // These are protected by mutex_.
   int64_t seek_position_ = kNotSeeking;
   SeekCallback seek_callback_;
-  bool packet_requested_ = false;
+  std::vector<PayloadAllocator*> allocators_;
+  size_t packets_requested_ = 0;
+  bool batch_requested_ = false;
   bool terminating_ = false;
 
   // These should be stable after init until the desctructor terminates.
@@ -126,7 +171,11 @@ class FfmpegDemuxImpl : public FfmpegDemux {
   int next_stream_to_end_ = -1;  // -1: don't end, streams_.size(): stop.
 
   SupplyCallback supply_callback_;
+  BatchSupplyCallback batch_supply_callback_;
   std::unique_ptr<Metadata> metadata_;
+
+  // Recycles DemuxPackets.
+  std::shared_ptr<PacketPool> packet_pool_;
 };
 
 // static
@@ -135,7 +184,7 @@ std::shared_ptr<Demux> FfmpegDemux::Create(std::shared_ptr<Reader> reader) {
 }
 
 FfmpegDemuxImpl::FfmpegDemuxImpl(std::shared_ptr<Reader> reader)
-    : reader_(reader) {
+    : reader_(reader), packet_pool_(PacketPool::Create(sizeof(DemuxPacket))) {
   ffmpeg_thread_ = std::thread(std::bind(&FfmpegDemuxImpl::Worker, this));
 }
 
@@ -174,17 +223,85 @@ size_t FfmpegDemuxImpl::stream_count() const {
   return streams_.size();
 }
 
+bool FfmpegDemuxImpl::can_accept_allocator(size_t stream_index) const {
+  return true;
+}
+
+void FfmpegDemuxImpl::set_allocator(size_t stream_index,
+                                    PayloadAllocator* allocator) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (allocators_.size() <= stream_index) {
+    allocators_.resize(stream_index + 1, nullptr);
+  }
+
+  allocators_[stream_index] = allocator;
+}
+
 void FfmpegDemuxImpl::SetSupplyCallback(const SupplyCallback& supply_callback) {
   supply_callback_ = supply_callback;
 }
 
 void FfmpegDemuxImpl::RequestPacket() {
   std::unique_lock<std::mutex> lock(mutex_);
-  packet_requested_ = true;
+  packets_requested_ = 1;
+  batch_requested_ = false;
+  condition_variable_.notify_all();
+}
+
+void FfmpegDemuxImpl::SetBatchSupplyCallback(
+    const BatchSupplyCallback& batch_supply_callback) {
+  batch_supply_callback_ = batch_supply_callback;
+}
+
+void FfmpegDemuxImpl::RequestPackets(size_t max_count) {
+  DCHECK(max_count != 0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  packets_requested_ = max_count;
+  batch_requested_ = true;
   condition_variable_.notify_all();
 }
 
 void FfmpegDemuxImpl::Worker() {
+  Init();
+  if (result_ != Result::kOk) {
+    // Initialization failed, so requests can't be satisfied.
+    return;
+  }
+
+  while (true) {
+    size_t packets_requested;
+    bool batch_requested;
+    int64_t seek_position;
+    SeekCallback seek_callback;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (packets_requested_ == 0 && !terminating_ &&
+             seek_position_ == kNotSeeking) {
+        condition_variable_.wait(lock);
+      }
+
+      if (terminating_) {
+        return;
+      }
+
+      packets_requested = packets_requested_;
+      packets_requested_ = 0;
+      batch_requested = batch_requested_;
+      batch_requested_ = false;
+
+      seek_position = seek_position_;
+      seek_position_ = kNotSeeking;
+
+      seek_callback_.swap(seek_callback);
+    }
+
+    ProcessRequests(packets_requested, batch_requested, seek_position,
+                    seek_callback);
+  }
+}
+
+void FfmpegDemuxImpl::Init() {
   static constexpr uint64_t kNanosecondsPerMicrosecond = 1000;
 
   io_context_ = AvIoContext::Create(reader_);
@@ -227,76 +344,109 @@ void FfmpegDemuxImpl::Worker() {
 
   result_ = Result::kOk;
   init_complete_.Occur();
+}
 
-  while (true) {
-    bool packet_requested;
-    int64_t seek_position;
-    SeekCallback seek_callback;
-
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      while (!packet_requested_ && !terminating_ &&
-             seek_position_ == kNotSeeking) {
-        condition_variable_.wait(lock);
-      }
+void FfmpegDemuxImpl::ProcessRequests(size_t packets_requested,
+                                      bool batch_requested,
+                                      int64_t seek_position,
+                                      const SeekCallback& seek_callback) {
+  if (seek_position != kNotSeeking) {
+    int r = av_seek_frame(format_context_.get(), -1, seek_position / 1000, 0);
+    if (r < 0) {
+      LOG(WARNING) << "av_seek_frame failed, result " << r;
+    }
+    next_stream_to_end_ = -1;
+    seek_callback();
+  }
 
-      if (terminating_) {
-        return;
-      }
+  if (packets_requested == 0) {
+    return;
+  }
 
-      packet_requested = packet_requested_;
-      packet_requested_ = false;
+  if (!batch_requested) {
+    size_t stream_index;
+    PacketPtr packet = PullPacket(&stream_index);
+    DCHECK(packet);
 
-      seek_position = seek_position_;
-      seek_position_ = kNotSeeking;
+    DCHECK(supply_callback_);
+    supply_callback_(stream_index, std::move(packet));
+    return;
+  }
 
-      seek_callback_.swap(seek_callback);
-    }
+  // Read packets until the request is satisfied or all the streams have ended,
+  // so small packets, like compressed audio, are delivered in one call.
+  std::vector<StreamPacket> packets;
+  packets.reserve(packets_requested);
+
+  if (next_stream_to_end_ == static_cast<int>(streams_.size())) {
+    // All the streams have ended. Repeat the last end-of-stream packet rather
+    // than replying with an empty batch.
+    DCHECK(!streams_.empty());
+    packets.emplace_back(streams_.size() - 1,
+                         Packet::CreateEndOfStream(next_pts_));
+  }
 
-    if (seek_position != kNotSeeking) {
-      int r = av_seek_frame(format_context_.get(), -1, seek_position / 1000, 0);
-      if (r < 0) {
-        LOG(WARNING) << "av_seek_frame failed, result " << r;
-      }
-      next_stream_to_end_ = -1;
-      seek_callback();
-    }
+  while (packets.size() < packets_requested &&
+         next_stream_to_end_ != static_cast<int>(streams_.size())) {
+    size_t stream_index;
+    PacketPtr packet = PullPacket(&stream_index);
+    DCHECK(packet);
+    packets.emplace_back(stream_index, std::move(packet));
+  }
 
-    if (packet_requested) {
-      size_t stream_index;
-      PacketPtr packet = PullPacket(&stream_index);
-      DCHECK(packet);
+  DCHECK(batch_supply_callback_);
+  batch_supply_callback_(std::move(packets));
+}
 
-      DCHECK(supply_callback_);
-      supply_callback_(stream_index, std::move(packet));
-    }
-  }
+PayloadAllocator* FfmpegDemuxImpl::allocator(size_t stream_index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return stream_index < allocators_.size() ? allocators_[stream_index]
+                                           : nullptr;
 }
 
 PacketPtr FfmpegDemuxImpl::PullPacket(size_t* stream_index_out) {
   DCHECK(stream_index_out);
 
-  if (next_stream_to_end_ != -1) {
-    // We're producing end-of-stream packets for all the streams.
-    return PullEndOfStreamPacket(stream_index_out);
-  }
+  while (true) {
+    if (next_stream_to_end_ != -1) {
+      // We're producing end-of-stream packets for all the streams.
+      return PullEndOfStreamPacket(stream_index_out);
+    }
 
-  ffmpeg::AvPacketPtr av_packet = ffmpeg::AvPacket::Create();
+    ffmpeg::AvPacketPtr av_packet = ffmpeg::AvPacket::Create();
 
-  av_packet->data = nullptr;
-  av_packet->size = 0;
+    av_packet->data = nullptr;
+    av_packet->size = 0;
 
-  if (av_read_frame(format_context_.get(), av_packet.get()) < 0) {
-    // End of stream. Start producing end-of-stream packets for all the streams.
-    next_stream_to_end_ = 0;
-    return PullEndOfStreamPacket(stream_index_out);
-  }
+    if (av_read_frame(format_context_.get(), av_packet.get()) < 0) {
+      // End of stream. Start producing end-of-stream packets for all the
+      // streams.
+      next_stream_to_end_ = 0;
+      return PullEndOfStreamPacket(stream_index_out);
+    }
 
-  *stream_index_out = static_cast<size_t>(av_packet->stream_index);
-  // TODO(dalesat): What if the packet has no PTS or duration?
-  next_pts_ = av_packet->pts + av_packet->duration;
+    *stream_index_out = static_cast<size_t>(av_packet->stream_index);
+    // TODO(dalesat): What if the packet has no PTS or duration?
+    next_pts_ = av_packet->pts + av_packet->duration;
 
-  return DemuxPacket::Create(std::move(av_packet));
+    PayloadAllocator* stream_allocator = allocator(*stream_index_out);
+    if (stream_allocator == nullptr || av_packet->size == 0) {
+      return DemuxPacket::Create(std::move(av_packet), packet_pool_);
+    }
+
+    // libavformat allocates packet data itself, so the payload has to be
+    // copied into the allocator required downstream. Copying it here keeps
+    // the copy off the graph's threads.
+    size_t size = static_cast<size_t>(av_packet->size);
+    void* payload = stream_allocator->AllocatePayloadBuffer(size);
+    if (payload != nullptr) {
+      memcpy(payload, av_packet->data, size);
+      return Packet::Create(PtsFromAvPacket(*av_packet), false, size, payload,
+                            stream_allocator);
+    }
+
+    LOG(WARNING) << "allocator starved copying demux packet";
+  }
 }
 
 PacketPtr FfmpegDemuxImpl::PullEndOfStreamPacket(size_t* stream_index_out) {
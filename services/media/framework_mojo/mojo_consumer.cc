@@ -14,7 +14,8 @@ void MojoConsumerMediaConsumer::Flush(const FlushCallback& callback) {
   MediaConsumerFlush(callback);
 }
 
-MojoConsumer::MojoConsumer() {}
+MojoConsumer::MojoConsumer()
+    : packet_pool_(PacketPool::Create(sizeof(PacketImpl))) {}
 
 MojoConsumer::~MojoConsumer() {}
 
@@ -46,7 +47,8 @@ void MojoConsumer::SendPacket(MediaPacketPtr media_packet,
   DCHECK(media_packet);
   DCHECK(supply_callback_);
   supply_callback_(
-      PacketImpl::Create(media_packet.Pass(), callback, task_runner_, buffer_));
+      PacketImpl::Create(media_packet.Pass(), callback, task_runner_, buffer_,
+                         packet_pool_));
 }
 
 void MojoConsumer::Prime(const PrimeCallback& callback) {
@@ -85,7 +87,8 @@ MojoConsumer::PacketImpl::PacketImpl(
     MediaPacketPtr media_packet,
     const SendPacketCallback& callback,
     scoped_refptr<base::SingleThreadTaskRunner> task_runner,
-    const MappedSharedBuffer& buffer)
+    const MappedSharedBuffer& buffer,
+    std::shared_ptr<PacketPool> pool)
     : Packet(media_packet->pts,
              media_packet->end_of_stream,
              media_packet->payload->length,
@@ -94,7 +97,8 @@ MojoConsumer::PacketImpl::PacketImpl(
                  : buffer.PtrFromOffset(media_packet->payload->offset)),
       media_packet_(media_packet.Pass()),
       callback_(callback),
-      task_runner_(task_runner) {}
+      task_runner_(task_runner),
+      pool_(pool) {}
 
 MojoConsumer::PacketImpl::~PacketImpl() {}
 
@@ -105,7 +109,10 @@ void MojoConsumer::PacketImpl::RunCallback(const SendPacketCallback& callback) {
 
 void MojoConsumer::PacketImpl::Release() {
   task_runner_->PostTask(FROM_HERE, base::Bind(&RunCallback, callback_));
-  delete this;
+  // Packets may outlive the consumer, so we hold a reference to the pool.
+  std::shared_ptr<PacketPool> pool = std::move(pool_);
+  this->~PacketImpl();
+  pool->ReleaseBlock(this);
 }
 
 }  // namespace media
@@ -5,12 +5,15 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_MOJO_MOJO_CONSUMER_H_
 #define SERVICES_MEDIA_FRAMEWORK_MOJO_MOJO_CONSUMER_H_
 
+#include <new>
+
 #include "base/single_thread_task_runner.h"
 #include "base/task_runner.h"
 #include "mojo/common/binding_set.h"
 #include "mojo/services/media/common/cpp/mapped_shared_buffer.h"
 #include "mojo/services/media/common/interfaces/media_transport.mojom.h"
 #include "services/media/framework/models/active_source.h"
+#include "services/media/framework/packet_pool.h"
 
 namespace mojo {
 namespace media {
@@ -78,9 +81,12 @@ class MojoConsumer : public MojoConsumerMediaConsumer, public ActiveSource {
         MediaPacketPtr media_packet,
         const SendPacketCallback& callback,
         scoped_refptr<base::SingleThreadTaskRunner> task_runner,
-        const MappedSharedBuffer& buffer) {
-      return PacketPtr(
-          new PacketImpl(media_packet.Pass(), callback, task_runner, buffer));
+        const MappedSharedBuffer& buffer,
+        std::shared_ptr<PacketPool> pool) {
+      DCHECK(pool);
+      void* block = pool->AllocateBlock(sizeof(PacketImpl));
+      return PacketPtr(new (block) PacketImpl(media_packet.Pass(), callback,
+                                              task_runner, buffer, pool));
     }
 
    protected:
@@ -90,7 +96,8 @@ class MojoConsumer : public MojoConsumerMediaConsumer, public ActiveSource {
     PacketImpl(MediaPacketPtr media_packet,
                const SendPacketCallback& callback,
                scoped_refptr<base::SingleThreadTaskRunner> task_runner,
-               const MappedSharedBuffer& buffer);
+               const MappedSharedBuffer& buffer,
+               std::shared_ptr<PacketPool> pool);
 
     ~PacketImpl() override;
 
@@ -99,6 +106,7 @@ class MojoConsumer : public MojoConsumerMediaConsumer, public ActiveSource {
     MediaPacketPtr media_packet_;
     const SendPacketCallback callback_;
     scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+    std::shared_ptr<PacketPool> pool_;
   };
 
   BindingSet<MediaConsumer> bindings_;
@@ -107,6 +115,7 @@ class MojoConsumer : public MojoConsumerMediaConsumer, public ActiveSource {
   scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
   MappedSharedBuffer buffer_;
   SupplyCallback supply_callback_;
+  std::shared_ptr<PacketPool> packet_pool_;
 };
 
 }  // namespace media
@@ -11,6 +11,8 @@
 namespace mojo {
 namespace media {
 
+constexpr size_t MojoProducer::kSupplyBatchSize;
+
 MojoProducer::MojoProducer() {
   task_runner_ = base::MessageLoop::current()->task_runner();
   DCHECK(task_runner_);
@@ -82,6 +84,10 @@ PayloadAllocator* MojoProducer::allocator() {
   return &mojo_allocator_;
 }
 
+size_t MojoProducer::input_queue_depth() {
+  return kSupplyBatchSize;
+}
+
 void MojoProducer::SetDemandCallback(const DemandCallback& demand_callback) {
   demand_callback_ = demand_callback;
 }
@@ -136,6 +142,62 @@ Demand MojoProducer::SupplyPacket(PacketPtr packet) {
   return demand;
 }
 
+size_t MojoProducer::supply_batch_size() {
+  return kSupplyBatchSize;
+}
+
+Demand MojoProducer::SupplyPackets(std::vector<PacketPtr>* packets) {
+  DCHECK(packets);
+  DCHECK(!packets->empty());
+
+  // If we're not connected, SupplyPacket throws the packets away.
+  if (!consumer_.is_bound()) {
+    return ActiveSink::SupplyPackets(packets);
+  }
+
+  if (first_pts_since_flush_ == Packet::kUnknownPts) {
+    first_pts_since_flush_ = packets->front()->pts();
+  }
+
+  Demand demand = Demand::kPositive;
+  size_t taken = 0;
+
+  {
+    base::AutoLock lock(lock_);
+    DCHECK(current_pushes_outstanding_ < max_pushes_outstanding_);
+    DCHECK(!end_of_stream_) << "packet pushed after end-of-stream";
+
+    // Take packets for as long as there's room for pushes.
+    while (demand != Demand::kNegative && taken != packets->size()) {
+      const PacketPtr& packet = (*packets)[taken++];
+      DCHECK(packet);
+
+      ++current_pushes_outstanding_;
+
+      if (packet->end_of_stream()) {
+        end_of_stream_ = true;
+        demand = Demand::kNegative;
+        max_pushes_outstanding_ = 0;
+      } else {
+        demand = current_pushes_outstanding_ < max_pushes_outstanding_
+                     ? Demand::kPositive
+                     : Demand::kNegative;
+      }
+    }
+  }
+
+  for (size_t index = 0; index < taken; ++index) {
+    PacketPtr packet = std::move((*packets)[index]);
+    MediaPacketPtr media_packet = CreateMediaPacket(packet);
+    task_runner_->PostTask(
+        FROM_HERE,
+        base::Bind(&MojoProducer::SendPacket, base::Unretained(this),
+                   packet.release(), base::Passed(media_packet.Pass())));
+  }
+
+  return demand;
+}
+
 void MojoProducer::Connect(InterfaceHandle<MediaConsumer> consumer,
                            const ConnectCallback& callback) {
   DCHECK(consumer);
@@ -51,8 +51,14 @@ class MojoProducer : public MediaProducer, public ActiveSink {
 
   void SetDemandCallback(const DemandCallback& demand_callback) override;
 
+  size_t input_queue_depth() override;
+
   Demand SupplyPacket(PacketPtr packet) override;
 
+  size_t supply_batch_size() override;
+
+  Demand SupplyPackets(std::vector<PacketPtr>* packets) override;
+
   // MediaProducer implementation.
   void Connect(InterfaceHandle<MediaConsumer> consumer,
                const ConnectCallback& callback) override;
@@ -60,6 +66,9 @@ class MojoProducer : public MediaProducer, public ActiveSink {
   void Disconnect() override;
 
  private:
+  // Maximum number of packets taken from the input at a time.
+  static constexpr size_t kSupplyBatchSize = 8;
+
   MojoProducer();
 
   // Sends a packet to the consumer.
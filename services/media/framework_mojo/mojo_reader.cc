@@ -21,8 +21,6 @@ MojoReader::MojoReader(InterfaceHandle<SeekingReader> seeking_reader)
   task_runner_ = base::MessageLoop::current()->task_runner();
   DCHECK(task_runner_);
 
-  read_in_progress_ = false;
-
   seeking_reader_->Describe(
       [this](MediaResult result, uint64_t size, bool can_seek) {
         result_ = Convert(result);
@@ -47,20 +45,34 @@ void MojoReader::ReadAt(size_t position,
   DCHECK(buffer);
   DCHECK(bytes_to_read);
 
-  DCHECK(!read_in_progress_)
-      << "ReadAt called while previous call still in progress";
-  read_in_progress_ = true;
-  read_at_position_ = position;
-  read_at_buffer_ = buffer;
-  read_at_bytes_to_read_ = bytes_to_read;
-  read_at_callback_ = callback;
-
-  // ReadAt may be called on non-mojo threads, so we use the runner.
-  task_runner_->PostTask(FROM_HERE, base::Bind(&MojoReader::ContinueReadAt,
-                                               base::Unretained(this)));
+  bool start;
+
+  {
+    base::AutoLock lock(pending_reads_lock_);
+    pending_reads_.push_back(
+        PendingRead{position, buffer, bytes_to_read, callback});
+    // If another read is in progress, this one is started when it completes.
+    start = pending_reads_.size() == 1;
+  }
+
+  if (start) {
+    // ReadAt may be called on non-mojo threads, so we use the runner.
+    task_runner_->PostTask(FROM_HERE, base::Bind(&MojoReader::ContinueReadAt,
+                                                 base::Unretained(this)));
+  }
 }
 
 void MojoReader::ContinueReadAt() {
+  {
+    base::AutoLock lock(pending_reads_lock_);
+    DCHECK(!pending_reads_.empty());
+    const PendingRead& read = pending_reads_.front();
+    read_at_position_ = read.position;
+    read_at_buffer_ = read.buffer;
+    read_at_bytes_to_read_ = read.bytes_to_read;
+    read_at_callback_ = read.callback;
+  }
+
   ready_.When([this]() {
     if (result_ != Result::kOk) {
       CompleteReadAt(result_);
@@ -136,7 +148,21 @@ void MojoReader::ReadResponseBody() {
 void MojoReader::CompleteReadAt(Result result, size_t bytes_read) {
   ReadAtCallback read_at_callback;
   read_at_callback_.swap(read_at_callback);
-  read_in_progress_ = false;
+
+  bool more;
+
+  {
+    base::AutoLock lock(pending_reads_lock_);
+    DCHECK(!pending_reads_.empty());
+    pending_reads_.pop_front();
+    more = !pending_reads_.empty();
+  }
+
+  if (more) {
+    task_runner_->PostTask(FROM_HERE, base::Bind(&MojoReader::ContinueReadAt,
+                                                 base::Unretained(this)));
+  }
+
   read_at_callback(result, bytes_read);
 }
 
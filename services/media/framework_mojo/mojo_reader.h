@@ -5,9 +5,10 @@
 #ifndef SERVICES_MEDIA_FRAMEWORK_MOJO_PARTS_MOJO_READER_H_
 #define SERVICES_MEDIA_FRAMEWORK_MOJO_PARTS_MOJO_READER_H_
 
-#include <atomic>
+#include <deque>
 
 #include "base/single_thread_task_runner.h"
+#include "base/synchronization/lock.h"
 #include "mojo/services/media/core/interfaces/seeking_reader.mojom.h"
 #include "services/media/framework/parts/reader.h"
 #include "services/media/framework/util/incident.h"
@@ -15,7 +16,9 @@
 namespace mojo {
 namespace media {
 
-// Reads raw data from a SeekingReader service.
+// Reads raw data from a SeekingReader service. ReadAt may be called again
+// before earlier calls complete. The reads are performed one at a time, in the
+// order they were requested.
 class MojoReader : public Reader {
  public:
   // Creates an MojoReader. Must be called on a mojo thread.
@@ -37,19 +40,28 @@ class MojoReader : public Reader {
  private:
   static constexpr size_t kDataPipeCapacity = 32u * 1024u;
 
+  // A ReadAt call that hasn't completed.
+  struct PendingRead {
+    size_t position;
+    uint8_t* buffer;
+    size_t bytes_to_read;
+    ReadAtCallback callback;
+  };
+
   // Calls ReadResponseBody.
   static void ReadResponseBodyStatic(void* self, MojoResult result);
 
   MojoReader(InterfaceHandle<SeekingReader> seeking_reader);
 
-  // Continues a ReadAt operation on the thread on which this reader was
-  // constructed (a mojo thread).
+  // Starts the ReadAt operation at the front of pending_reads_ on the thread
+  // on which this reader was constructed (a mojo thread).
   void ContinueReadAt();
 
   // Reads from response_body_ into response_body_buffer_.
   void ReadResponseBody();
 
-  // Completes a ReadAt operation by calling the read_at_callback_.
+  // Completes a ReadAt operation by calling the read_at_callback_ and starts
+  // the next one, if any.
   void CompleteReadAt(Result result, size_t bytes_read = 0);
 
   // Shuts down the consumer handle and calls CompleteReadAt.
@@ -62,7 +74,11 @@ class MojoReader : public Reader {
   Incident ready_;
   scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
 
-  std::atomic_bool read_in_progress_;
+  base::Lock pending_reads_lock_;
+  // ReadAt calls that haven't completed, the one in progress first.
+  std::deque<PendingRead> pending_reads_;
+
+  // The ReadAt operation in progress. Used only on the mojo thread.
   size_t read_at_position_;
   uint8_t* read_at_buffer_;
   size_t read_at_bytes_to_read_;